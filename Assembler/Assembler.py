@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 
 import sys
+import time
+import struct
 import CompileInstruction
 
-#List of already inserted libraries. 
+#List of already inserted libraries.
 #To prevent multiple insertions of the same library.
 #Global to allow access in recursion
 libraryList = []
@@ -20,84 +22,145 @@ programOffset = 0
 #Remove unreachable code
 optimizeSize = False
 
-
-def removeFunctionFromCode(parsedLines, toRemove):
-    returnList = []
-
-    start = -1
-    end = -1
-
+#Print the time spent in each stage to stderr
+printTiming = False
+
+#Write the program as binary to this file instead of printing the text listing
+binaryFile = None
+
+#Pad the binary with 0xFF bytes to a multiple of this size (0 for no padding)
+#the old external SPI flash programmer expects a multiple of 4096 bytes
+padBinaryTo = 0
+
+#Write the symbols and the listing to this file
+symbolFile = None
+
+#Write a relocatable object to this file instead of a program, see Linker.py for the format
+objectFile = None
+
+#Functions that are always reachable
+rootFunctions = ["Main", "Int1", "Int2", "Int3", "Int4", "Syscall"]
+
+#Instructions that can have a label as argument, these are compiled in pass two
+toCompileList = ["jump", "beq", "bne", "bgt", "bge", "bgts", "bges", "loadlabellow" ,"loadlabelhigh", ".dl"]
+
+#Relocation type of each instruction that can have a label as argument in an object
+relocationTypes = {"jump": "jump", "loadlabellow": "low", "loadlabelhigh": "high", ".dl": "dl"}
+
+#Compile function of each instruction
+instructionMap = {
+    "halt"      : CompileInstruction.compileHalt,
+    "read"      : CompileInstruction.compileRead,
+    "write"     : CompileInstruction.compileWrite,
+    "copy"      : CompileInstruction.compileCopy,
+    "push"      : CompileInstruction.compilePush,
+    "pop"       : CompileInstruction.compilePop,
+    "jump"      : CompileInstruction.compileJump,
+    "jumpo"     : CompileInstruction.compileJumpo,
+    "jumpr"     : CompileInstruction.compileJumpr,
+    "jumpro"    : CompileInstruction.compileJumpro,
+    "load"      : CompileInstruction.compileLoad,
+    "loadhi"    : CompileInstruction.compileLoadhi,
+    "beq"       : CompileInstruction.compileBeq,
+    "bne"       : CompileInstruction.compileBne,
+    "bgt"       : CompileInstruction.compileBgt,
+    "bge"       : CompileInstruction.compileBge,
+    "bgts"      : CompileInstruction.compileBgts,
+    "bges"      : CompileInstruction.compileBges,
+    "savpc"     : CompileInstruction.compileSavpc,
+    "reti"      : CompileInstruction.compileReti,
+    "or"        : CompileInstruction.compileOr,
+    "and"       : CompileInstruction.compileAnd,
+    "xor"       : CompileInstruction.compileXor,
+    "add"       : CompileInstruction.compileAdd,
+    "sub"       : CompileInstruction.compileSub,
+    "shiftl"    : CompileInstruction.compileShiftl,
+    "shiftr"    : CompileInstruction.compileShiftr,
+    "mult"      : CompileInstruction.compileMult,
+    "not"       : CompileInstruction.compileNot,
+    "addr2reg"  : CompileInstruction.compileAddr2reg,
+    "load32"    : CompileInstruction.compileLoad32,
+    "nop"       : CompileInstruction.compileNop,
+    ".dw"       : CompileInstruction.compileDw,
+    ".dd"       : CompileInstruction.compileDd,
+    ".db"       : CompileInstruction.compileDb,
+    ".ds"       : CompileInstruction.compileDs,
+    ".dl"       : CompileInstruction.compileDl,
+    "loadlabellow" : CompileInstruction.compileLoadLabelLow,
+    "loadlabelhigh" : CompileInstruction.compileLoadLabelHigh,
+    "readintid" : CompileInstruction.compileReadIntID,
+    "`include" : CompileInstruction.compileNothing
+}
+
+
+#instructions after which the next line is not executed
+fallThroughEnds = ["jump", "jumpo", "jumpr", "jumpro", "reti", "halt"]
+
+
+#removes the functions (and data) that cannot be reached from the root functions
+#the program is split in blocks that start with a named label. In the code section a block
+#ends at the next named label, below the code section (after Int4) at any label.
+#Lines outside of a block are always kept
+#A block that does not end with an unconditional jump falls through to the next block, like a
+#function into the loop labels of its asm() body, so it keeps the next block reachable
+def removeUnreachableCode(parsedLines):
+    blockNames = [] #name of each block
+    blockOfLine = [] #block of each line, -1 if not in a block
+    fallThrough = [] #(block, next block) for each block that falls through to the next one
+    block = -1
     belowCodeSection = False
+    lastInstruction = "" #first word of the previous line in the block
 
-    for idx, line in enumerate(parsedLines):
-        if line[1][0] == "Int4:":
+    for line in parsedLines:
+        word = line[1][0]
+        if word == "Int4:":
             belowCodeSection = True
-        if start == -1:
-            if line[1][0] == toRemove + ":":
-                start = idx
-                #print (start)
-                #print(parsedLines[start])
-        elif end == -1:
-            # continue until next function found
-            if (line[1][0][-1] == ':'):
-                if not belowCodeSection:
-                    if ("Label_" not in line[1][0]):
-                        end = idx
-                        #print (end)
-                        #print(parsedLines[end])
-                # when we are below the code section, stop at any new label
+        if word[-1] == ':':
+            if "Label_" not in word:
+                #data (.dw and such) does not fall through to code
+                if block >= 0 and lastInstruction not in fallThroughEnds and lastInstruction[:1] != ".":
+                    fallThrough.append((block, len(blockNames)))
+                block = len(blockNames)
+                blockNames.append(word[:-1])
+                lastInstruction = ""
+            elif belowCodeSection:
+                block = -1
+        else:
+            lastInstruction = word.lower()
+        blockOfLine.append(block)
+
+    #find the names each block refers to
+    names = set(blockNames)
+    blockRefs = [[] for name in blockNames]
+    for block, nextBlock in fallThrough:
+        blockRefs[block].append(blockNames[nextBlock])
+    reachable = set()
+    toVisit = list(rootFunctions)
+
+    for line, block in zip(parsedLines, blockOfLine):
+        if line[1][0] == ".ds":
+            continue
+        for word in line[1][1:]:
+            if word in names:
+                if block >= 0:
+                    blockRefs[block].append(word)
                 else:
-                    end = idx
-
-    returnList = returnList + parsedLines[0:start]
-    returnList = returnList + parsedLines[end:]
-
-    return returnList
-
-
-def removeUnreachebleCode(parsedLines):
-    #print("orig len:", len(parsedLines))
-    returnList = parsedLines
-
-    asm = [x[1] for x in parsedLines]
-    functionNames = []
-    jumps = []
-
-    for x in asm:
-
-        if len(x) > 0:
-            if (x[0][-1] == ':'):
-                if ("Label_" not in x[0]):
-                    functionNames.append(x[0][:-1])
-            if (x[0] == "addr2reg"):
-                if ("Label_" not in x[1]):
-                    jumps.append(x[1])
-
-            if (x[0] == "jump"):
-                if ("Label_" not in x[1]):
-                    jumps.append(x[1])
-
-    #for f in functionNames:
-    #    print(f)
-    
-    #for j in jumps:
-    #    print(j)
-
-    unusedFunctions = list((set(functionNames).difference(jumps)).difference(["Main", "Int1", "Int2", "Int3", "Int4", "Syscall"]))
-
-    foundUnusedFunctions = len(unusedFunctions)
-
-    for u in unusedFunctions:
-        #print(u)
-        returnList = removeFunctionFromCode(returnList, u)
+                    toVisit.append(word)
 
-    # recursive check
-    if foundUnusedFunctions > 0:
-        returnList = removeUnreachebleCode(returnList)
+    blocksOfName = {}
+    for block, name in enumerate(blockNames):
+        blocksOfName.setdefault(name, []).append(block)
 
-    #print("after len:", len(returnList))
+    #walk the call graph
+    while toVisit:
+        name = toVisit.pop()
+        if name in reachable or name not in blocksOfName:
+            continue
+        reachable.add(name)
+        for block in blocksOfName[name]:
+            toVisit.extend(blockRefs[block])
 
-    return returnList
+    return [line for line, block in zip(parsedLines, blockOfLine) if block < 0 or blockNames[block] in reachable]
 
 
 def parseLines(fileName):
@@ -112,66 +175,40 @@ def parseLines(fileName):
                 if (parsedLine != []):
                     parsedLines.append((i, parsedLine))
 
-    parsedLines.append((0, ['.EOF'])) # add end of file token
     return parsedLines
 
-def moveDataDown(parsedLines):
-    for idx, line in enumerate(parsedLines):
-        if (line[1][0] == ".EOF"): # return when gone through entire file
-            return parsedLines
-        if (line[1][0] == ".data"): # when we found the start of a .data segment
-            while (parsedLines[idx][1][0] != ".code" and parsedLines[idx][1][0] != ".rdata" and parsedLines[idx][1][0] != ".bss" and parsedLines[idx][1][0] != ".EOF"): # move all lines to the end until .code, .rdata or .EOF
-                parsedLines.append(parsedLines.pop(idx))
-
-    # should not get here
-    print("SHOULD NOT GET HERE")
-    sys.exit(1)
-    return None
-
-def moveRDataDown(parsedLines):
-    for idx, line in enumerate(parsedLines):
-        if (line[1][0] == ".EOF"): # return when gone through entire file
-            return parsedLines
-        if (line[1][0] == ".rdata"): # when we found the start of a .rdata segment
-            while (parsedLines[idx][1][0] != ".code" and parsedLines[idx][1][0] != ".data" and parsedLines[idx][1][0] != ".bss" and parsedLines[idx][1][0] != ".EOF"): # move all lines to the end until .code, .data or .EOF
-                parsedLines.append(parsedLines.pop(idx))
-
-    # should not get here
-    print("SHOULD NOT GET HERE")
-    sys.exit(1)
-    return None
-
-def moveBssDown(parsedLines):
-    for idx, line in enumerate(parsedLines):
-        if (line[1][0] == ".EOF"): # return when gone through entire file
-            return parsedLines
-        if (line[1][0] == ".bss"): # when we found the start of a .rdata segment
-            while (parsedLines[idx][1][0] != ".code" and parsedLines[idx][1][0] != ".data" and parsedLines[idx][1][0] != ".rdata" and parsedLines[idx][1][0] != ".EOF"): # move all lines to the end until .code, .data or .EOF
-                parsedLines.append(parsedLines.pop(idx))
-
-    # should not get here
-    print("SHOULD NOT GET HERE")
-    sys.exit(1)
-    return None
+#puts the .data, .rdata and .bss sections below the code, in that order,
+#and removes the .code, .data, .rdata and .bss lines
+#lines before the first section directive belong to the code
+def moveSectionsDown(parsedLines):
+    sections = {".code": [], ".data": [], ".rdata": [], ".bss": []}
+    section = sections[".code"]
 
+    for line in parsedLines:
+        if line[1][0] in sections:
+            section = sections[line[1][0]]
+        else:
+            section.append(line)
 
-def removeAssemblerDirectives(parsedLines):
-    return [line for line in parsedLines if line[1][0] not in [".code", ".rdata", ".data", ".bss", ".EOF"]]
-
+    return sections[".code"] + sections[".data"] + sections[".rdata"] + sections[".bss"]
 
 
+#inserts the included libraries above the code
+#each library is inserted above the previously inserted ones
 def insertLibraries(parsedLines):
-    returnList = []
-    returnList.extend(parsedLines)
+    insertLists = []
 
     for line in parsedLines:
         if (len(line[1]) == 2):
             if (line[1][0]) == "`include":
                 if (line[1][1] not in libraryList):
                     libraryList.append(line[1][1])
-                    insertList = insertLibraries(parseLines(line[1][1])) #recursion to include libraries within libraries
-                    for i in range(len(insertList)): 
-                        returnList.insert(i, insertList[i]) 
+                    insertLists.append(insertLibraries(moveSectionsDown(parseLines(line[1][1])))) #recursion to include libraries within libraries
+
+    returnList = []
+    for insertList in reversed(insertLists):
+        returnList.extend(insertList)
+    returnList.extend(parsedLines)
 
     return returnList
 
@@ -180,53 +217,8 @@ def compileLine(line):
     compiledLine = ""
 
     #check what kind of instruction this line is
-    switch = {
-        "halt"      : CompileInstruction.compileHalt,
-        "read"      : CompileInstruction.compileRead,
-        "write"     : CompileInstruction.compileWrite,
-        "copy"      : CompileInstruction.compileCopy,
-        "push"      : CompileInstruction.compilePush,
-        "pop"       : CompileInstruction.compilePop,
-        "jump"      : CompileInstruction.compileJump,
-        "jumpo"     : CompileInstruction.compileJumpo,
-        "jumpr"     : CompileInstruction.compileJumpr,
-        "jumpro"    : CompileInstruction.compileJumpro,
-        "load"      : CompileInstruction.compileLoad,
-        "loadhi"    : CompileInstruction.compileLoadhi,
-        "beq"       : CompileInstruction.compileBeq,
-        "bne"       : CompileInstruction.compileBne,
-        "bgt"       : CompileInstruction.compileBgt,
-        "bge"       : CompileInstruction.compileBge,
-        "bgts"      : CompileInstruction.compileBgts,
-        "bges"      : CompileInstruction.compileBges,
-        "savpc"     : CompileInstruction.compileSavpc,
-        "reti"      : CompileInstruction.compileReti,
-        "or"        : CompileInstruction.compileOr,
-        "and"       : CompileInstruction.compileAnd,
-        "xor"       : CompileInstruction.compileXor,
-        "add"       : CompileInstruction.compileAdd,
-        "sub"       : CompileInstruction.compileSub,
-        "shiftl"    : CompileInstruction.compileShiftl,
-        "shiftr"    : CompileInstruction.compileShiftr,
-        "mult"      : CompileInstruction.compileMult,
-        "not"       : CompileInstruction.compileNot,
-        "addr2reg"  : CompileInstruction.compileAddr2reg,
-        "load32"    : CompileInstruction.compileLoad32,
-        "nop"       : CompileInstruction.compileNop,
-        ".dw"       : CompileInstruction.compileDw,
-        ".dd"       : CompileInstruction.compileDd,
-        ".db"       : CompileInstruction.compileDb,
-        ".ds"       : CompileInstruction.compileDs,
-        ".dl"       : CompileInstruction.compileDl,
-        "loadlabellow" : CompileInstruction.compileLoadLabelLow,
-        "loadlabelhigh" : CompileInstruction.compileLoadLabelHigh,
-        "readintid" : CompileInstruction.compileReadIntID,
-        "`include" : CompileInstruction.compileNothing
-    }
-
-
     try:
-        compiledLine = switch[line[0].lower()](line)
+        compiledLine = instructionMap[line[0].lower()](line)
 
     #print errors
     except KeyError:
@@ -246,18 +238,20 @@ def passOne(parsedLines):
     for line in parsedLines:
         try:
             compiledLine = compileLine(line[1])
+            words = compiledLine.split()
 
             #fix instructions that have multiple lines
 
-            if compiledLine.split()[0] == "loadBoth":
-                passOneResult.append((line[0], compileLine(["load", compiledLine.split()[2], compiledLine.split()[3]])))
-                compiledLine = compileLine(["loadhi", compiledLine.split()[1], compiledLine.split()[3]])
+            if words[0] == "loadBoth":
+                passOneResult.append((line[0], compileLine(["load", words[2], words[3]])))
+                compiledLine = compileLine(["loadhi", words[1], words[3]])
+                words = compiledLine.split()
 
-            if compiledLine.split()[0] == "loadLabelHigh":
-                passOneResult.append((line[0], "loadLabelLow " + " ".join(compiledLine.split()[1:])))
+            if words[0] == "loadLabelHigh":
+                passOneResult.append((line[0], "loadLabelLow " + " ".join(words[1:])))
 
-            if compiledLine.split()[0] == "data":
-                for i in compiledLine.split():
+            if words[0] == "data":
+                for i in words:
                     if i != "data":
                         passOneResult.append((line[0], i + " //data"))
             else:
@@ -291,7 +285,7 @@ def obtainDefines(content):
 
             defineLines.append(line)
         else:
-            contentWithoutDefines.append(line) 
+            contentWithoutDefines.append(line)
 
     #parse the lines with defines
     for line in defineLines:
@@ -324,128 +318,129 @@ def addHeaderCode(parsedLines):
         header = [(0,"jump Main"),(0,"jump Int1"),(0,"jump Int2"),(0,"jump Int3"),(0,"jump Int4"), (0,"LengthOfProgram"), (0,"jump Syscall")]
     else:
         header = [(0,"jump Main"),(0,"jump Int1"),(0,"jump Int2"),(0,"jump Int3"),(0,"jump Int4"), (0,"LengthOfProgram")]
-    
+
     return header + parsedLines
 
-#move labels to the next line
-def moveLabels(parsedLines):
+#removes the labels, numbers each line by its address
+#and returns a map of labels to addresses
+#a label belongs to the first instruction below it
+#from this point no line should become multiple lines in the final code!
+def getLabelMap(parsedLines):
+    labelMap = {}
     returnList = []
+    labels = [] #labels waiting for an instruction
 
-    #move to next line
-    # (old iteration) for idx, line in enumerate(parsedLines):
-    idx = 0;
-    while idx < len(parsedLines):
-        line = parsedLines[idx]
-        if line[1].lower().split()[0] == "label":
-            if idx < len(parsedLines) - 1:
-                
-                if parsedLines[idx+1][1].lower().split()[0] == "label":
-                    # (OLD) if we have a label directly below, insert a nop as a quick fix
-                    #parsedLines.insert(idx+1, (0, "$*" + line[1].split()[1] + "*$ " +"00000000000000000000000000000000 //NOP to quickfix double labels"))
-
-                    # if we have a label directly below, insert the label in the first non-label line
-                    i = 2
-                    labelDone = False
-                    while idx+i < len(parsedLines) - 1 and not labelDone:
-                        if parsedLines[idx+i][1].lower().split()[0] != "label":
-                            labelDone = True
-                            parsedLines[idx+i] = (parsedLines[idx+i][0], "$*" + line[1].split()[1] + "*$ " + parsedLines[idx+i][1])
-                            # add label in comments, but only if the line does not need to have a second pass
-                            # TODO implement this!
-                            #if parsedLines[idx+i][1].split()[1][0] == "0" or parsedLines[idx+i][1].split()[1][0] == "1":
-                            #    parsedLines[idx+i][1] = parsedLines[idx+i][1] + " @" + line[1].split()[1][:-1]
-                        i+=1
-                else:
-                    parsedLines[idx+1] = (parsedLines[idx+1][0], "$*" + line[1].split()[1] + "*$ " + parsedLines[idx+1][1])
-                    # add label in comments, but only if the line does not need to have a second pass
-                    # TODO implement this!
-                    #if parsedLines[idx+1][1].split()[1][0] == "0" or parsedLines[idx+1][1].split()[1][0] == "1":
-                    #    parsedLines[idx+1][1] = parsedLines[idx+1][1] + " @" + line[1].split()[1][:-1]
-            else:
-                print("Error: label " + line[1].split()[1] + " has no instructions below it")
+    for line in parsedLines:
+        if line[1][:6].lower() == "label ":
+            labels.append(line[1].split()[1][:-1])
+            continue
+
+        address = len(returnList) + programOffset
+        for label in labels:
+            if label in labelMap:
+                print("Error: label " + label + " is already defined")
                 print("Assembler will now exit")
                 sys.exit(1)
-        idx += 1
-
-    #remove original labels
-    for line in parsedLines:
-        if line[1].lower().split()[0] != "label":
-            returnList.append(line)
-
-    return returnList
-
-
-#renumbers each line
-def redoLineNumbering(parsedLines):
-    returnList = []
-
-    for idx, line in enumerate(parsedLines):
-        returnList.append((idx + programOffset, line[1]))
-
-    return returnList
+            labelMap[label] = address
+        labels = []
 
-#removes label prefix and returns a map of labels to line numbers
-#assumes that $* does not occur somewhere else, and that labels are seperated by space
-def getLabelMap(parsedLines):
-    labelMap = {}
-    returnList = []
+        returnList.append((address, line[1]))
 
-    for line in parsedLines:
-        numberOfLabels = line[1].count("$*")
-        for i in range(numberOfLabels):
-            if line[1].split()[i][:2] == "$*" and line[1].split()[i][-3:] == ":*$":
-                if (line[1].split()[i][2:-3] in labelMap):
-                    print("Error: label " + line[1].split()[i][2:-3] + " is already defined")
-                    print("Assembler will now exit")
-                    sys.exit(1)
-
-                labelMap[line[1].split()[i][2:-3]] = line[0]
-
-        if line[1].split()[0][:2] == "$*" and line[1].split()[0][-2:] == "*$":
-            returnList.append((line[0], line[1].split("*$ ")[-1]))
-        else:
-            returnList.append(line)
-        
+    if labels:
+        print("Error: label " + labels[-1] + ": has no instructions below it")
+        print("Assembler will now exit")
+        sys.exit(1)
 
     return returnList, labelMap
 
 #compiles all labels
+#lines that still have a label are split once, other lines are left alone
 def passTwo(parsedLines, labelMap):
-    #lines that start with these names should be compiled
-    toCompileList = ["jump", "beq", "bne", "bgt", "bge", "bgts", "bges", "loadlabellow" ,"loadlabelhigh", ".dl"]
-
     for idx, line in enumerate(parsedLines):
-        if line[1].lower().split()[0] in toCompileList:
-            for idx2, word in enumerate(line[1].split()):              
+        words = line[1].split()
+        if words[0].lower() in toCompileList:
+            for idx2, word in enumerate(words):
                 if word in labelMap:
-                    x = line[1].split()
-                    x[idx2] = str(labelMap.get(word))
-                    y = compileLine(x)
-                    parsedLines[idx] = (parsedLines[idx][0], y)
-                 
+                    x = list(words)
+                    x[idx2] = str(labelMap[word])
+                    parsedLines[idx] = (line[0], compileLine(x))
 
     return parsedLines
 
 #check if all labels are compiled
 def checkNoLabels(parsedLines):
-    toCompileList = ["jump", "beq", "bne", "bgt", "bge", "bgts", "bges", "loadlabellow" ,"loadlabelhigh", ".dl"]
-    
     for idx, line in enumerate(parsedLines):
-        if line[1].lower().split()[0] in toCompileList:
+        words = line[1].split()
+        if words[0].lower() in toCompileList:
             labelPos = 0
-            if line[1].lower().split()[0] in ["jump", "loadlabellow", "loadlabelhigh", ".dl"]:
+            if words[0].lower() in ["jump", "loadlabellow", "loadlabelhigh", ".dl"]:
                 labelPos = 1
-            if line[1].lower().split()[0] in ["beq", "bne", "bgt", "bge", "bgts", "bges",]:
+            if words[0].lower() in ["beq", "bne", "bgt", "bge", "bgts", "bges",]:
                 labelPos = 3
-            print("Error: label " + line[1].split()[labelPos] + " is undefined")
+            print("Error: label " + words[labelPos] + " is undefined")
             print("Assembler will now exit")
             sys.exit(1)
 
-        if line[1].lower().split()[0] == "label":
-            print("Error: label " + line[1].split()[1] + " is used directly after another label")
-            print("Assembler will now exit")
-            sys.exit(1)
-        
+
+#prints the time spent in each stage and the number of lines after it to stderr
+def printTimingReport(stages):
+    total = 0.0
+    print("Assembler timing:", file=sys.stderr)
+    for name, seconds, lines in stages:
+        total += seconds
+        print("  {0:<24}{1:8.3f}s {2:8} lines".format(name, seconds, lines), file=sys.stderr)
+    print("  {0:<24}{1:8.3f}s".format("total", total), file=sys.stderr)
+
+
+#writes the program as big endian 32 bit words
+#each line starts with the 32 bits of its word
+def writeBinary(parsedLines, fileName):
+    words = [int(line[1][:32], 2) for line in parsedLines]
+    data = struct.pack(">" + str(len(words)) + "I", *words)
+
+    if padBinaryTo:
+        data += b"\xFF" * (-len(data) % padBinaryTo)
+
+    with open(fileName, 'wb') as f:
+        f.write(data)
+
+
+#writes the labels sorted by address, followed by the listing of each word with its address
+def writeSymbols(parsedLines, labelMap, fileName):
+    with open(fileName, 'w') as f:
+        f.write("; symbols\n")
+        for label, address in sorted(labelMap.items(), key=lambda x: (x[1], x[0])):
+            f.write("{0:08X} {1}\n".format(address, label))
+
+        f.write("\n; listing\n")
+        for address, line in parsedLines:
+            comment = line.split("//", maxsplit=1)
+            f.write("{0:08X} {1:08X} {2}\n".format(address, int(line[:32], 2), comment[1].strip() if len(comment) > 1 else ""))
+
+
+#writes the result of pass one as relocatable object
+#instructions with a label are compiled with address 0 and get a relocation for the label
+def writeObject(passOneResult, fileName):
+    with open(fileName, 'w') as f:
+        f.write("; B322 object\n")
+        wordCount = 0
+        for line in passOneResult:
+            words = line[1].split()
+            if line[1][:6].lower() == "label ":
+                f.write("symbol {0} {1}\n".format(words[1][:-1], wordCount))
+                continue
+
+            if words[0].lower() in relocationTypes:
+                compiledLine = compileLine([words[0], "0"] + words[2:])
+                f.write("word {0:08X} {1} {2}\n".format(int(compiledLine[:32], 2), relocationTypes[words[0].lower()], words[1]))
+            elif words[0].lower() in toCompileList:
+                print("Error in line " + str(line[0]) + ": " + line[1])
+                print("The error is: a label as branch offset is not supported in an object")
+                print("Assembler will now exit")
+                sys.exit(1)
+            else:
+                f.write("word {0:08X}\n".format(int(line[1][:32], 2)))
+            wordCount += 1
 
 
 def main():
@@ -454,65 +449,103 @@ def main():
     global BDOSprogram
     global programOffset
     global optimizeSize
+    global printTiming
+    global binaryFile
+    global padBinaryTo
+    global symbolFile
+    global objectFile
+
+    #options can be given after the mode and offset arguments
+    args = []
+    idx = 1
+    while idx < len(sys.argv):
+        arg = sys.argv[idx]
+        if arg == "-O":
+            optimizeSize = True
+        elif arg == "-t":
+            printTiming = True
+        elif arg == "-pad":
+            padBinaryTo = 4096
+        elif arg in ["-o", "-sym", "-c"] and idx + 1 < len(sys.argv):
+            idx += 1
+            if arg == "-o":
+                binaryFile = sys.argv[idx]
+            elif arg == "-sym":
+                symbolFile = sys.argv[idx]
+            else:
+                objectFile = sys.argv[idx]
+        else:
+            args.append(arg)
+        idx += 1
 
-    if len(sys.argv) >= 3:
-        BDOSprogram = (sys.argv[1].lower() == "bdos")
+    if len(args) >= 2:
+        BDOSprogram = (args[0].lower() == "bdos")
         if BDOSprogram:
-            programOffset = CompileInstruction.getNumber(sys.argv[2])
-    if len(sys.argv) >= 2:
-        BDOSos = (sys.argv[1].lower() == "os")
-    if sys.argv[len(sys.argv)-1] == "-O":
-        optimizeSize = True
+            programOffset = CompileInstruction.getNumber(args[1])
+    if len(args) >= 1:
+        BDOSos = (args[0].lower() == "os")
 
-    #parse lines from file
-    parsedLines = parseLines("code.asm")
+    stages = []
+    stageStart = time.perf_counter()
 
-    #move .data sections down
-    parsedLines = moveDataDown(parsedLines)
+    #records the time of a stage that just ended
+    def endStage(name, lines):
+        nonlocal stageStart
+        now = time.perf_counter()
+        stages.append((name, now - stageStart, len(lines)))
+        stageStart = now
 
-    #move .rdata sections down
-    parsedLines = moveRDataDown(parsedLines)
-
-    #move .bss sections down
-    parsedLines = moveBssDown(parsedLines)
+    #parse lines from file
+    parsedLines = parseLines("code.asm")
+    endStage("parse", parsedLines)
 
-    #remove all .code, .data, .rdata, .bss and .EOF lines
-    parsedLines = removeAssemblerDirectives(parsedLines)
+    #move .data, .rdata and .bss sections down and remove the section directives
+    parsedLines = moveSectionsDown(parsedLines)
+    endStage("sections", parsedLines)
 
     #insert libraries
     parsedLines = insertLibraries(parsedLines)
+    endStage("libraries", parsedLines)
 
-    if optimizeSize:
-        parsedLines = removeUnreachebleCode(parsedLines)
+    #an object does not have the root functions, so only the linked program could be optimized
+    if optimizeSize and not objectFile:
+        parsedLines = removeUnreachableCode(parsedLines)
+        endStage("remove unreachable", parsedLines)
 
     #obtain and remove the define statements
     defines, parsedLines = obtainDefines(parsedLines)
 
     #replace defined words with their value
-    parsedLines = processDefines(defines, parsedLines) 
+    parsedLines = processDefines(defines, parsedLines)
+    endStage("defines", parsedLines)
 
     #do pass one
     passOneResult = passOne(parsedLines)
+    endStage("pass one", passOneResult)
+
+    #the header, labels and program offset are done by the linker
+    if objectFile:
+        writeObject(passOneResult, objectFile)
+        endStage("output", passOneResult)
+        if printTiming:
+            printTimingReport(stages)
+        return
 
     #add interrupt code and jumps
     passOneResult = addHeaderCode(passOneResult)
 
-    #move labels to the next line
-    passOneResult = moveLabels(passOneResult)
-
-    #redo line numbers for jump addressing
+    #remove the labels and number the lines by address for jump addressing
     #from this point no line should become multiple lines in the final code!
     #also no shifting in line numbers!
-    passOneResult = redoLineNumbering(passOneResult)
-
-    #removes label prefixes and creates mapping from label to line
-    passOneResult, labelMap = getLabelMap(passOneResult) 
+    passOneResult, labelMap = getLabelMap(passOneResult)
+    endStage("labels", passOneResult)
 
     #do pass two
     passTwoResult = passTwo(passOneResult, labelMap)
 
     #check if all labels are processed
     checkNoLabels(passTwoResult)
+    endStage("pass two", passTwoResult)
 
     #only add length of program if not BDOS user program
     if not BDOSprogram:
@@ -520,9 +553,18 @@ def main():
         #calculate length of program
         passTwoResult[5] = (5, lenString)
 
-    #print result without line numbers
-    for line in passTwoResult:
-        print(line[1])
+    if binaryFile:
+        writeBinary(passTwoResult, binaryFile)
+    else:
+        #print result without line numbers
+        print("\n".join([line[1] for line in passTwoResult]))
+
+    if symbolFile:
+        writeSymbols(passTwoResult, labelMap, symbolFile)
+    endStage("output", passTwoResult)
+
+    if printTiming:
+        printTimingReport(stages)
 
 if __name__ == '__main__':
-    main()
\ No newline at end of file
+    main()
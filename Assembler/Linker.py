@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+
+#Links relocatable objects from the assembler (Assembler.py -c file.o) into a program
+#This way libraries only have to be compiled and assembled once, instead of for every program
+#
+#Object format, one item per line (lines starting with ; are comments):
+#  symbol <name> <index>       label of word <index> of the object
+#  word <hex>                  word without relocation
+#  word <hex> <type> <name>    word that is completed with the address of label <name>:
+#                                jump: address << 1 (jump instruction)
+#                                low:  lowest 16 bits of address << 12 (loadLabelLow)
+#                                high: highest 11 bits of address << 12 (loadLabelHigh)
+#                                dl:   address (.dl)
+#
+#Labels named Label_<number> (generated by BCC) or __<name> (BCC runtime functions)
+#are local to their object, all other labels are global
+
+import sys
+import Assembler
+import CompileInstruction
+
+#If the program we link is the BDOS operating system
+BDOSos = False
+
+#If we have to link the program as a BDOS user program
+BDOSprogram = False
+
+#Global offset of program in memory
+programOffset = 0
+
+
+#returns True if the label is only visible within its object
+def isLocalLabel(name):
+    return name.startswith("Label_") or name.startswith("__")
+
+
+#returns the name of the label as seen by the linker
+def linkName(name, objectName):
+    if isLocalLabel(name):
+        return name + "@" + objectName
+    return name
+
+
+#reads an object and returns its symbols and words
+#symbols is a list of (name, index), words is a list of (word, relocation type, label)
+def readObject(fileName):
+    symbols = []
+    words = []
+    with open(fileName, 'r') as f:
+        for i, line in enumerate(f, start=1):
+            items = line.split(";", maxsplit=1)[0].split()
+            if items == []:
+                continue
+            if items[0] == "symbol" and len(items) == 3:
+                symbols.append((items[1], int(items[2])))
+            elif items[0] == "word" and len(items) == 2:
+                words.append((int(items[1], 16), None, None))
+            elif items[0] == "word" and len(items) == 4 and items[2] in ["jump", "low", "high", "dl"]:
+                words.append((int(items[1], 16), items[2], items[3]))
+            else:
+                print("Error in " + fileName + " line " + str(i) + ": " + line.strip())
+                print("Invalid object line")
+                print("Linker will now exit")
+                sys.exit(1)
+
+    return symbols, words
+
+
+#returns the header words, like Assembler.addHeaderCode
+#the program length is filled in after linking
+def getHeaderWords():
+    header = [(0x90000000, "jump", "Main"), (0x90000000, "jump", "Int1"), (0x90000000, "jump", "Int2"),
+        (0x90000000, "jump", "Int3"), (0x90000000, "jump", "Int4")]
+    if not BDOSprogram:
+        header.append((0, None, None)) #length of program
+    if BDOSos:
+        header.append((0x90000000, "jump", "Syscall"))
+
+    return header
+
+
+#fills in the address of a label in a word
+def relocate(word, relocationType, address):
+    CompileInstruction.CheckFitsInBits(address, 27)
+    if relocationType == "jump":
+        return word | (address << 1)
+    if relocationType == "low":
+        return word | ((address & 0xFFFF) << 12)
+    if relocationType == "high":
+        return word | ((address >> 16) << 12)
+    return word | address
+
+
+#links the objects and returns the program as (address, line) like the assembler does,
+#together with the map of labels to addresses
+def link(objectFiles):
+    words = getHeaderWords()
+    labelMap = {}
+
+    for objectFile in objectFiles:
+        symbols, objectWords = readObject(objectFile)
+        base = len(words)
+        for name, index in symbols:
+            label = linkName(name, objectFile)
+            if label in labelMap:
+                print("Error: label " + label + " is already defined")
+                print("Linker will now exit")
+                sys.exit(1)
+            labelMap[label] = programOffset + base + index
+        words.extend([(word, relocationType, linkName(name, objectFile) if name else None) for word, relocationType, name in objectWords])
+
+    program = []
+    for idx, (word, relocationType, label) in enumerate(words):
+        comment = ""
+        if relocationType:
+            if label not in labelMap:
+                print("Error: label " + label + " is undefined")
+                print("Linker will now exit")
+                sys.exit(1)
+            try:
+                word = relocate(word, relocationType, labelMap[label])
+            except Exception as e:
+                print("Error: label " + label + ": {0}".format(e))
+                print("Linker will now exit")
+                sys.exit(1)
+            comment = " //" + relocationType + " " + label
+        program.append((programOffset + idx, '{0:032b}'.format(word) + comment))
+
+    #only add length of program if not BDOS user program
+    if not BDOSprogram:
+        program[5] = (program[5][0], '{0:032b}'.format(len(program)) + " //Length of program")
+
+    return program, labelMap
+
+
+def main():
+    global BDOSos
+    global BDOSprogram
+    global programOffset
+
+    binaryFile = None
+    symbolFile = None
+
+    #the mode and offset are given like for the assembler, followed by the objects
+    args = []
+    idx = 1
+    while idx < len(sys.argv):
+        arg = sys.argv[idx]
+        if arg == "-pad":
+            Assembler.padBinaryTo = 4096
+        elif arg in ["-o", "-sym"] and idx + 1 < len(sys.argv):
+            idx += 1
+            if arg == "-o":
+                binaryFile = sys.argv[idx]
+            else:
+                symbolFile = sys.argv[idx]
+        else:
+            args.append(arg)
+        idx += 1
+
+    if len(args) >= 2 and args[0].lower() == "bdos":
+        BDOSprogram = True
+        programOffset = CompileInstruction.getNumber(args[1])
+        args = args[2:]
+    elif len(args) >= 1 and args[0].lower() == "os":
+        BDOSos = True
+        args = args[1:]
+
+    if args == []:
+        print("Usage: Linker.py [bdos offset | os] [-pad] [-o file] [-sym file] object...")
+        sys.exit(1)
+
+    program, labelMap = link(args)
+
+    if binaryFile:
+        Assembler.writeBinary(program, binaryFile)
+    else:
+        #print result without line numbers
+        print("\n".join([line[1] for line in program]))
+
+    if symbolFile:
+        Assembler.writeSymbols(program, labelMap, symbolFile)
+
+if __name__ == '__main__':
+    main()
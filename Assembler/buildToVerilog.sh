@@ -1,21 +1,21 @@
 # Build script for assembly files
-if (python3 Assembler.py > ../Programmer/code.list) # compile and write to code.list in Programmer folder
+if (python3 Assembler.py -pad -o ../Programmer/code.bin) # compile and write code.bin to Programmer folder
    then
-   		# convert list to binary files, then copy the files to verilog folder
+   		# copy the binary to the verilog folder
    		# comment out the uart flasher to use simulation instead
        	
        	# WSL2 version
-       	#(cd ../Programmer && bash compileROM.sh && powershell.exe "python uartFlasher_win.py" && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
+       	#(cd ../Programmer && powershell.exe "python uartFlasher_win.py" && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
        	
        	# WSL1/Linux version
-       	(cd ../Programmer && bash compileROM.sh && python3 uartFlasher.py && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
+       	(cd ../Programmer && python3 uartFlasher.py && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
        	
         # Simulation only version
-        #(cd ../Programmer && bash compileROM.sh && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
+        #(cd ../Programmer && cp code.bin  ../Verilog/memory/code.bin && echo "Compile and Copy done")
 
        	# convert to text file
 		(cd ../Verilog/memory && bash bin2txt.sh && echo "Converted to txt")
    else
-   		# print the error, which is in code.list
-       	(cat ../Programmer/code.list)
+   		# the assembler has printed the error
+       	echo "Failed to assemble B332 ASM code"
 fi
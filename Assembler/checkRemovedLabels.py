@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+
+#Checks that removing unreachable code (Assembler.py -O) did not remove labels that are still used
+#Every label inside the asm() body of a C function (like a loop label) has to be kept when that function is kept,
+#since it is only reached by falling through from the start of the function
+#
+#Usage: checkRemovedLabels.py code.asm symbols [label...]
+#  code.asm: the code from BCC that was assembled
+#  symbols:  the symbol file of the assembled code (Assembler.py -sym)
+#  label:    labels that should always be kept
+
+import sys
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: checkRemovedLabels.py code.asm symbols [label...]")
+        sys.exit(1)
+
+    #the labels of C functions and variables, BCC writes a "; glb <name> :" comment for each
+    cLabels = set()
+    labelsOfFunction = [] #(function, label) for each label inside the asm() body of a function
+    function = None
+    with open(sys.argv[1], 'r') as f:
+        for line in f:
+            words = line.split()
+            if len(words) >= 3 and words[0] == ";" and words[1] == "glb":
+                cLabels.add(words[2])
+            elif len(words) > 0 and words[0][-1] == ":" and words[0][0] not in ";.":
+                name = words[0][:-1]
+                if name in cLabels:
+                    function = name
+                elif function and not name.startswith("Label_"):
+                    labelsOfFunction.append((function, name))
+
+    kept = set()
+    with open(sys.argv[2], 'r') as f:
+        for line in f:
+            if line.startswith("; listing"):
+                break
+            words = line.split()
+            if len(words) == 2:
+                kept.add(words[1])
+
+    errors = 0
+    for function, label in labelsOfFunction:
+        if function in kept and label not in kept:
+            print("Error: label " + label + " of function " + function + " was removed")
+            errors += 1
+
+    for label in sys.argv[3:]:
+        if label not in kept:
+            print("Error: label " + label + " was removed")
+            errors += 1
+
+    if errors:
+        sys.exit(1)
+
+    print("All labels of kept functions are kept")
+
+if __name__ == '__main__':
+    main()
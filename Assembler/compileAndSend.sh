@@ -1,28 +1,34 @@
 #!/bin/bash
 
+# the SPI flash programmer needs a binary padded to a multiple of 4096 bytes
+PADDING=""
+if [[ $1 == "flash" ||  $1 == "write" ]]
+then
+    PADDING="-pad"
+fi
+
 echo "Assembling B332 ASM code"
-if (python3 Assembler.py > ../Programmer/code.list) # compile and write to code.list in Programmer folder
+if (python3 Assembler.py $PADDING -o ../Programmer/code.bin) # compile and write code.bin to Programmer folder
 then
         echo "B332 ASM code successfully assembled"
-        # convert list to binary files and send to FPGC
+        # send to FPGC
 
         # WSL1/Linux version
         if [[ $1 == "flash" ||  $1 == "write" ]]
         then
-            (cd ../Programmer && bash compileROM.sh && echo "Flashing binary to FPGC flash" && python3 flash.py write)
+            (cd ../Programmer && echo "Flashing binary to FPGC flash" && python3 flash.py write)
         else
-            (cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC" && python3 uartFlasher.py)
+            (cd ../Programmer && echo "Sending binary to FPGC" && python3 uartFlasher.py)
         fi
 
         # WSL2/Windows version
         #if [[ $1 == "flash" ||  $1 == "write" ]]
         #then
-        #    (cd ../Programmer && bash compileROM.sh && echo "Flashing binary to FPGC flash" && python.exe flash_win.py write)
+        #    (cd ../Programmer && echo "Flashing binary to FPGC flash" && python.exe flash_win.py write)
         #else
-        #    (cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC" && python.exe uartFlasher_win.py)
+        #    (cd ../Programmer && echo "Sending binary to FPGC" && python.exe uartFlasher_win.py)
         #fi
 
-else # assemble failed, run again to show error
+else # assemble failed, the assembler has printed the error
     echo "Failed to assemble B332 ASM code"
-    python3 Assembler.py
 fi
\ No newline at end of file
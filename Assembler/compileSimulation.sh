@@ -6,6 +6,6 @@ if (python3 Assembler.py > ../Verilog/memory/mu.list) # compile and write to ver
          iverilog -o /home/bart/Documents/FPGA/FPGC5/Verilog/output/output /home/bart/Documents/FPGA/FPGC5/Verilog/testbench/B323_tb.v
          vvp /home/bart/Documents/FPGA/FPGC5/Verilog/output/output
    else
-         # print the error, which is in code.list
-         (cat ../Programmer/code.list)
+         # print the error, which the assembler wrote to mu.list
+         (cat ../Verilog/memory/mu.list)
 fi
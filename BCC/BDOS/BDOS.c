@@ -30,6 +30,8 @@
 
 #define FS_PATH_MAX_LENGHT  256         // max length of a path
 
+#define NETCHECK_INTERVAL   32768       // main loop iterations between checks of the netloader and netHID sockets (~1s when idle)
+
 // Interrupt IDs for extended interrupt handler
 #define INTID_TIMER2  0x0
 #define INTID_TIMER3  0x1
@@ -159,6 +161,9 @@ void BDOS_Restore()
 
     // restore netloader
     NETLOADER_init(NETLOADER_SOCKET);
+
+    // reopen netHID if the user program closed its socket, an open connection is kept
+    NETHID_checkSocket(NETHID_SOCKET);
 }
 
 // Main BDOS code
@@ -197,10 +202,20 @@ int main()
     SHELL_init();
 
     // main loop
+    word netCheckCount = 0;
     while (1)
     {
-        SHELL_loop();                       // update the shell state
-        NETLOADER_loop(NETLOADER_SOCKET);   // update the netloader state
+        SHELL_loop();                                   // update the shell state
+        wizHandleEvents(0xFF ^ (1 << NETHID_SOCKET));   // handle network events, like those of the netloader
+
+        // sockets can also end up closed without an event, so check their status once in a while
+        netCheckCount++;
+        if (netCheckCount == NETCHECK_INTERVAL)
+        {
+            netCheckCount = 0;
+            NETLOADER_checkSocket(NETLOADER_SOCKET);
+            NETHID_checkSocket(NETHID_SOCKET);
+        }
     }
 
     return 1;
@@ -428,7 +443,7 @@ void int4()
         word* spi3ChipSelect = (word*) 0xC02732;
         if (*spi3ChipSelect == 1)
         {
-            NETHID_loop(NETHID_SOCKET); // look for an input sent to netHID
+            wizHandleEvents(1 << NETHID_SOCKET); // handle an input sent to netHID
         }
     }
 
@@ -108,50 +108,41 @@ void NETHID_handleSession(word s)
 }
 
 
+// Handles the events of socket s
+void NETHID_handleEvents(word s, word ir)
+{
+    if (ir & WIZNET_IR_RECV)
+    {
+        // Handle the received inputs
+        NETHID_handleSession(s);
+    }
+    if (ir & (WIZNET_IR_DISCON | WIZNET_IR_TIMEOUT))
+    {
+        // Listen again when the connection is closed
+        wizInitSocketTCP(s, NETHID_PORT);
+    }
+}
+
+
 // Initialize netHID on socket s
 void NETHID_init(word s)
 {
     // Open socket in TCP Server mode
     wizInitSocketTCP(s, NETHID_PORT);
 
+    // Let wizHandleEvents call netHID on new data
+    wizSetSocketHandler(s, NETHID_handleEvents, WIZNET_IR_DISCON | WIZNET_IR_RECV | WIZNET_IR_TIMEOUT);
+
     NETHID_isInitialized = 1;
 }
 
 
-// Check for a change in the socket status
-// Handles change if exists
-void NETHID_loop(word s)
+// Initializes netHID on socket s again when the socket is closed or in an unknown state,
+//  for example after a failed LISTEN or when a user program closed it
+void NETHID_checkSocket(word s)
 {
-    // Get status for socket s
-    word sxStatus = wizGetSockReg8(s, WIZNET_SnSR);
-
-    if (sxStatus == WIZNET_SOCK_CLOSED)
-    { 
-        // Open the socket when closed
-        wizInitSocketTCP(s, NETHID_PORT);
-    }
-    else if (sxStatus == WIZNET_SOCK_ESTABLISHED)
-    {
-        // Handle session when a connection is established
-        NETHID_handleSession(s);
-    }
-    else if (sxStatus == WIZNET_SOCK_LISTEN)
+    if (!wizSocketIsOpen(s))
     {
-        // Keep on listening
+        NETHID_init(s);
     }
-    else if (sxStatus == WIZNET_SOCK_SYNSENT || sxStatus == WIZNET_SOCK_SYNRECV || sxStatus == WIZNET_SOCK_FIN_WAIT || sxStatus == WIZNET_SOCK_TIME_WAIT)
-    {
-        // Do nothing in these cases
-    }
-    else
-    {
-        /*
-        uprintln("Got unknown status:");
-        uprintlnHex(sxStatus);
-        */
-        // In other cases, reset the socket
-        wizInitSocketTCP(s, NETHID_PORT);
-    }
-    return;
 }
-
@@ -10,6 +10,8 @@
 #define NETLOADER_PORT 3220
 // Socket to listen to (0-7)
 #define NETLOADER_SOCKET 0
+// Status checks without new data before a session is stopped (~10s), see wizWaitSocketEvents
+#define NETLOADER_TIMEOUT 200
 
 // Checks if p starts with cmd
 // Returns 1 if true, 0 otherwise
@@ -28,37 +30,38 @@ word NETLOADER_frameCompare(char* p, char* cmd)
 }
 
 
-word NETLOADER_wordPosition = 0;
-word NETLOADER_currentByteShift = 24;
+char* NETLOADER_runPos = (char*) RUN_ADDR; // next word of the program to fill
+word NETLOADER_packState[2]; // unfinished word of the program and the number of bytes it still needs
 
 // Appends bytes from buffer to words in run address
+// Only used for the data in the first frame, the other frames are read directly to the run address
 void NETLOADER_appendBufferToRunAddress(char* b, word len)
 {
-    char* dst = (char*) RUN_ADDR;
-
     word i;
     for (i = 0; i < len; i++) 
     {
-        char readByte = b[i];
-
         // Read 4 bytes into one word, from left to right
-        readByte = readByte << NETLOADER_currentByteShift;
-        dst[NETLOADER_wordPosition] = dst[NETLOADER_wordPosition] + readByte;
-
+        NETLOADER_packState[0] = (NETLOADER_packState[0] << 8) + b[i];
+        NETLOADER_packState[1]--;
 
-        if (NETLOADER_currentByteShift == 0)
-        {
-            NETLOADER_currentByteShift = 24;
-            NETLOADER_wordPosition++;
-            dst[NETLOADER_wordPosition] = 0;
-        }
-        else
+        if (NETLOADER_packState[1] == 0)
         {
-            NETLOADER_currentByteShift -= 8;
+            *NETLOADER_runPos = NETLOADER_packState[0];
+            NETLOADER_runPos++;
+            NETLOADER_packState[1] = 4;
         }
     }
 }
 
+// Stores the last word of the program if it is not complete
+void NETLOADER_finishRunAddress()
+{
+    if (NETLOADER_packState[1] != 4)
+    {
+        *NETLOADER_runPos = NETLOADER_packState[0] << (NETLOADER_packState[1] << 3);
+    }
+}
+
 word NETLOADER_getContentLength(char* rbuf, word rsize)
 {
     word contentLengthStr[32];
@@ -191,13 +194,29 @@ void NETLOADER_handleSession(word s)
     char dbuf[10]; // percentage done for progress indication
     dbuf[0] = 0; // terminate
 
-    while (wizGetSockReg8(s, WIZNET_SnSR) == WIZNET_SOCK_ESTABLISHED)
+    // stop when the peer closed the connection or it timed out
+    word ir = 0;
+    while ((ir & (WIZNET_IR_DISCON | WIZNET_IR_TIMEOUT)) == 0)
     {
         word rsize = wizGetSockReg16(s, WIZNET_SnRX_RSR);
-        if (rsize != 0)
+        if (rsize == 0)
+        {
+            // wait for new data without polling the socket registers
+            ir = wizWaitSocketEvents(s, NETLOADER_TIMEOUT);
+            if (ir == 0)
+            {
+                // the connection is gone without an event, or the peer stopped sending
+                break;
+            }
+        }
+        else
         {
             char* rbuf = (char *) TEMP_ADDR;
-            wizReadRecvData(s, rbuf, rsize);
+            // after the first frame, program data is read directly to the run address
+            if (firstResponse || downloadToFile)
+            {
+                wizReadRecvData(s, rbuf, rsize);
+            }
             if (firstResponse)
             {
                 GFX_PrintConsole("\n");
@@ -209,12 +228,9 @@ void NETLOADER_handleSession(word s)
                     downloadToFile = 0;
 
                     // reset position counters
-                    NETLOADER_wordPosition = 0;
-                    NETLOADER_currentByteShift = 24;
-
-                    // clear first address of run addr
-                    char* dst = (char*) RUN_ADDR;
-                    dst[0] = 0;
+                    NETLOADER_runPos = (char*) RUN_ADDR;
+                    NETLOADER_packState[0] = 0;
+                    NETLOADER_packState[1] = 4;
                 }
                 // save to file
                 else if (rbuf[0] == 'D' && rbuf[1] == 'O' && rbuf[2] == 'W' && rbuf[3] == 'N')
@@ -295,7 +311,7 @@ void NETLOADER_handleSession(word s)
 
                 if (downloadToFile)
                 {
-                    FS_writeFile(rbuf+dataStart, rsize - dataStart);
+                    FS_writeFile(rbuf+dataStart, rsize - dataStart, 0);
                 }
                 else
                 {
@@ -320,6 +336,7 @@ void NETLOADER_handleSession(word s)
                     }
                     else
                     {
+                        NETLOADER_finishRunAddress();
                         NETLOADER_runProgramFromMemory();
                     }
                     return;
@@ -351,11 +368,11 @@ void NETLOADER_handleSession(word s)
 
                 if (downloadToFile)
                 {
-                    FS_writeFile(rbuf, rsize);
+                    FS_writeFile(rbuf, rsize, 0);
                 }
                 else
                 {
-                    NETLOADER_appendBufferToRunAddress(rbuf, rsize);
+                    NETLOADER_runPos = wizStreamRecvData(s, NETLOADER_runPos, rsize, NETLOADER_packState);
                 }
 
                 // all data downloaded
@@ -382,6 +399,7 @@ void NETLOADER_handleSession(word s)
                     }
                     else
                     {
+                        NETLOADER_finishRunAddress();
                         NETLOADER_runProgramFromMemory();
                     }
                     return;
@@ -389,50 +407,45 @@ void NETLOADER_handleSession(word s)
             }
         }
     }
-}
-
 
-// Initialize network bootloader on socket s
-void NETLOADER_init(word s)
-{
-    // Open socket in TCP Server mode
+    // listen for a new connection
     wizInitSocketTCP(s, NETLOADER_PORT);
 }
 
 
-// Check for a change in the socket status
-// Handles change if exists
-word NETLOADER_loop(word s)
+// Handles the events of socket s
+void NETLOADER_handleEvents(word s, word ir)
 {
-    // Get status for socket s
-    word sxStatus = wizGetSockReg8(s, WIZNET_SnSR);
-
-    if (sxStatus == WIZNET_SOCK_CLOSED)
-    { 
-        // Open the socket when closed
-        wizInitSocketTCP(s, NETLOADER_PORT);
-    }
-    else if (sxStatus == WIZNET_SOCK_ESTABLISHED)
+    if ((ir & (WIZNET_IR_CON | WIZNET_IR_RECV)) && wizGetSockReg8(s, WIZNET_SnSR) == WIZNET_SOCK_ESTABLISHED)
     {
         // Handle session when a connection is established
         NETLOADER_handleSession(s);
     }
-    else if (sxStatus == WIZNET_SOCK_LISTEN)
+    else if (ir & (WIZNET_IR_DISCON | WIZNET_IR_TIMEOUT))
     {
-        // Keep on listening
-        return 1;
-    }
-    else if (sxStatus == WIZNET_SOCK_SYNSENT || sxStatus == WIZNET_SOCK_SYNRECV || sxStatus == WIZNET_SOCK_FIN_WAIT || sxStatus == WIZNET_SOCK_TIME_WAIT)
-    {
-        // Do nothing in these cases
-        return 2;
-    }
-    else
-    {
-        // In other cases, reset the socket
+        // Listen again when the connection is closed
         wizInitSocketTCP(s, NETLOADER_PORT);
     }
+}
+
 
-    return 0;
+// Initialize network bootloader on socket s
+void NETLOADER_init(word s)
+{
+    // Open socket in TCP Server mode
+    wizInitSocketTCP(s, NETLOADER_PORT);
+
+    // Let wizHandleEvents call the netloader on new connections and data
+    wizSetSocketHandler(s, NETLOADER_handleEvents, WIZNET_IR_CON | WIZNET_IR_DISCON | WIZNET_IR_RECV | WIZNET_IR_TIMEOUT);
 }
 
+
+// Initializes the netloader on socket s again when the socket is closed or in an unknown state,
+//  for example after a failed LISTEN or when a user program closed it
+void NETLOADER_checkSocket(word s)
+{
+    if (!wizSocketIsOpen(s))
+    {
+        NETLOADER_init(s);
+    }
+}
@@ -24,6 +24,8 @@
 #define WIZNET_SIPR   0x000F    // Source IP address
 #define WIZNET_IR     0x0015    // Interrupt
 #define WIZNET_IMR    0x0016    // Interrupt Mask
+#define WIZNET_SIR    0x0017    // Socket Interrupt
+#define WIZNET_SIMR   0x0018    // Socket Interrupt Mask
 #define WIZNET_RTR    0x0019    // Timeout address
 #define WIZNET_RCR    0x001B    // Retry count
 #define WIZNET_UIPR   0x0028    // Unreachable IP address in UDP mode
@@ -50,6 +52,7 @@
 #define WIZNET_SnRX_RSR    0x0026        // RX RECEIVED SIZE REGISTER
 #define WIZNET_SnRX_RD     0x0028        // RX Read Pointer
 #define WIZNET_SnRX_WR     0x002A        // RX Write Pointer (supported?
+#define WIZNET_SnIMR       0x002C        // Interrupt Mask
 
 //Socket n Mode Register (0x0000)
 //WIZNET_SnMR
@@ -76,11 +79,11 @@
 
 //Socket n Interrupt Register (0x0002)
 //WIZNET_SnIR
-// Bit 0: CON
-// Bit 1: DISCON
-// Bit 2: RECV
-// Bit 3: TIMEOUT
-// Bit 4: SEND_OK
+#define WIZNET_IR_CON      0x01   // Connection with peer established
+#define WIZNET_IR_DISCON   0x02   // FIN or FIN/ACK received from peer
+#define WIZNET_IR_RECV     0x04   // Data received from peer
+#define WIZNET_IR_TIMEOUT  0x08   // ARP or TCP timeout
+#define WIZNET_IR_SENDOK   0x10   // SEND command completed
 
 //Socket n Status Register (0x0003)
 //WIZNET_SnSR 
@@ -107,6 +110,8 @@
 
 #define WIZNET_MAX_RBUF 2048 // buffer for receiving data (max rx packet size!)
 #define WIZNET_MAX_TBUF 2048 // buffer for sending data (max tx packet size!)
+#define WIZNET_MIN_SEND 512  // free space in the TX buffer before more data is sent, if more data is left
+#define WIZNET_WAIT_CHECK 4096 // polls of INTn between checks of the socket status while waiting for an event
 
 
 //-------------------
@@ -176,6 +181,114 @@ word WizSpiTransfer(word dataByte)
     return retval;
 }
 
+// Writes len (> 0) bytes from buf over SPI3, one byte per address
+void WizSpiWriteBytes(char* buf, word len)
+{
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r3\n"
+        "push r4\n"
+
+        "load32 W5500_SPI3_ADDR r1          ; r1 = W5500_SPI3_ADDR\n"
+        "add r4 r5 r3                       ; r3 = address after the last byte\n"
+
+        "WizSpiWriteBytesLoop:\n"
+        "    read 0 r4 r2                   ; get byte from buf\n"
+        "    write 0 r1 r2                  ; write byte over SPI3\n"
+        "    add r4 1 r4                    ; incr buf address\n"
+        "    beq r4 r3 2                    ; keep looping until all bytes are written\n"
+        "    jump WizSpiWriteBytesLoop\n"
+
+        "; restore regs\n"
+        "pop r4\n"
+        "pop r3\n"
+        "pop r1\n"
+        );
+}
+
+// Reads len (> 0) bytes over SPI3 into buf, one byte per address
+// Returns the address after the last byte
+char* WizSpiReadBytes(char* buf, word len)
+{
+    char* retval = 0;
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r3\n"
+        "push r4\n"
+
+        "load32 W5500_SPI3_ADDR r1          ; r1 = W5500_SPI3_ADDR\n"
+        "add r4 r5 r3                       ; r3 = address after the last byte\n"
+
+        "WizSpiReadBytesLoop:\n"
+        "    write 0 r1 r0                  ; write 0 over SPI3\n"
+        "    read 0 r1 r2                   ; read byte\n"
+        "    write 0 r4 r2                  ; store byte in buf\n"
+        "    add r4 1 r4                    ; incr buf address\n"
+        "    beq r4 r3 2                    ; keep looping until all bytes are read\n"
+        "    jump WizSpiReadBytesLoop\n"
+
+        "write -4 r14 r4                    ; write to stack to return\n"
+
+        "; restore regs\n"
+        "pop r4\n"
+        "pop r3\n"
+        "pop r1\n"
+        );
+
+    return retval;
+}
+
+// Reads len (> 0) bytes over SPI3 into buf, four bytes per address from left to right
+// packState[0] is the word that is being filled, packState[1] the number of bytes it still needs (1-4),
+//  so a word can continue in the next call. Each completed word is written once
+// Returns the address of the next word to fill
+char* WizSpiReadWords(char* buf, word len, word* packState)
+{
+    char* retval = 0;
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r4\n"
+        "push r5\n"
+        "push r7\n"
+        "push r8\n"
+
+        "load32 W5500_SPI3_ADDR r1          ; r1 = W5500_SPI3_ADDR\n"
+        "read 0 r6 r7                       ; r7 = word that is being filled\n"
+        "read 1 r6 r8                       ; r8 = number of bytes the word still needs\n"
+
+        "WizSpiReadWordsLoop:\n"
+        "    write 0 r1 r0                  ; write 0 over SPI3\n"
+        "    read 0 r1 r2                   ; read byte\n"
+        "    shiftl r7 8 r7                 ; make room for the byte\n"
+        "    or r7 r2 r7                    ; add byte to word\n"
+        "    sub r8 1 r8                    ; decr bytes needed\n"
+        "    bne r8 r0 4                    ; skip storing if the word is not complete\n"
+        "    write 0 r4 r7                  ; store word in buf\n"
+        "    add r4 1 r4                    ; incr buf address\n"
+        "    load 4 r8                      ; next word needs four bytes\n"
+        "    sub r5 1 r5                    ; decr bytes to read\n"
+        "    beq r5 r0 2                    ; keep looping until all bytes are read\n"
+        "    jump WizSpiReadWordsLoop\n"
+
+        "write 0 r6 r7                      ; save state for the next call\n"
+        "write 1 r6 r8\n"
+        "write -4 r14 r4                    ; write to stack to return\n"
+
+        "; restore regs\n"
+        "pop r8\n"
+        "pop r7\n"
+        "pop r5\n"
+        "pop r4\n"
+        "pop r1\n"
+        );
+
+    return retval;
+}
+
+
 
 // Write data to W5500
 void wizWrite(word addr, word cb, char* buf, word len)
@@ -191,10 +304,9 @@ void wizWrite(word addr, word cb, char* buf, word len)
   WizSpiTransfer(cb);
 
   // Send data
-  word i;
-  for (i = 0; i < len; i++)
+  if (len > 0)
   {
-    WizSpiTransfer(buf[i]);
+    WizSpiWriteBytes(buf, len);
   }
 
   WizSpiEndTransfer();
@@ -258,10 +370,9 @@ void wizRead(word addr, word cb, char* buf, word len)
   WizSpiTransfer(cb);
 
   // Read data
-  word i;
-  for (i = 0; i < len; i++)
+  if (len > 0)
   {
-    buf[i] = WizSpiTransfer(0);
+    WizSpiReadBytes(buf, len);
   }
 
   WizSpiEndTransfer();
@@ -440,77 +551,177 @@ void wizInitSocketTCP(word s, word port)
 }
 
 
+// Returns 1 if socket s is listening, connecting, connected or closing a connection
+// Returns 0 if it is closed or in another state, so it should be initialized again
+word wizSocketIsOpen(word s)
+{
+  word sxStatus = wizGetSockReg8(s, WIZNET_SnSR);
+  return (sxStatus == WIZNET_SOCK_LISTEN || sxStatus == WIZNET_SOCK_ESTABLISHED ||
+          sxStatus == WIZNET_SOCK_SYNSENT || sxStatus == WIZNET_SOCK_SYNRECV ||
+          sxStatus == WIZNET_SOCK_FIN_WAIT || sxStatus == WIZNET_SOCK_TIME_WAIT);
+}
+
+
 
 //-------------------
 //W5500 READING AND WRITING FUNCTIONS
 //-------------------
 
 
-// from memory, so no need for unsigned comparisons (because we have less than 2GB RAM)
-word wizWriteDataFromMemory(word s, char* buf, word buflen)
+// Waits until the last SEND command of socket s is completed
+// Returns 1 when completed, 0 when the connection is closed or timed out
+word wizWaitSendOK(word s)
 {
-  // Make sure there is something to send
-  if (buflen <= 0)
+  while (1)
   {
-    return 0;
+    word ir = wizGetSockReg8(s, WIZNET_SnIR);
+    if (ir & WIZNET_IR_SENDOK)
+    {
+      wizSetSockReg8(s, WIZNET_SnIR, WIZNET_IR_SENDOK); // clear only SEND_OK
+      return 1;
+    }
+    if (ir & WIZNET_IR_TIMEOUT || wizGetSockReg8(s, WIZNET_SnSR) == WIZNET_SOCK_CLOSED)
+    {
+      return 0;
+    }
   }
+}
 
-  word bytesSent = 0;
+// Sends len bytes over socket s, while keeping the TX buffer of the socket filled
+// Once WIZNET_MIN_SEND bytes (or the rest of the data) fit in the TX buffer,
+//  all free space is filled and SEND is issued, so sending and acks continue while the next part is written
+// When producer is 0 the data is read from buf,
+//  else producer(buf, n) is called first to put the next n (<= WIZNET_MAX_TBUF) bytes in buf,
+//  so the data can for example come from a file without reading it to memory first
+// The producer returns 1 on success, 0 to stop sending
+// Returns 1 when all data is sent, 0 on an error
+word wizStreamSendData(word s, char* buf, word len, word (*producer)(char* buf, word len))
+{
+  word bytesLeft = len;
+  word sending = 0; // whether a SEND command is not completed yet
+  word txwr = wizGetSockReg16(s, WIZNET_SnTX_WR);
 
-  // loop until all bytes are sent
-  while (bytesSent != buflen)
+  while (bytesLeft != 0)
   {
+    word minFree = bytesLeft;
+    if (minFree > WIZNET_MIN_SEND)
+      minFree = WIZNET_MIN_SEND;
 
-    if (wizGetSockReg8(s, WIZNET_SnSR) == WIZNET_SOCK_CLOSED)
+    // Wait until there is room in the transmit buffer, as long as the connection is open
+    word txfree = 0;
+    while (txfree < minFree)
     {
-      //uprintln("connection closed");
-      return 0;
+      word sxStatus = wizGetSockReg8(s, WIZNET_SnSR);
+      if (sxStatus != WIZNET_SOCK_ESTABLISHED && sxStatus != WIZNET_SOCK_CLOSE_WAIT)
+      {
+        return 0;
+      }
+      txfree = wizGetSockReg16(s, WIZNET_SnTX_FSR); // Size of the available buffer area
     }
 
-    word partToSend = buflen - bytesSent;
-    if (partToSend > WIZNET_MAX_TBUF)
-      partToSend = WIZNET_MAX_TBUF;
-
-    // Make sure there is room in the transmit buffer for what we want to send
-    word txfree = wizGetSockReg16(s, WIZNET_SnTX_FSR); // Size of the available buffer area
+    word partToSend = bytesLeft;
+    if (partToSend > txfree)
+      partToSend = txfree;
 
-    word timeout = 0;
-    while (txfree < partToSend) 
+    // Write the outgoing data to the transmit buffer
+    if (producer)
     {
-      timeout++; // Increase timeout counter
-      delay(1); // Wait a bit
-      txfree = wizGetSockReg16(s, WIZNET_SnTX_FSR); // Size of the available buffer area
-      
-      // After a second
-      if (timeout > 1000) 
+      if (!producer(buf, partToSend))
       {
-        wizCmd(s, WIZNET_CR_DISCON); // Disconnect the connection
-        //uprintln("timeout");
+        // Let the previous SEND complete, so the next send on s does not start one too early
+        if (sending)
+        {
+          wizWaitSendOK(s);
+        }
         return 0;
       }
+      wizWrite(txwr, WIZNET_WRITE_SnTX + (s << 5), buf, partToSend);
+    }
+    else
+    {
+      wizWrite(txwr, WIZNET_WRITE_SnTX + (s << 5), buf, partToSend);
+      buf += partToSend;
     }
+    txwr = (txwr + partToSend) & 0xFFFF;
+    bytesLeft -= partToSend;
 
-     // Space is available so we will send the buffer
-    word txwr = wizGetSockReg16(s, WIZNET_SnTX_WR);  // Read the Tx Write Pointer
+    // Only one SEND command can be active at a time
+    if (sending && !wizWaitSendOK(s))
+    {
+      return 0;
+    }
 
-    // Write the outgoing data to the transmit buffer
-    wizWrite(txwr, WIZNET_WRITE_SnTX + (s << 5), buf + bytesSent, partToSend);
+    // Update the write pointer and send the new data
+    wizSetSockReg16(s, WIZNET_SnTX_WR, txwr);
+    wizCmd(s, WIZNET_CR_SEND);
+    sending = 1;
+  }
 
-    // update the buffer pointer
-    word newSize = txwr + partToSend;
-    wizSetSockReg16(s, WIZNET_SnTX_WR, newSize);
+  // Make sure the next send starts without an active SEND command
+  return wizWaitSendOK(s);
+}
+
+// Sends buflen bytes from buf over socket s
+// Returns 1 when all data is sent, 0 on an error
+word wizWriteDataFromMemory(word s, char* buf, word buflen)
+{
+  // Make sure there is something to send
+  if (buflen <= 0)
+  {
+    return 0;
+  }
+
+  return wizStreamSendData(s, buf, buflen, 0);
+}
 
-    // Now Send the SEND command which tells the wiznet the pointer is updated
-    wizCmd(s, WIZNET_CR_SEND);
 
-    // Update the amount of bytes sent
-    bytesSent += partToSend;
+
+// Reads len bytes of received data of socket s directly into buf
+// If packState is 0, one byte is stored per address
+// Otherwise four bytes are stored per address from left to right, see WizSpiReadWords
+//  (start with packState[0] = 0 and packState[1] = 4, so data of the next call continues the unfinished word)
+// The read pointer is updated once for all data
+// Returns the address after the data, or of the unfinished word
+char* wizStreamRecvData(word s, char* buf, word len, word* packState)
+{
+  if (len == 0)
+  {
+    return buf;
   }
 
+  // Get the address where the wiznet is holding the data
+  word rxrd = wizGetSockReg16(s, WIZNET_SnRX_RD);
 
-  return 1;
-}
+  WizSpiBeginTransfer();
 
+  // Send address
+  word addrMSB = rxrd >> 8;
+  WizSpiTransfer(addrMSB); //msByte
+  WizSpiTransfer(rxrd); //lsByte
+
+  // Send control byte
+  WizSpiTransfer(WIZNET_READ_SnRX + (s << 5));
+
+  // Read data
+  if (packState)
+  {
+    buf = WizSpiReadWords(buf, len, packState);
+  }
+  else
+  {
+    buf = WizSpiReadBytes(buf, len);
+  }
+
+  WizSpiEndTransfer();
+
+  // Remove read data from rxbuffer to make space for new data
+  word nsize = rxrd + len;
+  wizSetSockReg16(s, WIZNET_SnRX_RD, nsize);  //replace read data pointer
+  //tell the wiznet we have retrieved the data
+  wizCmd(s, WIZNET_CR_RECV);
+
+  return buf;
+}
 
 
 // Read received data
@@ -526,18 +737,8 @@ word wizReadRecvData(word s, char* buf, word buflen)
     //uprintln("W: Received too large TCP data");
     buflen = WIZNET_MAX_RBUF; // - 1; // -1 Because room for 0 terminator
   }
-   
-  // Get the address where the wiznet is holding the data
-  word rxrd = wizGetSockReg16(s, WIZNET_SnRX_RD); 
 
-  // Read the data into the buffer
-  wizRead(rxrd, WIZNET_READ_SnRX + (s << 5), buf, buflen);
-
-  // Remove read data from rxbuffer to make space for new data
-  word nsize = rxrd + buflen;
-  wizSetSockReg16(s, WIZNET_SnRX_RD, nsize);  //replace read data pointer
-  //tell the wiznet we have retrieved the data
-  wizCmd(s, WIZNET_CR_RECV);
+  wizStreamRecvData(s, buf, buflen, 0);
 
   // Terminate buffer for printing in case the data was a string
   *(buf + buflen) = 0;
@@ -558,3 +759,95 @@ void wizFlush(word s, word rsize)
     wizCmd(s, WIZNET_CR_RECV);
   }
 }
+
+
+//-------------------
+//W5500 SOCKET EVENT FUNCTIONS
+//-------------------
+
+// Handler for the events of each socket, called by wizHandleEvents with the socket and its SnIR bits
+void (*wizSocketHandler[8])(word s, word ir);
+
+// Returns 1 if the W5500 has an enabled socket event pending
+// Reads the INTn pin of the W5500 (active low), so no SPI transfer is needed
+word wizEventPending()
+{
+  word* spi3Int = (word*) 0xC02733;
+  return (*spi3Int == 0);
+}
+
+// Reads and clears the events of socket s
+// Returns the SnIR bits that were set
+word wizGetSocketEvents(word s)
+{
+  word ir = wizGetSockReg8(s, WIZNET_SnIR);
+  if (ir != 0)
+  {
+    wizSetSockReg8(s, WIZNET_SnIR, ir); // a bit is cleared by writing a 1 to it
+  }
+  return ir;
+}
+
+// Sets handler as the handler for the events of socket s
+// The SnIR bits in events will make the INTn pin of the W5500 go low
+void wizSetSocketHandler(word s, void (*handler)(word s, word ir), word events)
+{
+  wizSocketHandler[s] = handler;
+  wizSetSockReg8(s, WIZNET_SnIMR, events);
+  word simr = wizReadSingle(WIZNET_SIMR, WIZNET_READ_COMMON);
+  wizWriteSingle(WIZNET_SIMR, WIZNET_WRITE_COMMON, simr | (1 << s));
+}
+
+// Calls the handlers of the sockets in mask (bit n for socket n) that have pending events
+// Only reads the sockets that are marked in SIR, the events of sockets without a handler are cleared
+void wizHandleEvents(word mask)
+{
+  if (!wizEventPending())
+  {
+    return;
+  }
+
+  word sir = wizReadSingle(WIZNET_SIR, WIZNET_READ_COMMON) & mask;
+  word s;
+  for (s = 0; s < 8; s++)
+  {
+    if (sir & (1 << s))
+    {
+      word ir = wizGetSocketEvents(s);
+      if (wizSocketHandler[s])
+      {
+        wizSocketHandler[s](s, ir);
+      }
+    }
+  }
+}
+
+// Waits until socket s has an event, and returns its SnIR bits after clearing them
+// Only the INTn pin is polled while no event is pending, and SIR is read to skip the events of other sockets
+// The socket status is read every WIZNET_WAIT_CHECK polls
+// Returns 0 when the socket is no longer connected,
+//  or after timeout status checks without an event (0 to wait forever)
+word wizWaitSocketEvents(word s, word timeout)
+{
+  word polls = 0;
+  word checks = 0;
+  while (1)
+  {
+    if (wizEventPending() && (wizReadSingle(WIZNET_SIR, WIZNET_READ_COMMON) & (1 << s)))
+    {
+      return wizGetSocketEvents(s);
+    }
+
+    polls++;
+    if (polls == WIZNET_WAIT_CHECK)
+    {
+      polls = 0;
+      checks++;
+      word sxStatus = wizGetSockReg8(s, WIZNET_SnSR);
+      if ((sxStatus != WIZNET_SOCK_ESTABLISHED && sxStatus != WIZNET_SOCK_CLOSE_WAIT) || checks == timeout)
+      {
+        return 0;
+      }
+    }
+  }
+}
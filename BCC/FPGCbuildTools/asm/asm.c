@@ -37,6 +37,15 @@
 
 #define LABELLISTLINENR_ADDR 0x65F000
 #define LABELLIST_ADDR 0x660000
+#define LABELHASH_ADDR 0x670000 // directly after the label names
+#define LABELREFS_ADDR 0x671000 // directly after the label hash table
+#define LABELREFS_SIZE 0x8F000 // up to 0x700000, the user stack is above that
+
+// sections of the input file, .rdata and .bss are handled as one section
+#define SECTION_NONE 0 // lines before the first section are ignored
+#define SECTION_CODE 1
+#define SECTION_DATA 2
+#define SECTION_RDATA 3
 
 #define LINEBUFFER_ADDR 0x4C0000
 char infilename[96];
@@ -54,9 +63,91 @@ char (*labelListName)[LABEL_NAME_SIZE] = (char (*)[LABEL_NAME_SIZE]) LABELLIST_A
 word* labelListLineNumber = (word*) LABELLISTLINENR_ADDR;
 //word labelListLineNumber[LABELLIST_SIZE]; // value should be the line number of the corresponding label name
 
+#define LABELHASH_SIZE 4096 // power of 2, twice LABELLIST_SIZE to keep the probe sequences short
+
+// open addressing hash table with linear probing
+// value is the index in labelListName + 1, so 0 means empty
+word* labelHashTable = (word*) LABELHASH_ADDR;
+
 word labelListIndex = 0; // current index in the label list
 word prevLinesWereLabels = 0; // allows the current line to know how many labels are pointing to it
 
+// Pass 1 tokenises each line into a record of PASS1_RECORD_SIZE words:
+//  the opcode, followed by the kind and value of each argument
+// Pass 2 then only has to encode the records, without parsing any text
+#define PASS1_RECORD_SIZE 7
+#define MAX_ARGS 3
+
+// kinds of arguments
+#define ARG_NONE 0
+#define ARG_REG 1 // value is the register number
+#define ARG_NUM 2 // value is the number
+#define ARG_LABEL 3 // value is the address of the label name in labelRefs
+
+// opcodes, in the same order as opcodeNames and pass2Handlers
+#define OP_HALT 0
+#define OP_READ 1
+#define OP_WRITE 2
+#define OP_COPY 3
+#define OP_PUSH 4
+#define OP_POP 5
+#define OP_JUMP 6
+#define OP_JUMPO 7
+#define OP_JUMPR 8
+#define OP_LOAD 9
+#define OP_LOADHI 10
+#define OP_BEQ 11
+#define OP_BNE 12
+#define OP_BGT 13
+#define OP_BGE 14
+#define OP_BGTS 15
+#define OP_BGES 16
+#define OP_SAVPC 17
+#define OP_RETI 18
+#define OP_OR 19
+#define OP_AND 20
+#define OP_XOR 21
+#define OP_ADD 22
+#define OP_SUB 23
+#define OP_SHIFTL 24
+#define OP_SHIFTR 25
+#define OP_MULT 26
+#define OP_NOT 27
+#define OP_LOADLABELLOW 28
+#define OP_LOADLABELHIGH 29
+#define OP_NOP 30
+#define OP_DW 31
+#define OP_DL 32
+#define OP_READINTID 33
+#define OP_PASS2_COUNT 34 // all opcodes below this one have a pass 2 handler
+#define OP_ADDR2REG 34 // pseudo instructions, expanded by pass 1
+#define OP_LOAD32 35
+#define OP_DB 36
+#define OP_COUNT 37
+
+char* opcodeNames[OP_COUNT] = {
+    "halt", "read", "write", "copy", "push", "pop",
+    "jump", "jumpo", "jumpr", "load", "loadhi", "beq",
+    "bne", "bgt", "bge", "bgts", "bges", "savpc",
+    "reti", "or", "and", "xor", "add", "sub",
+    "shiftl", "shiftr", "mult", "not", "loadLabelLow", "loadLabelHigh",
+    "nop", ".dw", ".dl", "readintid", "addr2reg", "load32",
+    ".db"
+};
+
+#define OPCODEHASH_SIZE 128 // power of 2, a few times OP_COUNT
+
+// same kind of hash table as labelHashTable, value is the opcode + 1
+word opcodeHashTable[OPCODEHASH_SIZE];
+
+// the tokenised current line
+word lineOpcode = 0;
+word lineArgKind[MAX_ARGS+1]; // index 0 is unused, so the indexes match the argument numbers
+word lineArg[MAX_ARGS+1];
+
+char* labelRefs = (char*) LABELREFS_ADDR; // names of all labels that are used as argument
+word labelRefsCursor = 0;
+
 // reads a line from the input file, tries to remove all extra characters
 word readFileLine()
 {
@@ -175,76 +266,10 @@ word readMemLine(char* memAddr)
 }
 
 
-// Fills bufOut with argi in linebuffer
-void getArgPos(word argi, char* bufOut)
-{
-    word linei = 0;
-    char c = 0;
-    word lineLength = strlen(lineBuffer);
-    while(argi > 0 && linei < lineLength)
-    {
-        c = lineBuffer[linei];
-        if (c == ' ')
-        {
-            argi--;
-        }
-        linei++;
-    }
-    if (linei == 0)
-    {
-        BDOS_PrintConsole("getArgPos error");
-        exit(1);
-    }
-    // copy until space or \n
-    word i = 0;
-    c = lineBuffer[linei];
-    while (c != ' ' && c != 0)
-    {
-        bufOut[i] = c;
-        linei++;
-        i++;
-        c = lineBuffer[linei];
-    }
-    bufOut[i] = 0; // terminate
-}
-
-
-// parses the number at argument i in linebuffer
+// parses a number string
 // can be hex or decimal or binary
-word getNumberAtArg(word argi)
+word parseNumber(char* strNumberBuf)
 {
-    word linei = 0;
-    char c = 0;
-    word lineLength = strlen(lineBuffer);
-    while(argi > 0 && linei < lineLength)
-    {
-        c = lineBuffer[linei];
-        if (c == ' ')
-        {
-            argi--;
-        }
-        linei++;
-    }
-    if (linei == 0)
-    {
-        BDOS_PrintConsole("NumberAtArg error");
-        exit(1);
-    }
-
-    // linei is now at the start of the number string
-    // copy until space or \n
-    char strNumberBuf[36];
-    word i = 0;
-    c = lineBuffer[linei];
-    while (c != ' ' && c != 0)
-    {
-        strNumberBuf[i] = c;
-        linei++;
-        i++;
-        c = lineBuffer[linei];
-    }
-    strNumberBuf[i] = 0; // terminate
-
     word valueToReturn = 0;
     if (strNumberBuf[1] == 'x' || strNumberBuf[1] == 'X')
     {
@@ -291,8 +316,248 @@ word isLabel()
     return 0;
 }
 
+// returns the hash of str, the caller masks it to the size of its hash table
+word getStringHash(char* str)
+{
+    word hash = 5381;
+    while (*str != 0)
+    {
+        hash = ((hash << 5) + hash) ^ *str;
+        str++;
+    }
+    return hash;
+}
+
+// clears the hash table, since the memory still contains data of previous programs
+void initLabelHashTable()
+{
+    word i;
+    for (i = 0; i < LABELHASH_SIZE; i++)
+    {
+        labelHashTable[i] = 0;
+    }
+}
+
+// adds the label at labelIndex to the first empty slot
+// duplicate labels are not checked, but a lookup always finds the first one
+//  because it was inserted earlier in the same probe sequence
+void addLabelToHashTable(word labelIndex)
+{
+    word slot = getStringHash(labelListName[labelIndex]) & (LABELHASH_SIZE - 1);
+    while (labelHashTable[slot] != 0)
+    {
+        slot = (slot + 1) & (LABELHASH_SIZE - 1);
+    }
+    labelHashTable[slot] = labelIndex + 1;
+}
+
+// fills opcodeHashTable with all names in opcodeNames
+void initOpcodeHashTable()
+{
+    word i;
+    for (i = 0; i < OPCODEHASH_SIZE; i++)
+    {
+        opcodeHashTable[i] = 0;
+    }
+
+    for (i = 0; i < OP_COUNT; i++)
+    {
+        word slot = getStringHash(opcodeNames[i]) & (OPCODEHASH_SIZE - 1);
+        while (opcodeHashTable[slot] != 0)
+        {
+            slot = (slot + 1) & (OPCODEHASH_SIZE - 1);
+        }
+        opcodeHashTable[slot] = i + 1;
+    }
+}
+
+// returns the opcode of the instruction name, or -1 if it is unknown
+word getOpcode(char* name)
+{
+    word slot = getStringHash(name) & (OPCODEHASH_SIZE - 1);
+    while (opcodeHashTable[slot] != 0)
+    {
+        word opcode = opcodeHashTable[slot] - 1;
+        if (strcmp(name, opcodeNames[opcode]) == 0)
+        {
+            return opcode;
+        }
+        slot = (slot + 1) & (OPCODEHASH_SIZE - 1);
+    }
+    return -1;
+}
+
+// copies the label name to labelRefs and returns its address
+word storeLabelRef(char* labelName)
+{
+    word labelNameLen = strlen(labelName) + 1;
+    if (labelRefsCursor + labelNameLen > LABELREFS_SIZE)
+    {
+        BDOS_PrintConsole("Too many label references\n");
+        exit(1);
+    }
+
+    char* labelRef = labelRefs + labelRefsCursor;
+    strcpy(labelRef, labelName);
+    labelRefsCursor += labelNameLen;
+    return (word) labelRef;
+}
+
+// returns 1 if the argument is a register name, like r12
+word isRegArg(char* argBuf)
+{
+    if (argBuf[0] != 'r' || argBuf[1] == 0)
+    {
+        return 0;
+    }
+
+    word i = 1;
+    while (argBuf[i] != 0)
+    {
+        if (argBuf[i] < '0' || argBuf[i] > '9')
+        {
+            return 0;
+        }
+        i++;
+    }
+
+    return 1;
+}
+
+// sets the kind and value of argument argi
+void tokeniseArg(word argi, char* argBuf)
+{
+    char c = argBuf[0];
+    if (isRegArg(argBuf))
+    {
+        lineArgKind[argi] = ARG_REG;
+        lineArg[argi] = strToInt(&argBuf[1]);
+    }
+    else if ((c >= '0' && c <= '9') || c == '-')
+    {
+        lineArgKind[argi] = ARG_NUM;
+        lineArg[argi] = parseNumber(argBuf);
+    }
+    else
+    {
+        lineArgKind[argi] = ARG_LABEL;
+        lineArg[argi] = storeLabelRef(argBuf);
+    }
+}
+
+// tokenises lineBuffer into lineOpcode and the arguments
+// the values of .dw and .db are not tokenised, since there can be any number of them
+void tokeniseLine()
+{
+    word argi;
+    for (argi = 1; argi <= MAX_ARGS; argi++)
+    {
+        lineArgKind[argi] = ARG_NONE;
+        lineArg[argi] = 0;
+    }
+
+    // instruction name
+    char nameBuf[16];
+    word linei = 0;
+    char c = lineBuffer[linei];
+    while (c != ' ' && c != 0 && linei < 15)
+    {
+        nameBuf[linei] = c;
+        linei++;
+        c = lineBuffer[linei];
+    }
+    nameBuf[linei] = 0; // terminate
+
+    lineOpcode = getOpcode(nameBuf);
+    if (lineOpcode == -1)
+    {
+        BDOS_PrintConsole("Unknown instruction!\n");
+        BDOS_PrintConsole(lineBuffer);
+        BDOS_PrintConsole("\n");
+        exit(1);
+    }
+
+    if (lineOpcode == OP_DW || lineOpcode == OP_DB)
+    {
+        return;
+    }
+
+    // arguments
+    char argBuf[LABEL_NAME_SIZE+1];
+    argi = 0;
+    while (c == ' ')
+    {
+        argi++;
+        if (argi > MAX_ARGS)
+        {
+            BDOS_PrintConsole("Too many arguments!\n");
+            BDOS_PrintConsole(lineBuffer);
+            BDOS_PrintConsole("\n");
+            exit(1);
+        }
+
+        // copy until space or \0
+        linei++;
+        word i = 0;
+        c = lineBuffer[linei];
+        while (c != ' ' && c != 0)
+        {
+            argBuf[i] = c;
+            linei++;
+            i++;
+            c = lineBuffer[linei];
+        }
+        argBuf[i] = 0; // terminate
+
+        tokeniseArg(argi, argBuf);
+    }
+}
+
+// writes the tokenised line as a record to the output
+void addRecord(char* outputAddr, char* outputCursor)
+{
+    char* record = outputAddr + *outputCursor;
+    record[0] = lineOpcode;
+    record[1] = lineArgKind[1];
+    record[2] = lineArg[1];
+    record[3] = lineArgKind[2];
+    record[4] = lineArg[2];
+    record[5] = lineArgKind[3];
+    record[6] = lineArg[3];
+    (*outputCursor) += PASS1_RECORD_SIZE;
+}
+
+// reads a record back into the tokenised line
+void readRecord(char* record)
+{
+    lineOpcode = record[0];
+    lineArgKind[1] = record[1];
+    lineArg[1] = record[2];
+    lineArgKind[2] = record[3];
+    lineArg[2] = record[4];
+    lineArgKind[3] = record[5];
+    lineArg[3] = record[6];
+}
+
+// adds a jump to labelName, used for the userBDOS header
+void addJumpRecord(char* outputAddr, char* outputCursor, char* labelName)
+{
+    lineOpcode = OP_JUMP;
+    lineArgKind[1] = ARG_LABEL;
+    lineArg[1] = storeLabelRef(labelName);
+    lineArgKind[2] = ARG_NONE;
+    lineArgKind[3] = ARG_NONE;
+    addRecord(outputAddr, outputCursor);
+}
+
 void Pass1StoreLabel()
 {
+    if (labelListIndex >= LABELLIST_SIZE)
+    {
+        BDOS_PrintConsole("Too many labels\n");
+        exit(1);
+    }
+
     // loop until \0 or space
     word labelStrLen = 0;
     while(lineBuffer[labelStrLen] != 0 && lineBuffer[labelStrLen] != ' ')
@@ -305,6 +570,8 @@ void Pass1StoreLabel()
     // terminate
     labelListName[labelListIndex][labelStrLen-1] = 0;
 
+    addLabelToHashTable(labelListIndex);
+
     labelListIndex++;
     // labelListLineNumber will be set when the next instruction is found
 
@@ -317,48 +584,34 @@ void Pass1StoreDefine()
     // defines are not supported right now, so they are skipped
 }
 
-// Create two lines with the same args:
+// Create two records with the same args:
 // loadLabelLow
 // loadLabelHigh
-// returns the number of lines added
+// returns the number of records added
 word Pass1Addr2reg(char* outputAddr, char* outputCursor)
 {
-    word lineBufArgsLen = strlen(lineBuffer) - 9; // minus addr2len and space
-    // copy name of instruction
-    memcpy((outputAddr + *outputCursor), "loadLabelLow ", 13);
-    (*outputCursor) += 13;
-    // copy args
-    memcpy((outputAddr + *outputCursor), (lineBuffer+9), lineBufArgsLen);
-    (*outputCursor) += lineBufArgsLen;
-    // add a newline
-    *(outputAddr + *outputCursor) = '\n';
-    (*outputCursor)++;
-
-    // copy name of instruction
-    memcpy((outputAddr + *outputCursor), "loadLabelHigh ", 14);
-    (*outputCursor) += 14;
-    // copy args
-    memcpy((outputAddr + *outputCursor), (lineBuffer+9), lineBufArgsLen);
-    (*outputCursor) += lineBufArgsLen;
-    // add a newline
-    *(outputAddr + *outputCursor) = '\n';
-    (*outputCursor)++;
+    lineOpcode = OP_LOADLABELLOW;
+    addRecord(outputAddr, outputCursor);
+    lineOpcode = OP_LOADLABELHIGH;
+    addRecord(outputAddr, outputCursor);
 
     return 2;
 }
 
 // Converts into load and loadhi
-// skips loadhi if the value fits in 32bits
-// returns the number of lines added
+// skips loadhi if the value fits in 16 bits
+// returns the number of records added
 word Pass1Load32(char* outputAddr, char* outputCursor)
 {
-    // get the destination register
-    char dstRegBuf[16];
-    getArgPos(2, dstRegBuf);
-    word dstRegBufLen = strlen(dstRegBuf);
+    // defines are not supported, so the value should be a number
+    if (lineArgKind[1] != ARG_NUM)
+    {
+        BDOS_PrintConsole("LOAD32: arg1 not a number\n");
+        exit(1);
+    }
 
-    // get and parse the value that is being loaded
-    word load32Value = getNumberAtArg(1);
+    // the destination register stays in arg2
+    word load32Value = lineArg[1];
 
     // split into 16 bit unsigned values
     word mask16Bit = 0xFFFF;
@@ -366,68 +619,32 @@ word Pass1Load32(char* outputAddr, char* outputCursor)
     word highVal = (load32Value >> 16) & mask16Bit;
 
     // add lowval
-    char buf[16];
-    itoa(lowVal, buf);
-    word buflen = strlen(buf);
-    // copy name of instruction
-    memcpy((outputAddr + *outputCursor), "load ", 5);
-    (*outputCursor) += 5;
-    // copy value
-    memcpy((outputAddr + *outputCursor), buf, buflen);
-    (*outputCursor) += buflen;
-    // add a space
-    *(outputAddr + *outputCursor) = ' ';
-    (*outputCursor)++;
-    // copy destination register
-    memcpy((outputAddr + *outputCursor), dstRegBuf, dstRegBufLen);
-    (*outputCursor) += dstRegBufLen;
-    // add a newline
-    *(outputAddr + *outputCursor) = '\n';
-    (*outputCursor)++;
+    lineOpcode = OP_LOAD;
+    lineArg[1] = lowVal;
+    addRecord(outputAddr, outputCursor);
 
     // add highval
     if (highVal) // skip if 0
     {
-        itoa(highVal, buf);
-        word buflen = strlen(buf);
-        // copy name of instruction
-        memcpy((outputAddr + *outputCursor), "loadhi ", 7);
-        (*outputCursor) += 7;
-        // copy value
-        memcpy((outputAddr + *outputCursor), buf, buflen);
-        (*outputCursor) += buflen;
-        // add a space
-        *(outputAddr + *outputCursor) = ' ';
-        (*outputCursor)++;
-        // copy destination register
-        memcpy((outputAddr + *outputCursor), dstRegBuf, dstRegBufLen);
-        (*outputCursor) += dstRegBufLen;
-        // add a newline
-        *(outputAddr + *outputCursor) = '\n';
-        (*outputCursor)++;
+        lineOpcode = OP_LOADHI;
+        lineArg[1] = highVal;
+        addRecord(outputAddr, outputCursor);
         return 2;
     }
 
     return 1;
 }
 
-// Creates a single .dw line using numBuf as value
-void addSingleDwLine(char* outputAddr, char* outputCursor, char* numBuf)
+// Creates a single .dw record using numBuf as value
+void addSingleDwRecord(char* outputAddr, char* outputCursor, char* numBuf)
 {
-    word numBufLen = strlen(numBuf);
-    // copy name of instruction
-    memcpy((outputAddr + *outputCursor), ".dw ", 4);
-    (*outputCursor) += 4;
-    // copy value
-    memcpy((outputAddr + *outputCursor), numBuf, numBufLen);
-    (*outputCursor) += numBufLen;
-    // add a newline
-    *(outputAddr + *outputCursor) = '\n';
-    (*outputCursor)++;
+    lineArgKind[1] = ARG_NUM;
+    lineArg[1] = parseNumber(numBuf);
+    addRecord(outputAddr, outputCursor);
 }
 
-// Puts each value after .dw on its own line with its own .dw prefix
-// returns the number of lines added
+// Creates a .dw record for each value after .dw
+// returns the number of records added
 word Pass1Dw(char* outputAddr, char* outputCursor)
 {
     word numberOfLinesAdded = 0;
@@ -441,7 +658,7 @@ word Pass1Dw(char* outputAddr, char* outputCursor)
         if (c == ' ')
         {
             numBuf[i] = 0; // terminate
-            addSingleDwLine(outputAddr, outputCursor, numBuf); // process number
+            addSingleDwRecord(outputAddr, outputCursor, numBuf); // process number
             numberOfLinesAdded++;
             i = 0; // reset numBuf index
         }
@@ -455,7 +672,7 @@ word Pass1Dw(char* outputAddr, char* outputCursor)
     }
 
     numBuf[i] = 0; // terminate
-    addSingleDwLine(outputAddr, outputCursor, numBuf); // process the final number
+    addSingleDwRecord(outputAddr, outputCursor, numBuf); // process the final number
     numberOfLinesAdded++;
 
     return numberOfLinesAdded;
@@ -468,7 +685,7 @@ void Pass1Db(char* outputAddr, char* outputCursor)
 }
 
 
-// Convert each line into the number of lines equal to the number of words in binary
+// Convert each line into the number of records equal to the number of words in binary
 // Also reads defines and processes labels
 void LinePass1(char* outputAddr, char* outputCursor)
 {
@@ -483,7 +700,7 @@ void LinePass1(char* outputAddr, char* outputCursor)
     }
     else
     {
-        // all instructions that can end up in multiple lines
+        // all instructions that can end up in multiple records
 
         // set values to the labels (while loop, since multiple labels can point to the same addr)
         while(prevLinesWereLabels > 0)
@@ -492,50 +709,55 @@ void LinePass1(char* outputAddr, char* outputCursor)
             prevLinesWereLabels--;
         }
 
-        if (memcmp(lineBuffer, "addr2reg ", 9))
+        tokeniseLine();
+
+        if (lineOpcode == OP_ADDR2REG)
         {
             globalLineCursor += Pass1Addr2reg(outputAddr, outputCursor);
         }
-        else if (memcmp(lineBuffer, "load32 ", 7))
+        else if (lineOpcode == OP_LOAD32)
         {
             globalLineCursor += Pass1Load32(outputAddr, outputCursor);
         }
-        else if (memcmp(lineBuffer, ".dw ", 4))
+        else if (lineOpcode == OP_DW)
         {
             globalLineCursor += Pass1Dw(outputAddr, outputCursor);
         }
-        else if (memcmp(lineBuffer, ".db ", 4))
+        else if (lineOpcode == OP_DB)
         {
             Pass1Db(outputAddr, outputCursor);
         }
         else
         {
-            // just copy the line
-            word lineBufLen = strlen(lineBuffer);
-            memcpy((outputAddr + *outputCursor), lineBuffer, lineBufLen);
-            (*outputCursor) += lineBufLen;
-            // add a newline
-            *(outputAddr + *outputCursor) = '\n';
-            (*outputCursor)++;
+            // all other instructions are a single record
+            addRecord(outputAddr, outputCursor);
             globalLineCursor++;
         }
     }    
 }
 
-void doPass1()
+// returns the length of the pass 1 output
+word doPass1()
 {
     BDOS_PrintConsole("Doing pass 1\n");
 
     memCursor = 0; // reset cursor for readMemLine
     globalLineCursor = 0; // keep track of the line number for the labels
+    labelRefsCursor = 0;
+
+    initLabelHashTable();
+    initOpcodeHashTable();
 
     char* outfileCodeAddr = (char*) OUTFILE_CODE_ADDR; // read from
     char* outfilePass1Addr = (char*) OUTFILE_PASS1_ADDR; // write to
     word filePass1Cursor = 0;
 
     // add userBDOS header instructions
-    memcpy(outfilePass1Addr, "jump Main\njump Int1\njump Int2\njump Int3\njump Int4\n", 50);
-    filePass1Cursor += 50;
+    addJumpRecord(outfilePass1Addr, &filePass1Cursor, "Main");
+    addJumpRecord(outfilePass1Addr, &filePass1Cursor, "Int1");
+    addJumpRecord(outfilePass1Addr, &filePass1Cursor, "Int2");
+    addJumpRecord(outfilePass1Addr, &filePass1Cursor, "Int3");
+    addJumpRecord(outfilePass1Addr, &filePass1Cursor, "Int4");
     globalLineCursor += 5;
 
     while (readMemLine(outfileCodeAddr) != EOF)
@@ -543,106 +765,43 @@ void doPass1()
         LinePass1(outfilePass1Addr, &filePass1Cursor);
     }
 
-    outfilePass1Addr[*(&filePass1Cursor)] = 0; // terminate
-
+    return filePass1Cursor;
 }
 
 #include "pass2.c"
 
+// pass 2 handler of each opcode below OP_PASS2_COUNT, in the same order as the opcodes
+void (*pass2Handlers[OP_PASS2_COUNT])(char*, char*) = {
+    pass2Halt, pass2Read, pass2Write, pass2Copy, pass2Push,
+    pass2Pop, pass2Jump, pass2Jumpo, pass2Jumpr, pass2Load,
+    pass2Loadhi, pass2Beq, pass2Bne, pass2Bgt, pass2Bge,
+    pass2Bgts, pass2Bges, pass2Savpc, pass2Reti, pass2Or,
+    pass2And, pass2Xor, pass2Add, pass2Sub, pass2Shiftl,
+    pass2Shiftr, pass2Mult, pass2Not, pass2LoadLabelLow, pass2LoadLabelHigh,
+    pass2Nop, pass2Dw, pass2Dl, pass2Readintid
+};
+
 void LinePass2(char* outputAddr, char* outputCursor)
 {
-    // Go through all possible instructions:
-    if (memcmp(lineBuffer, "halt", 4))
-        pass2Halt(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "read ", 5))
-        pass2Read(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "write ", 6))
-        pass2Write(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "copy ", 5))
-        pass2Copy(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "push ", 5))
-        pass2Push(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "pop ", 4))
-        pass2Pop(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "jump ", 5))
-        pass2Jump(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "jumpo ", 6))
-        pass2Jumpo(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "jumpr ", 6))
-        pass2Jumpr(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "load ", 5))
-        pass2Load(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "loadhi ", 7))
-        pass2Loadhi(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "beq ", 4))
-        pass2Beq(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "bne ", 4))
-        pass2Bne(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "bgt ", 4))
-        pass2Bgt(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "bge ", 4))
-        pass2Bge(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "bgts ", 5))
-        pass2Bgts(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "bges ", 5))
-        pass2Bges(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "savpc ", 6))
-        pass2Savpc(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "reti", 4))
-        pass2Reti(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "or ", 3))
-        pass2Or(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "and ", 4))
-        pass2And(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "xor ", 4))
-        pass2Xor(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "add ", 4))
-        pass2Add(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "sub ", 4))
-        pass2Sub(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "shiftl ", 7))
-        pass2Shiftl(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "shiftr ", 7))
-        pass2Shiftr(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "mult ", 5))
-        pass2Mult(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "not ", 4))
-        pass2Not(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "loadLabelLow ", 13))
-        pass2LoadLabelLow(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "loadLabelHigh ", 14))
-        pass2LoadLabelHigh(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "nop", 3))
-        pass2Nop(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, ".dw ", 4))
-        pass2Dw(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, ".dl ", 4))
-        pass2Dl(outputAddr, outputCursor);
-    else if (memcmp(lineBuffer, "readintid ", 10))
-        pass2Readintid(outputAddr, outputCursor);
-    else
-    {
-        BDOS_PrintConsole("Unknown instruction!\n");
-        BDOS_PrintConsole(lineBuffer);
-        BDOS_PrintConsole("\n");
-        exit(1);
-    }
+    // pseudo instructions are already expanded by pass 1, so all opcodes have a handler
+    pass2Handlers[lineOpcode](outputAddr, outputCursor);
 }
 
 
 // returns the length of the binary
-word doPass2()
+word doPass2(word pass1Length)
 {
     BDOS_PrintConsole("Doing pass 2\n");
 
-    memCursor = 0; // reset cursor for readMemLine
-
     char* outfilePass1Addr = (char*) OUTFILE_PASS1_ADDR; // read from
     char* outfilePass2Addr = (char*) OUTFILE_PASS2_ADDR; // write to
+    word filePass1Cursor = 0;
     word filePass2Cursor = 0;
 
-    while (readMemLine(outfilePass1Addr) != EOF)
+    while (filePass1Cursor < pass1Length)
     {
+        readRecord(outfilePass1Addr + filePass1Cursor);
+        filePass1Cursor += PASS1_RECORD_SIZE;
         LinePass2(outfilePass2Addr, &filePass2Cursor);
     }
 
@@ -650,125 +809,77 @@ word doPass2()
 }
 
 
+// appends lineBuffer with a newline to the section at outputAddr
+void appendLineToSection(char* outputAddr, char* outputCursor)
+{
+    word lineBufLen = strlen(lineBuffer);
+    memcpy((outputAddr + *outputCursor), lineBuffer, lineBufLen);
+    (*outputCursor) += lineBufLen;
+    // add a newline
+    *(outputAddr + *outputCursor) = '\n';
+    (*outputCursor)++;
+}
+
+// Reads the input file once and splits it into sections,
+//  then appends .data and after that .rdata and .bss to the .code section
 void moveDataDown()
 {
     char* outfileDataAddr = (char*) OUTFILE_DATA_ADDR;
-    *outfileDataAddr = 0; // initialize to 0
     word fileDataCursor = 0;
 
     char* outfileCodeAddr = (char*) OUTFILE_CODE_ADDR;
-    *outfileCodeAddr = 0; // initialize to 0
     word fileCodeCursor = 0;
 
-    BDOS_PrintConsole("Looking for .data and .code sections\n");
+    // .rdata and .bss are collected in the pass 1 region, which is only written after this function
+    char* outfileRdataAddr = (char*) OUTFILE_PASS1_ADDR;
+    word fileRdataCursor = 0;
 
-    // .data, also do pass one on the code
-    word inDataSection = 0;
-    word inCodeSection = 0;
+    BDOS_PrintConsole("Splitting sections\n");
+
+    word section = SECTION_NONE;
     while (readFileLine() != EOF)
     {
         if (memcmp(lineBuffer, ".data", 5))
         {
-            inDataSection = 1;
-            inCodeSection = 0;
-            continue; // skip this line
+            section = SECTION_DATA;
         }
-        if (memcmp(lineBuffer, ".rdata", 6))
+        else if (memcmp(lineBuffer, ".rdata", 6))
         {
-            inDataSection = 0;
-            inCodeSection = 0;
-            continue; // skip this line
+            section = SECTION_RDATA;
         }
-        if (memcmp(lineBuffer, ".code", 5))
+        else if (memcmp(lineBuffer, ".code", 5))
         {
-            inDataSection = 0;
-            inCodeSection = 1;
-            continue; // skip this line
+            section = SECTION_CODE;
         }
-        if (memcmp(lineBuffer, ".bss", 4))
+        else if (memcmp(lineBuffer, ".bss", 4))
         {
-            inDataSection = 0;
-            inCodeSection = 0;
-            continue; // skip this line
+            section = SECTION_RDATA;
         }
-
-
-        if (inDataSection)
+        else if (section == SECTION_CODE)
         {
-            // copy to data section
-            word lineBufLen = strlen(lineBuffer);
-            memcpy((outfileDataAddr + fileDataCursor), lineBuffer, lineBufLen);
-            fileDataCursor += lineBufLen;
-            // add a newline
-            *(outfileDataAddr + fileDataCursor) = '\n';
-            fileDataCursor++;
+            appendLineToSection(outfileCodeAddr, &fileCodeCursor);
         }
-
-        if (inCodeSection)
+        else if (section == SECTION_DATA)
         {
-            // copy to code section
-            word lineBufLen = strlen(lineBuffer);
-            memcpy((outfileCodeAddr + fileCodeCursor), lineBuffer, lineBufLen);
-            fileCodeCursor += lineBufLen;
-            // add a newline
-            *(outfileCodeAddr + fileCodeCursor) = '\n';
-            fileCodeCursor++;
+            appendLineToSection(outfileDataAddr, &fileDataCursor);
         }
-    }
-
-    *(outfileCodeAddr+fileCodeCursor) = 0; // terminate code section
-    // do not increment the codeCursor, because we will append the data section
-
-    BDOS_PrintConsole("Looking for .rdata and .bss sections\n");
-
-    // reopen file to reiterate
-    fclose();
-    fopenRead(infilename);
-
-    //.rdata and .bss at the same time
-    inDataSection = 0;
-    while (readFileLine() != EOF)
-    {
-        if (memcmp(lineBuffer, ".data", 5))
-        {
-            inDataSection = 0;
-            continue; // skip this line
-        }
-        if (memcmp(lineBuffer, ".rdata", 6))
-        {
-            inDataSection = 1;
-            continue; // skip this line
-        }
-        if (memcmp(lineBuffer, ".code", 5))
-        {
-            inDataSection = 0;
-            continue; // skip this line
-        }
-        if (memcmp(lineBuffer, ".bss", 4))
+        else if (section == SECTION_RDATA)
         {
-            inDataSection = 1;
-            continue; // skip this line
-        }
-
-        if (inDataSection)
-        {
-            // copy to data section
-            word lineBufLen = strlen(lineBuffer);
-            memcpy((outfileDataAddr + fileDataCursor), lineBuffer, lineBufLen);
-            fileDataCursor += lineBufLen;
-            // add a newline
-            *(outfileDataAddr + fileDataCursor) = '\n';
-            fileDataCursor++;
+            appendLineToSection(outfileRdataAddr, &fileRdataCursor);
         }
     }
 
-    *(outfileDataAddr+fileDataCursor) = 0; // terminate data section
-    fileDataCursor++;
-
     BDOS_PrintConsole("Appending all to .code section\n");
 
-    // append data section to code section, including \0
-    memcpy((outfileCodeAddr+fileCodeCursor), outfileDataAddr, fileDataCursor);
+    // append data section to code section
+    memcpy((outfileCodeAddr + fileCodeCursor), outfileDataAddr, fileDataCursor);
+    fileCodeCursor += fileDataCursor;
+
+    // append rdata and bss sections to code section
+    memcpy((outfileCodeAddr + fileCodeCursor), outfileRdataAddr, fileRdataCursor);
+    fileCodeCursor += fileRdataCursor;
+
+    *(outfileCodeAddr + fileCodeCursor) = 0; // terminate code section
 }
 
 
@@ -856,9 +967,9 @@ int main()
 
     fclose(); // done reading file, everything else can be done in memory
 
-    doPass1();
+    word pass1Length = doPass1();
 
-    word pass2Length = doPass2();
+    word pass2Length = doPass2(pass1Length);
 
     BDOS_PrintConsole("Writing to file\n");
 
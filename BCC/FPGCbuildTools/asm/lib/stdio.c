@@ -175,7 +175,7 @@ word fputData(char* outbufAddr, word lenOfData)
             partToSend = 0xFFFF;
 
         // write away
-        if (FS_writeFile((outbufAddr +bytesWritten), partToSend) != FS_ANSW_USB_INT_SUCCESS)
+        if (FS_writeFile((outbufAddr +bytesWritten), partToSend, 0) != FS_ANSW_USB_INT_SUCCESS)
             BDOS_PrintConsole("write error\n");
 
         // Update the amount of bytes sent
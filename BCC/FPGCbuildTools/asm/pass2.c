@@ -10,13 +10,16 @@
 word getNumberForLabel(char* labelName)
 {
     word bdosOffset = USERBDOS_OFFSET;
-    word i;
-    for (i = 0; i < labelListIndex; i++)
+    word slot = getStringHash(labelName) & (LABELHASH_SIZE - 1);
+    // probe until an empty slot, which means the label does not exist
+    while (labelHashTable[slot] != 0)
     {
+        word i = labelHashTable[slot] - 1;
         if (strcmp(labelName, labelListName[i]) == 0)
         {
             return (labelListLineNumber[i] + bdosOffset);
         }
+        slot = (slot + 1) & (LABELHASH_SIZE - 1);
     }
     BDOS_PrintConsole("Could not find label: ");
     BDOS_PrintConsole(labelName);
@@ -25,6 +28,28 @@ word getNumberForLabel(char* labelName)
     return 0;
 }
 
+// returns the number for the label at argument argi
+word getNumberForLabelArg(word argi)
+{
+    if (lineArgKind[argi] != ARG_LABEL)
+    {
+        BDOS_PrintConsole("Expected a label\n");
+        exit(1);
+    }
+    return getNumberForLabel((char*) lineArg[argi]);
+}
+
+// returns the number at argument argi
+word getNumberArg(word argi)
+{
+    if (lineArgKind[argi] != ARG_NUM)
+    {
+        BDOS_PrintConsole("Expected a number\n");
+        exit(1);
+    }
+    return lineArg[argi];
+}
+
 // Convert a 32 bit word into an array of 4 bytes
 void instrToByteArray(word instr, char* byteArray)
 {
@@ -45,7 +70,7 @@ void pass2Read(char* outputAddr, char* outputCursor)
 {
     word instr = 0xE0000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
     word negative = 0;
     if (arg1num < 0)
     {
@@ -63,28 +88,24 @@ void pass2Read(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("READ: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 8);
 
     // arg3
-    char arg3buf[16];
-    getArgPos(3, arg3buf);
     // arg3 should be a reg
-    if (arg3buf[0] != 'r')
+    if (lineArgKind[3] != ARG_REG)
     {
         BDOS_PrintConsole("READ: arg3 not a reg\n");
         exit(1);
     }
-    word arg3num = strToInt(&arg3buf[1]);
+    word arg3num = lineArg[3];
 
     instr += arg3num;
 
@@ -104,7 +125,7 @@ void pass2Write(char* outputAddr, char* outputCursor)
 {
     word instr = 0xD0000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
     word negative = 0;
     if (arg1num < 0)
     {
@@ -122,28 +143,24 @@ void pass2Write(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("WRITE: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 8);
 
     // arg3
-    char arg3buf[16];
-    getArgPos(3, arg3buf);
     // arg3 should be a reg
-    if (arg3buf[0] != 'r')
+    if (lineArgKind[3] != ARG_REG)
     {
         BDOS_PrintConsole("WRITE: arg3 not a reg\n");
         exit(1);
     }
-    word arg3num = strToInt(&arg3buf[1]);
+    word arg3num = lineArg[3];
 
     instr += (arg3num << 4);
 
@@ -163,7 +180,7 @@ void pass2Copy(char* outputAddr, char* outputCursor)
 {
     word instr = 0xC0000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
     word negative = 0;
     if (arg1num < 0)
     {
@@ -181,28 +198,24 @@ void pass2Copy(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("COPY: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 8);
 
     // arg3
-    char arg3buf[16];
-    getArgPos(3, arg3buf);
     // arg3 should be a reg
-    if (arg3buf[0] != 'r')
+    if (lineArgKind[3] != ARG_REG)
     {
         BDOS_PrintConsole("COPY: arg3 not a reg\n");
         exit(1);
     }
-    word arg3num = strToInt(&arg3buf[1]);
+    word arg3num = lineArg[3];
 
     instr += (arg3num << 4);
 
@@ -223,15 +236,13 @@ void pass2Push(char* outputAddr, char* outputCursor)
     word instr = 0xB0000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("PUSH: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 4);
 
@@ -247,15 +258,13 @@ void pass2Pop(char* outputAddr, char* outputCursor)
     word instr = 0xA0000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("POP: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += arg1num;
 
@@ -272,28 +281,14 @@ void pass2Jump(char* outputAddr, char* outputCursor)
     
     // check if jump to label
     // if yes, replace label with line number
-    char arg1buf[LABEL_NAME_SIZE+1];
-    getArgPos(1, arg1buf);
-    word arg1bufLen = strlen(arg1buf);
-    word argIsLabel = 0;
-    word i;
-    for (i = 0; i < arg1bufLen; i++)
-    {
-        if (arg1buf[i] < '0' || arg1buf[i] > '9')
-        {
-            argIsLabel = 1;
-            break;
-        }
-    }
-
     word arg1num = 0;
-    if (argIsLabel)
+    if (lineArgKind[1] == ARG_LABEL)
     {
-        arg1num = getNumberForLabel(arg1buf);
+        arg1num = getNumberForLabelArg(1);
     }
     else
     {
-        arg1num = getNumberAtArg(1);
+        arg1num = getNumberArg(1);
     }
 
     // arg1 should fit in 27 bits
@@ -316,7 +311,7 @@ void pass2Jumpo(char* outputAddr, char* outputCursor)
 {
     word instr = 0x90000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
 
     // arg1 should fit in 27 bits
     if ((arg1num >> 27) > 0)
@@ -339,7 +334,7 @@ void pass2Jumpr(char* outputAddr, char* outputCursor)
 {
     word instr = 0x80000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
 
     // arg1 should fit in 16 bits
     if ((arg1num >> 16) > 0)
@@ -351,15 +346,13 @@ void pass2Jumpr(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("JUMPR: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
@@ -374,7 +367,7 @@ void pass2Load(char* outputAddr, char* outputCursor)
 {
     word instr = 0x70000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
 
     // arg1 should fit in 16 bits
     if ((arg1num >> 16) > 0)
@@ -386,15 +379,13 @@ void pass2Load(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("LOAD: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += arg2num;
 
@@ -409,7 +400,7 @@ void pass2Loadhi(char* outputAddr, char* outputCursor)
 {
     word instr = 0x70000000;
 
-    word arg1num = getNumberAtArg(1);
+    word arg1num = getNumberArg(1);
 
     // arg1 should fit in 16 bits
     if ((arg1num >> 16) > 0)
@@ -421,15 +412,13 @@ void pass2Loadhi(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("LOADHI: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += arg2num;
 
@@ -447,34 +436,30 @@ void pass2Beq(char* outputAddr, char* outputCursor)
     word instr = 0x60000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BEQ: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BEQ: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -497,34 +482,30 @@ void pass2Bne(char* outputAddr, char* outputCursor)
     word instr = 0x50000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BNE: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BNE: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -547,34 +528,30 @@ void pass2Bgt(char* outputAddr, char* outputCursor)
     word instr = 0x40000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BGT: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BGT: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -597,34 +574,30 @@ void pass2Bge(char* outputAddr, char* outputCursor)
     word instr = 0x30000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BGE: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BGE: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -647,34 +620,30 @@ void pass2Bgts(char* outputAddr, char* outputCursor)
     word instr = 0x40000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BGTS: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BGTS: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -699,34 +668,30 @@ void pass2Bges(char* outputAddr, char* outputCursor)
     word instr = 0x30000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("BGES: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("BGES: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += (arg2num << 4);
 
 
     // arg3
-    word arg3num = getNumberAtArg(3);
+    word arg3num = getNumberArg(3);
 
     // arg3 should fit in 16 bits
     if ((arg3num >> 16) > 0)
@@ -751,15 +716,13 @@ void pass2Savpc(char* outputAddr, char* outputCursor)
     word instr = 0x20000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("SAVPC: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += arg1num;
 
@@ -784,26 +747,22 @@ void pass2ArithBase(char* outputAddr, char* outputCursor, word arithOpCode)
     instr += (arithOpCode << 23);
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("ARITH: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += (arg1num << 8);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     word arg2num = 0;
     // if arg2 is a const
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
-        arg2num= getNumberAtArg(2);
+        arg2num = getNumberArg(2);
 
         // arg1 should fit in 11 bits
         if ((arg2num >> 11) > 0)
@@ -817,20 +776,18 @@ void pass2ArithBase(char* outputAddr, char* outputCursor, word arithOpCode)
     }
     else // arg2 is a reg
     {
-        arg2num = strToInt(&arg2buf[1]);
+        arg2num = lineArg[2];
         instr += (arg2num << 4);
     }
 
     // arg3
-    char arg3buf[16];
-    getArgPos(3, arg3buf);
     // arg3 should be a reg
-    if (arg3buf[0] != 'r')
+    if (lineArgKind[3] != ARG_REG)
     {
         BDOS_PrintConsole("ARITH: arg3 not a reg\n");
         exit(1);
     }
-    word arg3num = strToInt(&arg3buf[1]);
+    word arg3num = lineArg[3];
 
     instr += arg3num;
 
@@ -890,9 +847,7 @@ void pass2LoadLabelLow(char* outputAddr, char* outputCursor)
 {
     word instr = 0x70000000;
 
-    char arg1buf[LABEL_NAME_SIZE+1];
-    getArgPos(1, arg1buf);
-    word arg1num = getNumberForLabel(arg1buf);
+    word arg1num = getNumberForLabelArg(1);
 
     // only use the lowest 16 bits
     arg1num = arg1num << 16;
@@ -901,15 +856,13 @@ void pass2LoadLabelLow(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("LOADLABELLOW: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += arg2num;
 
@@ -924,9 +877,7 @@ void pass2LoadLabelHigh(char* outputAddr, char* outputCursor)
 {
     word instr = 0x70000000;
 
-    char arg1buf[LABEL_NAME_SIZE+1];
-    getArgPos(1, arg1buf);
-    word arg1num = getNumberForLabel(arg1buf);
+    word arg1num = getNumberForLabelArg(1);
 
     // only use the highest 16 bits
     arg1num = arg1num >> 16;
@@ -934,15 +885,13 @@ void pass2LoadLabelHigh(char* outputAddr, char* outputCursor)
     instr += (arg1num << 12);
 
     // arg2
-    char arg2buf[16];
-    getArgPos(2, arg2buf);
     // arg2 should be a reg
-    if (arg2buf[0] != 'r')
+    if (lineArgKind[2] != ARG_REG)
     {
         BDOS_PrintConsole("LOADLABELHIGH: arg2 not a reg\n");
         exit(1);
     }
-    word arg2num = strToInt(&arg2buf[1]);
+    word arg2num = lineArg[2];
 
     instr += arg2num;
 
@@ -964,7 +913,7 @@ void pass2Nop(char* outputAddr, char* outputCursor)
 
 void pass2Dw(char* outputAddr, char* outputCursor)
 {
-    word dwValue = getNumberAtArg(1);
+    word dwValue = getNumberArg(1);
 
     // write to mem
     char byteInstr[4];
@@ -975,9 +924,7 @@ void pass2Dw(char* outputAddr, char* outputCursor)
 
 void pass2Dl(char* outputAddr, char* outputCursor)
 {
-    char arg1buf[LABEL_NAME_SIZE+1];
-    getArgPos(1, arg1buf);
-    word dlValue = getNumberForLabel(arg1buf);
+    word dlValue = getNumberForLabelArg(1);
 
     // write to mem
     char byteInstr[4];
@@ -991,15 +938,13 @@ void pass2Readintid(char* outputAddr, char* outputCursor)
     word instr = 0xE0000000;
 
     // arg1
-    char arg1buf[16];
-    getArgPos(1, arg1buf);
     // arg1 should be a reg
-    if (arg1buf[0] != 'r')
+    if (lineArgKind[1] != ARG_REG)
     {
         BDOS_PrintConsole("READINTID: arg1 not a reg\n");
         exit(1);
     }
-    word arg1num = strToInt(&arg1buf[1]);
+    word arg1num = lineArg[1];
 
     instr += arg1num;
 
@@ -85,8 +85,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IDENTTABLE_ADDR 0x450000
 #define SYNSTACK0_ADDR 0x460000
 #define SYNSTACK1_ADDR 0x470000
-#define INPUTBUFFER_ADDR 0x480000
+#define INPUTBUFFER_ADDR 0x4C0000 // read buffers of the files, up to 0x500000
 #define FILENAMES_ADDR 0x490000
+#define MACROHASH_ADDR 0x4A0000
+#define IDENTHASH_ADDR 0x4B0000
+#define SYMBOLINDEX_ADDR 0x480000
 
 #include "lib/math.c"
 #include "lib/sys.c"
@@ -106,6 +109,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_MACRO_TABLE_LEN   (4096+1024)
 #define MAX_IDENT_TABLE_LEN   (4096+1024+512) // must be greater than MAX_IDENT_LEN
 #define SYNTAX_STACK_MAX      (2048+1024)
+#define MACRO_HASH_SIZE       256 // must be a power of 2
+#define IDENT_HASH_SIZE       512 // must be a power of 2
+#define SYMBOL_HASH_SIZE      256 // must be a power of 2
 #define MAX_FILE_NAME_LEN     95
 
 #define MAX_INCLUDES         8
@@ -301,6 +307,8 @@ void GenExpr(void);
 
 void PushSyntax(word t);
 void PushSyntax2(word t, word v);
+void LinkSymbols(word pos);
+void UnlinkSymbols(word pos);
 
 
 void DumpSynDecls(void);
@@ -381,6 +389,14 @@ word CharQueueLen = 0;
 char *MacroTable = (char*) MACROTABLE_ADDR; //[MAX_MACRO_TABLE_LEN];
 word MacroTableLen = 0;
 
+/*
+  Macro hash chains:
+    MacroHash[hash]:     offset of the most recently added entry, -1 if none
+    MacroHashNext[ofs]:  offset of the next older entry with the same hash
+*/
+word MacroHash[MACRO_HASH_SIZE];
+word *MacroHashNext = (word*) MACROHASH_ADDR; //[MAX_MACRO_TABLE_LEN];
+
 /*
   Identifier table entry format:
     id char[idlen]: string (ASCIIZ)
@@ -390,6 +406,15 @@ char *IdentTable = (char*) IDENTTABLE_ADDR; //[MAX_IDENT_TABLE_LEN];
 word IdentTableLen = 0;
 word DummyIdent; // corresponds to empty string
 
+/*
+  Identifier hash chains (newest entry first, so the chains are ordered
+  by decreasing offset and the table can be truncated from the top):
+    IdentHash[hash]:     offset of the most recently added identifier, -1 if none
+    IdentHashNext[ofs]:  offset of the next older identifier with the same hash
+*/
+word IdentHash[IDENT_HASH_SIZE];
+word *IdentHashNext = (word*) IDENTHASH_ADDR; //[MAX_IDENT_TABLE_LEN];
+
 #define MAX_GOTO_LABELS 16
 
 word gotoLabels[MAX_GOTO_LABELS][2];
@@ -495,6 +520,22 @@ unsigned char *SyntaxStack0 = (unsigned char*) SYNSTACK0_ADDR; //[SYNTAX_STACK_M
 word *SyntaxStack1 = (word*) SYNSTACK1_ADDR; //[SYNTAX_STACK_MAX];
 word SyntaxStackCnt;
 
+/*
+  Symbol index of the tokIdent entries of the syntax stack (newest entry
+  first, so the chains are ordered by decreasing position and the stack
+  can be truncated from the top):
+    SymbolHash[hash]:    position of the most recent tokIdent, -1 if none
+    SymbolHashNext[pos]: position of the next older tokIdent with the same hash
+    SymbolBucket[pos]:   hash the entry was linked under, -1 if not linked
+    SymbolParen[pos]:    position of the innermost '(' still open before pos, -1 if none
+  Everything at and above a position is relinked whenever the stack is
+  changed below its top by InsertSyntax2()/DeleteSyntax() or UndoSyntax().
+*/
+word SymbolHash[SYMBOL_HASH_SIZE];
+word *SymbolHashNext = (word*) SYMBOLINDEX_ADDR; //[SYNTAX_STACK_MAX];
+word *SymbolBucket = (word*) (SYMBOLINDEX_ADDR + SYNTAX_STACK_MAX); //[SYNTAX_STACK_MAX];
+word *SymbolParen = (word*) (SYMBOLINDEX_ADDR + 2 * SYNTAX_STACK_MAX); //[SYNTAX_STACK_MAX];
+
 
 
 
@@ -531,20 +572,50 @@ word truncInt(word n)
 
 // prep.c code
 
-word FindMacro(char* name)
+word HashName(char* name)
+{
+  word h = 0;
+  while (*name)
+    h = (h << 5) + h + *name++;
+  return h;
+}
+
+void HashMacro(word i)
+{
+  word h = HashName(MacroTable + i + 1) & (MACRO_HASH_SIZE - 1);
+  MacroHashNext[i] = MacroHash[h];
+  MacroHash[h] = i;
+}
+
+void RehashMacros()
 {
   word i;
 
+  for (i = 0; i < MACRO_HASH_SIZE; i++)
+    MacroHash[i] = -1;
+
   for (i = 0; i < MacroTableLen; )
   {
-    if (!strcmp(MacroTable + i + 1, name))
-      return i + 1 + MacroTable[i];
-
+    HashMacro(i);
     i = i + 1 + MacroTable[i]; // skip id
     i = i + 1 + MacroTable[i]; // skip ex
   }
+}
 
-  return -1;
+word FindMacro(char* name)
+{
+  word i;
+  word found = -1;
+
+  // The chain is ordered newest first, keep going to find the oldest
+  // definition like a front-to-back scan of the table would
+  for (i = MacroHash[HashName(name) & (MACRO_HASH_SIZE - 1)]; i >= 0; i = MacroHashNext[i])
+  {
+    if (!strcmp(MacroTable + i + 1, name))
+      found = i + 1 + MacroTable[i];
+  }
+
+  return found;
 }
 
 word UndefineMacro(char* name)
@@ -563,6 +634,9 @@ word UndefineMacro(char* name)
               MacroTableLen - i - len);
       MacroTableLen -= len;
 
+      // the entries above have moved down
+      RehashMacros();
+
       return 1;
     }
 
@@ -587,9 +661,10 @@ void AddMacroIdent(char* name)
   if (MAX_MACRO_TABLE_LEN - MacroTableLen < l + 3)
     error("Macro table exhausted\n");
 
-  MacroTable[MacroTableLen++] = l + 1; // idlen
-  strcpy(MacroTable + MacroTableLen, name);
-  MacroTableLen += l + 1;
+  MacroTable[MacroTableLen] = l + 1; // idlen
+  strcpy(MacroTable + MacroTableLen + 1, name);
+  HashMacro(MacroTableLen);
+  MacroTableLen += 1 + l + 1;
 
   MacroTable[MacroTableLen] = 0; // exlen
 }
@@ -648,15 +723,33 @@ void DumpMacroTable(void)
 word FindIdent(char* name)
 {
   word i;
-  for (i = IdentTableLen; i > 0; )
+  for (i = IdentHash[HashName(name) & (IDENT_HASH_SIZE - 1)]; i >= 0; i = IdentHashNext[i])
   {
-    i -= 1 + IdentTable[i - 1];
     if (!strcmp(IdentTable + i, name))
       return i;
   }
   return -1;
 }
 
+void HashIdent(word i)
+{
+  word h = HashName(IdentTable + i) & (IDENT_HASH_SIZE - 1);
+  IdentHashNext[i] = IdentHash[h];
+  IdentHash[h] = i;
+}
+
+void UndoIdents(word len)
+{
+  // Remove the identifiers from the top of the table down to len,
+  // each of them is at the head of its hash chain when it's removed
+  while (IdentTableLen > len)
+  {
+    word i = IdentTableLen - 1 - IdentTable[IdentTableLen - 1];
+    IdentHash[HashName(IdentTable + i) & (IDENT_HASH_SIZE - 1)] = IdentHashNext[i];
+    IdentTableLen = i;
+  }
+}
+
 word AddIdent(char* name)
 {
   word i, len;
@@ -674,6 +767,7 @@ word AddIdent(char* name)
     error("Identifier table exhausted\n");
 
   strcpy(IdentTable + IdentTableLen, name);
+  HashIdent(i);
   IdentTableLen += len + 1;
   IdentTable[IdentTableLen++] = len + 1;
 
@@ -717,7 +811,7 @@ word AddGotoLabel(char* name, word label)
 void UndoNonLabelIdents(word len)
 {
   word i;
-  IdentTableLen = len;
+  UndoIdents(len);
   for (i = 0; i < gotoLabCnt; i++)
     if (gotoLabels[i][0] >= len)
     {
@@ -725,6 +819,7 @@ void UndoNonLabelIdents(word len)
       char* pto = IdentTable + IdentTableLen;
       word l = strlen(pfrom) + 2;
       memmove(pto, pfrom, l);
+      HashIdent(IdentTableLen);
       IdentTableLen += l;
       gotoLabels[i][0] = pto - IdentTable;
     }
@@ -2237,7 +2332,9 @@ word exprUnary(word tok, word* gotUnary, word commaSeparator, word argOfSizeOf)
 
         *--p = "(<"[argOfSizeOf]; // differentiate casts (something#) from not casts <something#>
 
+        UnlinkSymbols(synPtr);
         SyntaxStack1[synPtr] = AddIdent(p);
+        LinkSymbols(synPtr);
         tok = GetToken();
         if (argOfSizeOf)
         {
@@ -4779,12 +4876,60 @@ word TokenStartsDeclaration(word t, word params)
                       t == tokStatic));
 }
 
+word SymbolOpenParen(word pos)
+{
+  // Find the innermost '(' still open before pos
+  word t;
+  if (pos == 0)
+    return -1;
+  t = SyntaxStack0[pos - 1];
+  if (t == '(')
+    return pos - 1;
+  if (t == ')' && SymbolParen[pos - 1] >= 0)
+    return SymbolParen[SymbolParen[pos - 1]];
+  return SymbolParen[pos - 1];
+}
+
+void LinkSymbols(word pos)
+{
+  // Add the entries from pos to the top of the stack to the symbol index
+  for (; pos < SyntaxStackCnt; pos++)
+  {
+    SymbolParen[pos] = SymbolOpenParen(pos);
+    SymbolBucket[pos] = -1;
+    if (SyntaxStack0[pos] == tokIdent)
+    {
+      word h = SyntaxStack1[pos] & (SYMBOL_HASH_SIZE - 1);
+      SymbolBucket[pos] = h;
+      SymbolHashNext[pos] = SymbolHash[h];
+      SymbolHash[h] = pos;
+    }
+  }
+}
+
+void UnlinkSymbols(word pos)
+{
+  // Remove the entries from the top of the stack down to pos from the
+  // symbol index, each of them is at the head of its hash chain when it's removed
+  word i;
+  for (i = SyntaxStackCnt - 1; i >= pos; i--)
+    if (SymbolBucket[i] >= 0)
+      SymbolHash[SymbolBucket[i]] = SymbolHashNext[i];
+}
+
+void UndoSyntax(word cnt)
+{
+  UnlinkSymbols(cnt);
+  SyntaxStackCnt = cnt;
+}
+
 void PushSyntax2(word t, word v)
 {
   if (SyntaxStackCnt >= SYNTAX_STACK_MAX)
     error("Symbol table exhausted\n");
   SyntaxStack0[SyntaxStackCnt] = t;
   SyntaxStack1[SyntaxStackCnt++] = v;
+  LinkSymbols(SyntaxStackCnt - 1);
 }
 
 void PushSyntax(word t)
@@ -4796,6 +4941,7 @@ void InsertSyntax2(word pos, word t, word v)
 {
   if (SyntaxStackCnt >= SYNTAX_STACK_MAX)
     error("Symbol table exhausted\n");
+  UnlinkSymbols(pos);
   memmove(&SyntaxStack0[pos + 1],
           &SyntaxStack0[pos],
           sizeof(SyntaxStack0[0]) * (SyntaxStackCnt - pos));
@@ -4805,6 +4951,7 @@ void InsertSyntax2(word pos, word t, word v)
   SyntaxStack0[pos] = t;
   SyntaxStack1[pos] = v;
   SyntaxStackCnt++;
+  LinkSymbols(pos);
 }
 
 void InsertSyntax(word pos, word t)
@@ -4814,6 +4961,7 @@ void InsertSyntax(word pos, word t)
 
 void DeleteSyntax(word pos, word cnt)
 {
+  UnlinkSymbols(pos);
   memmove(&SyntaxStack0[pos],
           &SyntaxStack0[pos + cnt],
           sizeof(SyntaxStack0[0]) * (SyntaxStackCnt - (pos + cnt)));
@@ -4821,36 +4969,34 @@ void DeleteSyntax(word pos, word cnt)
           &SyntaxStack1[pos + cnt],
           sizeof(SyntaxStack1[0]) * (SyntaxStackCnt - (pos + cnt)));
   SyntaxStackCnt -= cnt;
+  LinkSymbols(pos);
 }
 
 word FindSymbol(char* s)
 {
-  word i;
+  word i, id;
 
   // TBD!!! return declaration scope number so
   // redeclarations can be reported if occur in the same scope.
 
-  // TBD??? Also, I could first use FindIdent() and then just look for the
-  // index into IdentTable[] instead of doing strcmp()
+  // Identifiers are unique in IdentTable[], so look the name up once
+  // and then just compare the indices into IdentTable[]
+  if ((id = FindIdent(s)) < 0)
+    return -1;
 
-  for (i = SyntaxStackCnt - 1; i >= 0; i--)
+  for (i = SymbolHash[id & (SYMBOL_HASH_SIZE - 1)]; i >= 0; i = SymbolHashNext[i])
   {
-    word t = SyntaxStack0[i];
-    if (t == tokIdent &&
-        !strcmp(IdentTable + SyntaxStack1[i], s))
-    {
-      return i;
-    }
-
-    if (t == ')')
-    {
-      // Skip over the function params
-      word c = -1;
-      while (c)
-      {
-        t = SyntaxStack0[--i];
-        c += (t == '(') - (t == ')');
-      }
+    // The entry may have been changed in place, e.g. into a tokTypedef
+    if (SyntaxStack0[i] == tokIdent &&
+        SyntaxStack1[i] == id)
+    {
+      // Skip over the params of the functions declared so far,
+      // only the params of a '(' that's still open are visible
+      word p = SymbolOpenParen(SyntaxStackCnt);
+      while (p > SymbolParen[i])
+        p = SymbolParen[p];
+      if (p == SymbolParen[i])
+        return i;
     }
   }
 
@@ -4886,15 +5032,18 @@ word SymType(word SynPtr)
 
 word FindTaggedDecl(char* s, word start, word* CurScope)
 {
-  word i;
+  word i, id;
 
   *CurScope = 1;
 
+  if ((id = FindIdent(s)) < 0)
+    return -1;
+
   for (i = start; i >= 0; i--)
   {
     word t = SyntaxStack0[i];
     if (t == tokTag &&
-        !strcmp(IdentTable + SyntaxStack1[i], s))
+        SyntaxStack1[i] == id)
     {
       return i - 1;
     }
@@ -5261,8 +5410,8 @@ word ParseArrayDimension(word AllowEmptyDimension)
   oldesp = sp;
   undoIdents = IdentTableLen;
   tok = ParseExpr(tok, &gotUnary, &synPtr, &constExpr, &exprVal, 0, 0);
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof"
-  SyntaxStackCnt = oldssp; // undo any temporary declarations from e.g. "sizeof" in the expression
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof"
+  UndoSyntax(oldssp); // undo any temporary declarations from e.g. "sizeof" in the expression
   sp = oldesp;
 
   if (tok != ']')
@@ -5719,7 +5868,7 @@ word InitVar(word synPtr, word tok)
   if (!strchr(",;", tok))
     errorUnexpectedToken(tok);
 
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof" or "str"
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof" or "str"
 
   return tok;
 }
@@ -5799,8 +5948,8 @@ word InitScalar(word synPtr, word tok)
     //error("ParseDecl(): cannot initialize a global variable with a non-constant expression\n");
     errorNotConst();
 
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof" or "str"
-  SyntaxStackCnt = oldssp; // undo any temporary declarations from e.g. "sizeof" or "str" in the expression
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof" or "str"
+  UndoSyntax(oldssp); // undo any temporary declarations from e.g. "sizeof" or "str" in the expression
   return tok;
 }
 
@@ -6705,8 +6854,8 @@ word ParseDecl(word tok, unsigned structInfo[4], word cast, word label)
 
 
         CurFxnName = NULL;
-        IdentTableLen = undoIdents; // remove all identifier names
-        SyntaxStackCnt = undoSymbolsPtr; // remove all params and locals
+        UndoIdents(undoIdents); // remove all identifier names
+        UndoSyntax(undoSymbolsPtr); // remove all params and locals
         SyntaxStack1[SymFuncPtr] = DummyIdent;
       }
 
@@ -7006,7 +7155,7 @@ word ParseStatement(word tok, word BrkCntTarget[2], word casesIdx)
         //error("ParseStatement(): '}' expected. Unexpected token %s\n", GetTokenName(tok));
         errorUnexpectedToken(tok);
       UndoNonLabelIdents(undoIdents); // remove all identifier names, except those of labels
-      SyntaxStackCnt = undoSymbolsPtr; // remove all params and locals
+      UndoSyntax(undoSymbolsPtr); // remove all params and locals
       CurFxnLocalOfs = undoLocalOfs; // destroy on-stack local variables
       if (doAnnotations)
       {
@@ -7798,7 +7947,16 @@ int main()
   memcpy(SyntaxStack0, SyntaxStackInit, sizeof SyntaxStackInit);
   SyntaxStackCnt = 10;
 
+  word i;
+  for (i = 0; i < IDENT_HASH_SIZE; i++)
+    IdentHash[i] = -1;
+  for (i = 0; i < MACRO_HASH_SIZE; i++)
+    MacroHash[i] = -1;
+  for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+    SymbolHash[i] = -1;
+
   SyntaxStack1[SymFuncPtr] = DummyIdent = AddIdent("");
+  LinkSymbols(0);
 
   GenInit();
 
@@ -140,6 +140,89 @@ word FS_spiTransfer(word dataByte)
 
 
 
+// Reads len (> 0) bytes over SPI1 into buf, one byte per address
+// Used to read a block of data from the CH376 without a function call per byte
+// Returns the address after the last byte
+char* FS_spiReadBytes(char* buf, word len)
+{
+    char* retval = 0;
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r3\n"
+        "push r4\n"
+
+        "load32 0xC0272B r1                 ; r1 = 0xC0272B\n"
+        "add r4 r5 r3                       ; r3 = address after the last byte\n"
+
+        "FS_spiReadBytesLoop:\n"
+        "    write 0 r1 r0                  ; write 0 over SPI1\n"
+        "    read 0 r1 r2                   ; read byte\n"
+        "    write 0 r4 r2                  ; store byte in buf\n"
+        "    add r4 1 r4                    ; incr buf address\n"
+        "    beq r4 r3 2                    ; keep looping until all bytes are read\n"
+        "    jump FS_spiReadBytesLoop\n"
+
+        "write -4 r14 r4                    ; write to stack to return\n"
+
+        "; restore regs\n"
+        "pop r4\n"
+        "pop r3\n"
+        "pop r1\n"
+        );
+
+    return retval;
+}
+
+// Reads len (> 0) bytes over SPI1 into buf, four bytes per address from left to right
+// packState[0] is the word that is being filled, packState[1] the number of bytes it still needs (1-4),
+//  so a word can continue in the next call. Each completed word is written once
+// Returns the address of the next word to fill
+char* FS_spiReadWords(char* buf, word len, word* packState)
+{
+    char* retval = 0;
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r4\n"
+        "push r5\n"
+        "push r7\n"
+        "push r8\n"
+
+        "load32 0xC0272B r1                 ; r1 = 0xC0272B\n"
+        "read 0 r6 r7                       ; r7 = word that is being filled\n"
+        "read 1 r6 r8                       ; r8 = number of bytes the word still needs\n"
+
+        "FS_spiReadWordsLoop:\n"
+        "    write 0 r1 r0                  ; write 0 over SPI1\n"
+        "    read 0 r1 r2                   ; read byte\n"
+        "    shiftl r7 8 r7                 ; make room for the byte\n"
+        "    or r7 r2 r7                    ; add byte to word\n"
+        "    sub r8 1 r8                    ; decr bytes needed\n"
+        "    bne r8 r0 4                    ; skip storing if the word is not complete\n"
+        "    write 0 r4 r7                  ; store word in buf\n"
+        "    add r4 1 r4                    ; incr buf address\n"
+        "    load 4 r8                      ; next word needs four bytes\n"
+        "    sub r5 1 r5                    ; decr bytes to read\n"
+        "    beq r5 r0 2                    ; keep looping until all bytes are read\n"
+        "    jump FS_spiReadWordsLoop\n"
+
+        "write 0 r6 r7                      ; save state for the next call\n"
+        "write 1 r6 r8\n"
+        "write -4 r14 r4                    ; write to stack to return\n"
+
+        "; restore regs\n"
+        "pop r8\n"
+        "pop r7\n"
+        "pop r5\n"
+        "pop r4\n"
+        "pop r1\n"
+        );
+
+    return retval;
+}
+
+
 // Get status after waiting for an interrupt
 word FS_WaitGetStatus()
 {
@@ -175,18 +258,77 @@ void FS_sendString(char* str)
 }
 
 
-// Function to send data d of size s
+// Function to send data d of size s (> 0), one byte per address
 void FS_sendData(char* d, word s)
 {
-    char chr = *d;          // first byte of data
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r3\n"
+        "push r4\n"
 
-    word i;
-    for(i = 0; (unsigned int) i < (unsigned int)s; i++)  // write s bytes
-    {
-        FS_spiTransfer(chr);
-        d++;                    // go to next data address
-        chr = *d;           // get data from address
-    }
+        "load32 0xC0272B r1                 ; r1 = 0xC0272B\n"
+        "add r4 r5 r3                       ; r3 = address after the last byte\n"
+
+        "FS_sendDataLoop:\n"
+        "    read 0 r4 r2                   ; get byte from d\n"
+        "    write 0 r1 r2                  ; write byte over SPI1\n"
+        "    add r4 1 r4                    ; incr data address\n"
+        "    beq r4 r3 2                    ; keep looping until all bytes are sent\n"
+        "    jump FS_sendDataLoop\n"
+
+        "; restore regs\n"
+        "pop r4\n"
+        "pop r3\n"
+        "pop r1\n"
+        );
+}
+
+// Function to send data d of size s (> 0), four bytes per address from left to right
+// packState[0] is what is left of the word that is being sent, packState[1] the number of bytes left in it (0-3),
+//  so a word can continue in the next call. Each word is read once
+// Returns the address of the next word to send
+char* FS_sendWords(char* d, word s, word* packState)
+{
+    char* retval = 0;
+    asm(
+        "; backup regs\n"
+        "push r1\n"
+        "push r4\n"
+        "push r5\n"
+        "push r7\n"
+        "push r8\n"
+
+        "load32 0xC0272B r1                 ; r1 = 0xC0272B\n"
+        "read 0 r6 r7                       ; r7 = what is left of the word that is being sent\n"
+        "read 1 r6 r8                       ; r8 = number of bytes left in the word\n"
+
+        "FS_sendWordsLoop:\n"
+        "    bne r8 r0 4                    ; skip getting a new word if there are bytes left\n"
+        "    read 0 r4 r7                   ; get word from d\n"
+        "    add r4 1 r4                    ; incr data address\n"
+        "    load 4 r8                      ; the word has four bytes left\n"
+        "    shiftr r7 24 r2                ; get the leftmost byte\n"
+        "    write 0 r1 r2                  ; write byte over SPI1\n"
+        "    shiftl r7 8 r7                 ; move the next byte to the left\n"
+        "    sub r8 1 r8                    ; decr bytes left in the word\n"
+        "    sub r5 1 r5                    ; decr bytes to send\n"
+        "    beq r5 r0 2                    ; keep looping until all bytes are sent\n"
+        "    jump FS_sendWordsLoop\n"
+
+        "write 0 r6 r7                      ; save state for the next call\n"
+        "write 1 r6 r8\n"
+        "write -4 r14 r4                    ; write to stack to return\n"
+
+        "; restore regs\n"
+        "pop r8\n"
+        "pop r7\n"
+        "pop r5\n"
+        "pop r4\n"
+        "pop r1\n"
+        );
+
+    return retval;
 }
 
 // Returns file size of currently opened file (32 bits)
@@ -245,15 +387,12 @@ word FS_readFile(char* buf, word s, word bytesToWord)
         return retval;
 
 
-    word bytesRead = 0; 
-    word wordsRead = 0;
     word doneReading = 0;
 
-    // clear first address
-    buf[wordsRead] = 0;
-
-    // used for shifting bytes to word
-    word currentByteShift = 24;
+    // word that is being filled and the number of bytes it still needs, for FS_spiReadWords
+    word packState[2];
+    packState[0] = 0;
+    packState[1] = 4;
 
     while (doneReading == 0)
     {
@@ -262,37 +401,13 @@ word FS_readFile(char* buf, word s, word bytesToWord)
         FS_spiTransfer(FS_CMD_RD_USB_DATA0);
         word readLen = FS_spiTransfer(0x00);
 
-        word readByte;
-
-        word i;
-        for (i = 0; i < readLen; i++) 
+        if (readLen != 0)
         {
-            readByte = FS_spiTransfer(0x00);
-
             // Read 4 bytes into one word, from left to right
             if (bytesToWord)
-            {
-                readByte = readByte << currentByteShift;
-                buf[wordsRead] = buf[wordsRead] + readByte;
-
-
-                if (currentByteShift == 0)
-                {
-                    currentByteShift = 24;
-                    wordsRead++;
-                    buf[wordsRead] = 0;
-                }
-                else
-                {
-                    currentByteShift -= 8;
-                }
-
-            }
+                buf = FS_spiReadWords(buf, readLen, packState);
             else
-            {
-                buf[bytesRead] = (char)readByte;
-                bytesRead = bytesRead + 1;
-            }
+                buf = FS_spiReadBytes(buf, readLen);
         }
         FS_spiEndTransfer();
 
@@ -315,15 +430,20 @@ word FS_readFile(char* buf, word s, word bytesToWord)
         }
     }
 
+    // Store the last word if it is not complete, from left to right like the others
+    if (bytesToWord && packState[1] != 4)
+        *buf = packState[0] << (packState[1] << 3);
+
     return retval;
 }
 
 
 // Writes data d of size s
+// if bytesToWord is true, four bytes will be taken from one address/word
 // Can only write 65536 bytes at a time
 // returns FS_ANSW_USB_INT_SUCCESS on success
-// TODO: optimize for speed
-word FS_writeFile(char* d, word s) 
+// the bytes of each block are sent by an assembly loop, so writing is limited by the SPI speed of the CH376
+word FS_writeFile(char* d, word s, word bytesToWord)
 {
     if (s == 0)
         return FS_ANSW_USB_INT_SUCCESS;
@@ -340,9 +460,13 @@ word FS_writeFile(char* d, word s)
         return retval;
 
 
-    word bytesWritten = 0;
     word doneWriting = 0;
 
+    // what is left of the word that is being sent and the number of bytes left in it, for FS_sendWords
+    word packState[2];
+    packState[0] = 0;
+    packState[1] = 0;
+
     while (doneWriting == 0)
     {
         // Write set of bytes (max 255)
@@ -350,8 +474,16 @@ word FS_writeFile(char* d, word s)
         FS_spiTransfer(FS_CMD_WR_REQ_DATA);
         word wrLen = FS_spiTransfer(0x00);
 
-        FS_sendData(d + bytesWritten, wrLen);
-        bytesWritten = bytesWritten + wrLen;
+        if (wrLen != 0)
+        {
+            if (bytesToWord)
+                d = FS_sendWords(d, wrLen, packState);
+            else
+            {
+                FS_sendData(d, wrLen);
+                d += wrLen;
+            }
+        }
         FS_spiEndTransfer();
 
         // update file size
@@ -2,7 +2,11 @@
 * Stdio replacement library
 * Contains a subset of functions to use as drop-in replacement
 * Specifically made for porting the BCC compiler
-* Getc has a memory buffer, and puts is put entirely into memory
+* Each file that is read has its own buffer, so switching between an include and
+*  the file that includes it does not read anything again
+* The file that is currently open on the CH376 stays open until another file is needed
+* Output is kept in memory and written to the output file in large parts while compiling,
+*  except for the part that can still be changed with fsetpos (the current function)
 */
 
 // maximum number of files to open at the same time (+1 because we skip index 0)
@@ -10,21 +14,34 @@
 #define FOPEN_FILENAME_LIMIT 32
 #define EOF -1
 
+// Buffers for reading, one for each file index
+// Length of buffer always should be less than 65536, since this is the maximum FS_readFile can do in a single call
+#define STDIO_FBUF_LEN 16384
+
+// Buffer for writing
+// The output is written to the file in parts of at least STDIO_OUTBUF_PART
+// Length of parts always should be less than 65536, since this is the maximum FS_writeFile can do in a single call
 #define FOPEN_OUTFILE_ADDR 0x500000
+#define STDIO_OUTBUF_LEN 0x100000
+#define STDIO_OUTBUF_PART 0x8000
 
 char fopenList[FOPEN_MAX_FILES][FOPEN_FILENAME_LIMIT]; // filenames for each opened file
 word fopenCurrentlyOpen[FOPEN_MAX_FILES]; // which indexes are currently opened
 word fopenCursors[FOPEN_MAX_FILES]; // cursors of currently opened files
+word fopenSizes[FOPEN_MAX_FILES]; // file sizes, -1 if not known yet
+char* fopenBuffers[FOPEN_MAX_FILES]; // read buffer of each file
+word fopenBufStart[FOPEN_MAX_FILES]; // where in the file the buffer starts
+word fopenBufLen[FOPEN_MAX_FILES]; // number of bytes in the buffer
 word CH376CurrentlyOpened = 0; // index in fopenList which is currently opened on CH376
-
-// Buffers for reading/writing
-// Length of buffer always should be less than 65536, since this is the maximum FS_readFile can do in a single call
-#define STDIO_FBUF_LEN 4096
-char *inputBuffer = (char*) INPUTBUFFER_ADDR; //[STDIO_FBUF_LEN];
-word inbufStartPos = 0; // where in the file the buffer starts
-word inbufCursor = 0; // where in the buffer we currently are working
-
-word outbufCursor = 0;
+word CH376Cursor = 0; // cursor of the file that is currently opened on CH376
+
+char *outbuf = (char*) FOPEN_OUTFILE_ADDR; //[STDIO_OUTBUF_LEN];
+char *outbufCursor = (char*) FOPEN_OUTFILE_ADDR; // where in the buffer we currently are working
+char *outbufCheck = (char*) FOPEN_OUTFILE_ADDR; // cursor at which fcheckOutbuf looks again if a part can be written
+word outbufBase = 0; // where in the file the buffer starts, everything before is written
+word outbufEnd = 0; // size of the output so far, only updated by fupdateOutbufEnd
+word outbufLocked = 0; // if fgetpos has given out a position that can still be used by fsetpos
+word outbufLockPos = 0; // the output from there on can not be written yet
 word outFileIndex = 0;
 
 word includeDepth = 0; // keeping track how many levels we are deep compiling, for progress bar
@@ -55,7 +72,12 @@ word fopen(const char* fname, const word write)
     // if write, create the file
     if (write)
     {
-        outbufCursor = 0; // where in the buffer we currently are working
+        // init write buffer
+        outbufCursor = outbuf;
+        outbufCheck = outbuf + STDIO_OUTBUF_PART;
+        outbufBase = 0;
+        outbufEnd = 0;
+        outbufLocked = 0;
 
         FS_close(); // to be sure
         CH376CurrentlyOpened = 0;
@@ -64,7 +86,7 @@ word fopen(const char* fname, const word write)
         if (FS_sendFullPath(fname) == FS_ANSW_USB_INT_SUCCESS)
         {
             // create the file
-            
+
             if (FS_createFile() == FS_ANSW_USB_INT_SUCCESS)
             {
                 //BDOS_PrintConsole("File created\n");
@@ -81,24 +103,21 @@ word fopen(const char* fname, const word write)
             return 0;
         }
     }
-    else // read
-    {
-        FS_close();
-        CH376CurrentlyOpened = 0;
-
-        // init read buffer
-        inbufStartPos = 0; // start at 0
-        inbufCursor = 0; // start at 0
-    }
 
     word i = 1; // skip index 0
+    char* buffer = (char*) INPUTBUFFER_ADDR;
     while (i < FOPEN_MAX_FILES)
     {
+        buffer += STDIO_FBUF_LEN;
         if (fopenCurrentlyOpen[i] == 0)
         {
             // found a free spot
             fopenCurrentlyOpen[i] = 1;
             fopenCursors[i] = 0;
+            fopenSizes[i] = -1;
+            fopenBuffers[i] = buffer;
+            fopenBufStart[i] = 0;
+            fopenBufLen[i] = 0;
             // write filename
             strcpy(fopenList[i], fname);
 
@@ -126,101 +145,121 @@ word fopen(const char* fname, const word write)
     return 0;
 }
 
+// opens file at index on CH376 (if not open already) and sets the cursor to pos
 // returns EOF if file cannot be opened
-word fcanopen(word i)
+word fopenOnCH376(word i, word pos)
 {
-    if (CH376CurrentlyOpened == i)
+    if (CH376CurrentlyOpened != i)
     {
-        return 0;
-    }
-
-    FS_close();
-    CH376CurrentlyOpened = 0;
+        FS_close(); // also when nothing is open, to be sure
+        CH376CurrentlyOpened = 0;
 
-    // if the resulting path is correct (can be file or directory)
-    if (FS_sendFullPath(fopenList[i]) == FS_ANSW_USB_INT_SUCCESS)
-    {
+        // if the resulting path is correct (can be file or directory)
+        if (FS_sendFullPath(fopenList[i]) != FS_ANSW_USB_INT_SUCCESS)
+        {
+            return EOF;
+        }
 
         // if we can successfully open the file (not directory)
-        if (FS_open() == FS_ANSW_USB_INT_SUCCESS)
+        if (FS_open() != FS_ANSW_USB_INT_SUCCESS)
         {
-            FS_close();
-            return 0;
+            return EOF;
         }
-        else
+
+        CH376CurrentlyOpened = i;
+        CH376Cursor = 0;
+
+        if (fopenSizes[i] < 0)
         {
-            return EOF;
+            fopenSizes[i] = FS_getFileSize();
         }
     }
-    else
+
+    if (CH376Cursor != pos)
     {
-        return EOF;
+        FS_setCursor(pos);
+        CH376Cursor = pos;
     }
 
-    return EOF;
+    return 0;
 }
 
+// returns EOF if file cannot be opened
+// the file stays open on CH376, since it will be used next
+word fcanopen(word i)
+{
+    return fopenOnCH376(i, 0);
+}
 
-// closes file at index
-// also closes the file on CH376 if it is currently open there as well
-void fclose(word i)
+
+// returns the position in the output file of the cursor
+word foutbufPos()
 {
-    if (CH376CurrentlyOpened == i)
+    return outbufBase + (outbufCursor - outbuf);
+}
+
+
+// output is only written at the cursor, and the cursor only moves back with fsetpos,
+// so the end of the output only has to be updated before using it
+void fupdateOutbufEnd()
+{
+    word pos = foutbufPos();
+    if (pos > outbufEnd)
     {
-        FS_close(); // to be sure
-        CH376CurrentlyOpened = 0;
+        outbufEnd = pos;
     }
+}
 
-    // if output file, write entire buffer to the file
-    if (outFileIndex == i && i > 0)
+
+// writes the output buffer up to file position end to the output file
+// and moves the rest of the buffer to the start
+void fwriteOutbuf(word end)
+{
+    word bytesToWrite = end - outbufBase;
+    if (fopenOnCH376(outFileIndex, outbufBase) == EOF)
     {
-        BDOS_PrintConsole("\nWriting to output file:\n");
-        // close other file if open
-        FS_close();
-        CH376CurrentlyOpened = 0;
+        BDOS_PrintConsole("E: could not open outfile\n");
+        return;
+    }
 
-        // if the resulting path is correct (can be file or directory)
-        if (FS_sendFullPath(fopenList[i]) == FS_ANSW_USB_INT_SUCCESS)
-        {
+    word bytesWritten = 0;
 
-            // if we can successfully open the file (not directory)
-            if (FS_open() == FS_ANSW_USB_INT_SUCCESS)
-            {
-                FS_setCursor(0); // set cursor to start
-                word bytesWritten = 0;
-                word* outbufAddr = (word*) FOPEN_OUTFILE_ADDR;
+    // loop until all bytes are sent
+    while (bytesWritten != bytesToWrite)
+    {
+        word partToSend = bytesToWrite - bytesWritten;
+        // send in parts of 0xFFFF
+        if (partToSend > 0xFFFF)
+            partToSend = 0xFFFF;
 
-                // loop until all bytes are sent
-                while (bytesWritten != outbufCursor)
-                {
-                    word partToSend = outbufCursor - bytesWritten;
-                    // send in parts of 0xFFFF
-                    if (partToSend > 0xFFFF)
-                        partToSend = 0xFFFF;
+        // write away
+        if (FS_writeFile((outbuf + bytesWritten), partToSend, 0) != FS_ANSW_USB_INT_SUCCESS)
+            BDOS_PrintConsole("write error\n");
 
-                    // write away
-                    if (FS_writeFile((outbufAddr +bytesWritten), partToSend) != FS_ANSW_USB_INT_SUCCESS)
-                        BDOS_PrintConsole("write error\n");
+        // Update the amount of bytes sent
+        bytesWritten += partToSend;
+    }
+    CH376Cursor += bytesToWrite;
 
-                    // Update the amount of bytes sent
-                    bytesWritten += partToSend;
+    memmove(outbuf, outbuf + bytesToWrite, outbufEnd - end);
+    outbufBase = end;
+    outbufCursor -= bytesToWrite;
 
-                    BDOS_PrintConsole(".");
-                }
-                BDOS_PrintConsole("\nDone!\n");
-                FS_close();
-            }
-            else
-            {
-                BDOS_PrintConsole("E: could not open outfile\n");
-                return;
-            }
-        }
-        else
-        {
-            BDOS_PrintConsole("E: could not open outfile\n");
-            return;
-        }
+    BDOS_PrintConsole(".");
+}
+
+
+// closes file at index
+// also closes the file on CH376 if it is currently open there as well
+void fclose(word i)
+{
+    // if output file, write the rest of the buffer to the file
+    if (outFileIndex == i && i > 0)
+    {
+        BDOS_PrintConsole("\nWriting to output file:\n");
+        fupdateOutbufEnd();
+        fwriteOutbuf(outbufEnd);
+        BDOS_PrintConsole("\nDone!\n");
 
         outFileIndex = 0;
     }
@@ -235,11 +274,48 @@ void fclose(word i)
         BDOS_PrintlnConsole("Done");
     }
 
+    if (CH376CurrentlyOpened == i)
+    {
+        FS_close();
+        CH376CurrentlyOpened = 0;
+    }
+
     fopenCurrentlyOpen[i] = 0;
     fopenList[i][0] = 0; // to be sure
 }
 
 
+// fills the buffer of file i with the data at the cursor
+// returns EOF at the end of the file or on error
+word ffillBuffer(word i)
+{
+    word pos = fopenCursors[i];
+
+    if (fopenOnCH376(i, pos) == EOF)
+    {
+        BDOS_PrintConsole("E: Could not open file\n");
+        return EOF;
+    }
+
+    word len = fopenSizes[i] - pos;
+    if (len <= 0)
+    {
+        return EOF;
+    }
+    if (len > STDIO_FBUF_LEN)
+    {
+        len = STDIO_FBUF_LEN;
+    }
+
+    FS_readFile(fopenBuffers[i], len, 0);
+    CH376Cursor += len;
+
+    fopenBufStart[i] = pos;
+    fopenBufLen[i] = len;
+    return 0;
+}
+
+
 // returns the current char at cursor (EOF is end of file)
 // increments the cursor
 word fgetc(word i)
@@ -251,79 +327,49 @@ word fgetc(word i)
         return EOF;
     }
 
-    // open on CH376 if not open already
-    if (CH376CurrentlyOpened != i)
+    word bufPos = fopenCursors[i] - fopenBufStart[i];
+
+    // we are at the end of the buffer (or it is not filled yet)
+    if (bufPos >= fopenBufLen[i])
     {
-        // close last one first, unless there is no last
-        if (CH376CurrentlyOpened != 0)
+        if (ffillBuffer(i) == EOF)
         {
-            //BDOS_PrintConsole("fgetc: Closed previous file\n");
-            FS_close();
+            return EOF;
         }
+        bufPos = 0;
+    }
 
+    // return from the buffer, and increment
+    char gotchar = fopenBuffers[i][bufPos];
+    fopenCursors[i]++;
+    // BDOS_PrintcConsole(gotchar); // useful for debugging
+    return gotchar;
+}
 
-        // if the resulting path is correct (can be file or directory)
-        if (FS_sendFullPath(fopenList[i]) == FS_ANSW_USB_INT_SUCCESS)
-        {
-
-            // if we can successfully open the file (not directory)
-            if (FS_open() == FS_ANSW_USB_INT_SUCCESS)
-            {
-                CH376CurrentlyOpened = i;
-                // set cursor to last position
-                FS_setCursor(fopenCursors[i]);
 
-                // reset the buffer
-                inbufStartPos = fopenCursors[i];
-                inbufCursor = 0;
+// writes the part of the output buffer that can not change anymore, if it is large enough
+void fcheckOutbuf()
+{
+    fupdateOutbufEnd();
 
-                //BDOS_PrintConsole("fgetc: File opened on CH376\n");
-            }
-            else
-            {
-                BDOS_PrintConsole("E: Could not open file\n");
-                return EOF;
-            }
-        }
-        else
-        {
-            BDOS_PrintConsole("E: Invalid path\n");
-            return EOF;
-        }
+    word end = outbufEnd;
+    if (outbufLocked)
+    {
+        end = outbufLockPos;
     }
 
-    // workaround for missing compiler check for ALU constants > 11 bit
-    word stdioBufLen = STDIO_FBUF_LEN;
-
-    if (inbufCursor >= STDIO_FBUF_LEN || inbufCursor == 0)  // we are at the end of the buffer (or it is not initialized yet)
+    if (end - outbufBase >= STDIO_OUTBUF_PART)
     {
-        // get filesize
-        word sizeOfFile = FS_getFileSize();
-        
-        // if we cannot completely fill the buffer:
-        if (inbufStartPos + stdioBufLen > sizeOfFile)
-        {
-            //  fill the buffer, and append with EOF token
-            FS_readFile(inputBuffer, sizeOfFile - inbufStartPos, 0);
-            inputBuffer[sizeOfFile - inbufStartPos] = EOF;
-        }
-        else
-        {
-            //  Fill buffer again
-            FS_readFile(inputBuffer, STDIO_FBUF_LEN, 0);
-        }
-        
-        inbufStartPos += stdioBufLen; // for the next fill
-
-        inbufCursor = 0; // start at the beginning of the buffer again
+        fwriteOutbuf(end);
+    }
+    else if (outbufEnd - outbufBase >= STDIO_OUTBUF_LEN - STDIO_OUTBUF_PART)
+    {
+        BDOS_PrintConsole("E: Output buffer is full\n");
+        exit(1);
     }
 
-    // return from the buffer, and increment
-    char gotchar = inputBuffer[inbufCursor];
-    inbufCursor++;
-    fopenCursors[i]++;
-    // BDOS_PrintcConsole(gotchar); // useful for debugging
-    return gotchar;
+    // look again when the output has grown by a part, or when the lock is gone
+    outbufCheck = outbuf + (outbufEnd - outbufBase) + STDIO_OUTBUF_PART;
 }
 
 
@@ -334,10 +380,13 @@ word fputs(word i, char* s)
     {
         BDOS_PrintConsole("W: Writing to something else than outfile!\n");
     }
-    word* outbufAddr = (word*) FOPEN_OUTFILE_ADDR;
     word slen = strlen(s);
-    memcpy((outbufAddr +outbufCursor), s, slen);
+    memcpy(outbufCursor, s, slen);
     outbufCursor += slen;
+    if (outbufCursor >= outbufCheck)
+    {
+        fcheckOutbuf();
+    }
     return 1;
 }
 
@@ -349,19 +398,30 @@ word fputc(word i, char c)
     {
         BDOS_PrintConsole("W: Writing to something else than outfile!\n");
     }
-    word* outbufAddr = (word*) FOPEN_OUTFILE_ADDR;
-    *(outbufAddr +outbufCursor) = c;
+    *outbufCursor = c;
     outbufCursor++;
+    if (outbufCursor >= outbufCheck)
+    {
+        fcheckOutbuf();
+    }
     return 1;
 }
 
+// the output from the returned position is kept in memory,
+// until the cursor is set back to the end with fsetpos
 int fgetpos(word i)
 {
     if (i != outFileIndex)
     {
         BDOS_PrintConsole("W: Getting cursor for something else than outfile!\n");
     }
-    return outbufCursor;
+    word pos = foutbufPos();
+    if (!outbufLocked)
+    {
+        outbufLocked = 1;
+        outbufLockPos = pos;
+    }
+    return pos;
 }
 
 int fsetpos(word i, word c)
@@ -370,7 +430,18 @@ int fsetpos(word i, word c)
     {
         BDOS_PrintConsole("W: Setting cursor for something else than outfile!\n");
     }
-    outbufCursor = c;
+    if (c < outbufBase)
+    {
+        BDOS_PrintConsole("E: Output was already written to the file\n");
+        return 0;
+    }
+    fupdateOutbufEnd();
+    outbufCursor = outbuf + (c - outbufBase);
+    if (c == outbufEnd && outbufLocked)
+    {
+        outbufLocked = 0;
+        fcheckOutbuf();
+    }
     return 1;
 }
 
@@ -390,10 +461,10 @@ word printd(word d)
     {
         BDOS_PrintDecConsole(d);
     }
-    
+
 }
 
 void exit(word i)
 {
     asm("jump Return_BDOS\n");
-}
\ No newline at end of file
+}
@@ -50,6 +50,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //CurFxnLocalOfs (gcc.c)
 */
 
+/* Register usage of the generated code
+r0      always 0
+r1      scratch, used by the structure copy helper
+r2      return value, holds subexpression results (V0)
+r3      callee-saved, register variable
+r4-r7   the first four arguments
+r8-r10  temporaries for subexpression results (T0-T2)
+        r10 is also callee-saved, it holds a register variable when no T2 is needed
+r11-r12 momentary temporaries
+r13     stack pointer
+r14     frame pointer
+r15     return address
+
+A function that changes r3 or r10, also from asm(), saves and restores them in its
+frame. Assembly code outside of a C function has to preserve them itself.
+*/
+
+int GenPeepOpt = 0; // -O, run the peephole optimizer on the function bodies
+FILE* GenFinalOutFile = NULL; // the output file while OutFile is the temporary file (GenWriteOutput())
 
 STATIC
 void GenInit(void)
@@ -68,6 +87,14 @@ void GenInit(void)
 STATIC
 int GenInitParams(int argc, char** argv, int* idx)
 {
+  (void)argc;
+
+  if (!strcmp(argv[*idx], "-O"))
+  {
+    GenPeepOpt = 1;
+    return 1;
+  }
+
   return 0;
 }
 
@@ -77,6 +104,15 @@ void GenInitFinalize(void)
   // finalization of initialization of target-specific code generator
   // Put all C specific wrapper code (start) here
 
+  // A library object is linked with a program that has the wrapper code
+  if (compileLib)
+    return;
+
+  // Write to a temporary file first, so that unused functions can be left out (GenWriteOutput())
+  GenFinalOutFile = OutFile;
+  if (!(OutFile = tmpfile()))
+    error("Cannot create a temporary file\n");
+
   if (compileUserBDOS)
   {
     printf2(
@@ -466,6 +502,17 @@ void GenPrintInstr3Operands(int instr, int instrval,
     }
   }
 
+  // ARITH instructions only have an unsigned 11 bit constant,
+  // so load larger constants into the AT register first
+  if (operand2 == B322OpConst && instr >= B322InstrOr && instr <= B322InstrMult &&
+      (operand2val < 0 || operand2val > 2047))
+  {
+    GenPrintInstr2Operands(B322InstrLoad, 0,
+                           B322OpConst, operand2val,
+                           B322OpRegAt, 0);
+    operand2 = B322OpRegAt;
+  }
+
   GenPrintInstr(instr, instrval);
   GenPrintOperand(operand1, operand1val);
   GenPrintOperandSeparator();
@@ -551,111 +598,2330 @@ void GenExtendRegIfNeeded(int reg, int opSz)
 }
 
 STATIC
-void GenJumpUncond(int label)
+void GenJumpUncond(int label)
+{
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                        B322OpNumLabel, label);
+}
+
+extern int GenWreg; // GenWreg is defined below
+
+STATIC
+void GenJumpIfEqual(int val, int label)
+{
+
+  GenPrintInstr2Operands(B322InstrLoad, 0,
+                         B322OpConst, val,
+                         TEMP_REG_B, 0);
+  /*
+  GenPrintInstr3Operands(MipsInstrBEQ, 0,
+                         GenWreg, 0,
+                         TEMP_REG_B, 0,
+                         B322OpNumLabel, label);
+  */
+  GenPrintInstr3Operands(B322InstrBne, 0,
+                         GenWreg, 0,
+                         TEMP_REG_B, 0,
+                         B322OpConst, 2);
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                         B322OpNumLabel, label);
+}
+
+#define MAX_JUMP_TABLE 1024 // maximum number of entries in a switch jump table
+
+// Returns 1 if cnt sorted case values from lo to hi are dense enough for a jump table.
+// Uses the span hi - lo (unsigned) instead of the number of entries hi - lo + 1,
+// which wraps to 0 when the values span INT_MIN..INT_MAX
+STATIC
+int GenSwitchIsDense(int lo, int hi, unsigned cnt)
+{
+  unsigned span = (unsigned)hi - (unsigned)lo;
+  return span < MAX_JUMP_TABLE && span < 3u * cnt;
+}
+
+// Jumps through a table to the case labels of Cases[first..last-1] (sorted and dense,
+// see GenSwitchIsDense, so the number of entries fits in range)
+STATIC
+void GenSwitchTable(int first, int last, int defLabel)
+{
+  unsigned base = Cases[first][0];
+  unsigned range = (unsigned)Cases[last - 1][0] - base + 1;
+  int tbl = LabelCnt++;
+  unsigned i;
+
+  // TEMP_REG_A = index into the table, anything out of range goes to the default label
+  GenPrintInstr3Operands(B322InstrSub, 0,
+                         GenWreg, 0,
+                         B322OpConst, Cases[first][0],
+                         TEMP_REG_A, 0);
+  GenPrintInstr2Operands(B322InstrLoad, 0,
+                         B322OpConst, range,
+                         TEMP_REG_B, 0);
+  GenPrintInstr3Operands(B322InstrBgtU, 0,
+                         TEMP_REG_B, 0,
+                         TEMP_REG_A, 0,
+                         B322OpConst, 2);
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                        B322OpNumLabel, defLabel);
+  GenPrintInstr2Operands(B322InstrAddr2reg, 0,
+                         B322OpNumLabel, tbl,
+                         TEMP_REG_B, 0);
+  GenPrintInstr3Operands(B322InstrAdd, 0,
+                         TEMP_REG_B, 0,
+                         TEMP_REG_A, 0,
+                         TEMP_REG_B, 0);
+  GenPrintInstr2Operands(B322InstrRead, 0,
+                         B322OpIndRegZero + TEMP_REG_B, 0,
+                         TEMP_REG_B, 0);
+  GenPrintInstr2Operands(B322InstrJumpr, 0,
+                         B322OpConst, 0,
+                         TEMP_REG_B, 0);
+
+  puts2(RoDataHeaderFooter[0]);
+  GenNumLabel(tbl);
+  for (i = 0; i < range; i++)
+  {
+    printf2(".dl ");
+    if ((unsigned)Cases[first][0] - base == i)
+      GenPrintNumLabel(Cases[first++][1]);
+    else
+      GenPrintNumLabel(defLabel);
+    puts2("");
+  }
+  puts2(CodeHeaderFooter[0]);
+}
+
+// Jumps to the case label of Cases[first..last-1] (sorted) that matches GenWreg,
+// or to defLabel. Dense ranges use a jump table, sparse ones a binary search.
+STATIC
+void GenSwitchTree(int first, int last, int defLabel)
+{
+  int cnt = last - first;
+  int mid, lbl, i, j, split = 0, best;
+
+  if (cnt >= 4)
+  {
+    if (GenSwitchIsDense(Cases[first][0], Cases[last - 1][0], cnt))
+    {
+      GenSwitchTable(first, last, defLabel);
+      return;
+    }
+  }
+
+  if (cnt <= 3)
+  {
+    for (; first < last; first++)
+      GenJumpIfEqual(Cases[first][0], Cases[first][1]);
+    GenJumpUncond(defLabel);
+    return;
+  }
+
+  // Split between two clusters of close values (near the middle), so the clusters
+  // can use jump tables, then
+  // if (GenWreg < Cases[mid][0]) search the lower half, else the upper half
+  mid = first + cnt / 2;
+  best = cnt;
+  for (i = first; i < last; i = j)
+  {
+    int dist = (i < mid) ? mid - i : i - mid;
+    if (i > first && dist < best)
+    {
+      best = dist;
+      split = i;
+    }
+    for (j = i + 1; j < last; j++)
+    {
+      if (!GenSwitchIsDense(Cases[i][0], Cases[j][0], j - i + 1))
+        break;
+    }
+  }
+  if (best < cnt)
+    mid = split;
+  lbl = LabelCnt++;
+  GenPrintInstr2Operands(B322InstrLoad, 0,
+                         B322OpConst, Cases[mid][0],
+                         TEMP_REG_B, 0);
+  GenPrintInstr3Operands(B322InstrBgt, 0,
+                         TEMP_REG_B, 0,
+                         GenWreg, 0,
+                         B322OpConst, 2);
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                        B322OpNumLabel, lbl);
+  GenSwitchTree(first, mid, defLabel);
+  GenNumLabel(lbl);
+  GenSwitchTree(mid, last, defLabel);
+}
+
+// Jumps to the case label of Cases[first..last-1] that matches GenWreg, or to defLabel
+STATIC
+void GenSwitch(int first, int last, int defLabel)
+{
+  int i, j;
+
+  // Sort the cases by value (signed, the order only needs to be consistent)
+  for (i = first + 1; i < last; i++)
+  {
+    int val = Cases[i][0], label = Cases[i][1];
+    for (j = i; j > first && Cases[j - 1][0] > val; j--)
+    {
+      Cases[j][0] = Cases[j - 1][0];
+      Cases[j][1] = Cases[j - 1][1];
+    }
+    Cases[j][0] = val;
+    Cases[j][1] = label;
+  }
+
+  GenSwitchTree(first, last, defLabel);
+}
+
+STATIC
+void GenJumpIfZero(int label)
+{
+#ifndef NO_ANNOTATIONS
+  printf2(" ; JumpIfZero\n");
+#endif
+  /* if Wreg == 0, jump to label
+  GenPrintInstr3Operands(MipsInstrBEQ, 0,
+                         GenWreg, 0,
+                         B322OpRegZero, 0,
+                         B322OpNumLabel, label);
+  */
+  GenPrintInstr3Operands(B322InstrBne, 0,
+                         GenWreg, 0,
+                         B322OpRegZero, 0,
+                         B322OpConst, 2);
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                         B322OpNumLabel, label);
+}
+
+STATIC
+void GenJumpIfNotZero(int label)
+{
+#ifndef NO_ANNOTATIONS
+  printf2(" ; JumpIfNotZero\n");
+#endif
+  /* if Wreg != 0, jump to label
+  GenPrintInstr3Operands(MipsInstrBNE, 0,
+                         GenWreg, 0,
+                         B322OpRegZero, 0,
+                         B322OpNumLabel, label);
+  */
+  GenPrintInstr3Operands(B322InstrBeq, 0,
+                         GenWreg, 0,
+                         B322OpRegZero, 0,
+                         B322OpConst, 2);
+  GenPrintInstr1Operand(B322InstrJump, 0,
+                         B322OpNumLabel, label);
+}
+
+#define MAX_COPY_UNROLL 8 // largest copy that is fully unrolled
+#define COPY_LOOP_UNROLL 4 // copies per iteration of a copy loop
+
+// Copies n words from the address in register src to the address in register dst
+// with copy instructions (one bus read and write each, no data register).
+// Larger copies use a loop, which changes src, dst and cnt
+STATIC
+void GenCopyWords(int dst, int src, int cnt, int n)
+{
+  int k;
+
+  if (n > MAX_COPY_UNROLL)
+  {
+    int lbl = LabelCnt++;
+
+    GenPrintInstr2Operands(B322InstrLoad, 0,
+                           B322OpConst, n / COPY_LOOP_UNROLL,
+                           cnt, 0);
+    GenNumLabel(lbl);
+    for (k = 0; k < COPY_LOOP_UNROLL; k++)
+      GenPrintInstr3Operands(B322InstrCopy, 0,
+                             B322OpConst, k,
+                             src, 0,
+                             dst, 0);
+    GenPrintInstr3Operands(B322InstrAdd, 0,
+                           src, 0,
+                           B322OpConst, COPY_LOOP_UNROLL,
+                           src, 0);
+    GenPrintInstr3Operands(B322InstrAdd, 0,
+                           dst, 0,
+                           B322OpConst, COPY_LOOP_UNROLL,
+                           dst, 0);
+    GenPrintInstr3Operands(B322InstrSub, 0,
+                           cnt, 0,
+                           B322OpConst, 1,
+                           cnt, 0);
+    GenPrintInstr3Operands(B322InstrBeq, 0,
+                           cnt, 0,
+                           B322OpRegZero, 0,
+                           B322OpConst, 2);
+    GenPrintInstr1Operand(B322InstrJump, 0,
+                          B322OpNumLabel, lbl);
+    n %= COPY_LOOP_UNROLL;
+  }
+
+  for (k = 0; k < n; k++)
+    GenPrintInstr3Operands(B322InstrCopy, 0,
+                           B322OpConst, k,
+                           src, 0,
+                           dst, 0);
+}
+
+int GenLeaf;
+int GenFrameless; // leaf function without any frame accesses, no FP/SP setup
+
+/*
+  Function buffering and register variables
+
+  The code of a function body is first written to a temporary file. When the end of
+  the function is reached, the body is read back, so the prolog can be generated with
+  the final frame size and the body can be rewritten before it goes to the output file.
+
+  Local variables and parameters that are only accessed directly (read/write ofs r14),
+  and never by address, are kept in the callee-saved registers r3 and r10.
+  r10 is also the third temporary register (T2), so it only holds a variable in
+  functions whose expressions don't need it. Either way a function that uses r3
+  or r10 saves it in the frame in the prolog and restores it in the epilog.
+  Functions with asm() keep all variables in memory, and save the callee-saved
+  registers that are mentioned in the asm code.
+
+  Leaf functions don't need to preserve the argument registers r4-r7, so the first
+  four parameters are used directly in the registers they are passed in, and the
+  argument registers without a parameter hold local variables. If nothing is left
+  in the frame after that, the function is emitted without a frame.
+*/
+
+FILE* GenFxnTmpFile = NULL;
+FILE* GenFxnOutFile = NULL; // the real output file while a function body is buffered
+char* GenFxnText = NULL;
+char** GenFxnLines = NULL;
+char* GenFxnNewText = NULL; // rewritten lines
+int GenFxnLineCnt = 0;
+
+#define MAX_FXN_LOCALS 512 // local variables (and sizes) remembered per function
+int GenLocalOfs[MAX_FXN_LOCALS];
+unsigned GenLocalSize[MAX_FXN_LOCALS];
+int GenLocalCnt;
+
+#define MAX_FXN_SLOTS 256 // frame slots that are considered for register variables
+int GenSlotOfs[MAX_FXN_SLOTS];
+int GenSlotUses[MAX_FXN_SLOTS];
+int GenSlotReg[MAX_FXN_SLOTS]; // register of the slot, 0 if in memory, -1 if it must stay in memory
+int GenSlotCnt;
+
+#define MAX_REG_VARS 2
+int GenRegVars[MAX_REG_VARS] = { B322OpRegV1, B322OpRegT2 };
+int GenRegVarOfs[MAX_REG_VARS]; // frame offset where the register is saved, 0 if not saved
+
+#define MAX_LINE_WORDS 4
+#define MAX_WORD_LEN 64
+char GenWords[MAX_LINE_WORDS][MAX_WORD_LEN];
+
+STATIC
+void GenLocalAlloc(int ofs, unsigned size)
+{
+  if (GenLocalCnt < MAX_FXN_LOCALS)
+  {
+    GenLocalOfs[GenLocalCnt] = ofs;
+    GenLocalSize[GenLocalCnt] = size;
+  }
+  GenLocalCnt++;
+}
+
+// Returns the register number of an assembly word, or -1 if it is not a register
+STATIC
+int GenWordReg(char* w)
+{
+  int r = 0;
+
+  if (*w != 'r' && *w != 'R')
+    return -1;
+  if (!strcmp(w + 1, "bp") || !strcmp(w + 1, "BP"))
+    return 14;
+  if (!strcmp(w + 1, "sp") || !strcmp(w + 1, "SP"))
+    return 15;
+  if (!*++w)
+    return -1;
+  while (*w)
+  {
+    if (!isdigit(*w))
+      return -1;
+    r = r * 10 + *w++ - '0';
+    if (r > 15)
+      return -1;
+  }
+  return r;
+}
+
+// Returns if an assembly word is a (decimal) number
+STATIC
+int GenWordNum(char* w)
+{
+  if (*w == '-')
+    w++;
+  if (!*w)
+    return 0;
+  while (*w)
+    if (!isdigit(*w++))
+      return 0;
+  return 1;
+}
+
+// Splits a buffered line into words (until a comment)
+// Returns the number of words, or 0 if the line is not an instruction
+STATIC
+int GenSplitLine(char* line)
+{
+  int n = 0;
+
+  while (*line == ' ' || *line == '\t')
+    line++;
+  if (*line == '.' || *line == ';' || *line == '\0')
+    return 0;
+
+  while (*line && *line != ';')
+  {
+    int len = 0;
+    if (n == MAX_LINE_WORDS)
+      return n + 1; // too many words, not one of ours
+    while (*line && *line != ' ' && *line != '\t' && *line != ';')
+    {
+      if (len < MAX_WORD_LEN - 1)
+        GenWords[n][len++] = *line;
+      line++;
+    }
+    GenWords[n++][len] = '\0';
+    while (*line == ' ' || *line == '\t')
+      line++;
+  }
+
+  if (GenWords[0][strlen(GenWords[0]) - 1] == ':')
+    return 0; // label
+  return n;
+}
+
+// Returns the index of a frame slot, adding the slot if needed
+STATIC
+int GenFindSlot(int ofs)
+{
+  int i;
+  for (i = 0; i < GenSlotCnt; i++)
+    if (GenSlotOfs[i] == ofs)
+      return i;
+  if (GenSlotCnt == MAX_FXN_SLOTS)
+    return -1;
+  GenSlotOfs[GenSlotCnt] = ofs;
+  GenSlotUses[GenSlotCnt] = 0;
+  GenSlotReg[GenSlotCnt] = 0;
+  return GenSlotCnt++;
+}
+
+// Marks the slots of an object whose address is taken, so they stay in memory
+// Returns 0 if the object is unknown
+STATIC
+int GenAddressTaken(int ofs)
+{
+  unsigned size = 0;
+  int i;
+
+  if (ofs >= 8/*RA + FP*/)
+  {
+    // Parameter (can also be a structure or the start of variable arguments)
+    for (i = 0; i < GenSlotCnt; i++)
+      if (GenSlotOfs[i] >= 8)
+        GenSlotReg[i] = -1;
+    return 1;
+  }
+
+  if (GenLocalCnt > MAX_FXN_LOCALS)
+    return 0;
+  for (i = 0; i < GenLocalCnt; i++)
+    if (GenLocalOfs[i] == ofs && GenLocalSize[i] > size)
+      size = GenLocalSize[i];
+  if (!size)
+    return 0;
+
+  for (i = 0; i < GenSlotCnt; i++)
+    if (GenSlotOfs[i] >= ofs && (unsigned)(GenSlotOfs[i] - ofs) < size)
+      GenSlotReg[i] = -1;
+  return 1;
+}
+
+// Reads the buffered function body back into GenFxnLines
+STATIC
+void GenReadFxnBody(void)
+{
+  long len = ftell(OutFile);
+  long i;
+
+  GenFxnText = malloc(len + 1);
+  GenFxnLines = malloc((len + 2) * sizeof(char*));
+  if (!GenFxnText || !GenFxnLines)
+    error("Out of memory\n");
+
+  rewind(OutFile);
+  if (fread(GenFxnText, 1, len, OutFile) != (size_t)len)
+    error("Error reading the function buffer\n");
+  GenFxnText[len] = '\0';
+
+  GenFxnLineCnt = 0;
+  GenFxnLines[GenFxnLineCnt] = GenFxnText;
+  for (i = 0; i < len; i++)
+  {
+    if (GenFxnText[i] == '\n')
+    {
+      GenFxnText[i] = '\0';
+      GenFxnLines[++GenFxnLineCnt] = GenFxnText + i + 1;
+    }
+  }
+  // the last (unterminated) line is empty when the text ends with '\n'
+  if (*GenFxnLines[GenFxnLineCnt])
+    GenFxnLineCnt++;
+}
+
+// Decides if the function can do without a frame: a leaf function
+// that doesn't use the frame pointer and saves no registers
+STATIC
+void GenFindFrameless(void)
+{
+  int i, j, n;
+
+  if (!GenLeaf || CurFxnAsmUsed)
+    return;
+  for (j = 0; j < MAX_REG_VARS; j++)
+    if (GenRegVarOfs[j])
+      return;
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    if (!GenFxnLines[i] || !(n = GenSplitLine(GenFxnLines[i])))
+      continue;
+    if (n > MAX_LINE_WORDS)
+      return;
+    for (j = 1; j < n; j++)
+      if (GenWordReg(GenWords[j]) == B322OpRegFp)
+        return;
+  }
+
+  GenFrameless = 1;
+}
+
+// Finds the frame slots that can be kept in registers
+// and rewrites their accesses in the function body
+STATIC
+void GenAllocRegVars(void)
+{
+  int i, j, n;
+  int used[MAX_REG_VARS];
+  int usedArgs = 0; // argument registers that are used in the body (bit mask)
+  int paramCnt = 0; // parameters passed in registers
+  char* p;
+
+  GenSlotCnt = 0;
+  GenFrameless = 0;
+  for (j = 0; j < MAX_REG_VARS; j++)
+  {
+    used[j] = 0;
+    GenRegVarOfs[j] = 0;
+  }
+
+  // Count the accesses to the frame slots, and find the registers that are already used
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    if (!(n = GenSplitLine(GenFxnLines[i])))
+      continue;
+
+    for (j = 1; j < n && j < MAX_LINE_WORDS; j++)
+    {
+      int r = GenWordReg(GenWords[j]), k;
+      for (k = 0; k < MAX_REG_VARS; k++)
+        if (r == GenRegVars[k])
+          used[k] = 1;
+      if (r >= B322OpRegA0 && r <= B322OpRegA3)
+        usedArgs |= 1 << (r - B322OpRegA0);
+    }
+
+    if (CurFxnAsmUsed)
+      continue;
+
+    if (n == 4 && (!strcmp(GenWords[0], "read") || !strcmp(GenWords[0], "write")) &&
+        !strcmp(GenWords[2], "r14") && GenWordNum(GenWords[1]))
+    {
+      int slot = GenFindSlot(atoi(GenWords[1]));
+      if (slot >= 0)
+        GenSlotUses[slot]++;
+    }
+    else if (n == 4 && (!strcmp(GenWords[0], "add") || !strcmp(GenWords[0], "sub")) &&
+             !strcmp(GenWords[1], "r14") && GenWordNum(GenWords[2]) && strcmp(GenWords[3], "r14"))
+    {
+      // Address of a local variable or parameter
+      // (marked after all slots are known)
+    }
+    else
+    {
+      for (j = 1; j < n && j < MAX_LINE_WORDS; j++)
+        if (GenWordReg(GenWords[j]) == 14)
+          break;
+      if (j < n && j < MAX_LINE_WORDS)
+        GenSlotCnt = -1; // unknown use of the frame pointer, keep everything in memory
+      if (n > MAX_LINE_WORDS)
+        GenSlotCnt = -1;
+    }
+    if (GenSlotCnt < 0)
+      break;
+  }
+
+  if (CurFxnAsmUsed || GenSlotCnt < 0)
+    GenSlotCnt = 0;
+
+  // Keep the objects whose address is taken in memory
+  for (i = 0; i < GenFxnLineCnt && GenSlotCnt; i++)
+  {
+    if (GenSplitLine(GenFxnLines[i]) != 4)
+      continue;
+    if ((!strcmp(GenWords[0], "add") || !strcmp(GenWords[0], "sub")) &&
+        !strcmp(GenWords[1], "r14") && GenWordNum(GenWords[2]))
+    {
+      int ofs = atoi(GenWords[2]);
+      if (GenWords[0][0] == 's')
+        ofs = -ofs;
+      if (!GenAddressTaken(ofs))
+        GenSlotCnt = 0;
+    }
+  }
+
+  if (GenLeaf)
+  {
+    if (CurFxnParamCntMin && CurFxnParamCntMax)
+      paramCnt = (CurFxnParamCntMax > 4) ? 4 : CurFxnParamCntMax;
+
+    // Keep the parameters in the argument registers they arrive in
+    for (j = 0; j < paramCnt; j++)
+    {
+      i = GenFindSlot(8 + 4 * j); //WORDSIZE
+      if (i >= 0 && !GenSlotReg[i] && GenSlotUses[i] && !((usedArgs >> j) & 1))
+        GenSlotReg[i] = B322OpRegA0 + j;
+      usedArgs |= 1 << j;
+    }
+
+    // Give the remaining argument registers to the most used local variables
+    for (j = paramCnt; j < 4; j++)
+    {
+      int best = -1, bestUses = 0;
+      if ((usedArgs >> j) & 1)
+        continue;
+      for (i = 0; i < GenSlotCnt; i++)
+        if (!GenSlotReg[i] && GenSlotOfs[i] < 0 && GenSlotUses[i] > bestUses)
+          bestUses = GenSlotUses[best = i];
+      if (best < 0)
+        break;
+      GenSlotReg[best] = B322OpRegA0 + j;
+    }
+  }
+
+  // Give the free registers to the most used slots
+  // (a register variable costs a save and a restore)
+  for (j = 0; j < MAX_REG_VARS; j++)
+  {
+    int best = -1, bestUses = 2;
+    if (used[j])
+      continue;
+    for (i = 0; i < GenSlotCnt; i++)
+      if (!GenSlotReg[i] && GenSlotUses[i] > bestUses)
+        bestUses = GenSlotUses[best = i];
+    if (best < 0)
+      break;
+    GenSlotReg[best] = GenRegVars[j];
+    used[j] = 1;
+  }
+
+  // Reserve frame space to save the used registers
+  for (j = 0; j < MAX_REG_VARS; j++)
+  {
+    if (used[j])
+    {
+      CurFxnMinLocalOfs -= 4; //WORDSIZE
+      GenRegVarOfs[j] = CurFxnMinLocalOfs;
+    }
+  }
+
+  // Rewrite the accesses to the register variables
+  n = 0;
+  for (i = 0; i < GenSlotCnt; i++)
+    if (GenSlotReg[i] > 0)
+      n++;
+  if (!n)
+    return;
+
+  GenFxnNewText = malloc(GenFxnLineCnt * 24);
+  if (!GenFxnNewText)
+    error("Out of memory\n");
+  p = GenFxnNewText;
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    int slot;
+    if (GenSplitLine(GenFxnLines[i]) != 4 ||
+        (strcmp(GenWords[0], "read") && strcmp(GenWords[0], "write")) ||
+        strcmp(GenWords[2], "r14") || !GenWordNum(GenWords[1]))
+      continue;
+    slot = GenFindSlot(atoi(GenWords[1]));
+    if (slot < 0 || GenSlotReg[slot] <= 0)
+      continue;
+
+    GenFxnLines[i] = p;
+    if (GenWords[0][0] == 'r')
+      sprintf(p, " or r0 r%d %s", GenSlotReg[slot], GenWords[3]);
+    else
+      sprintf(p, " or r0 %s r%d", GenWords[3], GenSlotReg[slot]);
+    p += strlen(p) + 1;
+  }
+}
+
+/*
+  Peephole optimizer (enabled with -O)
+
+  Runs on the buffered function body after the register variables are assigned.
+  The offsets of the relative branches (bXX, jumpo) are first turned into the lines
+  they point to, so instructions can be removed freely. The offsets are computed
+  again when the body is written out. The following sequences are rewritten:
+  - bXX a b 2 + jump Label_N: the inverted branch straight to Label_N
+  - a comparison that sets a register to 0 or 1, followed by a branch on that
+    register: a single branch on the comparison (if the register is dead afterwards)
+  - a jump to the next instruction: removed
+  - a read of a frame slot that was just written or read: a register move
+  - a move into a dead register: removed
+  - an instruction followed by a move of its result out of a register that dies:
+    the instruction writes the destination of the move directly
+  - a move followed by an instruction that reads the moved register, which dies there:
+    the instruction reads the source of the move
+  - a load32 of a small constant followed by an ALU instruction that uses it:
+    the constant goes into the instruction
+  - a load32 of a constant that is already in the register: removed
+  - a read into a register that only goes to a write with the same offset:
+    a copy (memory to memory, without the register)
+  Functions with asm() are left alone.
+*/
+
+int GenPeepRemovedTotal = 0;
+
+int* GenPeepTarget = NULL; // target line of a relative branch, -1 for other lines
+int* GenPeepTargetCnt = NULL; // number of relative branches to a line
+int* GenPeepSize = NULL; // size of a line in words (0 for comments and labels, -1 outside of .code)
+unsigned GenPeepReads; // registers that may be read somewhere in the function
+char* GenPeepText = NULL; // rewritten lines
+int GenPeepTextLen;
+int GenPeepTextMax;
+
+#define PEEP_OTHER  0 // continues with the next instruction
+#define PEEP_BRANCH 1 // conditional relative branch
+#define PEEP_JUMPO  2 // relative jump
+#define PEEP_JUMP   3 // jump to a label
+#define PEEP_STOP   4 // any other change of the control flow
+
+#define PEEP_MAX_DEPTH 3
+#define PEEP_MAX_STEPS 48
+
+// Instructions known to the peephole optimizer
+// The format starts with the PEEP_* class, followed by a character per operand:
+// s = register that is read, d = register that is written, x = register that is read and written,
+// r = register that is read or a number, n = number, l = label or number
+char* GenPeepInstrs[][2] =
+{
+  { "or", "0srd" }, { "and", "0srd" }, { "xor", "0srd" }, { "add", "0srd" },
+  { "sub", "0srd" }, { "shiftl", "0srd" }, { "shiftr", "0srd" }, { "mult", "0srd" },
+  { "not", "0sd" },
+  { "read", "0nsd" }, { "write", "0nss" }, { "copy", "0nss" },
+  { "push", "0s" }, { "pop", "0d" },
+  { "load32", "0nd" }, { "load", "0nd" }, { "loadhi", "0nx" }, { "addr2reg", "0ld" },
+  { "savpc", "0d" }, { "readintid", "0d" }, { "nop", "0" },
+  { "beq", "1ssn" }, { "bne", "1ssn" }, { "bgt", "1ssn" }, { "bge", "1ssn" },
+  { "bgts", "1ssn" }, { "bges", "1ssn" },
+  { "jumpo", "2n" },
+  { "jump", "3l" },
+  { "jumpr", "4ns" }, { "jumpro", "4ns" }, { "halt", "4" }, { "reti", "4" },
+  { NULL, NULL }
+};
+
+// Returns the operand format of the instruction in GenWords, or NULL if it is unknown
+STATIC
+char* GenPeepFormat(void)
+{
+  int i;
+  for (i = 0; GenPeepInstrs[i][0]; i++)
+    if (!strcmp(GenWords[0], GenPeepInstrs[i][0]))
+      break;
+  return GenPeepInstrs[i][1];
+}
+
+// Writes the instruction in GenWords (n words) to p
+STATIC
+void GenPeepJoin(char* p, int n)
+{
+  int i;
+  *p = '\0';
+  for (i = 0; i < n; i++)
+    p += sprintf(p, " %s", GenWords[i]);
+}
+
+// Finds the registers that are read and written by the instruction in GenWords (n words)
+// Returns the PEEP_* class of the instruction, or -1 if it is unknown
+STATIC
+int GenPeepRegs(int n, unsigned* rd, unsigned* wr)
+{
+  char* f = GenPeepFormat();
+  int i, r;
+
+  *rd = *wr = 0;
+  if (!f || n != (int)strlen(f))
+    return -1;
+
+  for (i = 1; i < n; i++)
+  {
+    r = GenWordReg(GenWords[i]);
+    switch (f[i])
+    {
+    case 's':
+    case 'd':
+    case 'x':
+      if (r < 0)
+        return -1;
+      if (f[i] != 'd')
+        *rd |= 1u << r;
+      if (f[i] != 's')
+        *wr |= 1u << r;
+      break;
+    case 'r':
+      if (r >= 0)
+      {
+        *rd |= 1u << r;
+        break;
+      }
+      // fallthrough
+    case 'n':
+      if (!GenWordNum(GenWords[i]))
+        return -1;
+      break;
+    }
+  }
+
+  // r0 is always 0
+  *rd &= ~1u;
+  *wr &= ~1u;
+  return f[0] - '0';
+}
+
+// Returns the PEEP_* class of an instruction line (and splits it into GenWords)
+STATIC
+int GenPeepSplit(int i, unsigned* rd, unsigned* wr)
+{
+  return GenPeepRegs(GenSplitLine(GenFxnLines[i]), rd, wr);
+}
+
+// Returns if a buffered line is a label
+STATIC
+int GenPeepIsLabel(int i)
+{
+  char* p = GenFxnLines[i];
+
+  if (!p || GenPeepSize[i])
+    return 0;
+  while (*p == ' ' || *p == '\t')
+    p++;
+  if (*p == '.' || *p == ';' || *p == '\0')
+    return 0;
+  while (*p && *p != ' ' && *p != '\t' && *p != ';')
+    p++;
+  return p[-1] == ':';
+}
+
+// Returns the line of a label in the code of the function, or -1
+STATIC
+int GenPeepFindLabel(char* name)
+{
+  size_t len = strlen(name);
+  int i;
+
+  if (strncmp(name, "Label_", 6))
+    return -1;
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    char* p = GenFxnLines[i];
+    if (!GenPeepIsLabel(i))
+      continue;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (!strncmp(p, name, len) && p[len] == ':')
+      return i;
+  }
+  return -1;
+}
+
+// Returns the line of the next instruction
+STATIC
+int GenPeepNext(int i)
+{
+  while (++i < GenFxnLineCnt && GenPeepSize[i] <= 0)
+    ;
+  return i;
+}
+
+// Returns the line of the previous instruction, or -1
+STATIC
+int GenPeepPrev(int i)
+{
+  while (--i >= 0 && GenPeepSize[i] <= 0)
+    ;
+  return i;
+}
+
+// Returns if there is a label in lines a+1 through b
+STATIC
+int GenPeepLabels(int a, int b)
+{
+  while (++a <= b)
+    if (GenPeepIsLabel(a))
+      return 1;
+  return 0;
+}
+
+// Returns if lines a+1 through b can be reached other than from line a
+// (through a label or as the target of a relative branch)
+STATIC
+int GenPeepEntry(int a, int b)
+{
+  int i;
+  for (i = a + 1; i <= b; i++)
+    if (GenPeepTargetCnt[i])
+      return 1;
+  return GenPeepLabels(a, b);
+}
+
+// Returns the size of the code in lines a through b-1
+STATIC
+int GenPeepDist(int a, int b)
+{
+  int size = 0;
+  for (; a < b; a++)
+    if (GenPeepSize[a] > 0)
+      size += GenPeepSize[a];
+  return size;
+}
+
+STATIC
+void GenPeepSetTarget(int i, int target)
+{
+  if (GenPeepTarget[i] >= 0)
+    GenPeepTargetCnt[GenPeepTarget[i]]--;
+  GenPeepTarget[i] = target;
+  if (target >= 0)
+    GenPeepTargetCnt[target]++;
+}
+
+STATIC
+void GenPeepDelete(int i)
+{
+  GenPeepSetTarget(i, -1);
+  GenFxnLines[i] = NULL;
+  GenPeepSize[i] = 0;
+}
+
+// Returns space for a rewritten line, or NULL if there is none left
+STATIC
+char* GenPeepNewLine(void)
+{
+  if (GenPeepTextMax - GenPeepTextLen < MAX_LINE_WORDS * MAX_WORD_LEN + 8)
+    return NULL;
+  return GenPeepText + GenPeepTextLen;
+}
+
+STATIC
+void GenPeepSetLine(int i, char* p)
+{
+  GenFxnLines[i] = p;
+  GenPeepTextLen += strlen(p) + 1;
+}
+
+// Writes the branch in GenWords with the inverted condition to p
+// (the offset is written when the body is written out)
+STATIC
+void GenPeepInvert(char* p)
+{
+  char* w = GenWords[0];
+
+  if (!strcmp(w, "beq") || !strcmp(w, "bne"))
+    sprintf(p, " %s %s %s 0", (w[1] == 'e') ? "bne" : "beq", GenWords[1], GenWords[2]);
+  else // a > b is !(b >= a), a >= b is !(b > a)
+    sprintf(p, " %s%s %s %s 0", (w[2] == 'e') ? "bgt" : "bge", w + 3, GenWords[2], GenWords[1]);
+}
+
+// Returns if the jump in line i is a function call
+STATIC
+int GenPeepIsCall(int i)
+{
+  unsigned rd, wr;
+
+  if ((i = GenPeepPrev(i)) < 0 || GenPeepSplit(i, &rd, &wr) != PEEP_OTHER)
+    return 0;
+  return !strcmp(GenWords[0], "add") && !strcmp(GenWords[1], "r15") &&
+         !strcmp(GenWords[2], "3") && !strcmp(GenWords[3], "r15");
+}
+
+// Returns if register r is not needed at the end of the function. The epilog needs
+// the return value (unless the function returns void) and the frame, stack and
+// return address registers, and restores the register variables
+STATIC
+int GenPeepDeadAtEnd(int r)
+{
+  int j;
+  for (j = 0; j < MAX_REG_VARS; j++)
+    if (GenRegVars[j] == r && !GenRegVarOfs[j])
+      return 0;
+  if (r == B322OpRegV0)
+    return CurFxnReturnExprTypeSynPtr >= 0 &&
+           SyntaxStack0[CurFxnReturnExprTypeSynPtr] == tokVoid && !IsMain;
+  return r < B322OpRegSp;
+}
+
+// Finds the registers that may be read somewhere in the function
+STATIC
+void GenPeepFindReads(void)
+{
+  unsigned rd, wr;
+  int i, cls;
+
+  GenPeepReads = 0;
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    if (GenPeepSize[i] <= 0)
+      continue;
+    cls = GenPeepSplit(i, &rd, &wr);
+    GenPeepReads |= rd;
+    if (cls == PEEP_JUMP && GenPeepFindLabel(GenWords[1]) < 0)
+    {
+      // A function call reads the arguments, anything else may read anything
+      if (GenPeepIsCall(i))
+        GenPeepReads |= 0xFu << B322OpRegA0;
+      else
+        GenPeepReads = ~0u;
+    }
+  }
+}
+
+// Returns if register r is written before it is read on all the paths from line i
+STATIC
+int GenPeepDead(int i, int r, int depth)
+{
+  int steps = 0;
+  unsigned rd, wr;
+  int cls;
+
+  if (depth > PEEP_MAX_DEPTH)
+    return 0;
+
+  // Not read anywhere
+  if (!((GenPeepReads >> r) & 1) && GenPeepDeadAtEnd(r))
+    return 1;
+
+  for (; steps < PEEP_MAX_STEPS; i++)
+  {
+    if (i >= GenFxnLineCnt)
+      return GenPeepDeadAtEnd(r);
+    if (GenPeepSize[i] <= 0)
+      continue;
+    steps++;
+
+    cls = GenPeepSplit(i, &rd, &wr);
+    if (cls < 0 || (rd >> r) & 1)
+      return 0;
+    if (cls == PEEP_BRANCH)
+    {
+      if (!GenPeepDead(GenPeepTarget[i], r, depth + 1))
+        return 0;
+      continue;
+    }
+    if ((wr >> r) & 1)
+      return 1;
+    if (cls == PEEP_JUMPO)
+    {
+      i = GenPeepTarget[i] - 1;
+    }
+    else if (cls == PEEP_JUMP)
+    {
+      int label = GenPeepFindLabel(GenWords[1]);
+      if (label < 0)
+      {
+        // A function call (savpc r15, add r15 3 r15, jump f) reads the arguments and keeps
+        // the register variables, the other registers are changed by the callee
+        return GenPeepIsCall(i) && r < B322OpRegSp && r != B322OpRegV1 && r != B322OpRegT2 &&
+               (r < B322OpRegA0 || r > B322OpRegA3);
+      }
+      i = label;
+    }
+    else if (cls == PEEP_STOP)
+    {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+// bXX a b 2 + jump Label_N -> inverted bXX a b to Label_N
+STATIC
+int GenPeepFoldJump(int i)
+{
+  unsigned rd, wr;
+  int j, label;
+  char* p;
+
+  // (the target may be a line that has been deleted)
+  j = GenPeepNext(i);
+  if (j >= GenFxnLineCnt || GenPeepTarget[i] <= j ||
+      GenPeepNext(GenPeepTarget[i] - 1) != GenPeepNext(j) || GenPeepEntry(i, j))
+    return 0;
+  if (GenPeepSplit(j, &rd, &wr) != PEEP_JUMP)
+    return 0;
+  label = GenPeepFindLabel(GenWords[1]);
+  if (label <= j || GenPeepDist(i, label) - GenPeepSize[j] > 0xFFFF)
+    return 0;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_BRANCH || !(p = GenPeepNewLine()))
+    return 0;
+  GenPeepInvert(p);
+  GenPeepSetLine(i, p);
+  GenPeepSetTarget(i, label);
+  GenPeepDelete(j);
+  return 1;
+}
+
+// bXX a b 3 + load32 0/1 rD + jumpo 2 + load32 1/0 rD + beq/bne rD r0 ofs
+// -> bXX a b ofs (or inverted), if rD is dead afterwards
+STATIC
+int GenPeepFoldSetTest(int i)
+{
+  unsigned rd, wr;
+  int l[5], k, d, v0, v1, target, taken;
+  char* p;
+
+  for (l[0] = i, k = 1; k < 5; k++)
+    if ((l[k] = GenPeepNext(l[k - 1])) >= GenFxnLineCnt)
+      return 0;
+  if (GenPeepTarget[l[0]] != l[3] || GenPeepTarget[l[2]] != l[4] ||
+      GenPeepEntry(l[0], l[2]) || GenPeepLabels(l[2], l[4]) ||
+      GenPeepTargetCnt[l[3]] != 1 || GenPeepTargetCnt[l[4]] != 1)
+    return 0;
+  for (k = l[2] + 1; k < l[4]; k++)
+    if (k != l[3] && GenPeepTargetCnt[k])
+      return 0;
+
+  if (GenPeepSplit(l[1], &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "load32") ||
+      (strcmp(GenWords[1], "0") && strcmp(GenWords[1], "1")))
+    return 0;
+  v0 = GenWords[1][0] - '0';
+  d = GenWordReg(GenWords[2]);
+  if (GenPeepSplit(l[3], &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "load32") ||
+      GenWordReg(GenWords[2]) != d || (GenWords[1][0] - '0') != !v0 || GenWords[1][1])
+    return 0;
+  v1 = !v0; // value when the first branch is taken
+  if (GenPeepSplit(l[2], &rd, &wr) != PEEP_JUMPO)
+    return 0;
+  if (GenPeepSplit(l[4], &rd, &wr) != PEEP_BRANCH || rd != (1u << d) ||
+      (strcmp(GenWords[0], "beq") && strcmp(GenWords[0], "bne")))
+    return 0;
+  taken = (GenWords[0][1] == 'e') ? !v1 : v1; // if the first branch is taken, is the second one?
+  target = GenPeepTarget[l[4]];
+
+  if (!GenPeepDead(l[4] + 1, d, 0) || !GenPeepDead(target, d, 0))
+    return 0;
+
+  if (GenPeepSplit(l[0], &rd, &wr) != PEEP_BRANCH || !(p = GenPeepNewLine()))
+    return 0;
+  if (taken)
+    sprintf(p, " %s %s %s 0", GenWords[0], GenWords[1], GenWords[2]);
+  else
+    GenPeepInvert(p);
+  GenPeepSetLine(l[0], p);
+  GenPeepSetTarget(l[0], target);
+  for (k = 1; k < 5; k++)
+    GenPeepDelete(l[k]);
+  return 1;
+}
+
+// Removes a jump to the next instruction
+STATIC
+int GenPeepJumpNext(int i)
+{
+  unsigned rd, wr;
+  int label;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_JUMP)
+    return 0;
+  label = GenPeepFindLabel(GenWords[1]);
+  if (label <= i || label > GenPeepNext(i))
+    return 0;
+  GenPeepDelete(i);
+  return 1;
+}
+
+// write/read ofs r14 rV + ... + read ofs r14 rD -> or r0 rV rD
+STATIC
+int GenPeepForward(int i)
+{
+  unsigned rd, wr;
+  int j, v, ofs, steps;
+  char* p;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER ||
+      (strcmp(GenWords[0], "read") && strcmp(GenWords[0], "write")) ||
+      GenWordReg(GenWords[2]) != B322OpRegFp)
+    return 0;
+  ofs = atoi(GenWords[1]);
+  v = GenWordReg(GenWords[3]);
+  if (v == B322OpRegFp || !v)
+    return 0;
+
+  for (steps = 0; steps < 8; steps++, i = j)
+  {
+    j = GenPeepNext(i);
+    if (j >= GenFxnLineCnt || GenPeepEntry(i, j) || GenPeepSplit(j, &rd, &wr) != PEEP_OTHER)
+      return 0;
+    if (!strcmp(GenWords[0], "read") && GenWordReg(GenWords[2]) == B322OpRegFp && atoi(GenWords[1]) == ofs)
+    {
+      if (GenWordReg(GenWords[3]) == v)
+      {
+        GenPeepDelete(j);
+        return 1;
+      }
+      if (!(p = GenPeepNewLine()))
+        return 0;
+      sprintf(p, " or r0 r%d %s", v, GenWords[3]);
+      GenPeepSetLine(j, p);
+      GenPeepReads |= 1u << v;
+      return 1;
+    }
+    // The slot may change through another write (except to another slot)
+    if (!strcmp(GenWords[0], "copy") ||
+        (!strcmp(GenWords[0], "write") &&
+         (GenWordReg(GenWords[2]) != B322OpRegFp || atoi(GenWords[1]) == ofs)))
+      return 0;
+    if ((wr >> v) & 1 || (wr >> B322OpRegFp) & 1)
+      return 0;
+  }
+  return 0;
+}
+
+// or r0 rA rB: removed if rB is dead, or merged into the instruction that computed rA
+STATIC
+int GenPeepMove(int i)
+{
+  unsigned rd, wr;
+  int a, b, j, n;
+  char* p;
+  char* f;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "or") ||
+      GenWordReg(GenWords[1]) != 0 || (a = GenWordReg(GenWords[2])) < 0)
+    return 0;
+  b = GenWordReg(GenWords[3]);
+
+  if (a == b || (b < B322OpRegSp && GenPeepDead(i + 1, b, 0)))
+  {
+    GenPeepDelete(i);
+    return 1;
+  }
+
+  // Let the previous instruction write rB instead of rA
+  if (!a || (j = GenPeepPrev(i)) < 0 || GenPeepEntry(j, i))
+    return 0;
+  if (GenPeepSplit(j, &rd, &wr) != PEEP_OTHER || wr != (1u << a))
+    return 0;
+  f = GenPeepFormat();
+  n = strlen(f);
+  if (f[n - 1] != 'd' || !strcmp(GenWords[0], "savpc") || !(p = GenPeepNewLine()))
+    return 0;
+  if (!GenPeepDead(i + 1, a, 0))
+    return 0;
+
+  GenPeepSplit(j, &rd, &wr);
+  sprintf(GenWords[n - 1], "r%d", b);
+  GenPeepJoin(p, n);
+  GenPeepSetLine(j, p);
+  GenPeepDelete(i);
+  return 1;
+}
+
+// Returns if register r is dead after the instruction in line j
+STATIC
+int GenPeepDeadAfter(int j, int r)
+{
+  unsigned rd, wr;
+  int cls = GenPeepSplit(j, &rd, &wr);
+
+  if (cls == PEEP_BRANCH)
+    return GenPeepDead(j + 1, r, 0) && GenPeepDead(GenPeepTarget[j], r, 0);
+  if (cls != PEEP_OTHER)
+    return 0;
+  return (wr >> r) & 1 || GenPeepDead(j + 1, r, 0);
+}
+
+// or r0 rA rB + an instruction that reads rB (which dies there) -> the instruction reads rA
+// (there may be a few instructions in between that leave rA and rB alone)
+STATIC
+int GenPeepPropagate(int i)
+{
+  unsigned rd, wr;
+  int a, b, j, k, n, cls;
+  char* p;
+  char* f;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "or") ||
+      GenWordReg(GenWords[1]) != 0 || (a = GenWordReg(GenWords[2])) < 0)
+    return 0;
+  b = GenWordReg(GenWords[3]);
+  if (b >= B322OpRegSp)
+    return 0;
+
+  // Find the instruction that reads rB, skipping a few that don't change rA or rB
+  for (k = 0, j = i; ; k++)
+  {
+    int prev = j;
+    j = GenPeepNext(j);
+    if (k == 4 || j >= GenFxnLineCnt || GenPeepEntry(prev, j))
+      return 0;
+    cls = GenPeepSplit(j, &rd, &wr);
+    if ((rd >> b) & 1)
+      break;
+    if (cls != PEEP_OTHER || (wr >> a) & 1 || (wr >> b) & 1)
+      return 0;
+  }
+  if (!GenPeepDeadAfter(j, b))
+    return 0;
+
+  cls = GenPeepSplit(j, &rd, &wr);
+  if ((cls != PEEP_OTHER && cls != PEEP_BRANCH) || !((rd >> b) & 1) || !(p = GenPeepNewLine()))
+    return 0;
+  f = GenPeepFormat();
+  n = strlen(f);
+  for (k = 1; k < n; k++)
+  {
+    if (GenWordReg(GenWords[k]) != b)
+      continue;
+    if (f[k] == 'x')
+      return 0;
+    if (f[k] != 'd')
+      sprintf(GenWords[k], "r%d", a);
+  }
+
+  GenPeepJoin(p, n);
+  GenPeepSetLine(j, p);
+  GenPeepDelete(i);
+  return 1;
+}
+
+// load32 C rX + ALU instruction that reads rX (which dies there) -> the instruction uses C
+STATIC
+int GenPeepFoldConst(int i)
+{
+  unsigned rd, wr;
+  int c, x, j;
+  char* p;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "load32"))
+    return 0;
+  c = atoi(GenWords[1]);
+  x = GenWordReg(GenWords[2]);
+  if (c < 0 || c > 2047 || (j = GenPeepNext(i)) >= GenFxnLineCnt || GenPeepEntry(i, j) ||
+      !GenPeepDeadAfter(j, x))
+    return 0;
+
+  if (GenPeepSplit(j, &rd, &wr) != PEEP_OTHER || strcmp(GenPeepFormat(), "0srd") ||
+      !(p = GenPeepNewLine()))
+    return 0;
+  if (GenWordReg(GenWords[2]) == x && GenWordReg(GenWords[1]) != x)
+  {
+    sprintf(GenWords[2], "%d", c);
+  }
+  else if (GenWordReg(GenWords[1]) == x && GenWordReg(GenWords[2]) >= 0 &&
+           GenWordReg(GenWords[2]) != x &&
+           (!strcmp(GenWords[0], "add") || !strcmp(GenWords[0], "mult") || !strcmp(GenWords[0], "or") ||
+            !strcmp(GenWords[0], "and") || !strcmp(GenWords[0], "xor")))
+  {
+    strcpy(GenWords[1], GenWords[2]);
+    sprintf(GenWords[2], "%d", c);
+  }
+  else
+  {
+    return 0;
+  }
+
+  GenPeepJoin(p, 4);
+  GenPeepSetLine(j, p);
+  GenPeepDelete(i);
+  return 1;
+}
+
+// Removes load32 of constants that are already in the register
+STATIC
+int GenPeepConsts(void)
+{
+  unsigned known = 1, rd, wr;
+  int val[16];
+  int i, cls, changed = 0;
+
+  val[0] = 0;
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    if (GenPeepTargetCnt[i] || GenPeepIsLabel(i))
+      known = 1;
+    if (GenPeepSize[i] <= 0)
+      continue;
+
+    cls = GenPeepSplit(i, &rd, &wr);
+    if (!strcmp(GenWords[0], "load32"))
+    {
+      int r = GenWordReg(GenWords[2]);
+      int v = atoi(GenWords[1]);
+      if ((known >> r) & 1 && val[r] == v)
+      {
+        GenPeepDelete(i);
+        changed = 1;
+        continue;
+      }
+      known |= 1u << r;
+      val[r] = v;
+      continue;
+    }
+
+    known &= ~wr;
+    if (cls != PEEP_OTHER && cls != PEEP_BRANCH)
+    {
+      known = 1;
+    }
+    else if (!strcmp(GenWords[0], "or") && wr)
+    {
+      // Move (or r0 rA rB)
+      int a = GenWordReg(GenWords[1]);
+      int b = GenWordReg(GenWords[2]);
+      if (!a && b >= 0 && (known >> b) & 1)
+      {
+        a = GenWordReg(GenWords[3]);
+        known |= 1u << a;
+        val[a] = val[b];
+      }
+    }
+  }
+  return changed;
+}
+
+// Removes an instruction whose result is not used
+STATIC
+int GenPeepDeadCode(int i)
+{
+  unsigned rd, wr;
+  int d;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER || !wr || (wr & (wr - 1)) ||
+      !strcmp(GenWords[0], "read") || !strcmp(GenWords[0], "pop") ||
+      !strcmp(GenWords[0], "savpc") || !strcmp(GenWords[0], "readintid"))
+    return 0;
+  for (d = 0; !((wr >> d) & 1); d++)
+    ;
+  if (d >= B322OpRegSp || !GenPeepDead(i + 1, d, 0))
+    return 0;
+  GenPeepDelete(i);
+  return 1;
+}
+
+// add/sub rA N rT + read/write ofs rT rX (rT dies there) -> read/write ofs+N rA rX
+STATIC
+int GenPeepFoldOffset(int i)
+{
+  unsigned rd, wr;
+  int a, t, n, j, ofs;
+  char* p;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER ||
+      (strcmp(GenWords[0], "add") && strcmp(GenWords[0], "sub")) ||
+      (a = GenWordReg(GenWords[1])) < 0 || !GenWordNum(GenWords[2]))
+    return 0;
+  n = (GenWords[0][0] == 's') ? -atoi(GenWords[2]) : atoi(GenWords[2]);
+  t = GenWordReg(GenWords[3]);
+  if ((j = GenPeepNext(i)) >= GenFxnLineCnt || GenPeepEntry(i, j) || !GenPeepDeadAfter(j, t))
+    return 0;
+
+  if (GenPeepSplit(j, &rd, &wr) != PEEP_OTHER ||
+      (strcmp(GenWords[0], "read") && strcmp(GenWords[0], "write")) ||
+      GenWordReg(GenWords[2]) != t || (GenWords[0][0] == 'w' && GenWordReg(GenWords[3]) == t))
+    return 0;
+  ofs = atoi(GenWords[1]) + n;
+  if (ofs < -0xFFFF || ofs > 0xFFFF || !(p = GenPeepNewLine()))
+    return 0;
+  sprintf(p, " %s %d r%d %s", GenWords[0], ofs, a, GenWords[3]);
+  GenPeepSetLine(j, p);
+  GenPeepDelete(i);
+  return 1;
+}
+
+// read ofs rA rT + write ofs rB rT (rT dies there) -> copy ofs rA rB
+STATIC
+int GenPeepCopy(int i)
+{
+  unsigned rd, wr;
+  int a, t, j, ofs;
+  char* p;
+
+  if (GenPeepSplit(i, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "read"))
+    return 0;
+  ofs = atoi(GenWords[1]);
+  a = GenWordReg(GenWords[2]);
+  t = GenWordReg(GenWords[3]);
+  if ((j = GenPeepNext(i)) >= GenFxnLineCnt || GenPeepEntry(i, j) || !GenPeepDeadAfter(j, t))
+    return 0;
+
+  if (GenPeepSplit(j, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "write") ||
+      atoi(GenWords[1]) != ofs || GenWordReg(GenWords[3]) != t || GenWordReg(GenWords[2]) == t ||
+      !(p = GenPeepNewLine()))
+    return 0;
+  sprintf(p, " copy %d r%d %s", ofs, a, GenWords[2]);
+  GenPeepSetLine(j, p);
+  GenPeepDelete(i);
+  return 1;
+}
+
+/*
+  Induction variables (part of -O)
+
+  A loop here is the code from a label down to a jump back to it, which can only be
+  entered by falling into the label and which has no calls. A register that the loop
+  only changes by adding or subtracting a constant is an induction variable i.
+  Addresses computed in the loop as base + ((i + K) << k), where the base is a register
+  that the loop doesn't change or the address of a symbol, are taken from a pointer
+  register instead. The pointer is set to base + (i << k) before the loop and is stepped
+  right after i, K << k goes into the read/write offset. A pointer register must not be
+  used in the loop and must be dead where the loop is left.
+*/
+
+#define MAX_LOOP_LABELS 32
+#define MAX_LOOP_EXITS  32
+#define MAX_IND_PTRS    4
+#define MAX_IND_ADDRS   16
+
+int GenLoopExits[MAX_LOOP_EXITS]; // lines outside of the loop that it jumps to
+int GenLoopExitCnt;
+
+// Inserts n empty lines before line at
+STATIC
+void GenPeepInsert(int at, int n)
+{
+  int i, cnt = GenFxnLineCnt + n;
+
+  if (!(GenFxnLines = realloc(GenFxnLines, (cnt + 1) * sizeof(char*))) ||
+      !(GenPeepTarget = realloc(GenPeepTarget, (cnt + 1) * sizeof(int))) ||
+      !(GenPeepTargetCnt = realloc(GenPeepTargetCnt, (cnt + 1) * sizeof(int))) ||
+      !(GenPeepSize = realloc(GenPeepSize, (cnt + 1) * sizeof(int))))
+    error("Out of memory\n");
+
+  for (i = GenFxnLineCnt - 1; i >= at; i--)
+  {
+    GenFxnLines[i + n] = GenFxnLines[i];
+    GenPeepTarget[i + n] = GenPeepTarget[i];
+    GenPeepTargetCnt[i + n] = GenPeepTargetCnt[i];
+    GenPeepSize[i + n] = GenPeepSize[i];
+  }
+  for (i = at; i < at + n; i++)
+  {
+    GenFxnLines[i] = NULL;
+    GenPeepTarget[i] = -1;
+    GenPeepTargetCnt[i] = 0;
+    GenPeepSize[i] = 0;
+  }
+  GenFxnLineCnt = cnt;
+
+  for (i = 0; i < cnt; i++)
+    if (GenPeepTarget[i] >= at)
+      GenPeepTarget[i] += n;
+}
+
+// Puts an instruction into an empty line (there must be space for it)
+STATIC
+void GenPeepPutLine(int i, char* line)
+{
+  char* p = GenPeepNewLine();
+
+  strcpy(p, line);
+  GenPeepSetLine(i, p);
+  GenPeepSize[i] = strncmp(line, " addr2reg", 9) ? 1 : 2;
+}
+
+// Returns the number of the label in line i (Label_N:), or -1
+STATIC
+int GenPeepLabelNum(int i)
+{
+  char* p = GenFxnLines[i];
+
+  if (!GenPeepIsLabel(i))
+    return -1;
+  while (*p == ' ' || *p == '\t')
+    p++;
+  if (strncmp(p, "Label_", 6) || !isdigit(p[6]))
+    return -1;
+  return atoi(p + 6);
+}
+
+// Returns if lines h+1 through e can be reached from outside of lines h through e
+STATIC
+int GenPeepLoopEntries(int h, int e)
+{
+  int labels[MAX_LOOP_LABELS];
+  int i, k, n, cnt = 0;
+
+  for (i = h; i <= e; i++)
+  {
+    if (!GenPeepIsLabel(i))
+      continue;
+    if ((n = GenPeepLabelNum(i)) < 0 || cnt == MAX_LOOP_LABELS)
+      return 1;
+    labels[cnt++] = n;
+  }
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    char* p = GenFxnLines[i];
+    if (!p || (i >= h && i <= e) || GenPeepIsLabel(i))
+      continue;
+    if (GenPeepTarget[i] >= h && GenPeepTarget[i] <= e)
+      return 1;
+    for (; *p; p++)
+    {
+      if (strncmp(p, "Label_", 6))
+        continue;
+      n = atoi(p += 6);
+      for (k = 0; k < cnt; k++)
+        if (labels[k] == n)
+          return 1;
+    }
+  }
+  return 0;
+}
+
+// Finds the registers used and the number of writes to each register in lines h through e
+// and where the loop is left to. Returns 0 if the loop has calls or anything unusual.
+STATIC
+int GenPeepLoopScan(int h, int e, unsigned* used, int* writes)
+{
+  unsigned rd, wr;
+  int i, k, r, cls, target;
+
+  *used = 0;
+  for (r = 0; r < 16; r++)
+    writes[r] = 0;
+  GenLoopExitCnt = 0;
+
+  for (i = h; i <= e; i++)
+  {
+    if (GenPeepSize[i] <= 0)
+      continue;
+    cls = GenPeepSplit(i, &rd, &wr);
+    if (cls < 0 || cls == PEEP_STOP || !strcmp(GenWords[0], "savpc"))
+      return 0;
+    *used |= rd | wr;
+    for (r = 0; r < 16; r++)
+      writes[r] += (wr >> r) & 1;
+
+    target = -1;
+    if (cls == PEEP_BRANCH || cls == PEEP_JUMPO)
+      target = GenPeepTarget[i];
+    else if (cls == PEEP_JUMP && (target = GenPeepFindLabel(GenWords[1])) < 0)
+      return 0; // a call
+    if (target >= 0 && (target < h || target > e))
+    {
+      for (k = 0; k < GenLoopExitCnt; k++)
+        if (GenLoopExits[k] == target)
+          break;
+      if (k == MAX_LOOP_EXITS)
+        return 0;
+      GenLoopExits[k] = target;
+      GenLoopExitCnt += k == GenLoopExitCnt;
+    }
+  }
+  return 1;
+}
+
+// Returns a register that can hold a pointer in the loop, or -1
+STATIC
+int GenPeepLoopReg(unsigned used, unsigned fxnUsed)
+{
+  static char regs[] = { 1, 9, 8, 12, 11, 7, 6, 5, 4, 2 };
+  int i, k, r;
+
+  for (i = 0; i < (int)sizeof regs; i++)
+  {
+    r = regs[i];
+    if ((used >> r) & 1)
+      continue;
+    if (r != B322OpRegV0 && !((fxnUsed >> r) & 1))
+      return r;
+    for (k = 0; k < GenLoopExitCnt; k++)
+      if (!GenPeepDead(GenLoopExits[k], r, 0))
+        break;
+    if (k == GenLoopExitCnt)
+      return r;
+  }
+  return -1;
+}
+
+// Returns the last line before line i that writes register reg in the same straight piece
+// of code, without changing register r in between, or -1
+STATIC
+int GenPeepWriter(int i, int reg, int r)
+{
+  unsigned rd, wr;
+  int j;
+
+  for (; (j = GenPeepPrev(i)) >= 0 && !GenPeepEntry(j, i); i = j)
+  {
+    if (GenPeepSplit(j, &rd, &wr) != PEEP_OTHER || (wr >> r) & 1)
+      return -1;
+    if ((wr >> reg) & 1)
+      return j;
+  }
+  return -1;
+}
+
+// Checks if register x in line f holds (r + K) << k for induction register r
+STATIC
+int GenPeepIndIndex(int f, int x, int r, int* k, int* K)
+{
+  unsigned rd, wr;
+  int j;
+
+  *k = *K = 0;
+  if (x == r)
+    return 1;
+  if ((j = GenPeepWriter(f, x, r)) < 0)
+    return 0;
+  GenPeepSplit(j, &rd, &wr);
+  if (!strcmp(GenWords[0], "shiftl") && GenWordNum(GenWords[2]) && atoi(GenWords[2]) < 16)
+  {
+    *k = atoi(GenWords[2]);
+    if ((x = GenWordReg(GenWords[1])) == r)
+      return 1;
+    if (x <= 0 || (j = GenPeepWriter(j, x, r)) < 0)
+      return 0;
+    GenPeepSplit(j, &rd, &wr);
+  }
+  if ((strcmp(GenWords[0], "add") && strcmp(GenWords[0], "sub")) ||
+      GenWordReg(GenWords[1]) != r || !GenWordNum(GenWords[2]))
+    return 0;
+  *K = (GenWords[0][0] == 's') ? -atoi(GenWords[2]) : atoi(GenWords[2]);
+  return 1;
+}
+
+// Checks if register b in line f holds a register that the loop doesn't change (*base)
+// or the address of a symbol (*base = -1, the symbol goes into sym)
+STATIC
+int GenPeepIndBase(int f, int b, int r, int* writes, int* base, char* sym)
+{
+  unsigned rd, wr;
+  int j;
+
+  if (b == r)
+    return 0;
+  if (!writes[b])
+  {
+    *base = b;
+    return 1;
+  }
+  if ((j = GenPeepWriter(f, b, r)) < 0)
+    return 0;
+  GenPeepSplit(j, &rd, &wr);
+  if (!strcmp(GenWords[0], "addr2reg"))
+  {
+    *base = -1;
+    strcpy(sym, GenWords[1]);
+    return 1;
+  }
+  if (!strcmp(GenWords[0], "or") && !GenWordReg(GenWords[1]) &&
+      (b = GenWordReg(GenWords[2])) > 0 && b != r && !writes[b])
+  {
+    *base = b;
+    return 1;
+  }
+  return 0;
+}
+
+// Tries to take the addresses computed from induction register r (changed in line inc)
+// in the loop in lines h through e from pointer registers
+// Returns the number of lines inserted
+STATIC
+int GenPeepIndVar(int h, int e, int inc, int r, unsigned used, int* writes)
+{
+  unsigned rd, wr, fxnUsed = 0;
+  int ptrBase[MAX_IND_PTRS], ptrShift[MAX_IND_PTRS], ptrReg[MAX_IND_PTRS], ptrTmp[MAX_IND_PTRS];
+  char ptrSym[MAX_IND_PTRS][MAX_WORD_LEN];
+  int addrLine[MAX_IND_ADDRS], addrPtr[MAX_IND_ADDRS], addrOfs[MAX_IND_ADDRS];
+  int ptrCnt = 0, addrCnt = 0, initCnt = 0;
+  int i, f, k, K, base, step;
+  char sym[MAX_WORD_LEN], line[MAX_LINE_WORDS * MAX_WORD_LEN + 8];
+  char* instr;
+
+  GenPeepSplit(inc, &rd, &wr);
+  instr = (GenWords[0][0] == 's') ? "sub" : "add";
+  step = atoi(GenWords[2]);
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+    if (GenPeepSize[i] > 0)
+    {
+      GenPeepSplit(i, &rd, &wr);
+      fxnUsed |= rd | wr;
+    }
+
+  for (f = h; f <= e && addrCnt < MAX_IND_ADDRS; f++)
+  {
+    unsigned char w[2];
+
+    if (GenPeepSize[f] <= 0 || f == inc ||
+        GenPeepSplit(f, &rd, &wr) != PEEP_OTHER || strcmp(GenWords[0], "add"))
+      continue;
+    w[0] = GenWordReg(GenWords[1]);
+    w[1] = GenWordReg(GenWords[2]);
+    if (w[0] > 15 || w[1] > 15 || !w[0] || !w[1] || w[0] == w[1])
+      continue;
+
+    // Either operand can be the index
+    for (i = 0; i < 2; i++)
+      if (GenPeepIndIndex(f, w[i], r, &k, &K) && GenPeepIndBase(f, w[!i], r, writes, &base, sym))
+        break;
+    if (i == 2 || (K << k) < -2047 || (K << k) > 2047)
+      continue;
+
+    for (i = 0; i < ptrCnt; i++)
+      if (ptrBase[i] == base && ptrShift[i] == k && (base >= 0 || !strcmp(ptrSym[i], sym)))
+        break;
+    if (i == ptrCnt)
+    {
+      if (ptrCnt == MAX_IND_PTRS || (step << k) > 2047 ||
+          (ptrReg[i] = GenPeepLoopReg(used, fxnUsed)) < 0)
+        continue;
+      // The address of a symbol and the shifted index need two registers to set up the pointer
+      ptrTmp[i] = (base < 0 && k) ? GenPeepLoopReg(used | (1u << ptrReg[i]), fxnUsed) : 0;
+      if (ptrTmp[i] < 0)
+        continue;
+      used |= 1u << ptrReg[i];
+      GenPeepReads |= (1u << ptrReg[i]) | (1u << ptrTmp[i]);
+      ptrBase[i] = base;
+      ptrShift[i] = k;
+      strcpy(ptrSym[i], sym);
+      initCnt += ptrTmp[i] ? 3 : (base < 0 || k) ? 2 : 1;
+      ptrCnt++;
+    }
+    addrLine[addrCnt] = f;
+    addrPtr[addrCnt] = i;
+    addrOfs[addrCnt++] = K << k;
+  }
+
+  if (!addrCnt ||
+      GenPeepTextMax - GenPeepTextLen < (addrCnt + initCnt + ptrCnt + 1) * (int)sizeof line)
+    return 0;
+
+  // Take the addresses from the pointers
+  for (i = 0; i < addrCnt; i++)
+  {
+    int p = ptrReg[addrPtr[i]], ofs = addrOfs[i];
+    GenPeepSplit(f = addrLine[i], &rd, &wr);
+    if (!ofs)
+      sprintf(line, " or r0 r%d %s", p, GenWords[3]);
+    else
+      sprintf(line, " %s r%d %d %s", (ofs < 0) ? "sub" : "add", p, (ofs < 0) ? -ofs : ofs, GenWords[3]);
+    GenPeepSetLine(f, strcpy(GenPeepNewLine(), line));
+  }
+
+  // Step the pointers along with the induction variable
+  GenPeepInsert(inc + 1, ptrCnt);
+  for (i = 0; i < ptrCnt; i++)
+  {
+    sprintf(line, " %s r%d %d r%d", instr, ptrReg[i], step << ptrShift[i], ptrReg[i]);
+    GenPeepPutLine(inc + 1 + i, line);
+  }
+
+  // And set them up before the loop
+  GenPeepInsert(h, initCnt);
+  for (f = h, i = 0; i < ptrCnt; i++)
+  {
+    int p = ptrReg[i];
+    if (ptrTmp[i])
+    {
+      sprintf(line, " shiftl r%d %d r%d", r, ptrShift[i], p);
+      GenPeepPutLine(f++, line);
+      sprintf(line, " addr2reg %s r%d", ptrSym[i], ptrTmp[i]);
+      GenPeepPutLine(f++, line);
+      sprintf(line, " add r%d r%d r%d", ptrTmp[i], p, p);
+    }
+    else if (ptrBase[i] < 0)
+    {
+      sprintf(line, " addr2reg %s r%d", ptrSym[i], p);
+      GenPeepPutLine(f++, line);
+      sprintf(line, " add r%d r%d r%d", p, r, p);
+    }
+    else if (ptrShift[i])
+    {
+      sprintf(line, " shiftl r%d %d r%d", r, ptrShift[i], p);
+      GenPeepPutLine(f++, line);
+      sprintf(line, " add r%d r%d r%d", ptrBase[i], p, p);
+    }
+    else
+    {
+      sprintf(line, " add r%d r%d r%d", ptrBase[i], r, p);
+    }
+    GenPeepPutLine(f++, line);
+  }
+
+  return ptrCnt + initCnt;
+}
+
+// Strength-reduces the addresses in the loop ending with the jump back in line e
+// Returns the number of lines inserted
+STATIC
+int GenPeepInduction(int e)
+{
+  unsigned rd, wr, used;
+  int writes[16];
+  int h, i, r, n;
+
+  if (GenPeepSplit(e, &rd, &wr) != PEEP_JUMP || (h = GenPeepFindLabel(GenWords[1])) < 0 || h > e)
+    return 0;
+  if (GenPeepLoopEntries(h, e) || !GenPeepLoopScan(h, e, &used, writes))
+    return 0;
+
+  for (i = h; i <= e; i++)
+  {
+    // add/sub rI N rI
+    if (GenPeepSize[i] <= 0 || GenPeepSplit(i, &rd, &wr) != PEEP_OTHER ||
+        (strcmp(GenWords[0], "add") && strcmp(GenWords[0], "sub")) ||
+        (r = GenWordReg(GenWords[1])) <= 0 || r >= B322OpRegSp ||
+        GenWordReg(GenWords[3]) != r || !GenWordNum(GenWords[2]) || writes[r] != 1)
+      continue;
+    if ((n = GenPeepIndVar(h, e, i, r, used, writes)) > 0)
+      return n;
+  }
+  return 0;
+}
+
+// Prepares the buffered function body for the peephole optimizer
+// Returns 0 if it contains something that is not understood
+STATIC
+int GenPeepInit(void)
+{
+  unsigned rd, wr;
+  int i, k, n, cls, code = 1;
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    char* p = GenFxnLines[i];
+
+    GenPeepTarget[i] = -1;
+    GenPeepTargetCnt[i] = 0;
+    GenPeepSize[i] = 0;
+
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '.')
+    {
+      if (!strncmp(p, ".code", 5))
+        code = 1;
+      else if (!strncmp(p, ".data", 5) || !strncmp(p, ".rdata", 6) || !strncmp(p, ".bss", 4))
+        code = 0;
+      else if (code)
+        return 0; // data in the code
+      GenPeepSize[i] = -1;
+      continue;
+    }
+    if (!code)
+    {
+      GenPeepSize[i] = -1;
+      continue;
+    }
+    if (!(n = GenSplitLine(GenFxnLines[i])))
+      continue;
+    if (GenPeepRegs(n, &rd, &wr) < 0)
+      return 0;
+
+    GenPeepSize[i] = 1;
+    if (!strcmp(GenWords[0], "addr2reg"))
+      GenPeepSize[i] = 2;
+    else if (!strcmp(GenWords[0], "load32") &&
+             (GenWords[1][0] == '-' || strtol(GenWords[1], NULL, 10) > 0xFFFF))
+      GenPeepSize[i] = 2;
+  }
+
+  // Find the targets of the relative branches
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    if (GenPeepSize[i] <= 0)
+      continue;
+    cls = GenPeepSplit(i, &rd, &wr);
+    if (cls != PEEP_BRANCH && cls != PEEP_JUMPO)
+      continue;
+
+    n = atoi(GenWords[cls == PEEP_JUMPO ? 1 : 3]);
+    if (n <= 0)
+      return 0;
+    for (k = i; k < GenFxnLineCnt && n > 0; k++)
+      if (GenPeepSize[k] > 0)
+        n -= GenPeepSize[k];
+    while (k < GenFxnLineCnt && GenPeepSize[k] <= 0)
+      k++;
+    if (n || k >= GenFxnLineCnt)
+      return 0; // into an instruction or out of the body
+    GenPeepSetTarget(i, k);
+  }
+  return 1;
+}
+
+STATIC
+void GenPeephole(void)
+{
+  int i, pass, changed, before, after;
+  int cnt = GenFxnLineCnt + 1;
+
+  GenPeepTarget = malloc(cnt * sizeof(int));
+  GenPeepTargetCnt = malloc(cnt * sizeof(int));
+  GenPeepSize = malloc(cnt * sizeof(int));
+  GenPeepTextMax = cnt * 32 + MAX_LINE_WORDS * MAX_WORD_LEN + 8;
+  GenPeepText = malloc(GenPeepTextMax);
+  GenPeepTextLen = 0;
+  if (!GenPeepTarget || !GenPeepTargetCnt || !GenPeepSize || !GenPeepText)
+    error("Out of memory\n");
+
+  if (!GenPeepInit())
+  {
+    free(GenPeepTarget);
+    GenPeepTarget = NULL;
+    return;
+  }
+
+  before = GenPeepDist(0, GenFxnLineCnt);
+  for (pass = 0; pass < 8; pass++)
+  {
+    changed = 0;
+    GenPeepFindReads();
+    for (i = 0; i < GenFxnLineCnt; i++)
+    {
+      if (GenPeepSize[i] <= 0)
+        continue;
+      changed |= GenPeepFoldSetTest(i) || GenPeepFoldJump(i) || GenPeepJumpNext(i) ||
+                 GenPeepForward(i) || GenPeepMove(i) || GenPeepPropagate(i) ||
+                 GenPeepFoldConst(i) || GenPeepFoldOffset(i) || GenPeepCopy(i) ||
+                 GenPeepDeadCode(i);
+    }
+    changed |= GenPeepConsts();
+    for (i = 0; i < GenFxnLineCnt; i++)
+    {
+      int n;
+      if (GenPeepSize[i] > 0 && (n = GenPeepInduction(i)) > 0)
+      {
+        // The loop is now n lines longer
+        i += n;
+        changed = 1;
+      }
+    }
+    if (!changed)
+      break;
+  }
+  after = GenPeepDist(0, GenFxnLineCnt);
+
+  GenPeepRemovedTotal += before - after;
+  printf("%s(): %d of %d instructions removed\n", CurFxnName, before - after, before);
+}
+
+/*
+  Inlining
+
+  A frameless leaf function takes its arguments in r4-r7, returns its result in r2
+  and only changes registers that every call changes, so a call to it can be replaced
+  by a copy of its body. The bodies of such functions declared inline (up to
+  MAX_INLINE_INSTRS instructions) and, with -O, of all such functions up to
+  MAX_AUTO_INLINE_INSTRS instructions are recorded when they are written out.
+  The calls to them further down the file are expanded with fresh labels, dropping the
+  call sequence and the argument area reserved for the callee. The function itself is
+  still written out for other files and for calls through pointers.
+*/
+
+#define MAX_INLINE_FXNS 256
+#define MAX_INLINE_INSTRS 32
+#define MAX_AUTO_INLINE_INSTRS 8
+#define MAX_INLINE_LABELS 32
+
+char* GenInlineName[MAX_INLINE_FXNS];
+char* GenInlineBody[MAX_INLINE_FXNS]; // instructions and labels, separated by '\n'
+int GenInlineCnt = 0;
+char* GenInlineRec = NULL; // body that is being recorded
+int GenInlineRecLen;
+char* GenInlineText = NULL; // expanded bodies in the current function
+
+// Returns if the (frameless) function that is about to be written out can be inlined
+STATIC
+int GenInlineable(void)
 {
-  GenPrintInstr1Operand(B322InstrJump, 0,
-                        B322OpNumLabel, label);
-}
+  int i, cnt = 0, labels = 0;
 
-extern int GenWreg; // GenWreg is defined below
+  if (!GenFrameless || !(CurFxnInline || GenPeepOpt) || GenInlineCnt >= MAX_INLINE_FXNS)
+    return 0;
 
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    char* l = GenFxnLines[i];
+    if (!l)
+      continue;
+    while (*l == ' ' || *l == '\t')
+      l++;
+    if (*l == '.')
+      return 0; // data
+    if (!strncmp(l, "Label_", 6))
+      labels++;
+    else if (GenSplitLine(l))
+      cnt++;
+  }
+
+  return labels <= MAX_INLINE_LABELS &&
+         cnt <= (CurFxnInline ? MAX_INLINE_INSTRS : MAX_AUTO_INLINE_INSTRS);
+}
+
+// Adds a line that is written out to the recorded body
 STATIC
-void GenJumpIfEqual(int val, int label)
+void GenInlineRecord(char* line)
 {
+  char* l = line;
 
-  GenPrintInstr2Operands(B322InstrLoad, 0,
-                         B322OpConst, val,
-                         TEMP_REG_B, 0);
-  /*
-  GenPrintInstr3Operands(MipsInstrBEQ, 0,
-                         GenWreg, 0,
-                         TEMP_REG_B, 0,
-                         B322OpNumLabel, label);
-  */
-  GenPrintInstr3Operands(B322InstrBne, 0,
-                         GenWreg, 0,
-                         TEMP_REG_B, 0,
-                         B322OpConst, 2);
-  GenPrintInstr1Operand(B322InstrJump, 0,
-                         B322OpNumLabel, label);
+  while (*l == ' ' || *l == '\t')
+    l++;
+  if (*l == ';' || *l == '\0')
+    return;
+  strcpy(GenInlineRec + GenInlineRecLen, line);
+  GenInlineRecLen += strlen(line);
+  GenInlineRec[GenInlineRecLen++] = '\n';
+  GenInlineRec[GenInlineRecLen] = '\0';
 }
 
+// Returns the inline function called by the call sequence at line i, or -1
 STATIC
-void GenJumpIfZero(int label)
+int GenInlineCall(int i)
 {
-#ifndef NO_ANNOTATIONS
-  printf2(" ; JumpIfZero\n");
-#endif
-  /* if Wreg == 0, jump to label
-  GenPrintInstr3Operands(MipsInstrBEQ, 0,
-                         GenWreg, 0,
-                         B322OpRegZero, 0,
-                         B322OpNumLabel, label);
-  */
-  GenPrintInstr3Operands(B322InstrBne, 0,
-                         GenWreg, 0,
-                         B322OpRegZero, 0,
-                         B322OpConst, 2);
-  GenPrintInstr1Operand(B322InstrJump, 0,
-                         B322OpNumLabel, label);
+  int k;
+
+  if (i + 2 >= GenFxnLineCnt ||
+      GenSplitLine(GenFxnLines[i]) != 2 || strcmp(GenWords[0], "savpc") || strcmp(GenWords[1], "r15") ||
+      GenSplitLine(GenFxnLines[i + 1]) != 4 || strcmp(GenWords[0], "add") || strcmp(GenWords[1], "r15") ||
+      strcmp(GenWords[2], "3") || strcmp(GenWords[3], "r15") ||
+      GenSplitLine(GenFxnLines[i + 2]) != 2 || strcmp(GenWords[0], "jump"))
+    return -1;
+
+  for (k = 0; k < GenInlineCnt; k++)
+    if (!strcmp(GenInlineName[k], GenWords[1]))
+      return k;
+  return -1;
 }
 
+// Returns if line i grows (sign 1) or shrinks (sign -1) the stack by 16 (the argument area)
 STATIC
-void GenJumpIfNotZero(int label)
+int GenInlineArgArea(int i, int sign)
 {
-#ifndef NO_ANNOTATIONS
-  printf2(" ; JumpIfNotZero\n");
-#endif
-  /* if Wreg != 0, jump to label
-  GenPrintInstr3Operands(MipsInstrBNE, 0,
-                         GenWreg, 0,
-                         B322OpRegZero, 0,
-                         B322OpNumLabel, label);
-  */
-  GenPrintInstr3Operands(B322InstrBeq, 0,
-                         GenWreg, 0,
-                         B322OpRegZero, 0,
-                         B322OpConst, 2);
-  GenPrintInstr1Operand(B322InstrJump, 0,
-                         B322OpNumLabel, label);
+  return i >= 0 && i < GenFxnLineCnt && GenFxnLines[i] &&
+         GenSplitLine(GenFxnLines[i]) == 4 && !strcmp(GenWords[0], (sign > 0) ? "sub" : "add") &&
+         !strcmp(GenWords[1], "r13") && !strcmp(GenWords[2], "16") && !strcmp(GenWords[3], "r13");
 }
 
-fpos_t GenPrologPos;
-int GenLeaf;
+// Copies an inline function body to p as separate lines with new labels
+// Returns the end of the copy
+STATIC
+char* GenInlineCopy(char* p, char** lines, int* cnt, char* body)
+{
+  int from[MAX_INLINE_LABELS], to[MAX_INLINE_LABELS];
+  int labels = 0, k;
+  char* b;
+
+  // Give the labels of the body new numbers
+  for (b = body; *b; )
+  {
+    if (!strncmp(b, "Label_", 6) && labels < MAX_INLINE_LABELS)
+    {
+      from[labels] = atoi(b + 6);
+      to[labels++] = LabelCnt++;
+    }
+    while (*b && *b++ != '\n')
+      ;
+  }
+
+  lines[(*cnt)++] = p;
+  for (b = body; *b; )
+  {
+    if (*b == '\n')
+    {
+      *p++ = '\0';
+      if (*++b)
+        lines[(*cnt)++] = p;
+    }
+    else if (!strncmp(b, "Label_", 6) && isdigit(b[6]))
+    {
+      int n = atoi(b + 6);
+      for (k = 0; k < labels; k++)
+        if (from[k] == n)
+          n = to[k];
+      p += sprintf(p, "Label_%d", n);
+      b += 6;
+      while (isdigit(*b))
+        b++;
+    }
+    else
+    {
+      *p++ = *b++;
+    }
+  }
+  return p;
+}
 
+// Replaces the calls to the recorded inline functions with copies of their bodies
 STATIC
-void GenWriteFrameSize(void) //WORDSIZE
+void GenInlineCalls(void)
 {
-  unsigned size = 8/*RA + FP*/ - CurFxnMinLocalOfs;
-  //printf2(" subu r13, r13, %10u\n", size); // 10 chars are enough for 32-bit unsigned ints
-  printf2(" sub r13 %10u r13\n", size); // r13 = r13 - size
+  int i, k, j, cnt = 0;
+  size_t size = 0;
+  char** lines;
+  char* p;
 
-  //printf2(" sw r14, %10u r13\n", size - 8);
-  printf2(" write %10u r13 r14\n", size - 8); // write r14 to memory[r13+(size-8)]
-  
-  //printf2(" addu r14, r13, %10u\n", size - 8);
-  printf2(" add r13 %10u r14\n", size - 8); // r14 = r13 + (size-8)
+  for (i = 0; i < GenFxnLineCnt; i++)
+    if ((k = GenInlineCall(i)) >= 0)
+    {
+      // (the new labels can have more digits)
+      size += 2 * strlen(GenInlineBody[k]) + 1;
+      for (p = GenInlineBody[k]; *p; p++)
+        cnt += *p == '\n';
+    }
+  if (!size)
+    return;
+
+  lines = malloc((GenFxnLineCnt + cnt) * sizeof(char*));
+  GenInlineText = p = malloc(size);
+  if (!lines || !p)
+    error("Out of memory\n");
 
-  //printf2(" %csw r15, 4 r14\n", GenLeaf ? ';' : ' ');
-  printf2(" %c write 4 r14 r15\n", GenLeaf ? ';' : ' '); // write r15 to memory[r14+4]
+  for (i = j = 0; i < GenFxnLineCnt; i++)
+  {
+    if ((k = GenInlineCall(i)) < 0)
+    {
+      lines[j++] = GenFxnLines[i];
+      continue;
+    }
+    // The callee doesn't use the area where the arguments in registers would be saved
+    if (j > 0 && GenInlineArgArea(i - 1, 1) && GenInlineArgArea(i + 3, -1))
+    {
+      j--;
+      i++;
+    }
+    p = GenInlineCopy(p, lines, &j, GenInlineBody[k]);
+    i += 2;
+  }
+
+  free(GenFxnLines);
+  GenFxnLines = lines;
+  GenFxnLineCnt = j;
+
+  // The function may not call anything anymore
+  if (!CurFxnAsmUsed)
+  {
+    GenLeaf = 1;
+    for (i = 0; i < GenFxnLineCnt && GenLeaf; i++)
+    {
+      int n = GenSplitLine(GenFxnLines[i]);
+      for (k = 1; k < n && k < MAX_LINE_WORDS; k++)
+        if (GenWordReg(GenWords[k]) == B322OpRegRa)
+          GenLeaf = 0;
+    }
+  }
 }
 
+// Writes the (optimized) function body
 STATIC
-void GenUpdateFrameSize(void)
+void GenWriteFxnBody(void)
 {
-  fpos_t pos;
-  fgetpos(OutFile, &pos);
-  fsetpos(OutFile, &GenPrologPos);
-  GenWriteFrameSize();
-  fsetpos(OutFile, &pos);
+  int i;
+  char buf[MAX_LINE_WORDS * MAX_WORD_LEN + 8];
+
+  for (i = 0; i < GenFxnLineCnt; i++)
+  {
+    char* line = GenFxnLines[i];
+    if (!line)
+      continue;
+    if (GenPeepTarget && GenPeepTarget[i] >= 0)
+    {
+      // Relative branch, write the new offset
+      int n = GenSplitLine(line);
+      int ofs = GenPeepDist(i, GenPeepTarget[i]);
+      if (n == 2)
+        sprintf(buf, " %s %d", GenWords[0], ofs);
+      else
+        sprintf(buf, " %s %s %s %d", GenWords[0], GenWords[1], GenWords[2], ofs);
+      line = buf;
+    }
+    puts2(line);
+    if (GenInlineRec)
+      GenInlineRecord(line);
+  }
+
+  free(GenPeepTarget);
+  free(GenPeepTargetCnt);
+  free(GenPeepSize);
+  free(GenPeepText);
+  GenPeepTarget = NULL;
+  GenPeepTargetCnt = NULL;
+  GenPeepSize = NULL;
+  GenPeepText = NULL;
 }
 
 STATIC
 void GenFxnProlog(void)
 {
+  GenLeaf = 1; // will be reset to 0 if a call is generated
+  GenLocalCnt = 0;
+
+  // Buffer the function body
+  if (OutFile)
+  {
+    if (!GenFxnTmpFile && !(GenFxnTmpFile = tmpfile()))
+      error("Cannot create a temporary file\n");
+    GenFxnOutFile = OutFile;
+    OutFile = GenFxnTmpFile;
+    rewind(OutFile);
+  }
+}
+
+// Returns the current position in the buffered function body or -1 if the body isn't buffered
+STATIC
+long GenGetFxnPos(void)
+{
+  return GenFxnOutFile ? ftell(OutFile) : -1;
+}
+
+// Throws away the code generated since GenGetFxnPos() returned pos
+STATIC
+void GenDropFxnCode(long pos)
+{
+  if (GenFxnOutFile && pos >= 0)
+    fseek(OutFile, pos, SEEK_SET);
+}
+
+STATIC
+void GenWriteFxnProlog(void)
+{
+  int i, j, cnt = 0;
+  int size = 8/*RA + FP*/ - CurFxnMinLocalOfs; //WORDSIZE
+
+  // The parameters and local variables of a frameless function are all in registers
+  if (GenFrameless)
+    return;
+
   if (CurFxnParamCntMin && CurFxnParamCntMax)
   {
-    int i, cnt = CurFxnParamCntMax;
+    cnt = CurFxnParamCntMax;
     if (cnt > 4)
       cnt = 4; //WORDSIZE?
     // TBD!!! for structure passing use the cumulative parameter size
@@ -664,15 +2930,55 @@ void GenFxnProlog(void)
     // all words except the first to the stack). But passing structures
     // in registers from assembly code won't always work.
     for (i = 0; i < cnt; i++)
-      GenPrintInstr2Operands(B322InstrWrite, 0,
-                             B322OpIndRegSp, 4 * i, //WORDSIZE
-                             B322OpRegA0 + i, 0);
+    {
+      j = GenFindSlot(8 + 4 * i); //WORDSIZE
+      if (j < 0 || GenSlotReg[j] <= 0)
+        GenPrintInstr2Operands(B322InstrWrite, 0,
+                               B322OpIndRegSp, 4 * i, //WORDSIZE
+                               B322OpRegA0 + i, 0);
+    }
   }
 
-  GenLeaf = 1; // will be reset to 0 if a call is generated
+  GenPrintInstr3Operands(B322InstrSub, 0,
+                         B322OpRegSp, 0,
+                         B322OpConst, size,
+                         B322OpRegSp, 0);
+  GenPrintInstr2Operands(B322InstrWrite, 0,
+                         B322OpIndRegSp, size - 8,
+                         B322OpRegFp, 0);
+  GenPrintInstr3Operands(B322InstrAdd, 0,
+                         B322OpRegSp, 0,
+                         B322OpConst, size - 8,
+                         B322OpRegFp, 0);
+  if (!GenLeaf)
+    GenPrintInstr2Operands(B322InstrWrite, 0,
+                           B322OpIndRegFp, 4, //WORDSIZE
+                           B322OpRegRa, 0);
 
-  fgetpos(OutFile, &GenPrologPos);
-  GenWriteFrameSize();
+  // Save the callee-saved registers and load the register variables of parameters
+  for (j = 0; j < MAX_REG_VARS; j++)
+    if (GenRegVarOfs[j])
+      GenPrintInstr2Operands(B322InstrWrite, 0,
+                             B322OpIndRegFp, GenRegVarOfs[j],
+                             GenRegVars[j], 0);
+  for (i = 0; i < GenSlotCnt; i++)
+  {
+    int ofs = GenSlotOfs[i];
+    if (GenSlotReg[i] <= 0 || ofs < 8)
+      continue;
+    if (ofs < 8 + 4 * cnt && !(ofs & 3))
+    {
+      if (GenSlotReg[i] != B322OpRegA0 + ((ofs - 8) >> 2))
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                             B322OpRegZero, 0,
+                             B322OpRegA0 + ((ofs - 8) >> 2), 0,
+                             GenSlotReg[i], 0);
+    }
+    else
+      GenPrintInstr2Operands(B322InstrRead, 0,
+                             B322OpIndRegFp, ofs,
+                             GenSlotReg[i], 0);
+  }
 }
 
 STATIC
@@ -700,25 +3006,91 @@ void GenGrowStack(int size) //WORDSIZE
 STATIC
 void GenFxnEpilog(void)
 {
-  GenUpdateFrameSize();
+  int i;
+  clock_t t = clock();
 
-  if (!GenLeaf)
-    GenPrintInstr2Operands(B322InstrRead, 0,
-                           B322OpIndRegFp, 4, //WORDSIZE
-                           B322OpRegRa, 0);
+  // Rewrite the buffered function body and write it out with the prolog and epilog
+  if (GenFxnOutFile)
+  {
+    GenReadFxnBody();
+    OutFile = GenFxnOutFile;
+    GenFxnOutFile = NULL;
+  }
+  else
+  {
+    GenFxnLineCnt = 0;
+  }
+  StatTimeOutput += clock() - t;
+
+  t = clock();
+  if (!CurFxnAsmUsed)
+    GenInlineCalls();
+  GenAllocRegVars();
+  if (GenPeepOpt && !CurFxnAsmUsed)
+    GenPeephole();
+  GenFindFrameless();
+  StatTimeOptimize += clock() - t;
+
+  t = clock();
+  if (GenInlineable())
+  {
+    size_t size = 1;
+    for (i = 0; i < GenFxnLineCnt; i++)
+      if (GenFxnLines[i])
+        size += strlen(GenFxnLines[i]) + 16;
+    if (!(GenInlineRec = malloc(size)))
+      error("Out of memory\n");
+    GenInlineRecLen = 0;
+    *GenInlineRec = '\0';
+  }
+  GenWriteFxnProlog();
+  GenWriteFxnBody();
+  if (GenInlineRec)
+  {
+    if (!(GenInlineName[GenInlineCnt] = malloc(strlen(CurFxnName) + 1)))
+      error("Out of memory\n");
+    strcpy(GenInlineName[GenInlineCnt], CurFxnName);
+    GenInlineBody[GenInlineCnt++] = GenInlineRec;
+    GenInlineRec = NULL;
+  }
+  StatTimeOutput += clock() - t;
 
-  GenPrintInstr2Operands(B322InstrRead, 0,
-                         B322OpIndRegFp, 0,
-                         B322OpRegFp, 0);
+  // Restore the registers and tear down the frame
+  if (!GenFrameless)
+  {
+    for (i = 0; i < MAX_REG_VARS; i++)
+      if (GenRegVarOfs[i])
+        GenPrintInstr2Operands(B322InstrRead, 0,
+                               B322OpIndRegFp, GenRegVarOfs[i],
+                               GenRegVars[i], 0);
+
+    if (!GenLeaf)
+      GenPrintInstr2Operands(B322InstrRead, 0,
+                             B322OpIndRegFp, 4, //WORDSIZE
+                             B322OpRegRa, 0);
 
-  GenPrintInstr3Operands(B322InstrAdd, 0,
-                         B322OpRegSp, 0,
-                         B322OpConst, 8/*RA + FP*/ - CurFxnMinLocalOfs, //WORDSIZE
-                         B322OpRegSp, 0);
+    GenPrintInstr2Operands(B322InstrRead, 0,
+                           B322OpIndRegFp, 0,
+                           B322OpRegFp, 0);
+
+    GenPrintInstr3Operands(B322InstrAdd, 0,
+                           B322OpRegSp, 0,
+                           B322OpConst, 8/*RA + FP*/ - CurFxnMinLocalOfs, //WORDSIZE
+                           B322OpRegSp, 0);
+  }
 
   GenPrintInstr2Operands(B322InstrJumpr, 0,
                         B322OpConst, 0,
                         B322OpRegRa, 0);
+
+  free(GenFxnText);
+  free(GenFxnLines);
+  free(GenFxnNewText);
+  free(GenInlineText);
+  GenFxnText = NULL;
+  GenFxnLines = NULL;
+  GenFxnNewText = NULL;
+  GenInlineText = NULL;
 }
 
 STATIC
@@ -767,14 +3139,11 @@ int GenGetBinaryOperatorInstr(int tok)
   case '%':
   case tokAssignDiv:
   case tokAssignMod:
-    printf("DIVISION/MOD is not supported!\n");
-    return B322InstrHalt;
   case tokUDiv:
   case tokUMod:
   case tokAssignUDiv:
   case tokAssignUMod:
-    printf("DIVISION/MOD is not supported!\n");
-    return B322InstrHalt;
+    return B322InstrNop; // B322 has no divider, see GenDivMod()
   case tokLShift:
   case tokAssignLSh:
     return B322InstrShiftl;
@@ -1249,6 +3618,20 @@ void GenPrep(int* idx)
         stack[oldIdxRight + 1][0] = tok;
       }
     }
+    break;
+  case tokAssignMul:
+    if (stack[oldIdxRight][0] == tokNumInt || stack[oldIdxRight][0] == tokNumUint)
+    {
+      // Change multiplication by a power of 2 to left shift
+      unsigned m = truncUint(stack[oldIdxRight][1]);
+      if (m && !(m & (m - 1)))
+      {
+        t1 = 0;
+        while (m >>= 1) t1++;
+        stack[oldIdxRight][1] = t1;
+        stack[oldIdxRight + 1][0] = tok = tokAssignLSh;
+      }
+    }
   }
 
   switch (tok)
@@ -1262,16 +3645,26 @@ void GenPrep(int* idx)
   case tokLocalOfs:
     break;
 
-  case tokPostAdd:
-  case tokPostSub:
   case '-':
   case '/':
-  case '%':
-  case tokUDiv:
-  case tokUMod:
   case tokLShift:
   case tokRShift:
   case tokURShift:
+    GenPrep(idx);
+    GenPrep(idx);
+    // Drop subtracting 0, shifting by 0 and signed division by 1,
+    // the left operand's value is the result
+    if (stack[oldIdxRight][0] == tokNumInt &&
+        truncUint(stack[oldIdxRight][1]) == (unsigned)(tok == '/'))
+    {
+      stack[oldIdxRight][0] = tokUnaryPlus;
+      stack[oldIdxRight + 1][0] = tokUnaryPlus;
+    }
+    break;
+
+  case '%':
+  case tokUDiv:
+  case tokUMod:
   case tokLogAnd:
   case tokLogOr:
   case tokComma:
@@ -1320,6 +3713,8 @@ void GenPrep(int* idx)
   case tokAssignAnd:
   case tokAssignXor:
   case tokAssignOr:
+  case tokPostAdd:
+  case tokPostSub:
     GenPrep(idx);
     oldIdxLeft = *idx;
     GenPrep(idx);
@@ -1392,12 +3787,23 @@ void GenPrep(int* idx)
       {
       case '*':
         // Change multiplication to left shift, this helps indexing arrays of ints/pointers/etc
-        if (m && !(m & (m - 1)))
+        if (!m || (m & (m - 1)))
+          break;
+        t1 = 0;
+        while (m >>= 1) t1++;
+        stack[oldIdxRight][1] = m = t1;
+        tok = tokLShift;
+        // fallthrough, left * 1 is left << 0
+      case '+':
+      case '^':
+      case '|':
+      case '&':
+        // left + 0, left << 0, left ^ 0, left | 0 and left & 0xFFFFFFFF are just left,
+        // turn the constant and the operator into no-op unary pluses
+        if (m == ((tok == '&') ? 0xFFFFFFFF : 0))
         {
-          t1 = 0;
-          while (m >>= 1) t1++;
-          stack[oldIdxRight][1] = t1;
-          tok = tokLShift;
+          stack[oldIdxRight][0] = tokUnaryPlus;
+          tok = tokUnaryPlus;
         }
         break;
       case tokLEQ:
@@ -1810,23 +4216,201 @@ void GenCmp(int* idx, int op)
     }
   }
 
-  *idx += condbranch != 0;
+  *idx += condbranch != 0;
+}
+
+STATIC
+int GenIsCmp(int t)
+{
+  return
+    t == '<' ||
+    t == '>' ||
+    t == tokGEQ ||
+    t == tokLEQ ||
+    t == tokULess ||
+    t == tokUGreater ||
+    t == tokUGEQ ||
+    t == tokULEQ ||
+    t == tokEQ ||
+    t == tokNEQ;
+}
+
+int DivModUsed = 0; // which division/modulo subroutines are used (1 = signed, 2 = unsigned)
+
+STATIC
+int GenIsModulo(int tok)
+{
+  return tok == '%' || tok == tokUMod || tok == tokAssignMod || tok == tokAssignUMod;
+}
+
+// Calls the (signed or unsigned) division subroutine, which is emitted in GenFin()
+// Takes the dividend in TEMP_REG_A and the divisor in TEMP_REG_B
+// Returns the register with the quotient or remainder (depending on tok)
+// The subroutine returns via the hardware stack (like a syscall), so r15 is not touched
+// and all registers other than AT, TEMP_REG_A and TEMP_REG_B are preserved
+STATIC
+int GenCallDivMod(int tok)
+{
+  int sign = tok == '/' || tok == '%' || tok == tokAssignDiv || tok == tokAssignMod;
+
+  DivModUsed |= sign ? 1 : 2;
+
+  GenPrintInstr1Operand(B322InstrSavpc, 0,
+                        B322OpRegAt, 0);
+  GenPrintInstr1Operand(B322InstrPush, 0,
+                        B322OpRegAt, 0);
+  printf2(" jump %s\n", sign ? "__divmod" : "__udivmod");
+
+  return GenIsModulo(tok) ? TEMP_REG_B : TEMP_REG_A;
+}
+
+// Signed division/modulo of reg by a positive power of 2 (m)
+// Shifting/masking the absolute value keeps rounding towards zero as C requires
+STATIC
+void GenDivModPow2(int tok, int reg, unsigned m)
+{
+  int instr = B322InstrShiftr;
+  int op = B322OpConst;
+  int val = 0;
+
+  if (GenIsModulo(tok))
+  {
+    instr = B322InstrAnd;
+    val = (int)(m - 1);
+    if (m - 1 > 2047)
+    {
+      // Load the mask beforehand, the branch offsets below need single instructions
+      GenPrintInstr2Operands(B322InstrLoad, 0,
+                             B322OpConst, val,
+                             TEMP_REG_B, 0);
+      op = TEMP_REG_B;
+    }
+  }
+  else
+  {
+    while (m >>= 1) val++;
+  }
+
+  GenPrintInstr3Operands(B322InstrBge, 0,
+                         reg, 0,
+                         B322OpRegZero, 0,
+                         B322OpConst, 5);
+  GenPrintInstr3Operands(B322InstrSub, 0,
+                         B322OpRegZero, 0,
+                         reg, 0,
+                         reg, 0);
+  GenPrintInstr3Operands(instr, 0,
+                         reg, 0,
+                         op, val,
+                         reg, 0);
+  GenPrintInstr3Operands(B322InstrSub, 0,
+                         B322OpRegZero, 0,
+                         reg, 0,
+                         reg, 0);
+  GenPrintInstr1Operand(B322InstrJumpo, 0,
+                        B322OpConst, 2);
+  GenPrintInstr3Operands(instr, 0,
+                         reg, 0,
+                         op, val,
+                         reg, 0);
 }
 
+int GenStructCpyCalled = 0; // the structure copy function is needed in GenFin()
+
+// Returns if identifier v is the label of the structure copy function
 STATIC
-int GenIsCmp(int t)
+int GenIsStructCpy(int v)
 {
-  return
-    t == '<' ||
-    t == '>' ||
-    t == tokGEQ ||
-    t == tokLEQ ||
-    t == tokULess ||
-    t == tokUGreater ||
-    t == tokUGEQ ||
-    t == tokULEQ ||
-    t == tokEQ ||
-    t == tokNEQ;
+  return StructCpyLabel && isdigit(IdentTable[v]) && atoi(IdentTable + v) == StructCpyLabel;
+}
+
+// Returns the syntax pointer after the type of the parameter at SynPtr
+// if it is a pointer to char or void, or an integer type if !ptr, -1 otherwise
+STATIC
+int GenMemcpyParam(int SynPtr, int ptr)
+{
+  int t;
+  while (SyntaxStack0[SynPtr] == tokIdent || SyntaxStack0[SynPtr] == tokLocalOfs)
+    SynPtr++;
+  if (ptr && SyntaxStack0[SynPtr++] != '*')
+    return -1;
+  t = SyntaxStack0[SynPtr++];
+  if (ptr && (t == tokVoid || t == tokChar || t == tokSChar || t == tokUChar))
+    return SynPtr;
+  if (!ptr && (t == tokChar || t == tokSChar || t == tokUChar || t == tokShort || t == tokUShort ||
+               t == tokInt || t == tokUnsigned || t == tokLong || t == tokULong))
+    return SynPtr;
+  return -1;
+}
+
+// Returns if identifier v is a function declared like the library memcpy():
+// void or pointer memcpy(char/void* dest, char/void* src, integer n).
+// A char is a word, so it copies n words
+STATIC
+int GenIsLibMemcpy(int v)
+{
+  int synPtr, minParams, maxParams, retSynPtr, paramSynPtr, t;
+
+  if (strcmp(IdentTable + v, "memcpy") ||
+      (synPtr = FindSymbol(IdentTable + v)) < 0 ||
+      SymType(synPtr) != SymFxn ||
+      !GetFxnInfo(synPtr, &minParams, &maxParams, &retSynPtr, &paramSynPtr) ||
+      minParams != 3 || maxParams != 3)
+    return 0;
+
+  if ((paramSynPtr = GenMemcpyParam(paramSynPtr, 1)) < 0 || SyntaxStack0[paramSynPtr] != tokIdent ||
+      (paramSynPtr = GenMemcpyParam(paramSynPtr, 1)) < 0 || SyntaxStack0[paramSynPtr] != tokIdent ||
+      (paramSynPtr = GenMemcpyParam(paramSynPtr, 0)) < 0 || SyntaxStack0[paramSynPtr] != ')')
+    return 0;
+
+  t = SyntaxStack0[retSynPtr];
+  return t == tokVoid || t == '*';
+}
+
+// Generates the call between stack[first] ('(') and stack[last] (')') as copy
+// instructions if it is a structure copy, or with -O a call of the library memcpy()
+// with a constant number of words.
+// The arguments are already in the argument registers (the last one in A0).
+// Returns 0 if it is another call
+STATIC
+int GenCopyCall(int first, int last)
+{
+  int dst, src, cnt, n;
+
+  if (stack[last][1] != 3 * SizeOfWord)
+    return 0;
+
+  if (GenIsStructCpy(stack[last - 1][1]) &&
+      (stack[last - 3][0] == tokNumInt || stack[last - 3][0] == tokNumUint) && stack[last - 2][0] == ',')
+  {
+    // fxn(size, src, dst)
+    n = stack[last - 3][1];
+    dst = B322OpRegA2;
+    src = B322OpRegA1;
+    cnt = B322OpRegA0;
+  }
+  else if (GenPeepOpt &&
+           (stack[first + 1][0] == tokNumInt || stack[first + 1][0] == tokNumUint) && stack[first + 2][0] == ',' &&
+           GenIsLibMemcpy(stack[last - 1][1]))
+  {
+    // memcpy(dst, src, n)
+    n = stack[first + 1][1];
+    dst = B322OpRegA0;
+    src = B322OpRegA1;
+    cnt = B322OpRegA2;
+  }
+  else
+  {
+    return 0;
+  }
+
+  // Both return the destination
+  GenPrintInstr3Operands(B322InstrOr, 0,
+                         B322OpRegZero, 0,
+                         dst, 0,
+                         GenWreg, 0);
+  GenCopyWords(dst, src, cnt, n);
+  return 1;
 }
 
 // Improved register/stack-based code generator
@@ -1839,10 +4423,24 @@ void GenExpr0(void)
   int maxCallDepth = 0;
   int callDepth = 0;
   int paramOfs = 0;
+  int callIdx = 0;
   int t = sp - 1;
 
   if (stack[t][0] == tokIf || stack[t][0] == tokIfNot || stack[t][0] == tokReturn)
+  {
     t--;
+  }
+  else
+  {
+    // The value isn't used, x++ is the same as ++x, which needs no copy of the old value
+    switch (stack[t][0])
+    {
+    case tokPostInc: stack[t][0] = tokInc; break;
+    case tokPostDec: stack[t][0] = tokDec; break;
+    case tokPostAdd: stack[t][0] = tokAssignAdd; break;
+    case tokPostSub: stack[t][0] = tokAssignSub; break;
+    }
+  }
   GenPrep(&t);
 
   for (i = 0; i < sp; i++)
@@ -1898,6 +4496,10 @@ void GenExpr0(void)
                            t == tokLShift ||
                            t == tokRShift ||
                            t == tokURShift ||
+                           t == '/' ||
+                           t == '%' ||
+                           t == tokUDiv ||
+                           t == tokUMod ||
                            GenIsCmp(t))))
       {
         if (gotUnary)
@@ -1948,6 +4550,7 @@ void GenExpr0(void)
       if (gotUnary)
         GenPushReg();
       gotUnary = 0;
+      callIdx = i;
       if (maxCallDepth != 1 && v < 16)
         GenGrowStack(16 - v);
       paramOfs = v - 4;
@@ -1982,6 +4585,8 @@ void GenExpr0(void)
       break;
 
     case ')':
+      if (maxCallDepth == 1 && stack[i - 1][0] == tokIdent && GenCopyCall(callIdx, i))
+        break;
       GenLeaf = 0;
       if (maxCallDepth != 1)
       {
@@ -2016,6 +4621,8 @@ void GenExpr0(void)
                              B322OpRegRa, 0);
         GenPrintInstr1Operand(B322InstrJump, 0,
                               B322OpLabel, stack[i - 1][1]);
+        if (GenIsStructCpy(stack[i - 1][1]))
+          GenStructCpyCalled = 1;
       }
       else
       {
@@ -2094,28 +4701,39 @@ void GenExpr0(void)
     case tokUDiv:
     case '%':
     case tokUMod:
+      if (stack[i - 1][0] == tokNumInt)
+      {
+        unsigned m = truncUint(stack[i - 1][1]);
+        if ((tok == '/' || tok == '%') && m && !(m & (m - 1)) && !(m & 0x80000000))
+        {
+          GenDivModPow2(tok, GenWreg, m);
+          break;
+        }
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               GenWreg, 0,
+                               TEMP_REG_A, 0);
+        GenPrintInstr2Operands(B322InstrLoad, 0,
+                               B322OpConst, stack[i - 1][1],
+                               TEMP_REG_B, 0);
+      }
+      else
       {
-        printf("DIVISION/MOD is not supported!\n");
-        /*
         GenPopReg();
-        if (tok == '/' || tok == '%')
-          GenPrintInstr3Operands(MipsInstrDiv, 0,
-                                 B322OpRegZero, 0,
-                                 GenLreg, 0,
-                                 GenRreg, 0);
-        else
-          GenPrintInstr3Operands(MipsInstrDivU, 0,
+        if (GenLreg != TEMP_REG_A)
+          GenPrintInstr3Operands(B322InstrOr, 0,
                                  B322OpRegZero, 0,
                                  GenLreg, 0,
-                                 GenRreg, 0);
-        if (tok == '%' || tok == tokUMod)
-          GenPrintInstr1Operand(MipsInstrMfHi, 0,
-                                GenWreg, 0);
-        else
-          GenPrintInstr1Operand(MipsInstrMfLo, 0,
-                                GenWreg, 0);
-        */
+                                 TEMP_REG_A, 0);
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               GenRreg, 0,
+                               TEMP_REG_B, 0);
       }
+      GenPrintInstr3Operands(B322InstrOr, 0,
+                             B322OpRegZero, 0,
+                             GenCallDivMod(tok), 0,
+                             GenWreg, 0);
       break;
 
     case tokInc:
@@ -2159,6 +4777,32 @@ void GenExpr0(void)
 
     case tokPostAdd:
     case tokPostSub:
+      if (stack[i - 1][0] == tokRevLocalOfs || stack[i - 1][0] == tokRevIdent)
+      {
+        // Access the variable directly, so a local one can go in a register
+        int instr = GenGetBinaryOperatorInstr(tok);
+
+        if (stack[i - 1][0] == tokRevLocalOfs)
+          GenReadLocal(TEMP_REG_B, v, stack[i - 1][1]);
+        else
+          GenReadIdent(TEMP_REG_B, v, stack[i - 1][1]);
+
+        GenPrintInstr3Operands(instr, 0,
+                               TEMP_REG_B, 0,
+                               GenWreg, 0,
+                               TEMP_REG_A, 0);
+
+        if (stack[i - 1][0] == tokRevLocalOfs)
+          GenWriteLocal(TEMP_REG_A, v, stack[i - 1][1]);
+        else
+          GenWriteIdent(TEMP_REG_A, v, stack[i - 1][1]);
+
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               TEMP_REG_B, 0,
+                               GenWreg, 0);
+      }
+      else
       {
         int instr = GenGetBinaryOperatorInstr(tok);
         GenPopReg();
@@ -2263,43 +4907,20 @@ void GenExpr0(void)
     case tokAssignUMod:
       if (stack[i - 1][0] == tokRevLocalOfs || stack[i - 1][0] == tokRevIdent)
       {
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               GenWreg, 0,
+                               TEMP_REG_B, 0);
+
         if (stack[i - 1][0] == tokRevLocalOfs)
-          GenReadLocal(TEMP_REG_B, v, stack[i - 1][1]);
+          GenReadLocal(TEMP_REG_A, v, stack[i - 1][1]);
         else
-          GenReadIdent(TEMP_REG_B, v, stack[i - 1][1]);
+          GenReadIdent(TEMP_REG_A, v, stack[i - 1][1]);
 
-        if (tok == tokAssignDiv || tok == tokAssignMod)
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr3Operands(MipsInstrDiv, 0,
-                                 B322OpRegZero, 0,
-                                 TEMP_REG_B, 0,
-                                 GenWreg, 0);*/
-        }
-        else
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr3Operands(MipsInstrDivU, 0,
-                                 B322OpRegZero, 0,
-                                 TEMP_REG_B, 0,
-                                 GenWreg, 0);*/
-        }
-        if (tok == tokAssignMod || tok == tokAssignUMod)
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr1Operand(MipsInstrMfHi, 0,
-                                GenWreg, 0);*/
-        }
-        else
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr1Operand(MipsInstrMfLo, 0,
-                                GenWreg, 0);*/
-        }
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               GenCallDivMod(tok), 0,
+                               GenWreg, 0);
 
         if (stack[i - 1][0] == tokRevLocalOfs)
           GenWriteLocal(GenWreg, v, stack[i - 1][1]);
@@ -2308,62 +4929,26 @@ void GenExpr0(void)
       }
       else
       {
-        int lsaved, rsaved;
+        int rres;
         GenPopReg();
-        if (GenWreg == GenLreg)
-        {
+        // Keep the address in GenWreg, since the division subroutine uses both temp registers
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               GenRreg, 0,
+                               TEMP_REG_B, 0);
+        if (GenWreg != GenLreg)
           GenPrintInstr3Operands(B322InstrOr, 0,
                                  B322OpRegZero, 0,
                                  GenLreg, 0,
-                                 TEMP_REG_B, 0);
-          lsaved = TEMP_REG_B;
-          rsaved = GenRreg;
-        }
-        else
-        {
-          // GenWreg == GenRreg here
-          GenPrintInstr3Operands(B322InstrOr, 0,
-                                 B322OpRegZero, 0,
-                                 GenRreg, 0,
-                                 TEMP_REG_B, 0);
-          rsaved = TEMP_REG_B;
-          lsaved = GenLreg;
-        }
+                                 GenWreg, 0);
 
-        GenReadIndirect(GenWreg, GenLreg, v); // destroys either GenLreg or GenRreg because GenWreg coincides with one of them
-        if (tok == tokAssignDiv || tok == tokAssignMod)
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr3Operands(MipsInstrDiv, 0,
-                                 B322OpRegZero, 0,
-                                 GenWreg, 0,
-                                 rsaved, 0);*/
-        }
-        else
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr3Operands(MipsInstrDivU, 0,
-                                 B322OpRegZero, 0,
-                                 GenWreg, 0,
-                                 rsaved, 0);*/
-        }
-        if (tok == tokAssignMod || tok == tokAssignUMod)
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr1Operand(MipsInstrMfHi, 0,
-                                GenWreg, 0);*/
-        }
-        else
-        {
-          printf("DIVISION/MOD is not supported!\n");
-          /*
-          GenPrintInstr1Operand(MipsInstrMfLo, 0,
-                                GenWreg, 0);*/
-        }
-        GenWriteIndirect(lsaved, GenWreg, v);
+        GenReadIndirect(TEMP_REG_A, GenWreg, v);
+        rres = GenCallDivMod(tok);
+        GenWriteIndirect(GenWreg, rres, v);
+        GenPrintInstr3Operands(B322InstrOr, 0,
+                               B322OpRegZero, 0,
+                               rres, 0,
+                               GenWreg, 0);
       }
       GenExtendRegIfNeeded(GenWreg, v);
       break;
@@ -2571,11 +5156,210 @@ void GenExpr(void)
   GenExpr0();
 }
 
+/*
+  Removal of unused functions:
+  the output is written to a temporary file, and the position of each function
+  in it is recorded. When the temporary file is copied to the output file, the
+  functions that can not be reached from the code and data outside of the
+  functions (the startup and interrupt wrapper code, data initializers and
+  asm() at file scope) are left out.
+  A function is reached when its name is used in the code of a reached
+  function: a call, taking its address or a reference from an asm() block.
+  Library objects (--lib) keep all functions, the program uses them.
+*/
+char** GenFxnNames = NULL;
+long* GenFxnStarts = NULL; // position of the function in the temporary file
+long* GenFxnEnds = NULL;
+int GenFxnCnt = 0;
+int GenFxnMax = 0;
+int* GenFxnHash = NULL; // function index + 1, 0 if the slot is free
+unsigned GenFxnHashSize = 0;
+
+// Records the start of the function that is about to be generated
+STATIC
+void GenFxnStart(char* name)
+{
+  if (!GenFinalOutFile)
+    return;
+
+  if (GenFxnCnt >= GenFxnMax)
+  {
+    GenFxnMax = GenFxnMax ? GenFxnMax * 2 : 256;
+    GenFxnNames = realloc(GenFxnNames, GenFxnMax * sizeof(char*));
+    GenFxnStarts = realloc(GenFxnStarts, GenFxnMax * sizeof(long));
+    GenFxnEnds = realloc(GenFxnEnds, GenFxnMax * sizeof(long));
+    if (!GenFxnNames || !GenFxnStarts || !GenFxnEnds)
+      error("Out of memory\n");
+  }
+  if (!(GenFxnNames[GenFxnCnt] = malloc(strlen(name) + 1)))
+    error("Out of memory\n");
+  strcpy(GenFxnNames[GenFxnCnt], name);
+  GenFxnStarts[GenFxnCnt] = ftell(OutFile);
+}
+
+// Records the end of the function that has been generated
+STATIC
+void GenFxnEnd(void)
+{
+  if (!GenFinalOutFile)
+    return;
+
+  GenFxnEnds[GenFxnCnt++] = ftell(OutFile);
+}
+
+STATIC
+unsigned GenFxnHashName(char* name, int len)
+{
+  unsigned h = 0;
+  while (len--)
+    h = h * 31 + (*name++ & 0xFFu);
+  return h & (GenFxnHashSize - 1);
+}
+
+// Returns the index of the function with the given name or -1
+STATIC
+int GenFindFxn(char* name, int len)
+{
+  unsigned h = GenFxnHashName(name, len);
+
+  while (GenFxnHash[h])
+  {
+    char* n = GenFxnNames[GenFxnHash[h] - 1];
+    if (!strncmp(n, name, len) && n[len] == '\0')
+      return GenFxnHash[h] - 1;
+    h = (h + 1) & (GenFxnHashSize - 1);
+  }
+  return -1;
+}
+
+// Marks the functions used in the code from p to end as live and adds them to the work list
+STATIC
+void GenMarkFxnRefs(char* p, char* end, char* live, int* work, int* workCnt)
+{
+  while (p < end)
+  {
+    if (*p == ';')
+    {
+      // comment
+      while (p < end && *p != '\n')
+        p++;
+    }
+    else if (*p == '"')
+    {
+      // string in an asm() block
+      p++;
+      while (p < end && *p != '"' && *p != '\n')
+        p++;
+      p++;
+    }
+    else if (*p == '_' || isalnum(*p & 0xFFu))
+    {
+      char* w = p;
+      int k;
+      while (p < end && (*p == '_' || isalnum(*p & 0xFFu)))
+        p++;
+      if ((k = GenFindFxn(w, p - w)) >= 0 && !live[k])
+      {
+        live[k] = 1;
+        work[(*workCnt)++] = k;
+      }
+    }
+    else
+      p++;
+  }
+}
+
+// Copies the temporary file to the output file, without the functions that are not used
+STATIC
+void GenWriteOutput(void)
+{
+  long size, pos;
+  char* text;
+  char* live;
+  int* work;
+  int workCnt = 0;
+  int i;
+
+  if (!GenFinalOutFile)
+    return;
+
+  size = ftell(OutFile);
+  text = malloc(size + 1);
+  live = calloc(GenFxnCnt + 1, 1);
+  work = malloc((GenFxnCnt + 1) * sizeof(int));
+  for (GenFxnHashSize = 1; GenFxnHashSize < 2u * GenFxnCnt + 1; GenFxnHashSize *= 2)
+    ;
+  GenFxnHash = calloc(GenFxnHashSize, sizeof(int));
+  if (!text || !live || !work || !GenFxnHash)
+    error("Out of memory\n");
+
+  rewind(OutFile);
+  if (fread(text, 1, size, OutFile) != (size_t)size)
+    error("Cannot read the temporary file\n");
+
+  for (i = 0; i < GenFxnCnt; i++)
+  {
+    unsigned h = GenFxnHashName(GenFxnNames[i], strlen(GenFxnNames[i]));
+    while (GenFxnHash[h])
+      h = (h + 1) & (GenFxnHashSize - 1);
+    GenFxnHash[h] = i + 1;
+  }
+
+  // Everything outside of the functions is used
+  pos = 0;
+  for (i = 0; i <= GenFxnCnt; i++)
+  {
+    long end = (i < GenFxnCnt) ? GenFxnStarts[i] : size;
+    GenMarkFxnRefs(text + pos, text + end, live, work, &workCnt);
+    if (i < GenFxnCnt)
+      pos = GenFxnEnds[i];
+  }
+
+  // And so is everything the used functions refer to
+  while (workCnt)
+  {
+    i = work[--workCnt];
+    GenMarkFxnRefs(text + GenFxnStarts[i], text + GenFxnEnds[i], live, work, &workCnt);
+  }
+
+  pos = 0;
+  for (i = 0; i <= GenFxnCnt; i++)
+  {
+    if (i < GenFxnCnt && live[i])
+      continue;
+    {
+      long end = (i < GenFxnCnt) ? GenFxnStarts[i] : size;
+      fwrite(text + pos, 1, end - pos, GenFinalOutFile);
+    }
+    if (i < GenFxnCnt)
+    {
+      if (verbose)
+        printf("%s() is not used\n", GenFxnNames[i]);
+      StatDeadFxns++;
+      pos = GenFxnEnds[i];
+    }
+  }
+
+  fclose(OutFile);
+  OutFile = GenFinalOutFile;
+  GenFinalOutFile = NULL;
+
+  for (i = 0; i < GenFxnCnt; i++)
+    free(GenFxnNames[i]);
+  free(GenFxnNames);
+  free(GenFxnStarts);
+  free(GenFxnEnds);
+  free(GenFxnHash);
+  free(text);
+  free(live);
+  free(work);
+}
+
 STATIC
 void GenFin(void)
 {
   // No idea what this does (something with structs??), so I just literally converted it to B322 asm
-  if (StructCpyLabel)
+  if (GenStructCpyCalled)
   {
     int lbl = LabelCnt++;
 
@@ -2586,7 +5370,7 @@ void GenFin(void)
     //puts2(" move r2, r6\n" //r2 := r6
     //      " move r3, r6"); //r3 := r3
     puts2(" or r0 r6 r2\n"
-          " or r0 r6 r3");
+          " or r0 r6 r1");
 
 
     GenNumLabel(lbl);
@@ -2597,11 +5381,10 @@ void GenFin(void)
     //      " sb r6, 0 r3\n"        // mem[r3]:=r6
     //      " addiu r3, r3, 1");    // r3:= r3+1
 
-    puts2(" read 0 r5 r6\n"
+    puts2(" copy 0 r5 r1\n"
           " add r5 1 r5\n"
           " sub r4 1 r4\n"
-          " write 0 r3 r6\n"
-          " add r3 1 r3");
+          " add r1 1 r1");
 
     //printf2(" bne r4, r0, "); GenPrintNumLabel(lbl); // if r4 != 0, jump to lbl
     printf2("beq r4 r0 2\n");
@@ -2614,8 +5397,113 @@ void GenFin(void)
     puts2(CodeHeaderFooter[1]);
   }
 
+  // Division/modulo subroutine (shift-subtract, not recursive)
+  // Input: r11 = dividend, r12 = divisor
+  // Output: r11 = quotient, r12 = remainder
+  // Called with savpc r1, push r1, jump, so it returns using the hardware stack.
+  // Only r1, r11 and r12 are changed
+  // Named labels are used, so the Assembler does not see it as part of the previous function
+  if (DivModUsed)
+  {
+    int lblCore = LabelCnt++;
+    int lblSmall = LabelCnt++;
+    int lblBig = LabelCnt++;
+    int lblSkip = LabelCnt++;
+    int lblLoop = LabelCnt++;
+    int lblDone = LabelCnt++;
+
+    puts2(CodeHeaderFooter[0]);
+
+    if (DivModUsed & 2)
+    {
+      puts2("__udivmod:");
+      puts2(" push r2\n"
+            " push r3\n"
+            " push r4\n"
+            " or r0 r0 r2\n"        // no sign for the remainder
+            " or r0 r0 r3");        // no sign for the quotient
+      printf2(" jump "); GenPrintNumLabel(lblCore); puts2("");
+    }
+
+    if (DivModUsed & 1)
+    {
+      puts2("__divmod:");
+      puts2(" push r2\n"
+            " push r3\n"
+            " push r4\n"
+            " shiftr r11 31 r2\n"   // r2 = sign of the remainder (sign of the dividend)
+            " xor r11 r12 r3\n"
+            " shiftr r3 31 r3\n"    // r3 = sign of the quotient
+            " beq r2 r0 2\n"
+            " sub r0 r11 r11\n"     // dividend = abs(dividend)
+            " bges r12 r0 2\n"
+            " sub r0 r12 r12");     // divisor = abs(divisor)
+    }
+
+    GenNumLabel(lblCore);
+    puts2(" beq r12 r0 3\n"         // division by zero gives 0 with the dividend as remainder
+          " bgt r12 r11 2");        // divisor > dividend
+    printf2(" jump "); GenPrintNumLabel(lblBig); puts2("");
+
+    GenNumLabel(lblSmall);
+    puts2(" or r0 r11 r1\n"
+          " or r0 r0 r11");
+    printf2(" jump "); GenPrintNumLabel(lblDone); puts2("");
+
+    GenNumLabel(lblBig);
+    // A divisor with the highest bit set can only fit once in the dividend
+    // (and would overflow the remainder register in the loop below)
+    puts2(" bges r12 r0 4\n"
+          " sub r11 r12 r1\n"
+          " load 1 r11");
+    printf2(" jump "); GenPrintNumLabel(lblDone); puts2("");
+    puts2(" load 32 r4");
+
+    // Skip the leading zero bytes of the dividend (it is not 0 here)
+    GenNumLabel(lblSkip);
+    puts2(" shiftr r11 24 r1\n"
+          " bne r1 r0 4\n"
+          " shiftl r11 8 r11\n"
+          " sub r4 8 r4");
+    printf2(" jump "); GenPrintNumLabel(lblSkip); puts2("");
+    puts2(" or r0 r0 r1");
+
+    // Shift the dividend into the remainder one bit at a time,
+    // and shift the quotient bits into the dividend register
+    GenNumLabel(lblLoop);
+    puts2(" shiftl r1 1 r1\n"
+          " bges r11 r0 2\n"
+          " or r1 1 r1\n"
+          " shiftl r11 1 r11\n"
+          " bgt r12 r1 3\n"
+          " sub r1 r12 r1\n"
+          " or r11 1 r11\n"
+          " sub r4 1 r4\n"
+          " beq r4 r0 2");
+    printf2(" jump "); GenPrintNumLabel(lblLoop); puts2("");
+
+    // Apply the signs and return
+    GenNumLabel(lblDone);
+    puts2(" beq r3 r0 2\n"
+          " sub r0 r11 r11\n"
+          " beq r2 r0 2\n"
+          " sub r0 r1 r1\n"
+          " or r0 r1 r12\n"
+          " pop r4\n"
+          " pop r3\n"
+          " pop r2\n"
+          " pop r1\n"
+          " jumpr 3 r1");
+
+    puts2(CodeHeaderFooter[1]);
+  }
+
   // Put all ending C specific wrapper code here
-  if (compileUserBDOS)
+  if (compileLib)
+  {
+    // the program that the library object is linked with has the wrapper code
+  }
+  else if (compileUserBDOS)
   {
     printf2(
       ".code\n"
@@ -2823,7 +5711,7 @@ void GenFin(void)
       "    halt        ; should not get here\n");
   }
 
-  if (compileOS)
+  if (compileOS && !compileLib)
   {
     printf2(
       ".code\n"
@@ -2848,6 +5736,6 @@ void GenFin(void)
       );
   }
 
-  
-
+  if (GenPeepOpt)
+    printf("Peephole optimizer: %d instructions removed\n", GenPeepRemovedTotal);
 }
@@ -88,6 +88,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdarg.h> // only used for printf related stuff and warnings/errors. Should be able to remove by replacing ALL(...) occurrences with a normal print function
 #include <stdlib.h>
 #include <stdio.h> // I/O functions
+#include <time.h> // clock() for --stats
+#include <sys/stat.h> // stat() for the include cache
+#include <unistd.h> // getpid() for the include cache
 
 //#if UINT_MAX >= 0xFFFFFFFF
 //#define CAN_COMPILE_32BIT
@@ -219,6 +222,18 @@ int fsetpos(FILE*, fpos_t*);
 #define SYNTAX_STACK_MAX (4096+1024)
 #endif
 
+#ifndef MACRO_HASH_SIZE
+#define MACRO_HASH_SIZE      256 // must be a power of 2
+#endif
+
+#ifndef IDENT_HASH_SIZE
+#define IDENT_HASH_SIZE      1024 // must be a power of 2
+#endif
+
+#ifndef SYMBOL_HASH_SIZE
+#define SYMBOL_HASH_SIZE     512 // must be a power of 2
+#endif
+
 #ifndef MAX_FILE_NAME_LEN
 #define MAX_FILE_NAME_LEN    95
 #endif
@@ -596,6 +611,22 @@ int strncmp(const char * s1, const char * s2, size_t n )
   }
 }
 
+STATIC
+int memcmp(const void* s1, const void* s2, size_t n)
+{
+  unsigned char* p1 = (unsigned char*) s1;
+  unsigned char* p2 = (unsigned char*) s2;
+
+  while (n--)
+  {
+    if (*p1 != *p2)
+      return *p1 - *p2;
+    p1++;
+    p2++;
+  }
+  return 0;
+}
+
 
 
 // all public prototypes
@@ -660,16 +691,30 @@ STATIC
 void GenJumpIfNotZero(int Label);
 STATIC
 void GenJumpIfEqual(int val, int Label);
+STATIC
+void GenSwitch(int first, int last, int defLabel);
 
 STATIC
 void GenFxnProlog(void);
 STATIC
 void GenFxnEpilog(void);
+STATIC
+long GenGetFxnPos(void);
+STATIC
+void GenDropFxnCode(long pos);
+STATIC
+void GenFxnStart(char* name);
+STATIC
+void GenFxnEnd(void);
+STATIC
+void GenWriteOutput(void);
 void GenIsrProlog(void);
 void GenIsrEpilog(void);
 
 STATIC
 int GenMaxLocalsSize(void);
+STATIC
+void GenLocalAlloc(int ofs, unsigned size);
 
 STATIC
 void GenDumpChar(int ch);
@@ -680,6 +725,10 @@ STATIC
 void PushSyntax(int t);
 STATIC
 void PushSyntax2(int t, int v);
+STATIC
+void LinkSymbols(int pos);
+STATIC
+void UnlinkSymbols(int pos);
 
 #ifndef NO_ANNOTATIONS
 STATIC
@@ -779,6 +828,17 @@ int warnCnt = 0;
 // custom compiler flags
 int compileUserBDOS = 0;
 int compileOS = 0;
+int compileLib = 0; // no startup and interrupt wrapper code, for a library object
+
+// --stats: lookup counters and time per compilation phase
+int stats = 0;
+unsigned StatIdentLookups = 0, StatIdentProbes = 0;
+unsigned StatMacroLookups = 0, StatMacroProbes = 0;
+unsigned StatSymbolLookups = 0, StatSymbolProbes = 0;
+clock_t StatTimeOptimize = 0; // register allocation and peephole optimization
+clock_t StatTimeOutput = 0; // reading back and writing out function bodies
+unsigned StatDeadFxns = 0; // functions left out of the output
+unsigned StatIncludes = 0, StatCacheHits = 0; // included files, and how many came from the include cache
 
 // prep.c data
 
@@ -805,6 +865,14 @@ int CharQueueLen = 0;
 */
 char MacroTable[MAX_MACRO_TABLE_LEN];
 int MacroTableLen = 0;
+
+/*
+  Macro hash chains:
+    MacroHash[hash]:     offset of the most recently added entry, -1 if none
+    MacroHashNext[ofs]:  offset of the next older entry with the same hash
+*/
+int MacroHash[MACRO_HASH_SIZE];
+int MacroHashNext[MAX_MACRO_TABLE_LEN];
 #endif
 
 /*
@@ -816,6 +884,15 @@ char IdentTable[MAX_IDENT_TABLE_LEN];
 int IdentTableLen = 0;
 int DummyIdent; // corresponds to empty string
 
+/*
+  Identifier hash chains (newest entry first, so the chains are ordered
+  by decreasing offset and the table can be truncated from the top):
+    IdentHash[hash]:     offset of the most recently added identifier, -1 if none
+    IdentHashNext[ofs]:  offset of the next older identifier with the same hash
+*/
+int IdentHash[IDENT_HASH_SIZE];
+int IdentHashNext[MAX_IDENT_TABLE_LEN];
+
 #ifndef MAX_GOTO_LABELS
 #define MAX_GOTO_LABELS 16
 #endif
@@ -823,6 +900,7 @@ int gotoLabels[MAX_GOTO_LABELS][2];
 // gotoLabStat[]: bit 1 = used (by "goto label;"), bit 0 = defined (with "label:")
 char gotoLabStat[MAX_GOTO_LABELS];
 int gotoLabCnt = 0;
+int gotoLabDefCnt = 0; // total number of "label:" definitions seen
 
 #ifndef MAX_CASES
 #define MAX_CASES 128
@@ -843,6 +921,35 @@ int SysSearchPathsLen = 0;
 char SearchPaths[MAX_SEARCH_PATH];
 int SearchPathsLen = 0;
 
+#ifndef NO_PREPROCESSOR
+/*
+  Include cache (-cache dir), see CacheReserve() for the format:
+    CacheFileCnt:   FileCnt inside the include that is recorded or replayed, 0 if none
+    CacheReplaying: 1 if the tokens of the include come from the cache, 0 if they are recorded
+    CacheBuf[]:     key, tokens and the macro table after the include (grows as needed)
+    CacheChars:     replay: the string literal that GetString() reads next
+    CacheStrLenPos: record: position of the length of the string literal GetString() records, -1 if none
+    CacheIdentName, CacheValueInt, CacheValid: the token values last recorded or replayed
+*/
+char CacheDir[MAX_SEARCH_PATH]; // empty if not used
+int CacheFileCnt = 0;
+int CacheReplaying = 0;
+char* CacheBuf = NULL;
+int CacheBufLen = 0;
+int CacheBufSize = 0;
+int CachePos = 0;
+int CacheKeyLen = 0;
+int CacheTokensEnd = 0;
+char CachePath[MAX_SEARCH_PATH + 16];
+int CachePrepSp = 0;
+char* CacheChars = NULL;
+int CacheCharsLen = 0;
+int CacheStrLenPos = -1;
+char CacheIdentName[MAX_IDENT_LEN + 1];
+int CacheValueInt = 0;
+int CacheValid = 0;
+#endif
+
 // Data structures to support #ifdef/#ifndef,#else,#endif
 int PrepDontSkipTokens = 1;
 int PrepStack[PREP_STACK_SIZE][2];
@@ -915,6 +1022,8 @@ int CurFxnMinLocalOfs = 0; // negative
 
 int CurFxnReturnExprTypeSynPtr = 0;
 int CurFxnEpilogLabel = 0;
+int CurFxnAsmUsed = 0; // if asm() is used inside the current function
+int CurFxnInline = 0; // if the current function is declared inline
 
 char* CurFxnName = NULL;
 #ifndef NO_FUNC_
@@ -929,6 +1038,22 @@ unsigned char SyntaxStack0[SYNTAX_STACK_MAX];
 int SyntaxStack1[SYNTAX_STACK_MAX];
 int SyntaxStackCnt;
 
+/*
+  Symbol index of the tokIdent entries of the syntax stack (newest entry
+  first, so the chains are ordered by decreasing position and the stack
+  can be truncated from the top):
+    SymbolHash[hash]:    position of the most recent tokIdent, -1 if none
+    SymbolHashNext[pos]: position of the next older tokIdent with the same hash
+    SymbolBucket[pos]:   hash the entry was linked under, -1 if not linked
+    SymbolParen[pos]:    position of the innermost '(' still open before pos, -1 if none
+  Everything at and above a position is relinked whenever the stack is
+  changed below its top by InsertSyntax2()/DeleteSyntax() or UndoSyntax().
+*/
+int SymbolHash[SYMBOL_HASH_SIZE];
+int SymbolHashNext[SYNTAX_STACK_MAX];
+int SymbolBucket[SYNTAX_STACK_MAX];
+int SymbolParen[SYNTAX_STACK_MAX];
+
 // all code
 
 STATIC
@@ -966,22 +1091,57 @@ int truncInt(int n)
 
 // prep.c code
 
+STATIC
+unsigned HashName(char* name)
+{
+  unsigned h = 0;
+  while (*name)
+    h = (h << 5) + h + (unsigned char)*name++;
+  return h;
+}
+
 #ifndef NO_PREPROCESSOR
 STATIC
-int FindMacro(char* name)
+void HashMacro(int i)
+{
+  unsigned h = HashName(MacroTable + i + 1) & (MACRO_HASH_SIZE - 1);
+  MacroHashNext[i] = MacroHash[h];
+  MacroHash[h] = i;
+}
+
+STATIC
+void RehashMacros(void)
 {
   int i;
 
+  for (i = 0; i < MACRO_HASH_SIZE; i++)
+    MacroHash[i] = -1;
+
   for (i = 0; i < MacroTableLen; )
   {
-    if (!strcmp(MacroTable + i + 1, name))
-      return i + 1 + MacroTable[i];
-
+    HashMacro(i);
     i = i + 1 + MacroTable[i]; // skip id
     i = i + 1 + MacroTable[i]; // skip ex
   }
+}
 
-  return -1;
+STATIC
+int FindMacro(char* name)
+{
+  int i, found = -1;
+
+  StatMacroLookups++;
+
+  // The chain is ordered newest first, keep going to find the oldest
+  // definition like a front-to-back scan of the table would
+  for (i = MacroHash[HashName(name) & (MACRO_HASH_SIZE - 1)]; i >= 0; i = MacroHashNext[i])
+  {
+    StatMacroProbes++;
+    if (!strcmp(MacroTable + i + 1, name))
+      found = i + 1 + MacroTable[i];
+  }
+
+  return found;
 }
 
 STATIC
@@ -1001,6 +1161,9 @@ int UndefineMacro(char* name)
               MacroTableLen - i - len);
       MacroTableLen -= len;
 
+      // the entries above have moved down
+      RehashMacros();
+
       return 1;
     }
 
@@ -1022,9 +1185,10 @@ void AddMacroIdent(char* name)
   if (MAX_MACRO_TABLE_LEN - MacroTableLen < l + 3)
     error("Macro table exhausted\n");
 
-  MacroTable[MacroTableLen++] = l + 1; // idlen
-  strcpy(MacroTable + MacroTableLen, name);
-  MacroTableLen += l + 1;
+  MacroTable[MacroTableLen] = l + 1; // idlen
+  strcpy(MacroTable + MacroTableLen + 1, name);
+  HashMacro(MacroTableLen);
+  MacroTableLen += 1 + l + 1;
 
   MacroTable[MacroTableLen] = 0; // exlen
 }
@@ -1090,15 +1254,37 @@ STATIC
 int FindIdent(char* name)
 {
   int i;
-  for (i = IdentTableLen; i > 0; )
+  StatIdentLookups++;
+  for (i = IdentHash[HashName(name) & (IDENT_HASH_SIZE - 1)]; i >= 0; i = IdentHashNext[i])
   {
-    i -= 1 + IdentTable[i - 1];
+    StatIdentProbes++;
     if (!strcmp(IdentTable + i, name))
       return i;
   }
   return -1;
 }
 
+STATIC
+void HashIdent(int i)
+{
+  unsigned h = HashName(IdentTable + i) & (IDENT_HASH_SIZE - 1);
+  IdentHashNext[i] = IdentHash[h];
+  IdentHash[h] = i;
+}
+
+STATIC
+void UndoIdents(int len)
+{
+  // Remove the identifiers from the top of the table down to len,
+  // each of them is at the head of its hash chain when it's removed
+  while (IdentTableLen > len)
+  {
+    int i = IdentTableLen - 1 - IdentTable[IdentTableLen - 1];
+    IdentHash[HashName(IdentTable + i) & (IDENT_HASH_SIZE - 1)] = IdentHashNext[i];
+    IdentTableLen = i;
+  }
+}
+
 STATIC
 int AddIdent(char* name)
 {
@@ -1117,6 +1303,7 @@ int AddIdent(char* name)
     error("Identifier table exhausted\n");
 
   strcpy(IdentTable + IdentTableLen, name);
+  HashIdent(i);
   IdentTableLen += len + 1;
   IdentTable[IdentTableLen++] = len + 1;
 
@@ -1137,6 +1324,7 @@ STATIC
 int AddGotoLabel(char* name, int label)
 {
   int i;
+  gotoLabDefCnt += label;
   for (i = 0; i < gotoLabCnt; i++)
   {
     if (!strcmp(IdentTable + gotoLabels[i][0], name))
@@ -1159,7 +1347,7 @@ STATIC
 void UndoNonLabelIdents(int len)
 {
   int i;
-  IdentTableLen = len;
+  UndoIdents(len);
   for (i = 0; i < gotoLabCnt; i++)
     if (gotoLabels[i][0] >= len)
     {
@@ -1167,6 +1355,7 @@ void UndoNonLabelIdents(int len)
       char* pto = IdentTable + IdentTableLen;
       int l = strlen(pfrom) + 2;
       memmove(pto, pfrom, l);
+      HashIdent(IdentTableLen);
       IdentTableLen += l;
       gotoLabels[i][0] = pto - IdentTable;
     }
@@ -1305,6 +1494,15 @@ int GetNextChar(void)
 {
   int ch = EOF;
 
+#ifndef NO_PREPROCESSOR
+  // a string literal that is replayed from the include cache
+  if (CacheCharsLen)
+  {
+    CacheCharsLen--;
+    return *CacheChars++ & 0xFF;
+  }
+#endif
+
   if (FileCnt && Files[FileCnt - 1])
   {
     if ((ch = fgetc(Files[FileCnt - 1])) == EOF)
@@ -1350,15 +1548,348 @@ void ShiftCharN(int n)
 }
 
 #ifndef NO_PREPROCESSOR
+/*
+  Include cache (-cache dir):
+  the tokens that an included file gives to the parser, after preprocessing,
+  and the macro table it leaves behind. The next compile that includes the same
+  file with the same macros defined replays these instead of reading, lexing
+  and preprocessing the file again. The declarations are still parsed, since
+  BCC is a single-pass compiler that generates the code while parsing.
+
+  Cache file (<dir>/<hash of the path and macros>.bcc):
+    key:    "bcc include cache 1\n", path, size and modification time of the file,
+            the macro table before the #include
+    int:    length of the tokens
+    tokens: int tok, int LineNo, int LinePos, char flags,
+            [name (ASCIIZ) if flags & 1], [int TokenValueInt if flags & 2],
+            [int length, "literal" with octal escapes if tok is tokLitStr]
+    int:    length of the macro table after the include, macro table
+  TokenIdentName and TokenValueInt are only stored when they change, because
+  the parser can still use them after the next token (e.g. for labels).
+
+  Files that include other files or use #line are not cached.
+*/
+STATIC
+void CacheReserve(int len)
+{
+  if (CacheBufLen + len > CacheBufSize)
+  {
+    CacheBufSize = (CacheBufLen + len) * 2;
+    if ((CacheBuf = realloc(CacheBuf, CacheBufSize)) == NULL)
+      error("Out of memory for the include cache\n");
+  }
+}
+
+STATIC
+void CacheAdd(void* p, int len)
+{
+  CacheReserve(len);
+  memcpy(CacheBuf + CacheBufLen, p, len);
+  CacheBufLen += len;
+}
+
+STATIC
+void CacheAddInt(int v)
+{
+  CacheAdd(&v, sizeof v);
+}
+
+STATIC
+int CacheGetInt(void)
+{
+  int v;
+  memcpy(&v, CacheBuf + CachePos, sizeof v);
+  CachePos += sizeof v;
+  return v;
+}
+
+STATIC
+void CacheStop(void)
+{
+  CacheFileCnt = 0;
+  CacheReplaying = 0;
+  CacheStrLenPos = -1;
+  CacheCharsLen = 0;
+}
+
+// Checks the lengths in the cache file that is loaded after the key, up to end
+// Returns 1 if the tokens and the macro table are complete, 0 if the file is damaged
+STATIC
+int CacheCheck(int end)
+{
+  int tok, flags, len;
+
+  CachePos = 2 * CacheKeyLen;
+  if (end - CachePos < (int)sizeof len)
+    return 0;
+  len = CacheGetInt();
+  if (len < 0 || len > end - CachePos)
+    return 0;
+  CacheTokensEnd = CachePos + len;
+
+  while (CachePos < CacheTokensEnd)
+  {
+    if (CacheTokensEnd - CachePos < 3 * (int)sizeof tok + 1)
+      return 0;
+    tok = CacheGetInt();
+    CachePos += 2 * sizeof tok; // LineNo, LinePos
+    flags = CacheBuf[CachePos++];
+    if (flags & 1)
+    {
+      for (len = 0; CachePos + len < CacheTokensEnd && CacheBuf[CachePos + len] != '\0'; len++)
+        ;
+      if (CachePos + len >= CacheTokensEnd || len > MAX_IDENT_LEN)
+        return 0;
+      CachePos += len + 1;
+    }
+    if (flags & 2)
+    {
+      if (CacheTokensEnd - CachePos < (int)sizeof len)
+        return 0;
+      CachePos += sizeof len;
+    }
+    if (tok == tokLitStr)
+    {
+      if (CacheTokensEnd - CachePos < (int)sizeof len)
+        return 0;
+      len = CacheGetInt();
+      if (len < 2 || len > CacheTokensEnd - CachePos ||
+          CacheBuf[CachePos] != '"' || CacheBuf[CachePos + len - 1] != '"')
+        return 0;
+      CachePos += len;
+    }
+  }
+
+  // the macro table after the include ends the file
+  if (end - CachePos < (int)sizeof len)
+    return 0;
+  len = CacheGetInt();
+  if (len < 0 || len > MAX_MACRO_TABLE_LEN || len != end - CachePos)
+    return 0;
+
+  CachePos = 2 * CacheKeyLen + sizeof len;
+  return 1;
+}
+
+// Looks up the file that is about to be included in the cache
+// Returns 1 if its tokens will be replayed, 0 if they will be recorded (or the file is not cached)
+STATIC
+int CacheStart(char* path)
+{
+  struct stat st;
+  char info[64];
+  unsigned h = 0;
+  FILE* f;
+  long len;
+  int i;
+
+  if (stat(path, &st))
+    return 0;
+
+  // the key: the path, size and modification time of the file and the macros defined before the #include
+  CacheBufLen = 0;
+  CacheAdd("bcc include cache 1\n", 20);
+  CacheAdd(path, strlen(path) + 1);
+  sprintf(info, "%ld %ld", (long)st.st_size, (long)st.st_mtime);
+  CacheAdd(info, strlen(info) + 1);
+  CacheAddInt(MacroTableLen);
+  CacheAdd(MacroTable, MacroTableLen);
+  CacheKeyLen = CacheBufLen;
+
+  // the file name leaves out the size and modification time,
+  // so the cache file is replaced when the included file changes
+  for (i = 0; path[i] != '\0'; i++)
+    h = (h << 5) + h + (unsigned char)path[i];
+  for (i = 0; i < MacroTableLen; i++)
+    h = (h << 5) + h + (unsigned char)MacroTable[i];
+  sprintf(CachePath, "%s/%08x.bcc", CacheDir, h & 0xFFFFFFFFu);
+
+  CacheFileCnt = FileCnt + 1;
+  CachePrepSp = PrepSp;
+  CacheValid = 0;
+
+  if ((f = fopen(CachePath, "rb")) != NULL)
+  {
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len > CacheKeyLen)
+    {
+      CacheReserve(len);
+      // a damaged file (e.g. a compile was interrupted while writing it) is recorded again
+      if (fread(CacheBuf + CacheKeyLen, 1, len, f) == (size_t)len &&
+          !memcmp(CacheBuf, CacheBuf + CacheKeyLen, CacheKeyLen) &&
+          CacheCheck(CacheKeyLen + len))
+      {
+        fclose(f);
+        CacheReplaying = 1;
+        return 1;
+      }
+    }
+    fclose(f);
+  }
+
+  // not in the cache (or out of date), record the tokens
+  CacheAddInt(0); // length of the tokens, known at the end
+  return 0;
+}
+
+// Called at the end of the included file that is recorded or replayed
+STATIC
+void CacheEnd(void)
+{
+  char tmpPath[MAX_SEARCH_PATH + 32];
+  FILE* f;
+  int len, ok;
+
+  // a file with an unbalanced #if(n)def depends on its includer, do not cache it
+  if (!CacheReplaying && PrepSp == CachePrepSp && CacheStrLenPos < 0)
+  {
+    len = CacheBufLen - CacheKeyLen - sizeof len;
+    memcpy(CacheBuf + CacheKeyLen, &len, sizeof len);
+    CacheAddInt(MacroTableLen);
+    CacheAdd(MacroTable, MacroTableLen);
+
+    // write a temporary file first and rename it, so an interrupted compile
+    // or another bcc that writes the same entry never leaves a partial file behind
+    sprintf(tmpPath, "%s.%ld.tmp", CachePath, (long)getpid());
+    if ((f = fopen(tmpPath, "wb")) != NULL)
+    {
+      ok = fwrite(CacheBuf, 1, CacheBufLen, f) == (size_t)CacheBufLen;
+      ok &= fclose(f) == 0;
+      if (!ok || rename(tmpPath, CachePath))
+        remove(tmpPath);
+    }
+  }
+
+  CacheStop();
+}
+
+STATIC
+void CacheRecordToken(int tok)
+{
+  char flags = 0;
+
+  if (!CacheValid || strcmp(CacheIdentName, TokenIdentName))
+    flags |= 1;
+  if (!CacheValid || CacheValueInt != TokenValueInt)
+    flags |= 2;
+  CacheValid = 1;
+
+  CacheAddInt(tok);
+  CacheAddInt(LineNo);
+  CacheAddInt(LinePos);
+  CacheAdd(&flags, 1);
+  if (flags & 1)
+  {
+    strcpy(CacheIdentName, TokenIdentName);
+    CacheAdd(TokenIdentName, strlen(TokenIdentName) + 1);
+  }
+  if (flags & 2)
+  {
+    CacheValueInt = TokenValueInt;
+    CacheAddInt(TokenValueInt);
+  }
+
+  if (tok == tokLitStr)
+  {
+    // GetString() adds the chars of the literal
+    CacheStrLenPos = CacheBufLen;
+    CacheAddInt(0);
+    CacheAdd("\"", 1);
+  }
+}
+
+// Adds char ch of the string literal that is recorded
+STATIC
+void CacheRecordChar(unsigned ch)
+{
+  char e[4];
+
+  if (ch >= ' ' && ch <= '~' && ch != '\\' && ch != '"')
+  {
+    e[0] = ch;
+    CacheAdd(e, 1);
+    return;
+  }
+
+  e[0] = '\\';
+  e[1] = '0' + ((ch >> 6) & 7);
+  e[2] = '0' + ((ch >> 3) & 7);
+  e[3] = '0' + (ch & 7);
+  CacheAdd(e, 4);
+}
+
+// Ends the string literal that is recorded
+STATIC
+void CacheRecordStringEnd(void)
+{
+  int len;
+
+  CacheAdd("\"", 1);
+  len = CacheBufLen - CacheStrLenPos - sizeof len;
+  memcpy(CacheBuf + CacheStrLenPos, &len, sizeof len);
+  CacheStrLenPos = -1;
+}
+
+// Returns the next token of the included file that is replayed,
+// or -1 at its end
+STATIC
+int CacheReplayToken(void)
+{
+  int tok, flags;
+
+  if (CachePos >= CacheTokensEnd)
+  {
+    // leave the macro table behind like the included file did
+    MacroTableLen = CacheGetInt();
+    memcpy(MacroTable, CacheBuf + CachePos, MacroTableLen);
+    RehashMacros();
+    CacheStop();
+    return -1;
+  }
+
+  tok = CacheGetInt();
+  LineNo = CacheGetInt();
+  LinePos = CacheGetInt();
+  flags = CacheBuf[CachePos++];
+  if (flags & 1)
+  {
+    strcpy(TokenIdentName, CacheBuf + CachePos);
+    TokenIdentNameLen = strlen(TokenIdentName);
+    CachePos += TokenIdentNameLen + 1;
+  }
+  if (flags & 2)
+    TokenValueInt = CacheGetInt();
+
+  if (tok == tokLitStr)
+  {
+    // let GetString() read the literal from the cache
+    CacheCharsLen = CacheGetInt();
+    CacheChars = CacheBuf + CachePos;
+    CachePos += CacheCharsLen;
+    CharQueueLen = 0;
+    ShiftChar();
+  }
+
+  return tok;
+}
+
 STATIC
 void IncludeFile(int quot)
 {
   int nlen = strlen(TokenValueString);
+  char cFileDir[255] = "";
+  char* path = FileNames[FileCnt]; // the file that was opened
 
   if (CharQueueLen != 3)
     //error("#include parsing error\n");
     errorInternal(2);
 
+  // a file that includes other files is not cached
+  if (CacheFileCnt)
+    CacheStop();
+
   if (FileCnt >= MAX_INCLUDES)
     error("Too many include files\n");
 
@@ -1381,7 +1912,6 @@ void IncludeFile(int quot)
   if (quot == '"')
   {
     // Get path from c file to compile, so it can be appended to the include paths
-    char cFileDir[255] = "";
     strcpy(cFileDir, FileNames[0]);
 
     int len = strlen(cFileDir);  
@@ -1401,6 +1931,8 @@ void IncludeFile(int quot)
     strcpy(FileNames[FileCnt], TokenValueString);
     strcat(cFileDir, FileNames[FileCnt]);
     Files[FileCnt] = fopen(cFileDir, "r");
+    if (Files[FileCnt])
+      path = cFileDir;
   }
 
   // Next, iterate the search paths trying to open "file" or <file>.
@@ -1446,6 +1978,15 @@ void IncludeFile(int quot)
     errorFile(TokenValueString);
   }
 
+  StatIncludes++;
+  if (CacheDir[0] && CacheStart(path))
+  {
+    // the tokens come from the cache, the file itself is not read
+    fclose(Files[FileCnt]);
+    Files[FileCnt] = NULL;
+    StatCacheHits++;
+  }
+
   // reset line/pos and empty the char queue
   CharQueueLen = 0;
   LineNo = LinePos = 1;
@@ -1459,6 +2000,11 @@ void IncludeFile(int quot)
 STATIC
 int EndOfFiles(void)
 {
+#ifndef NO_PREPROCESSOR
+  if (CacheFileCnt == FileCnt)
+    CacheEnd();
+#endif
+
   // if there are no including files, we're done
   if (!--FileCnt)
     return 1;
@@ -1727,6 +2273,10 @@ void GetString(char terminator, int wide, int option)
   while (!(*p == terminator || strchr("\n\r", *p)))
   {
     ch = GetCharValue(wide);
+#ifndef NO_PREPROCESSOR
+    if (CacheStrLenPos >= 0)
+      CacheRecordChar(ch);
+#endif
     switch (option)
     {
     case '#': // string literal (with file name) for #line and #include
@@ -1765,6 +2315,11 @@ void GetString(char terminator, int wide, int option)
   if (option == 'd')
     GenDumpChar(-1);
 
+#ifndef NO_PREPROCESSOR
+  if (CacheStrLenPos >= 0)
+    CacheRecordStringEnd();
+#endif
+
   ShiftCharN(1);
 
   SkipSpace(option != '#');
@@ -2231,7 +2786,7 @@ void Reserve4Expansion(char* name, int len)
 // TBD??? implement file I/O for input source code and output code (use fxn ptrs/wrappers to make librarization possible)
 // DONE: support string literals
 STATIC
-int GetToken(void)
+int GetTokenLex(void)
 {
   char* p = CharQueue;
   int ch;
@@ -2363,6 +2918,12 @@ int GetToken(void)
         //           flag = 2 -- return to a file after #include
         //        other flags -- uninteresting
 
+#ifndef NO_PREPROCESSOR
+        // the line numbers are not kept in the include cache
+        if (CacheFileCnt)
+          CacheStop();
+#endif
+
         // DONE: should also support the following C89 form:
         // # line linenum filename-opt
 
@@ -2559,6 +3120,10 @@ int GetToken(void)
         if (PrepDontSkipTokens)
           IncludeFile(quot);
 
+        // the tokens of a file from the include cache are not lexed
+        if (CacheReplaying && (tok = CacheReplayToken()) >= 0)
+          return tok;
+
         continue;
       }
       else if (!strcmp(TokenIdentName, "ifdef"))
@@ -2635,6 +3200,35 @@ int GetToken(void)
   return tokEof;
 }
 
+STATIC
+int GetToken(void)
+{
+  int tok;
+
+#ifndef NO_PREPROCESSOR
+  if (CacheReplaying)
+  {
+    if ((tok = CacheReplayToken()) >= 0)
+      return tok;
+    // the included file is done, GetTokenLex() continues with the including file
+  }
+#endif
+
+  tok = GetTokenLex();
+
+#ifndef NO_PREPROCESSOR
+  if (CacheFileCnt && !CacheReplaying)
+  {
+    if (tok == tokLitStrWide)
+      CacheStop();
+    else
+      CacheRecordToken(tok);
+  }
+#endif
+
+  return tok;
+}
+
 STATIC
 void errorRedecl(char* s)
 {
@@ -3056,7 +3650,9 @@ int exprUnary(int tok, int* gotUnary, int commaSeparator, int argOfSizeOf)
 
         *--p = "(<"[argOfSizeOf]; // differentiate casts (something#) from not casts <something#>
 
+        UnlinkSymbols(synPtr);
         SyntaxStack1[synPtr] = AddIdent(p);
+        LinkSymbols(synPtr);
         tok = GetToken();
         if (argOfSizeOf)
         {
@@ -3647,9 +4243,9 @@ int divCheckAndCalc(int tok, int* psl, int sr, int Unsigned, int ConstExpr[2])
     if (Unsigned)
     {
       if (tok == '/')
-        sl = (int)((unsigned)division(sl , sr));
+        sl = (int)((unsigned)sl / (unsigned)sr);
       else
-        sl = (int)((unsigned)modulo(sl , sr));
+        sl = (int)((unsigned)sl % (unsigned)sr);
     }
     else
     {
@@ -3825,6 +4421,8 @@ int AllocLocal(unsigned size)
   if (CurFxnMinLocalOfs > CurFxnLocalOfs)
     CurFxnMinLocalOfs = CurFxnLocalOfs;
 
+  GenLocalAlloc(CurFxnLocalOfs, size);
+
   return CurFxnLocalOfs;
 }
 
@@ -6405,7 +7003,58 @@ int TokenStartsDeclaration(int t, int params)
 #ifndef NO_TYPEDEF_ENUM
                       t == tokTypedef ||
 #endif
-                      t == tokStatic));
+                      t == tokStatic || t == tokInline));
+}
+
+STATIC
+int SymbolOpenParen(int pos)
+{
+  // Find the innermost '(' still open before pos
+  int t;
+  if (pos == 0)
+    return -1;
+  t = SyntaxStack0[pos - 1];
+  if (t == '(')
+    return pos - 1;
+  if (t == ')' && SymbolParen[pos - 1] >= 0)
+    return SymbolParen[SymbolParen[pos - 1]];
+  return SymbolParen[pos - 1];
+}
+
+STATIC
+void LinkSymbols(int pos)
+{
+  // Add the entries from pos to the top of the stack to the symbol index
+  for (; pos < SyntaxStackCnt; pos++)
+  {
+    SymbolParen[pos] = SymbolOpenParen(pos);
+    SymbolBucket[pos] = -1;
+    if (SyntaxStack0[pos] == tokIdent)
+    {
+      int h = SyntaxStack1[pos] & (SYMBOL_HASH_SIZE - 1);
+      SymbolBucket[pos] = h;
+      SymbolHashNext[pos] = SymbolHash[h];
+      SymbolHash[h] = pos;
+    }
+  }
+}
+
+STATIC
+void UnlinkSymbols(int pos)
+{
+  // Remove the entries from the top of the stack down to pos from the
+  // symbol index, each of them is at the head of its hash chain when it's removed
+  int i;
+  for (i = SyntaxStackCnt - 1; i >= pos; i--)
+    if (SymbolBucket[i] >= 0)
+      SymbolHash[SymbolBucket[i]] = SymbolHashNext[i];
+}
+
+STATIC
+void UndoSyntax(int cnt)
+{
+  UnlinkSymbols(cnt);
+  SyntaxStackCnt = cnt;
 }
 
 STATIC
@@ -6415,6 +7064,7 @@ void PushSyntax2(int t, int v)
     error("Symbol table exhausted\n");
   SyntaxStack0[SyntaxStackCnt] = t;
   SyntaxStack1[SyntaxStackCnt++] = v;
+  LinkSymbols(SyntaxStackCnt - 1);
 }
 
 STATIC
@@ -6428,6 +7078,7 @@ void InsertSyntax2(int pos, int t, int v)
 {
   if (SyntaxStackCnt >= SYNTAX_STACK_MAX)
     error("Symbol table exhausted\n");
+  UnlinkSymbols(pos);
   memmove(&SyntaxStack0[pos + 1],
           &SyntaxStack0[pos],
           sizeof(SyntaxStack0[0]) * (SyntaxStackCnt - pos));
@@ -6437,6 +7088,7 @@ void InsertSyntax2(int pos, int t, int v)
   SyntaxStack0[pos] = t;
   SyntaxStack1[pos] = v;
   SyntaxStackCnt++;
+  LinkSymbols(pos);
 }
 
 STATIC
@@ -6448,6 +7100,7 @@ void InsertSyntax(int pos, int t)
 STATIC
 void DeleteSyntax(int pos, int cnt)
 {
+  UnlinkSymbols(pos);
   memmove(&SyntaxStack0[pos],
           &SyntaxStack0[pos + cnt],
           sizeof(SyntaxStack0[0]) * (SyntaxStackCnt - (pos + cnt)));
@@ -6455,37 +7108,37 @@ void DeleteSyntax(int pos, int cnt)
           &SyntaxStack1[pos + cnt],
           sizeof(SyntaxStack1[0]) * (SyntaxStackCnt - (pos + cnt)));
   SyntaxStackCnt -= cnt;
+  LinkSymbols(pos);
 }
 
 STATIC
 int FindSymbol(char* s)
 {
-  int i;
+  int i, id;
 
   // TBD!!! return declaration scope number so
   // redeclarations can be reported if occur in the same scope.
 
-  // TBD??? Also, I could first use FindIdent() and then just look for the
-  // index into IdentTable[] instead of doing strcmp()
+  // Identifiers are unique in IdentTable[], so look the name up once
+  // and then just compare the indices into IdentTable[]
+  StatSymbolLookups++;
+  if ((id = FindIdent(s)) < 0)
+    return -1;
 
-  for (i = SyntaxStackCnt - 1; i >= 0; i--)
+  for (i = SymbolHash[id & (SYMBOL_HASH_SIZE - 1)]; i >= 0; i = SymbolHashNext[i])
   {
-    int t = SyntaxStack0[i];
-    if (t == tokIdent &&
-        !strcmp(IdentTable + SyntaxStack1[i], s))
+    StatSymbolProbes++;
+    // The entry may have been changed in place, e.g. into a tokTypedef
+    if (SyntaxStack0[i] == tokIdent &&
+        SyntaxStack1[i] == id)
     {
-      return i;
-    }
-
-    if (t == ')')
-    {
-      // Skip over the function params
-      int c = -1;
-      while (c)
-      {
-        t = SyntaxStack0[--i];
-        c += (t == '(') - (t == ')');
-      }
+      // Skip over the params of the functions declared so far,
+      // only the params of a '(' that's still open are visible
+      int p = SymbolOpenParen(SyntaxStackCnt);
+      while (p > SymbolParen[i])
+        p = SymbolParen[p];
+      if (p == SymbolParen[i])
+        return i;
     }
   }
 
@@ -6523,15 +7176,18 @@ int SymType(int SynPtr)
 STATIC
 int FindTaggedDecl(char* s, int start, int* CurScope)
 {
-  int i;
+  int i, id;
 
   *CurScope = 1;
 
+  if ((id = FindIdent(s)) < 0)
+    return -1;
+
   for (i = start; i >= 0; i--)
   {
     int t = SyntaxStack0[i];
     if (t == tokTag &&
-        !strcmp(IdentTable + SyntaxStack1[i], s))
+        SyntaxStack1[i] == id)
     {
       return i - 1;
     }
@@ -6560,13 +7216,16 @@ int FindTaggedDecl(char* s, int start, int* CurScope)
 STATIC
 int FindTypedef(char* s)
 {
-  int i;
+  int i, id;
+
+  if ((id = FindIdent(s)) < 0)
+    return -1;
 
   for (i = SyntaxStackCnt - 1; i >= 0; i--)
   {
     int t = SyntaxStack0[i];
     if ((t == tokTypedef || t == tokIdent) &&
-        !strcmp(IdentTable + SyntaxStack1[i], s))
+        SyntaxStack1[i] == id)
     {
       // if the closest declaration isn't from typedef,
       // (i.e. if it's a variable/function declaration),
@@ -6929,8 +7588,8 @@ int ParseArrayDimension(int AllowEmptyDimension)
   oldesp = sp;
   undoIdents = IdentTableLen;
   tok = ParseExpr(tok, &gotUnary, &synPtr, &constExpr, &exprVal, 0, 0);
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof"
-  SyntaxStackCnt = oldssp; // undo any temporary declarations from e.g. "sizeof" in the expression
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof"
+  UndoSyntax(oldssp); // undo any temporary declarations from e.g. "sizeof" in the expression
   sp = oldesp;
 
   if (tok != ']')
@@ -6972,6 +7631,8 @@ static int BrkCntTargetFxn[2];
 STATIC
 int ParseBlock(int BrkCntTarget[2], int casesIdx);
 STATIC
+int ParseDeadStatement(int tok, int BrkCntTarget[2], int casesIdx, long pos, int* dead);
+STATIC
 void AddFxnParamSymbols(int SyntaxPtr);
 STATIC
 void CheckRedecl(int lastSyntaxPtr);
@@ -7166,8 +7827,8 @@ lcont:
 
             tok = ParseExpr(GetToken(), &gotUnary, &synPtr, &constExpr, &val, ',', 0);
 
-            IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof"
-            SyntaxStackCnt = oldssp; // undo any temporary declarations from e.g. "sizeof" in the expression
+            UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof"
+            UndoSyntax(oldssp); // undo any temporary declarations from e.g. "sizeof" in the expression
             sp = oldesp;
 
             if (!gotUnary)
@@ -7581,7 +8242,7 @@ int InitVar(int synPtr, int tok)
   if (!strchr(",;", tok))
     errorUnexpectedToken(tok);
 
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof" or "str"
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof" or "str"
 
   return tok;
 }
@@ -7683,8 +8344,8 @@ int InitScalar(int synPtr, int tok)
     //error("ParseDecl(): cannot initialize a global variable with a non-constant expression\n");
     errorNotConst();
 
-  IdentTableLen = undoIdents; // remove all temporary identifier names from e.g. "sizeof" or "str"
-  SyntaxStackCnt = oldssp; // undo any temporary declarations from e.g. "sizeof" or "str" in the expression
+  UndoIdents(undoIdents); // remove all temporary identifier names from e.g. "sizeof" or "str"
+  UndoSyntax(oldssp); // undo any temporary declarations from e.g. "sizeof" or "str" in the expression
   return tok;
 }
 
@@ -8153,14 +8814,26 @@ int ParseDecl(int tok, unsigned structInfo[4], int cast, int label)
 {
   int base[2];
   int lastSyntaxPtr;
-  int external = tok == tokExtern;
-  int Static = tok == tokStatic;
+  int Inline = 0;
+  int external, Static;
 #ifndef NO_TYPEDEF_ENUM
-  int typeDef = tok == tokTypedef;
+  int typeDef;
 #else
   (void)label;
 #endif
 
+  // inline can come before or after the storage class
+  if (tok == tokInline)
+  {
+    Inline = 1;
+    tok = GetToken();
+  }
+  external = tok == tokExtern;
+  Static = tok == tokStatic;
+#ifndef NO_TYPEDEF_ENUM
+  typeDef = tok == tokTypedef;
+#endif
+
   if (external |
 #ifndef NO_TYPEDEF_ENUM
       typeDef |
@@ -8168,11 +8841,20 @@ int ParseDecl(int tok, unsigned structInfo[4], int cast, int label)
       Static)
   {
     tok = GetToken();
+    if (tok == tokInline)
+    {
+      Inline = 1;
+      tok = GetToken();
+    }
     if (!TokenStartsDeclaration(tok, 1))
       //error("ParseDecl(): unexpected token %s\n", GetTokenName(tok));
       // Implicit int (as in "extern x; static y;") isn't supported
       errorUnexpectedToken(tok);
   }
+  else if (Inline && !TokenStartsDeclaration(tok, 1))
+  {
+    errorUnexpectedToken(tok);
+  }
   tok = ParseBase(tok, base);
 
 #ifndef NO_TYPEDEF_ENUM
@@ -8613,6 +9295,8 @@ int ParseDecl(int tok, unsigned structInfo[4], int cast, int label)
         int i;
         int endLabel = 0;
 
+        GenFxnStart(IdentTable + SyntaxStack1[lastSyntaxPtr]);
+
 #ifndef NO_ANNOTATIONS
         DumpDecl(lastSyntaxPtr, 0);
 #endif
@@ -8621,6 +9305,8 @@ int ParseDecl(int tok, unsigned structInfo[4], int cast, int label)
         IsMain = !strcmp(CurFxnName, "main");
 
         gotoLabCnt = 0;
+        CurFxnAsmUsed = 0;
+        CurFxnInline = Inline;
 
         if (verbose)
           printf("%s()\n", CurFxnName);
@@ -8722,9 +9408,11 @@ int ParseDecl(int tok, unsigned structInfo[4], int cast, int label)
         }
 #endif
 
+        GenFxnEnd();
+
         CurFxnName = NULL;
-        IdentTableLen = undoIdents; // remove all identifier names
-        SyntaxStackCnt = undoSymbolsPtr; // remove all params and locals
+        UndoIdents(undoIdents); // remove all identifier names
+        UndoSyntax(undoSymbolsPtr); // remove all params and locals
         SyntaxStack1[SymFuncPtr] = DummyIdent;
       }
 #ifndef NO_ANNOTATIONS
@@ -9045,7 +9733,7 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
         //error("ParseStatement(): '}' expected. Unexpected token %s\n", GetTokenName(tok));
         errorUnexpectedToken(tok);
       UndoNonLabelIdents(undoIdents); // remove all identifier names, except those of labels
-      SyntaxStackCnt = undoSymbolsPtr; // remove all params and locals
+      UndoSyntax(undoSymbolsPtr); // remove all params and locals
       CurFxnLocalOfs = undoLocalOfs; // destroy on-stack local variables
 #ifndef NO_ANNOTATIONS
       GenStartCommentLine(); printf2("}\n");
@@ -9226,7 +9914,8 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
     {
       int labelBefore = LabelCnt++;
       int labelAfter = LabelCnt++;
-      int forever = 0;
+      int forever = 0, dead;
+      long deadPos = -1;
 #ifndef NO_ANNOTATIONS
       GenStartCommentLine(); printf2("while\n");
 #endif
@@ -9260,7 +9949,10 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
 #endif
         // Special cases for while(0) and while(1)
         if (!(forever = truncInt(exprVal)))
+        {
+          deadPos = GenGetFxnPos();
           GenJumpUncond(labelAfter);
+        }
       }
       else
       {
@@ -9304,7 +9996,10 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
       tok = GetToken();
       brkCntTarget[0] = labelAfter; // break target
       brkCntTarget[1] = labelBefore; // continue target
-      tok = ParseStatement(tok, brkCntTarget, casesIdx);
+      if (deadPos >= 0)
+        tok = ParseDeadStatement(tok, brkCntTarget, casesIdx, deadPos, &dead);
+      else
+        tok = ParseStatement(tok, brkCntTarget, casesIdx);
 
       // Special case for while(0)
       if (!(constExpr && !forever))
@@ -9415,6 +10110,8 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
     {
       int labelAfterIf = LabelCnt++;
       int labelAfterElse = LabelCnt++;
+      int alwaysTrue = 0, dead = 0;
+      long deadPos = -1;
 #ifndef NO_ANNOTATIONS
       GenStartCommentLine(); printf2("if\n");
 #endif
@@ -9446,7 +10143,14 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
 #endif
         // Special cases for if(0) and if(1)
         if (!truncInt(exprVal))
+        {
+          deadPos = GenGetFxnPos();
           GenJumpUncond(labelAfterIf);
+        }
+        else
+        {
+          alwaysTrue = 1;
+        }
       }
       else
       {
@@ -9488,18 +10192,27 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
       }
 
       tok = GetToken();
-      tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+      if (deadPos >= 0)
+        tok = ParseDeadStatement(tok, BrkCntTarget, casesIdx, deadPos, &dead);
+      else
+        tok = ParseStatement(tok, BrkCntTarget, casesIdx);
 
       // DONE: else
       if (tok == tokElse)
       {
-        GenJumpUncond(labelAfterElse);
+        deadPos = alwaysTrue ? GenGetFxnPos() : -1;
+        // No need to jump over the else part if there's no code before it
+        if (!dead)
+          GenJumpUncond(labelAfterElse);
         GenNumLabel(labelAfterIf);
 #ifndef NO_ANNOTATIONS
         GenStartCommentLine(); printf2("else\n");
 #endif
         tok = GetToken();
-        tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+        if (deadPos >= 0)
+          tok = ParseDeadStatement(tok, BrkCntTarget, casesIdx, deadPos, &dead);
+        else
+          tok = ParseStatement(tok, BrkCntTarget, casesIdx);
         GenNumLabel(labelAfterElse);
       }
       else
@@ -9685,7 +10398,7 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
       if (decl)
       {
         UndoNonLabelIdents(undoIdents); // remove all identifier names, except those of labels
-        SyntaxStackCnt = undoSymbolsPtr; // remove all params and locals
+        UndoSyntax(undoSymbolsPtr); // remove all params and locals
         CurFxnLocalOfs = undoLocalOfs; // destroy on-stack local variables
       } 
 #endif
@@ -9723,7 +10436,6 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
       int undoCases = CasesCnt;
       int brkLabel = LabelCnt++;
       int lbl = LabelCnt++;
-      int i;
 #ifndef NO_ANNOTATIONS
       GenStartCommentLine(); printf2("switch\n");
 #endif
@@ -9773,15 +10485,10 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
 
       // End of switch reached (not via break), skip conditional jumps
       GenJumpUncond(brkLabel);
-      // Generate conditional jumps
+      // Generate the jumps to the cases (a jump table or a binary search),
+      // if none of the cases matches, take the default case
       GenNumLabel(lbl);
-      for (i = undoCases + 1; i < CasesCnt; i++)
-      {
-        GenJumpIfEqual(Cases[i][0], Cases[i][1]);
-      }
-      // If none of the cases matches, take the default case
-      if (Cases[undoCases][1] != brkLabel)
-        GenJumpUncond(Cases[undoCases][1]);
+      GenSwitch(undoCases + 1, CasesCnt, Cases[undoCases][1]);
       GenNumLabel(brkLabel); // break label
 
       CasesCnt = undoCases;
@@ -9852,6 +10559,7 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
     }
     else if (tok == tok_Asm)
     {
+      CurFxnAsmUsed = 1;
       tok = GetToken();
       if (tok != '(')
         //error("ParseStatement(): '(' expected after 'asm'\n");
@@ -9921,10 +10629,30 @@ int ParseStatement(int tok, int BrkCntTarget[2], int casesIdx)
 }
 
 // TBD!!! think of ways of getting rid of casesIdx
+// Parses a statement that can only be reached through a case or goto label in it.
+// If it has no such labels, throws away the code generated for it and since pos.
+// *dead tells whether the code has been thrown away.
+STATIC
+int ParseDeadStatement(int tok, int BrkCntTarget[2], int casesIdx, long pos, int* dead)
+{
+  int cases = CasesCnt;
+  int labels = gotoLabDefCnt;
+  int def = casesIdx ? Cases[casesIdx - 1][1] : 0;
+
+  tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+
+  *dead = cases == CasesCnt && labels == gotoLabDefCnt &&
+          def == (casesIdx ? Cases[casesIdx - 1][1] : 0) && pos >= 0;
+  if (*dead)
+    GenDropFxnCode(pos);
+  return tok;
+}
+
 STATIC
 int ParseBlock(int BrkCntTarget[2], int casesIdx)
 {
   int tok = GetToken();
+  int dead = 0;
 
   // Catch redeclarations of function parameters by not
   // beginning a new scope if this block begins a function
@@ -9958,12 +10686,21 @@ int ParseBlock(int BrkCntTarget[2], int casesIdx)
         tok = GetToken();
         // a statement is needed after "label:"
         tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+        dead = 0;
       }
 #endif
     }
     else if (ParseLevel > 0 || tok == tok_Asm)
     {
-      tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+      int t = tok;
+      // Statements following return, break, continue and goto are unreachable
+      // until there's a label
+      if (dead)
+        tok = ParseDeadStatement(tok, BrkCntTarget, casesIdx, GenGetFxnPos(), &dead);
+      else
+        tok = ParseStatement(tok, BrkCntTarget, casesIdx);
+      if (t == tokReturn || t == tokBreak || t == tokCont || t == tokGoto)
+        dead = 1;
     }
     else
       //error("ParseBlock(): Unexpected token %s\n", GetTokenName(tok));
@@ -9975,6 +10712,7 @@ int main(int argc, char** argv)
 {
   // gcc/MinGW inserts a call to __main() here.
   int i;
+  clock_t tStart = clock(), tParse, tFin, tEnd;
 
   // Run-time initializer for SyntaxStack0[] to reduce
   // executable file size (SyntaxStack0[] will be in .bss)
@@ -9994,6 +10732,15 @@ int main(int argc, char** argv)
   memcpy(SyntaxStack0, SyntaxStackInit, sizeof SyntaxStackInit);
   SyntaxStackCnt = division(sizeof SyntaxStackInit , sizeof SyntaxStackInit[0]);
 
+  for (i = 0; i < IDENT_HASH_SIZE; i++)
+    IdentHash[i] = -1;
+  for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+    SymbolHash[i] = -1;
+#ifndef NO_PREPROCESSOR
+  for (i = 0; i < MACRO_HASH_SIZE; i++)
+    MacroHash[i] = -1;
+#endif
+
 #ifdef __SMALLER_C__
 #ifdef DETERMINE_VA_LIST
   DetermineVaListType();
@@ -10001,6 +10748,7 @@ int main(int argc, char** argv)
 #endif
 
   SyntaxStack1[SymFuncPtr] = DummyIdent = AddIdent("");
+  LinkSymbols(0);
 
 #ifndef NO_FP
   {
@@ -10034,6 +10782,11 @@ int main(int argc, char** argv)
       compileUserBDOS = 1;
       continue;
     }
+    else if (!strcmp(argv[i], "--lib"))
+    {
+      compileLib = 1;
+      continue;
+    }
     else if (!strcmp(argv[i], "-signed-char"))
     {
       // this is the default option
@@ -10106,6 +10859,11 @@ int main(int argc, char** argv)
       warnings = 1;
       continue;
     }
+    else if (!strcmp(argv[i], "--stats"))
+    {
+      stats = 1;
+      continue;
+    }
 #ifndef NO_PREPROCESSOR
     else if (!strcmp(argv[i], "-I") || !strcmp(argv[i], "-SI"))
     {
@@ -10131,6 +10889,17 @@ int main(int argc, char** argv)
         continue;
       }
     }
+    else if (!strcmp(argv[i], "-cache"))
+    {
+      if (i + 1 < argc)
+      {
+        if (strlen(argv[++i]) >= MAX_SEARCH_PATH)
+          //error("Path name too long\n");
+          errorFileName();
+        strcpy(CacheDir, argv[i]);
+        continue;
+      }
+    }
     else if (!strcmp(argv[i], "-nopp"))
     {
       // TBD!!! don't do preprocessing when this option is present
@@ -10267,8 +11036,10 @@ int main(int argc, char** argv)
 #ifndef NO_PPACK
   PragmaPackValue = SizeOfWord;
 #endif
+  tParse = clock();
   ParseBlock(NULL, 0);
 
+  tFin = clock();
   GenFin();
 
 #ifndef NO_ANNOTATIONS
@@ -10288,9 +11059,27 @@ int main(int argc, char** argv)
   if (warnings && warnCnt)
     printf("%d warnings\n", warnCnt);
   GenStartCommentLine(); printf2("Compilation succeeded.\n");
+  GenWriteOutput();
 
   if (OutFile)
     fclose(OutFile);
 
+  if (stats)
+  {
+    tEnd = clock();
+    printf("Identifier lookups: %u (%u entries compared)\n", StatIdentLookups, StatIdentProbes);
+    printf("Macro lookups:      %u (%u entries compared)\n", StatMacroLookups, StatMacroProbes);
+    printf("Symbol lookups:     %u (%u entries scanned)\n", StatSymbolLookups, StatSymbolProbes);
+    printf("Unused functions:   %u\n", StatDeadFxns);
+    printf("Included files:     %u (%u from the include cache)\n", StatIncludes, StatCacheHits);
+    printf("Setup:              %.3f s\n", (double)(tParse - tStart) / CLOCKS_PER_SEC);
+    printf("Parse and generate: %.3f s\n",
+           (double)(tFin - tParse - StatTimeOptimize - StatTimeOutput) / CLOCKS_PER_SEC);
+    printf("Optimize:           %.3f s\n", (double)StatTimeOptimize / CLOCKS_PER_SEC);
+    printf("Output:             %.3f s\n", (double)StatTimeOutput / CLOCKS_PER_SEC);
+    printf("Finish:             %.3f s\n", (double)(tEnd - tFin) / CLOCKS_PER_SEC);
+    printf("Total:              %.3f s\n", (double)(tEnd - tStart) / CLOCKS_PER_SEC);
+  }
+
   return 0;
 }
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# script for checking that assembling BDOS with -O (like compileBDOS.sh) keeps the labels that are still used,
+#  like the loop labels in the asm() bodies of functions
+
+echo "Compiling C code to B332 ASM"
+if (./bcc --os BDOS/BDOS.c ../Assembler/code.asm) # compile c code and write compiled code to code.asm in Assembler folder
+then
+    echo "C code successfully compiled"
+
+    echo "Assembling B332 ASM code with -O"
+    if (cd ../Assembler && python3 Assembler.py os -O -o /tmp/checkBDOSlabels.bin -sym /tmp/checkBDOSlabels.sym)
+    then
+        echo "B332 ASM code successfully assembled"
+        (cd ../Assembler && python3 checkRemovedLabels.py code.asm /tmp/checkBDOSlabels.sym \
+            GFX_clearBGpaletteTableLoop GFX_scrollUpLoop FS_spiReadBytesLoop FS_sendDataLoop WizSpiWriteBytesLoop)
+    else # assemble failed, the assembler has printed the error
+        echo "Failed to assemble B332 ASM code"
+        exit 1
+    fi
+else # compile failed
+    echo "Failed to compile C code"
+    exit 1
+fi
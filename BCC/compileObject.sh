@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# script for compiling a C file to a relocatable object, which can be linked with Assembler/Linker.py
+# usage: ./compileObject.sh [bcc flags] file.c file.o
+# use --lib for library objects, these do not have the startup and interrupt wrapper code
+# example for a BDOS user program with a prebuilt library object,
+# where userBDOS/LIBS.C defines word and includes the libraries (LIB/MATH.C, LIB/STDLIB.C, LIB/SYS.C):
+#   ./compileObject.sh --bdos --lib userBDOS/LIBS.C libs.o
+#   ./compileObject.sh --bdos userBDOS/PROGRAM.C program.o
+#   (cd ../Assembler && python3 Linker.py bdos 0x400000 -o ../Programmer/code.bin ../BCC/program.o ../BCC/libs.o)
+
+OBJFILE="${@: -1}"
+OBJFILE="$(cd "$(dirname "$OBJFILE")" && pwd)/$(basename "$OBJFILE")" # the assembler runs in another folder
+
+echo "Compiling C code to B332 ASM"
+if (./bcc "${@:1:$#-1}" ../Assembler/code.asm) # compile c code and write compiled code to code.asm in Assembler folder
+then
+    echo "C code successfully compiled"
+
+    echo "Assembling B332 ASM code to object"
+    if (cd ../Assembler && python3 Assembler.py -c "$OBJFILE") # assemble and write the object
+    then
+        echo "B332 ASM code successfully assembled to $OBJFILE"
+    else # assemble failed, the assembler has printed the error
+        echo "Failed to assemble B332 ASM code"
+        exit 1
+    fi
+else # compile failed
+    echo "Failed to compile C code"
+    exit 1
+fi
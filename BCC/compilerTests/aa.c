@@ -0,0 +1,92 @@
+// switch with case values from INT_MIN to INT_MAX
+int extremes(int x)
+{
+    switch (x)
+    {
+        case -2147483647 - 1: return 1;
+        case -1: return 2;
+        case 0: return 3;
+        case 1: return 4;
+        case 2147483647: return 5;
+    }
+    return 9;
+}
+
+// dense switch (jump table) with negative values
+int dense(int x)
+{
+    switch (x)
+    {
+        case -3: return 1;
+        case -2: return 2;
+        case -1: return 3;
+        case 0: return 4;
+        case 2: return 5;
+        case 3: return 6;
+        default: return 9;
+    }
+}
+
+// sparse switch (compare tree) with a dense cluster
+int sparse(int x)
+{
+    switch (x)
+    {
+        case -100000: return 1;
+        case 7: return 2;
+        case 500: return 3;
+        case 501: return 4;
+        case 502: return 5;
+        case 504: return 6;
+        case 100000: return 7;
+    }
+    return 9;
+}
+
+int main()
+{
+    int r = 0;
+    int i;
+
+    if (extremes(-2147483647 - 1) == 1) r += 1;
+    if (extremes(-1) == 2) r += 1;
+    if (extremes(0) == 3) r += 1;
+    if (extremes(1) == 4) r += 1;
+    if (extremes(2147483647) == 5) r += 1;
+    if (extremes(2) == 9) r += 1;
+    if (extremes(-2147483647) == 9) r += 1;
+
+    for (i = -5; i <= 5; i++)
+        r += dense(i); // 9+9+1+2+3+4+9+5+6+9+9 = 66
+
+    if (sparse(-100000) == 1) r += 1;
+    if (sparse(7) == 2) r += 1;
+    if (sparse(501) == 4) r += 1;
+    if (sparse(503) == 9) r += 1;
+    if (sparse(504) == 6) r += 1;
+    if (sparse(100000) == 7) r += 1;
+    if (sparse(-7) == 9) r += 1;
+
+    return r; // 7 + 66 + 7 = 80
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
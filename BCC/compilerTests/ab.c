@@ -0,0 +1,71 @@
+// locals and parameters that are kept in callee-saved registers
+
+int twice(int x)
+{
+    return x + x;
+}
+
+void addTo(int* p, int v)
+{
+    *p += v;
+}
+
+// more locals than registers, all live across calls
+int manyLocals(int a, int b)
+{
+    int c = a + 1;
+    int d = b + 2;
+    int e = c + d;
+    int f = twice(e);
+    int g = twice(a) + b;
+    int h = f - g;
+    return a + b + c + d + e + f + g + h; // with (1, 2): 1+2+2+4+6+12+4+8 = 39
+}
+
+// a local whose address is taken has to stay in memory
+int addressTaken(int n)
+{
+    int sum = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        addTo(&sum, i);
+    return sum;
+}
+
+// parameters stay correct in recursion
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+    int r = 0;
+    r += manyLocals(1, 2); // 39
+    r += addressTaken(6);  // 15
+    r += fib(10);          // 55
+    return r;              // 109
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
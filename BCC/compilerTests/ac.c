@@ -0,0 +1,78 @@
+// comparisons, branches and moves, which the -O peephole optimizer rewrites
+
+int lt(int a, int b) { return a < b; }
+int ge(int a, int b) { return a >= b; }
+int ult(unsigned int a, unsigned int b) { return a < b; }
+int uge(unsigned int a, unsigned int b) { return a >= b; }
+
+int g = 0;
+
+int classify(int x)
+{
+    if (x < -1000)
+        return 1;
+    if (x <= 0)
+        return 2;
+    if (x == 5 || x == 70000)
+        return 3;
+    if (x > 10 && x != 12)
+        return 4;
+    return 5;
+}
+
+int main()
+{
+    int r = 0;
+    int a = 3;
+    int b = a;
+    int c;
+    int i;
+
+    // comparisons as values
+    r += lt(-5, 3) + ge(-5, 3) * 2;                     // 1
+    r += ult(0xFFFFFFFF, 3) * 4 + uge(0xFFFFFFFF, 3);   // 1
+    r += (a == b) + (a != b) * 2 + (a > 2) + (a <= 2);  // 2
+
+    // comparisons in branches, with small and large constants
+    r += classify(-70000) + classify(0) + classify(5) + classify(70000) + classify(12) + classify(11); // 1+2+3+3+5+4 = 18
+
+    // store followed by a load of the same variable, and chains of moves
+    g = a + 4;
+    c = g;
+    b = c;
+    a = b;
+    r += a + g; // 14
+
+    // loop with a condition on a value computed in the loop
+    c = 0;
+    for (i = 0; i < 10; i++)
+    {
+        if ((i & 1) == 0)
+            continue;
+        c += i;
+    }
+    r += c; // 25
+
+    return r; // 1 + 1 + 2 + 18 + 14 + 25 = 61
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
@@ -0,0 +1,92 @@
+// leaf functions, which can use their parameters in registers without a frame
+
+int one(int a)
+{
+    return a + 1;
+}
+
+int four(int a, int b, int c, int d)
+{
+    return a - b + c * d;
+}
+
+// more parameters than argument registers
+int six(int a, int b, int c, int d, int e, int f)
+{
+    return a + b + c + d + e - f;
+}
+
+// parameters that are changed in the body
+int countDown(int n, int step)
+{
+    int steps = 0;
+    while (n > 0)
+    {
+        n -= step;
+        steps++;
+    }
+    return steps + n;
+}
+
+// a leaf with a local array needs a frame
+int arraySum(int n)
+{
+    int a[5];
+    int i;
+    int sum = 0;
+    for (i = 0; i < 5; i++)
+        a[i] = n + i;
+    for (i = 0; i < 5; i++)
+        sum += a[i];
+    return sum;
+}
+
+// a leaf that writes through a pointer parameter
+void store(int* p, int v)
+{
+    *p = v;
+}
+
+// not a leaf, the parameters have to survive the calls
+int outer(int a, int b)
+{
+    int x = one(a);
+    int y = four(a, b, 2, 3);
+    return x + y + a + b;
+}
+
+int main()
+{
+    int r = 0;
+    int v = 0;
+    r += one(4);                  // 5
+    r += four(7, 2, 3, 4);        // 17
+    r += six(1, 2, 3, 4, 5, 6);   // 9
+    r += countDown(10, 3);        // 4 + -2 = 2
+    r += arraySum(2);             // 20
+    store(&v, 11);
+    r += v;                       // 11
+    r += outer(5, 1);             // 6 + 10 + 6 = 22
+    return r;                     // 86
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
@@ -0,0 +1,85 @@
+// calls to small functions that are replaced by their body
+
+int later(int a);
+
+inline int square(int a)
+{
+    return a * a;
+}
+
+// has labels of its own, which must stay unique when it is inlined more than once
+inline int clamp(int v, int lo, int hi)
+{
+    if (v < lo)
+        return lo;
+    if (v > hi)
+        return hi;
+    return v;
+}
+
+// calls inline functions itself
+inline int sumOfSquares(int a, int b)
+{
+    return square(a) + square(b);
+}
+
+// small enough to be inlined with -O without the inline keyword
+int inc(int a)
+{
+    return a + 1;
+}
+
+// recursion is never inlined
+int fact(int n)
+{
+    if (n < 2)
+        return 1;
+    return n * fact(n - 1);
+}
+
+int apply(int (*f)(int), int v)
+{
+    return f(v);
+}
+
+int main()
+{
+    int r = 0;
+    int i = 3;
+    r += square(i++);                           // 9, i is incremented once
+    r += i;                                     // 4
+    r += clamp(-5, 0, 10) + clamp(20, 0, 10) + clamp(7, 0, 10); // 0 + 10 + 7
+    r += sumOfSquares(2, 3);                    // 13
+    r += inc(inc(1));                           // 3
+    r += fact(4);                               // 24
+    r += apply(square, 5);                      // 25, through a pointer
+    r += apply(inc, 1);                         // 2
+    r += later(6);                              // 7, defined after the call
+    return r;                                   // 104
+}
+
+inline int later(int a)
+{
+    return a + 1;
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
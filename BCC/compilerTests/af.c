@@ -0,0 +1,98 @@
+// algebraic identities and code that can't be reached
+
+int calls = 0;
+
+int count(int v)
+{
+    calls++;
+    return v;
+}
+
+int identities(int x)
+{
+    int r = 0;
+    unsigned u = 40;
+    int y = x;
+    r += count(x) + 0;      // count() is still called
+    r += x * 1 - 0;
+    r += (x | 0) + (x ^ 0) + (x & -1);
+    r += (x << 0) + (x >> 0);
+    r += -7 / 1;            // -7
+    r += -7 / 2;            // -3, signed division is not a shift
+    r += u / 8;             // 5
+    y *= 4;
+    r += y;
+    return r;               // with 3: 3 + 3 + 9 + 6 - 7 - 3 + 5 + 12 = 28
+}
+
+int deadCode(int n)
+{
+    int r = 0;
+    if (0)
+        r += 100;
+    while (0)
+        r += 100;
+    if (1)
+        r += 1;
+    else
+        r += 100;
+
+    // goto into the body of an if (0)
+    if (n)
+        goto inside;
+    if (0)
+    {
+        r += 100;
+inside:
+        r += 2;
+    }
+
+    // case labels inside code that looks dead
+    switch (n)
+    {
+    case 0:
+        r += 100;
+        break;
+        r += 100;
+    case 1:
+        if (0)
+        {
+    case 2:
+            r += 4;
+        }
+        r += 8;
+    }
+    return r;
+    r += 100;
+}
+
+int main()
+{
+    int r = 0;
+    r += identities(3);     // 28
+    r += calls;             // 1
+    r += deadCode(2);       // 1 + 2 + 4 + 8 = 15
+    r += deadCode(1);       // 1 + 2 + 8 = 11
+    return r;               // 55
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
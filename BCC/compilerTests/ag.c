@@ -0,0 +1,101 @@
+// loops whose array indexing is turned into pointer increments
+
+struct Pair
+{
+    int a;
+    int b;
+};
+
+int src[16];
+int dst[16];
+struct Pair pairs[6];
+int grid[4][5];
+
+void copy(int* d, int* s, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        d[i] = s[i];
+}
+
+int main()
+{
+    int r = 0;
+    int i, j;
+    int local[8];
+
+    for (i = 0; i < 16; i++)
+        src[i] = i;
+
+    copy(dst, src, 16);
+    r += dst[15] + dst[1];          // 16
+
+    // stepped by 2
+    for (i = 0; i < 16; i += 2)
+        r += src[i];                // 56
+
+    // counting down
+    for (i = 7; i >= 0; i--)
+        local[i] = src[i] * 2;
+    r += local[7] + local[0];       // 14
+
+    // the counter is changed in the body as well
+    for (i = 0; i < 16; i++)
+    {
+        r += src[i];
+        i += 3;
+    }                               // 0 + 4 + 8 + 12 = 24
+
+    // larger elements
+    for (i = 0; i < 6; i++)
+    {
+        pairs[i].a = i;
+        pairs[i].b = src[i + 1];
+    }
+    r += pairs[5].a + pairs[5].b;   // 11
+
+    // nested
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 5; j++)
+            grid[i][j] = i * j;
+    r += grid[3][4] + grid[2][3];   // 18
+
+    // break and continue, counter used after the loop
+    for (i = 0; i < 16; i++)
+    {
+        if (src[i] == 3)
+            continue;
+        if (src[i] == 6)
+            break;
+        r += src[i];
+    }                               // 0 + 1 + 2 + 4 + 5 = 12
+    r += i;                         // 6
+
+    // compare loop
+    for (i = 0; i < 16 && src[i] == dst[i]; i++)
+        ;
+    r += i;                         // 16
+
+    return r;                       // 173
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
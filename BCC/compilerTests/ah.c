@@ -0,0 +1,115 @@
+// structure copies and memcpy() of a constant size, generated as copy instructions
+// a char is one word, so the sizes below are in words
+
+struct S1 { char a; };
+struct S2 { char a, b; };
+struct S3 { char a, b, c; };
+struct S8 { char a[8]; };
+struct S9 { char a[9]; };
+struct S13 { char a[12]; char last; };
+
+struct S9 g9;
+
+void memcpy(char* dest, char* src, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        dest[i] = src[i];
+}
+
+int sum9(struct S9* s)
+{
+    int i, r = 0;
+    for (i = 0; i < 9; i++)
+        r += s->a[i];
+    return r;
+}
+
+int twice(int v)
+{
+    return v + v;
+}
+
+int main()
+{
+    int r = 0;
+    int i;
+    char buf[20], out[20];
+    struct S1 a1, b1;
+    struct S2 a2, b2;
+    struct S3 a3, b3;
+    struct S8 a8, b8;
+    struct S9 a9, b9;
+    struct S13 a13, b13;
+
+    a1.a = 1;
+    b1 = a1;
+    r += b1.a;                      // 1
+
+    a2.a = 2; a2.b = 3;
+    b2 = a2;
+    r += b2.a + b2.b;               // 5
+
+    a3.a = 4; a3.b = 5; a3.c = 6;
+    b3 = a3;
+    r += b3.a + b3.c;               // 10
+
+    for (i = 0; i < 8; i++)
+        a8.a[i] = i;
+    b8 = a8;
+    r += b8.a[0] + b8.a[7];         // 7
+
+    for (i = 0; i < 9; i++)
+        a9.a[i] = i + 1;
+    b9 = a9;
+    r += b9.a[8];                   // 9
+
+    for (i = 0; i < 12; i++)
+        a13.a[i] = 1;
+    a13.last = 13;
+    b13 = a13;
+    r += b13.a[11] + b13.last;      // 14
+
+    // the copies have other calls in them
+    g9 = b9 = a9;
+    r += sum9(&g9);                 // 45
+    r += sum9(&(b8 = a8, b9));      // 45
+    r += twice((b3 = a3).b);        // 10
+
+    // memcpy() with constant and variable sizes
+    for (i = 0; i < 20; i++)
+    {
+        buf[i] = i;
+        out[i] = 0;
+    }
+    memcpy(out, buf, 1);
+    memcpy(out + 1, buf + 1, 5);
+    memcpy(out + 6, buf + 6, 12);
+    r += out[0] + out[5] + out[17]; // 22
+    i = 2;
+    memcpy(out + 18, buf + 19, i - 1);
+    r += out[18] + out[19];         // 19
+
+    return r;                       // 187
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
@@ -0,0 +1,45 @@
+// a memcpy() that is not the library one is called, not replaced by copy instructions
+
+// copies n ints instead of n words, and returns the number of ints
+int memcpy(int* dest, int* src, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        dest[i] = src[i];
+    return n;
+}
+
+int main()
+{
+    int buf[20], out[20];
+    int i, r;
+    for (i = 0; i < 20; i++)
+    {
+        buf[i] = i;
+        out[i] = 0;
+    }
+    r = memcpy(out + 1, buf + 1, 5);
+    r += memcpy(out + 10, buf + 10, 1);
+    return r + out[5] + out[10]; // 5 + 1 + 5 + 10 = 21
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
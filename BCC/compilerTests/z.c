@@ -0,0 +1,53 @@
+int div(int a, int b)
+{
+    return a / b;
+}
+
+int mod(int a, int b)
+{
+    return a % b;
+}
+
+unsigned int udiv(unsigned int a, unsigned int b)
+{
+    return a / b;
+}
+
+int main()
+{
+    int a = -1000;
+    int b = 7;
+    unsigned int u = 0xFFFFFFF0;
+    int x = 0;
+
+    x += div(a, b);       // -142
+    x += mod(a, b);       // -6
+    x += a / 8;           // -125
+    x += a % 16;          // -8
+    x += udiv(u, 3) >> 24; // 85
+    x += u % 5000;        // 2280
+    b /= 2;
+    x += b;               // 3
+    return x - 2000;      // 87
+}
+
+
+void int1()
+{
+
+}
+
+void int2()
+{
+    
+}
+
+void int3()
+{
+    
+}
+
+void int4()
+{
+    
+}
@@ -0,0 +1,167 @@
+// Writes and reads files through FS_writeFile and FS_readFile, in byte mode and in word mode
+// Runs as a BDOS user program in the emulator with the CH376 model, see runEmulatorTests.sh
+// The folder /FSTEST should exist on the USB drive
+
+#define word char
+
+#include "../userBDOS/LIB/MATH.C"
+#include "../userBDOS/LIB/SYS.C"
+#include "../userBDOS/LIB/STDLIB.C"
+#include "../userBDOS/LIB/FS.C"
+
+// not a multiple of four, and more than a sector
+#define TEST_LEN 1001
+
+char *bytes = (char*) 0x500000; // one byte per word
+char *words = (char*) 0x510000; // four bytes per word
+char *readBuf = (char*) 0x520000;
+
+word errors = 0;
+
+// the byte at position i of the test data
+word testByte(word i)
+{
+  return (i * 7 + (i >> 8) + 3) & 0xFF;
+}
+
+// the byte at position i of data that is stored four bytes per word, from left to right
+word packedByte(char* buf, word i)
+{
+  return (buf[i >> 2] >> (24 - ((i & 3) << 3))) & 0xFF;
+}
+
+void check(char* what, word ok)
+{
+  if (!ok)
+  {
+    BDOS_PrintConsole("E: ");
+    BDOS_PrintConsole(what);
+    BDOS_PrintConsole("\n");
+    errors++;
+  }
+}
+
+// creates the file and opens it at the start
+word createFile(char* path)
+{
+  FS_close();
+  if (FS_sendFullPath(path) != FS_ANSW_USB_INT_SUCCESS)
+    return 0;
+  if (FS_createFile() != FS_ANSW_USB_INT_SUCCESS)
+    return 0;
+  FS_sendFullPath(path);
+  FS_open();
+  return FS_setCursor(0) == FS_ANSW_USB_INT_SUCCESS;
+}
+
+word openFile(char* path)
+{
+  FS_close();
+  if (FS_sendFullPath(path) != FS_ANSW_USB_INT_SUCCESS)
+    return 0;
+  if (FS_open() != FS_ANSW_USB_INT_SUCCESS)
+    return 0;
+  return FS_setCursor(0) == FS_ANSW_USB_INT_SUCCESS;
+}
+
+// clears the read buffer, and puts a marker after the words that a word mode read of len bytes may write
+void clearReadBuf(word len)
+{
+  word i;
+  for (i = 0; i < TEST_LEN; i++)
+  {
+    readBuf[i] = 0;
+  }
+  readBuf[(len + 3) >> 2] = 0x12345678;
+}
+
+// reads len bytes from position pos of the opened file in word mode, and compares them to the test data
+void checkWordRead(char* what, word pos, word len)
+{
+  clearReadBuf(len);
+  FS_setCursor(pos);
+  check(what, FS_readFile(readBuf, len, 1) == FS_ANSW_USB_INT_SUCCESS);
+
+  word i;
+  word bad = 0;
+  for (i = 0; i < len; i++)
+  {
+    if (packedByte(readBuf, i) != testByte(pos + i))
+      bad++;
+  }
+  check(what, bad == 0);
+  check("word mode read writes past the data", readBuf[(len + 3) >> 2] == 0x12345678);
+}
+
+int main()
+{
+  word i;
+  char pathBytes[] = "/FSTEST/BYTES.BIN";
+  char pathWords[] = "/FSTEST/WORDS.BIN";
+
+  for (i = 0; i < TEST_LEN; i++)
+  {
+    bytes[i] = testByte(i);
+  }
+  for (i = 0; i < TEST_LEN; i += 4)
+  {
+    words[i >> 2] = (testByte(i) << 24) + (testByte(i + 1) << 16) + (testByte(i + 2) << 8) + testByte(i + 3);
+  }
+
+  // byte mode write, in two parts
+  check("create BYTES.BIN", createFile(pathBytes));
+  check("byte mode write", FS_writeFile(bytes, 600, 0) == FS_ANSW_USB_INT_SUCCESS);
+  check("byte mode write", FS_writeFile(bytes + 600, TEST_LEN - 600, 0) == FS_ANSW_USB_INT_SUCCESS);
+  FS_close();
+
+  // word mode write, where the parts do not end at a word
+  check("create WORDS.BIN", createFile(pathWords));
+  check("word mode write", FS_writeFile(words, TEST_LEN, 1) == FS_ANSW_USB_INT_SUCCESS);
+  FS_close();
+
+  // byte mode read
+  check("open BYTES.BIN", openFile(pathBytes));
+  check("file size", FS_getFileSize() == TEST_LEN);
+  clearReadBuf(0);
+  check("byte mode read", FS_readFile(readBuf, TEST_LEN, 0) == FS_ANSW_USB_INT_SUCCESS);
+  word bad = 0;
+  for (i = 0; i < TEST_LEN; i++)
+  {
+    if (readBuf[i] != bytes[i])
+      bad++;
+  }
+  check("byte mode data", bad == 0);
+
+  // word mode reads of the whole file and from an unaligned position
+  checkWordRead("word mode read", 0, TEST_LEN);
+  checkWordRead("word mode read at 3", 3, 517);
+
+  // the file written in word mode
+  check("open WORDS.BIN", openFile(pathWords));
+  check("file size", FS_getFileSize() == TEST_LEN);
+  checkWordRead("word mode read of WORDS.BIN", 0, TEST_LEN);
+  FS_close();
+
+  if (errors == 0)
+  {
+    BDOS_PrintConsole("FS test passed\n");
+  }
+  return errors;
+}
+
+void int1()
+{
+  timer1Value = 1; // notify ending of timer1
+}
+
+void int2()
+{
+}
+
+void int3()
+{
+}
+
+void int4()
+{
+}
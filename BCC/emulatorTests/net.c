@@ -0,0 +1,117 @@
+// Receives and sends data through the W5500 library, see runEmulatorTests.sh
+// Runs as a BDOS user program in the emulator with the W5500 model
+// The peer of the connection on port 3220 sends TEST_LEN bytes, which are sent back unchanged
+// The peer of the connection on port 3221 sends the same data, which is read four bytes per word
+//  in parts of odd sizes and compared to the data of the first connection
+
+#define word char
+
+#include "../userBDOS/LIB/MATH.C"
+#include "../userBDOS/LIB/SYS.C"
+#include "../userBDOS/LIB/STDLIB.C"
+#include "../userBDOS/LIB/WIZ5500.C"
+
+// more than the RX and TX buffers, and not a multiple of four
+#define TEST_LEN 20003
+
+char *bytes = (char*) 0x500000; // one byte per word
+char *words = (char*) 0x520000; // four bytes per word
+
+word errors = 0;
+
+void check(char* what, word ok)
+{
+  if (!ok)
+  {
+    BDOS_PrintConsole("E: ");
+    BDOS_PrintConsole(what);
+    BDOS_PrintConsole("\n");
+    errors++;
+  }
+}
+
+// waits until socket s is connected
+void waitConnected(word s)
+{
+  while (wizGetSockReg8(s, WIZNET_SnSR) != WIZNET_SOCK_ESTABLISHED);
+}
+
+// receives len bytes on socket s, at most maxPart bytes per call
+// returns the address after the data, or of the unfinished word
+char* receive(word s, char* buf, word len, word maxPart, word* packState)
+{
+  word got = 0;
+  while (got < len)
+  {
+    word rsize = wizGetSockReg16(s, WIZNET_SnRX_RSR);
+    if (rsize > maxPart)
+      rsize = maxPart;
+    if (rsize != 0)
+    {
+      buf = wizStreamRecvData(s, buf, rsize, packState);
+      got += rsize;
+    }
+  }
+  return buf;
+}
+
+int main()
+{
+  char ip[4] = {192, 168, 0, 213};
+  char gw[4] = {192, 168, 0, 1};
+  char mac[6] = {0xDE, 0xAD, 0xBE, 0xEF, 0x24, 0x64};
+  char sub[4] = {255, 255, 255, 0};
+  wiz_Init(ip, gw, mac, sub);
+
+  // byte mode, echoed back
+  wizInitSocketTCP(0, 3220);
+  waitConnected(0);
+  receive(0, bytes, TEST_LEN, TEST_LEN, 0);
+  check("send", wizWriteDataFromMemory(0, bytes, TEST_LEN));
+  wizCmd(0, WIZNET_CR_DISCON);
+
+  // packed mode
+  word packState[2];
+  packState[0] = 0;
+  packState[1] = 4;
+  words[(TEST_LEN >> 2) + 1] = 0x12345678;
+  wizInitSocketTCP(1, 3221);
+  waitConnected(1);
+  char* end = receive(1, words, TEST_LEN, 333, packState);
+  wizCmd(1, WIZNET_CR_DISCON);
+  check("packed mode end", end == words + (TEST_LEN >> 2));
+  *end = packState[0] << (packState[1] << 3); // the unfinished word
+
+  word i;
+  word bad = 0;
+  for (i = 0; i < TEST_LEN; i++)
+  {
+    if (((words[i >> 2] >> (24 - ((i & 3) << 3))) & 0xFF) != bytes[i])
+      bad++;
+  }
+  check("packed mode data", bad == 0);
+  check("packed mode writes past the data", words[(TEST_LEN >> 2) + 1] == 0x12345678);
+
+  if (errors == 0)
+  {
+    BDOS_PrintConsole("Net test passed\n");
+  }
+  return errors;
+}
+
+void int1()
+{
+  timer1Value = 1; // notify ending of timer1
+}
+
+void int2()
+{
+}
+
+void int3()
+{
+}
+
+void int4()
+{
+}
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# runs the programs in emulatorTests and CP as BDOS user programs in the emulator,
+#  with the device models of the emulator, a temporary folder as the USB drive
+#  and network connections with data from temporary files
+# build the emulator first with make in the Emulator folder
+
+usbDir=$(mktemp -d)
+failList=()
+
+# compiles BDOS user program $1 to code.bin in the Programmer folder
+compileUserProgram()
+{
+    echo "Processing: $1"
+    if ! (./bcc --bdos $1 ../Assembler/code.asm) # compile c code with BDOS flag and write compiled code to code.asm in Assembler folder
+    then
+        echo "Failed to compile C code"
+        return 1
+    fi
+    if ! (cd ../Assembler && python3 Assembler.py bdos 0x400000 -O -o ../Programmer/code.bin) # assemble and write code.bin to Programmer folder
+    then
+        # the assembler has printed the error
+        echo "Failed to assemble B332 ASM code"
+        return 1
+    fi
+}
+
+# FS_writeFile and FS_readFile in byte and word mode, with the CH376 model
+mkdir $usbDir/FSTEST
+if compileUserProgram emulatorTests/fs.c
+then
+    output=$(../Emulator/emulator -bdos -usb $usbDir -stats -maxcycles 1000000000 ../Programmer/code.bin)
+    echo "$output"
+    if [[ $output != *"FS test passed"* ]]
+    then
+        failList+=("emulatorTests/fs.c")
+    elif ! cmp $usbDir/FSTEST/BYTES.BIN $usbDir/FSTEST/WORDS.BIN
+    then
+        failList+=("emulatorTests/fs.c: the files written in byte and word mode differ")
+    fi
+else
+    failList+=("emulatorTests/fs.c: failed to build")
+fi
+
+# CP, which reads and writes the file four bytes per word in parts of 0xFFFC bytes
+head -c 200003 /dev/urandom > $usbDir/RND.BIN
+if compileUserProgram userBDOS/CP.C
+then
+    ../Emulator/emulator -bdos -usb $usbDir -args "CP /RND.BIN /COPY.BIN" -stats -maxcycles 2000000000 ../Programmer/code.bin
+    if ! cmp $usbDir/RND.BIN $usbDir/COPY.BIN
+    then
+        failList+=("userBDOS/CP.C: the copy differs")
+    fi
+else
+    failList+=("userBDOS/CP.C: failed to build")
+fi
+
+# the W5500 library, which receives data in byte and word mode and sends it back
+head -c 20003 /dev/urandom > $usbDir/NETIN.BIN
+if compileUserProgram emulatorTests/net.c
+then
+    output=$(../Emulator/emulator -bdos -net 3220:$usbDir/NETIN.BIN:$usbDir/NETOUT.BIN -net 3221:$usbDir/NETIN.BIN:- -stats -maxcycles 1000000000 ../Programmer/code.bin)
+    echo "$output"
+    if [[ $output != *"Net test passed"* ]]
+    then
+        failList+=("emulatorTests/net.c")
+    elif ! cmp $usbDir/NETIN.BIN $usbDir/NETOUT.BIN
+    then
+        failList+=("emulatorTests/net.c: the echoed data differs")
+    fi
+else
+    failList+=("emulatorTests/net.c: failed to build")
+fi
+
+# WEBSERV, which sends a file from the USB drive while reading the next part of it
+printf 'GET /RND.BIN HTTP/1.1\r\n\r\n' > $usbDir/REQUEST.TXT
+if compileUserProgram userBDOS/WEBSERV.C
+then
+    ../Emulator/emulator -bdos -usb $usbDir -net 80:$usbDir/REQUEST.TXT:$usbDir/RESPONSE.TXT -netstop -stats -maxcycles 1000000000 ../Programmer/code.bin
+    if ! tail -c 200003 $usbDir/RESPONSE.TXT | cmp - $usbDir/RND.BIN
+    then
+        failList+=("userBDOS/WEBSERV.C: the response differs from the file")
+    fi
+else
+    failList+=("userBDOS/WEBSERV.C: failed to build")
+fi
+
+rm -rf $usbDir
+
+if [[ ${#failList[@]} -ne 0 ]]
+then
+    echo "Failed tests:"
+    printf '%s\n' "${failList[@]}"
+    exit 1
+fi
+echo "All tests passed"
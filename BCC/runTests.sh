@@ -1,44 +1,68 @@
 #!/bin/bash
 
+# compiles and runs the tests on the FPGC
+# each test is compiled without and with -O, and both return values are compared
+#  to the expected value in compilerTests/retList.txt (if the test is listed there)
+
 retList=()
+failList=()
 # loop though c file arguments, compile them and run them
 for filename in "$@"
 do
-    echo "Processing: $filename"
-    # for each c file, compile and run
-    echo "Compiling C code to B332 ASM"
-    if (./bcc $filename ../Assembler/code.asm) # compile c code and write compiled code to code.asm in Assembler folder
-    then
-        echo "C code successfully compiled"
-
-        echo "Assembling B332 ASM code"
-        if (cd ../Assembler && python3 Assembler.py > ../Programmer/code.list) # compile and write to code.list in Programmer folder
+    # expected return value of the test
+    expected=$(awk -v name="$(basename "$filename" .c)" '$1 == name {print $2}' compilerTests/retList.txt)
+
+    for opt in "" "-O"
+    do
+        echo "Processing: $filename $opt"
+        # for each c file, compile and run
+        echo "Compiling C code to B332 ASM"
+        if (./bcc $opt $filename ../Assembler/code.asm) # compile c code and write compiled code to code.asm in Assembler folder
         then
-                echo "B332 ASM code successfully assembled"
-                # convert list to binary files and send to FPGC
+            echo "C code successfully compiled"
 
-                # WSL1/linux version
-                (cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC" && python3 uartFlasher.py testMode)
+            echo "Assembling B332 ASM code"
+            if (cd ../Assembler && python3 Assembler.py -o ../Programmer/code.bin) # compile and write code.bin to Programmer folder
+            then
+                    echo "B332 ASM code successfully assembled"
+                    # send to FPGC
 
-                # WSL2/windows version
-                #(cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC" && python.exe uartFlasher_win.py testMode)
+                    # WSL1/linux version
+                    (cd ../Programmer && echo "Sending binary to FPGC" && python3 uartFlasher.py testMode)
 
-                retVal="$?"
-                echo "$filename exited with code: $retVal"
-                retList+=("$retVal")
+                    # WSL2/windows version
+                    #(cd ../Programmer && echo "Sending binary to FPGC" && python.exe uartFlasher_win.py testMode)
 
-        else # assemble failed, run again to show error
-            echo "Failed to assemble B332 ASM code"
-            cd ../Assembler && python3 Assembler.py
+                    retVal="$?"
+                    echo "$filename $opt exited with code: $retVal"
+                    retList+=("$retVal")
+                    if [[ -n $expected && $retVal != $expected ]]
+                    then
+                        failList+=("$filename $opt: got $retVal, expected $expected")
+                    fi
+
+            else # assemble failed, the assembler has printed the error
+                echo "Failed to assemble B332 ASM code"
+                failList+=("$filename $opt: failed to assemble")
+            fi
+        else # compile failed
+            echo "Failed to compile C code"
+            failList+=("$filename $opt: failed to compile")
         fi
-    else # compile failed
-        echo "Failed to compile C code"
-    fi
 
-    # sleep alternative since it is broken in WSL1
-    read -t 0.1
+        # sleep alternative since it is broken in WSL1
+        read -t 0.1
+    done
 
 done
 
-echo "Got the follwing return values:"
-echo ${retList[@]} 
\ No newline at end of file
+echo "Got the follwing return values (without and with -O):"
+echo ${retList[@]}
+
+if [[ ${#failList[@]} -ne 0 ]]
+then
+    echo "Failed tests:"
+    printf '%s\n' "${failList[@]}"
+    exit 1
+fi
+echo "All tests passed"
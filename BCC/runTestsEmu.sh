@@ -0,0 +1,61 @@
+#!/bin/bash
+
+# same as runTests.sh, but runs the tests in the emulator instead of on the FPGC
+# build the emulator first with make in the Emulator folder
+# each test is compiled without and with -O, and both return values are compared
+#  to the expected value in compilerTests/retList.txt (if the test is listed there)
+
+retList=()
+failList=()
+# loop though c file arguments, compile them and run them
+for filename in "$@"
+do
+    # expected return value of the test
+    expected=$(awk -v name="$(basename "$filename" .c)" '$1 == name {print $2}' compilerTests/retList.txt)
+
+    for opt in "" "-O"
+    do
+        echo "Processing: $filename $opt"
+        # for each c file, compile and run
+        echo "Compiling C code to B332 ASM"
+        if (./bcc $opt $filename ../Assembler/code.asm) # compile c code and write compiled code to code.asm in Assembler folder
+        then
+            echo "C code successfully compiled"
+
+            echo "Assembling B332 ASM code"
+            if (cd ../Assembler && python3 Assembler.py -o ../Programmer/code.bin) # compile and write code.bin to Programmer folder
+            then
+                    echo "B332 ASM code successfully assembled"
+                    # run it in the emulator
+                    (cd ../Programmer && echo "Running binary in emulator" && ../Emulator/emulator -test -maxcycles 1000000000 code.bin)
+
+                    retVal="$?"
+                    echo "$filename $opt exited with code: $retVal"
+                    retList+=("$retVal")
+                    if [[ -n $expected && $retVal != $expected ]]
+                    then
+                        failList+=("$filename $opt: got $retVal, expected $expected")
+                    fi
+
+            else # assemble failed, the assembler has printed the error
+                echo "Failed to assemble B332 ASM code"
+                failList+=("$filename $opt: failed to assemble")
+            fi
+        else # compile failed
+            echo "Failed to compile C code"
+            failList+=("$filename $opt: failed to compile")
+        fi
+    done
+
+done
+
+echo "Got the follwing return values (without and with -O):"
+echo ${retList[@]}
+
+if [[ ${#failList[@]} -ne 0 ]]
+then
+    echo "Failed tests:"
+    printf '%s\n' "${failList[@]}"
+    exit 1
+fi
+echo "All tests passed"
@@ -16,20 +16,19 @@ then
     echo "C code successfully compiled"
 
     echo "Assembling B332 ASM code"
-    if (cd ../Assembler && python3 Assembler.py bdos 0x400000 -O > ../Programmer/code.list) # assemble with offset for BDOS and write to code.list in Programmer folder
+    if (cd ../Assembler && python3 Assembler.py bdos 0x400000 -O -o ../Programmer/code.bin) # assemble and write code.bin to Programmer folder
     then
             echo "B332 ASM code successfully assembled"
-            # convert list to binary files and send to FPGC
+            # send to FPGC
 
             # WSL1/linux version
-            (cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC over Network" && python3 netFlash.py code.bin)
+            (cd ../Programmer && echo "Sending binary to FPGC over Network" && python3 netFlash.py code.bin)
 
             # WSL2/windows version
-            #(cd ../Programmer && bash compileROM.sh noPadding && echo "Sending binary to FPGC over Network" && python.exe netFlash.py code.bin)
+            #(cd ../Programmer && echo "Sending binary to FPGC over Network" && python.exe netFlash.py code.bin)
     
-    else # assemble failed, run again to show error
+    else # assemble failed, the assembler has printed the error
         echo "Failed to assemble B332 ASM code"
-        cd ../Assembler && python3 Assembler.py bdos 0x400000 -O
     fi
 else # compile failed
     echo "Failed to compile C code"
@@ -23,20 +23,19 @@ then
     echo "C code successfully compiled"
 
     echo "Assembling B332 ASM code"
-    if (cd ../Assembler && python3 Assembler.py bdos 0x400000 -O > ../Programmer/code.list) # assemble with offset for BDOS and write to code.list in Programmer folder
+    if (cd ../Assembler && python3 Assembler.py bdos 0x400000 -O -o ../Programmer/code.bin) # assemble and write code.bin to Programmer folder
     then
             echo "B332 ASM code successfully assembled"
-            # convert list to binary files and upload to FPGC
+            # upload to FPGC
 
             # WSL1/linux version
-            (cd ../Programmer && bash compileROM.sh noPadding && cp code.bin $OUTFILE && echo "Uploading $OUTFILE to FPGC over Network" && python3 netUpload.py $OUTFILE && rm $OUTFILE)
+            (cd ../Programmer && cp code.bin $OUTFILE && echo "Uploading $OUTFILE to FPGC over Network" && python3 netUpload.py $OUTFILE && rm $OUTFILE)
 
             # WSL2/windows version
-            #(cd ../Programmer && bash compileROM.sh noPadding && cp code.bin $2 && echo "Uploading $2 to FPGC over Network" && python.exe netUpload.py $2 && rm $2)
+            #(cd ../Programmer && cp code.bin $2 && echo "Uploading $2 to FPGC over Network" && python.exe netUpload.py $2 && rm $2)
     
-    else # assemble failed, run again to show error
+    else # assemble failed, the assembler has printed the error
         echo "Failed to assemble B332 ASM code"
-        cd ../Assembler && python3 Assembler.py bdos 0x400000 -O
     fi
 else # compile failed
     echo "Failed to compile C code"
@@ -0,0 +1,1565 @@
+/*****************************************************************************/
+/*                                                                           */
+/*                          B322 Emulator (FPGC5)                            */
+/*                                                                           */
+/*           Cycle-approximate instruction set emulator for the B322         */
+/*          Runs code.bin files on a host, using the FPGC5 memory map        */
+/*                                                                           */
+/*****************************************************************************/
+
+/* Notes:
+- Implements the 16 instructions from Documentation/docs/cpu.md
+- Cycle counts follow the fetch/getRegs/readMem/writeBack phases of Timer.v,
+    where fetch, readMem and writeBack wait for the memory latency of the MU
+- I/O devices are stubs: UART0 TX is written to stdout, the OS timers and the
+    frame drawn interrupt are emulated, other SPI devices always read 0xFF
+- With -usb, the CH376 on SPI1 is emulated with the files of a host directory
+    as the USB drive. The delays of the CH376 are estimates, not measurements
+- The W5500 on SPI3 is emulated, with TCP connections from -net whose data
+    comes from and goes to host files. The network delays are estimates as well
+- In BDOS mode the user program is loaded at an offset, and the system calls
+    and interrupt handlers of BDOS are emulated on the host
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// Memory map
+#define SDRAM_SIZE      0x800000
+#define FLASH_ADDR      0x800000
+#define FLASH_SIZE      0x400000
+#define VRAM32_ADDR     0xC00000
+#define VRAM32_SIZE     0x420
+#define VRAM8_ADDR      0xC00420
+#define VRAM8_SIZE      0x2002
+#define VRAMSPR_ADDR    0xC02422
+#define VRAMSPR_SIZE    0x100
+#define ROM_ADDR        0xC02522
+#define ROM_SIZE        0x200
+#define IO_ADDR         0xC02722
+
+#define IO_UART0_RX     0xC02722
+#define IO_UART0_TX     0xC02723
+#define IO_UART2_RX     0xC02726
+#define IO_UART2_TX     0xC02727
+#define IO_SPI1         0xC0272B
+#define IO_SPI1_CS      0xC0272C
+#define IO_SPI1_NINT    0xC0272D
+#define IO_SPI2_NINT    0xC02730
+#define IO_SPI3         0xC02731
+#define IO_SPI3_CS      0xC02732
+#define IO_SPI3_INT     0xC02733
+#define IO_GPIO         0xC02737
+#define IO_TIMER1_VAL   0xC02739
+#define IO_TIMER1_CTRL  0xC0273A
+#define IO_TIMER2_VAL   0xC0273B
+#define IO_TIMER2_CTRL  0xC0273C
+#define IO_TIMER3_VAL   0xC0273D
+#define IO_TIMER3_CTRL  0xC0273E
+#define IO_PS2          0xC02740
+#define IO_BOOTMODE     0xC02741
+
+// Timing (in 25MHz clock cycles)
+#define CLOCK_HZ            25000000
+#define CYCLES_PER_MS       25000   // prescaler of the OStimer
+#define CYCLES_PER_FRAME    416667  // 60Hz frame drawn interrupt
+#define LAT_SDRAM_READ      8       // activate + CAS 2 + burst of 2 + bus_done
+#define LAT_SDRAM_WRITE     6       // activate + burst of 2 + bus_done
+#define LAT_FLASH_READ      24      // quad SPI continuous read of 32 bits
+#define LAT_VRAM_READ       2       // bus_done_next
+#define LAT_VRAM_WRITE      1
+#define LAT_ROM             1
+#define LAT_IO              2
+#define LAT_UART_TX         250     // 10 bits at 1MBaud
+#define LAT_SPI             10      // 8 bits at 25MHz
+#define LAT_SPI_CH376       64      // the CH376 SPI runs at a lower clock
+#define CH376_DELAY_CMD     2500    // 100 us for a command without disk access
+#define CH376_DELAY_OPEN    25000   // 1 ms to open, create or delete a file
+#define CH376_DELAY_SECTOR  12500   // 0.5 ms for a block that needs a 512 byte sector
+#define CH376_DELAY_BLOCK   500     // 20 us for a block within the current sector
+#define W5500_DELAY_PACKET  5000    // 200 us between received packets, and to set up a connection
+#define W5500_DELAY_ACK     12500   // 500 us until the peer acknowledges sent data
+#define W5500_SEND_CYCLES   2       // cycles per byte that is sent, 100 Mbit/s
+
+// Interrupt pins, in order of priority
+#define INT_TIMER1      0   // int1
+#define INT_TIMER2      1   // int2
+#define INT_UART0       2   // int3
+#define INT_FRAME       3   // int4
+#define INT_TIMER3      4   // ext_int1 (id 1)
+#define INT_PS2         5   // ext_int2 (id 2)
+#define INT_UART1       6   // ext_int3 (id 3)
+#define INT_UART2       7   // ext_int4 (id 4)
+#define INT_COUNT       8
+
+#define STACK_SIZE      1024
+#define PC_MASK         0x7FFFFFF   // 27 bit addresses
+
+// Magic return addresses for the emulated BDOS (outside the memory map)
+#define BDOS_RET_PROGRAM    0x7FFFF00
+#define BDOS_RET_INTERRUPT  0x7FFFF10
+#define BDOS_RET_SYSCALL    0x7FFFF20
+#define BDOS_SYSCALL_ADDR   0x200000
+
+// System call IDs of BDOS
+#define SYSCALL_FIFO_AVAILABLE  1
+#define SYSCALL_FIFO_READ       2
+#define SYSCALL_PRINT_C_CONSOLE 3
+#define SYSCALL_GET_ARGS        4
+#define SYSCALL_GET_PATH        5
+#define SYSCALL_GET_USB_KB_BUF  6
+
+#define BDOS_ARGS_ADDR      0x210000    // emulated SHELL_command
+#define BDOS_PATH_ADDR      0x210100    // emulated SHELL_pathBackup
+#define BDOS_USBKB_ADDR     0x210200    // emulated USB keyboard buffer
+
+// CH376 commands (see BDOS/lib/fs.c)
+#define CH376_GET_IC_VER    0x01
+#define CH376_RESET_ALL     0x05
+#define CH376_GET_FILE_SIZE 0x0C
+#define CH376_SET_USB_MODE  0x15
+#define CH376_GET_STATUS    0x22
+#define CH376_RD_USB_DATA0  0x27
+#define CH376_WR_REQ_DATA   0x2D
+#define CH376_SET_FILE_NAME 0x2F
+#define CH376_DISK_CONNECT  0x30
+#define CH376_DISK_MOUNT    0x31
+#define CH376_FILE_OPEN     0x32
+#define CH376_FILE_CREATE   0x34
+#define CH376_FILE_ERASE    0x35
+#define CH376_FILE_CLOSE    0x36
+#define CH376_BYTE_LOCATE   0x39
+#define CH376_BYTE_READ     0x3A
+#define CH376_BYTE_RD_GO    0x3B
+#define CH376_BYTE_WRITE    0x3C
+#define CH376_BYTE_WR_GO    0x3D
+#define CH376_DIR_CREATE    0x40
+#define CH376_NO_CMD        -1
+
+// CH376 statuses
+#define CH376_IC_VER            0x43
+#define CH376_RET_SUCCESS       0x51
+#define CH376_INT_SUCCESS       0x14
+#define CH376_INT_CONNECT       0x15
+#define CH376_INT_DISK_READ     0x1D
+#define CH376_INT_DISK_WRITE    0x1E
+#define CH376_ERR_OPEN_DIR      0x41
+#define CH376_ERR_MISS_FILE     0x42
+
+#define CH376_BLOCK_SIZE    64      // bytes per RD_USB_DATA0 or WR_REQ_DATA
+#define CH376_NAME_LEN      64
+#define CH376_PATH_LEN      1024
+
+// W5500 registers, commands and states (see BDOS/lib/wiz5500.c)
+#define W5500_SIR           0x17
+#define W5500_SIMR          0x18
+#define W5500_VERSIONR      0x39
+#define W5500_SnMR          0x00
+#define W5500_SnCR          0x01
+#define W5500_SnIR          0x02
+#define W5500_SnSR          0x03
+#define W5500_SnPORT        0x04
+#define W5500_SnDPORT       0x10
+#define W5500_SnTX_FSR      0x20
+#define W5500_SnTX_RD       0x22
+#define W5500_SnTX_WR       0x24
+#define W5500_SnRX_RSR      0x26
+#define W5500_SnRX_RD       0x28
+#define W5500_SnRX_WR       0x2A
+#define W5500_CR_OPEN       0x01
+#define W5500_CR_LISTEN     0x02
+#define W5500_CR_CONNECT    0x04
+#define W5500_CR_DISCON     0x08
+#define W5500_CR_CLOSE      0x10
+#define W5500_CR_SEND       0x20
+#define W5500_CR_RECV       0x40
+#define W5500_IR_CON        0x01
+#define W5500_IR_DISCON     0x02
+#define W5500_IR_RECV       0x04
+#define W5500_IR_SENDOK     0x10
+#define W5500_SOCK_CLOSED   0x00
+#define W5500_SOCK_INIT     0x13
+#define W5500_SOCK_LISTEN   0x14
+#define W5500_SOCK_SYNSENT  0x15
+#define W5500_SOCK_ESTABLISHED 0x17
+#define W5500_SOCK_UDP      0x22
+
+#define W5500_SOCKETS       8
+#define W5500_BUF_SIZE      2048    // default RX and TX buffer of each socket
+#define W5500_MSS           1460    // bytes per received packet
+#define W5500_MAX_SENDS     16      // sends that are not acknowledged yet
+#define NET_MAX_CONNECTIONS 16
+
+
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+// CPU state
+u32 regs[16];
+u32 pc = 0;
+u32 hwStack[STACK_SIZE];
+u32 hwStackPtr = 0;
+int intEnabled = 1;
+u32 pcIntBackup = 0;
+u32 extIntID = 0;
+int intPending[INT_COUNT];
+
+// Memories
+u32* sdram;
+u32* flash;
+u32 vram32[VRAM32_SIZE];
+u32 vram8[VRAM8_SIZE];
+u32 vramspr[VRAMSPR_SIZE];
+u32 rom[ROM_SIZE];
+
+// I/O state
+u32 timerValue[3];
+u64 timerDeadline[3];   // 0 if not running
+u32 gpio = 0;
+
+// CH376 state, the USB drive is the directory usbRoot
+char* usbRoot = NULL;
+char ch376Dir[CH376_PATH_LEN];    // opened directory, relative to usbRoot
+char ch376Name[CH376_NAME_LEN];   // name from SET_FILE_NAME
+int ch376NameLen = 0;
+int ch376Cs = 1;
+int ch376Cmd = CH376_NO_CMD;      // command of the current SPI frame
+int ch376ArgIndex = 0;            // bytes transferred after the command byte
+u32 ch376Arg = 0;
+u32 ch376Status = 0;
+u64 ch376IntAt = 0;               // nINT is low from this cycle, 0 if no interrupt
+u32 ch376ReadByte = 0xFF;         // byte that is read back from SPI1
+char ch376Path[CH376_PATH_LEN];   // host path of the opened file
+unsigned char* ch376File = NULL;  // contents of the opened file
+u32 ch376FileSize = 0;
+u32 ch376FileCap = 0;
+int ch376FileOpen = 0;
+int ch376FileDirty = 0;
+u32 ch376Pos = 0;                 // byte cursor in the opened file
+u32 ch376Left = 0;                // bytes left of BYTE_READ or BYTE_WRITE
+u32 ch376BlockLen = 0;            // bytes in the current block
+u32 ch376BlockPos = 0;
+
+// TCP connections of the emulated network, from -net port:infile:outfile
+struct
+{
+  int port;               // local port for LISTEN, or destination port for CONNECT
+  unsigned char* in;      // data that the peer sends
+  u32 inLen;
+  u32 inPos;
+  FILE* out;              // data that the peer receives, NULL if not kept
+  int used;
+} netConn[NET_MAX_CONNECTIONS];
+int netConnCount = 0;
+int netConnClosed = 0;
+
+// W5500 state
+struct
+{
+  unsigned char reg[0x30];  // registers that only hold the written value
+  u32 ir;
+  u32 sr;
+  u32 txRd;                 // 16 bit pointers, data up to txRd is sent
+  u32 txWr;                 // TX_WR of the last SEND
+  u32 txAcked;              // data up to txAcked is acknowledged
+  u32 rxRd;                 // RX_RD of the last RECV
+  u32 rxWr;
+  int conn;                 // index in netConn, -1 if not connected
+  u64 connectAt;            // cycle the connection is established
+  u64 nextPacketAt;         // cycle the next packet can be received
+  u64 sendDoneAt;           // cycle the SEND completes, 0 if no SEND is active
+  u32 ackPos[W5500_MAX_SENDS];
+  u64 ackAt[W5500_MAX_SENDS];
+  int ackFirst;
+  int ackCount;
+  unsigned char tx[W5500_BUF_SIZE];
+  unsigned char rx[W5500_BUF_SIZE];
+} w5500Socket[W5500_SOCKETS];
+unsigned char w5500Common[0x40];
+int w5500Cs = 1;
+int w5500FramePos = 0;    // byte of the current SPI frame
+u32 w5500Addr = 0;
+u32 w5500Control = 0;
+u32 w5500ReadByte = 0xFF;
+
+// Statistics
+u64 cycles = 0;
+u64 instructions = 0;
+u64 memReads = 0;
+u64 memWrites = 0;
+u64 nextFrame = CYCLES_PER_FRAME;
+u64 ch376BusyCycles = 0;
+u64 netBytesIn = 0;
+u64 netBytesOut = 0;
+
+// Options
+int optBdos = 0;
+u32 bdosOffset = 0x400000;
+int optTrace = 0;
+int optStats = 0;
+int optTestMode = 0;
+int optNetStop = 0;
+u64 optMaxCycles = 0;
+char* optArgs = "";
+
+int lastUartByte = -1;
+int running = 1;
+
+
+void fatal(char* msg, u32 value)
+{
+  fprintf(stderr, "emulator: %s 0x%X (pc = 0x%X)\n", msg, value, pc);
+  exit(1);
+}
+
+// Raises the interrupt of the CH376 with status after delay cycles
+void ch376Interrupt(u32 status, u32 delay)
+{
+  ch376Status = status;
+  ch376IntAt = cycles + delay;
+  ch376BusyCycles += delay;
+}
+
+// Writes the opened file back to the host if it has changed
+void ch376WriteBack()
+{
+  FILE* f;
+  if (!ch376FileOpen || !ch376FileDirty)
+    return;
+
+  f = fopen(ch376Path, "wb");
+  if (!f)
+    fatal("cannot write the opened file of the USB drive, size", ch376FileSize);
+  fwrite(ch376File, 1, ch376FileSize, f);
+  fclose(f);
+  ch376FileDirty = 0;
+}
+
+// Makes the host path of the name from SET_FILE_NAME in the opened directory
+void ch376HostPath(char* path)
+{
+  ch376Name[ch376NameLen] = '\0';
+  if (snprintf(path, CH376_PATH_LEN, "%s%s/%s", usbRoot, ch376Dir, ch376Name) >= CH376_PATH_LEN)
+    fatal("CH376 path too long, length", strlen(ch376Dir));
+}
+
+// Loads the file at path as the opened file
+void ch376LoadFile(char* path, u32 size)
+{
+  FILE* f;
+
+  ch376WriteBack();
+  ch376FileCap = size + 1;
+  ch376File = realloc(ch376File, ch376FileCap);
+  ch376FileSize = 0;
+  f = fopen(path, "rb");
+  if (f)
+  {
+    ch376FileSize = fread(ch376File, 1, size, f);
+    fclose(f);
+  }
+  strcpy(ch376Path, path);
+  ch376FileOpen = 1;
+  ch376FileDirty = 0;
+  ch376Pos = 0;
+}
+
+// FILE_OPEN, a directory becomes the opened directory
+void ch376Open()
+{
+  char path[CH376_PATH_LEN];
+  struct stat st;
+
+  ch376HostPath(path);
+  if (!strcmp(ch376Name, "/"))
+  {
+    // the root opens like a file
+    ch376Dir[0] = '\0';
+    ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_OPEN);
+  }
+  else if (stat(path, &st))
+  {
+    ch376Interrupt(CH376_ERR_MISS_FILE, CH376_DELAY_OPEN);
+  }
+  else if (S_ISDIR(st.st_mode))
+  {
+    if (strlen(ch376Dir) + ch376NameLen + 2 > CH376_PATH_LEN)
+      fatal("CH376 path too long, length", strlen(ch376Dir));
+    strcat(ch376Dir, "/");
+    strcat(ch376Dir, ch376Name);
+    ch376Interrupt(CH376_ERR_OPEN_DIR, CH376_DELAY_OPEN);
+  }
+  else
+  {
+    ch376LoadFile(path, st.st_size);
+    ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_OPEN);
+  }
+}
+
+// FILE_CREATE, (re)creates an empty file and opens it
+void ch376Create()
+{
+  char path[CH376_PATH_LEN];
+  FILE* f;
+
+  ch376HostPath(path);
+  f = fopen(path, "wb");
+  if (!f)
+  {
+    ch376Interrupt(CH376_ERR_MISS_FILE, CH376_DELAY_OPEN);
+    return;
+  }
+  fclose(f);
+  ch376LoadFile(path, 0);
+  ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_OPEN);
+}
+
+// FILE_ERASE and DIR_CREATE
+void ch376EraseOrMkdir(int mkdirCmd)
+{
+  char path[CH376_PATH_LEN];
+  int failed;
+
+  ch376HostPath(path);
+  if (mkdirCmd)
+    failed = mkdir(path, 0777) != 0;
+  else
+    failed = remove(path) != 0;
+  ch376Interrupt(failed ? CH376_ERR_MISS_FILE : CH376_INT_SUCCESS, CH376_DELAY_OPEN);
+}
+
+// Starts the next block of BYTE_READ or BYTE_WRITE, or ends it when no bytes are left
+// Blocks end at 64 byte boundaries of the file, like the USB buffer of the CH376
+void ch376NextBlock(int write)
+{
+  if (ch376Left == 0)
+  {
+    ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_BLOCK);
+    return;
+  }
+
+  ch376BlockLen = CH376_BLOCK_SIZE - (ch376Pos % CH376_BLOCK_SIZE);
+  if (ch376BlockLen > ch376Left)
+    ch376BlockLen = ch376Left;
+  ch376BlockPos = 0;
+
+  ch376Interrupt(write ? CH376_INT_DISK_WRITE : CH376_INT_DISK_READ,
+    (ch376Pos % 512 == 0) ? CH376_DELAY_SECTOR : CH376_DELAY_BLOCK);
+}
+
+// Handles the command byte at the start of an SPI frame
+void ch376Command(u32 cmd)
+{
+  ch376Cmd = cmd;
+  ch376ArgIndex = 0;
+  ch376Arg = 0;
+
+  switch (cmd)
+  {
+    case CH376_SET_FILE_NAME:
+      ch376NameLen = 0;
+      break;
+    case CH376_FILE_OPEN:
+      ch376Open();
+      break;
+    case CH376_FILE_CREATE:
+      ch376Create();
+      break;
+    case CH376_FILE_ERASE:
+    case CH376_DIR_CREATE:
+      ch376EraseOrMkdir(cmd == CH376_DIR_CREATE);
+      break;
+    case CH376_DISK_CONNECT:
+    case CH376_DISK_MOUNT:
+      ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_OPEN);
+      break;
+    case CH376_BYTE_RD_GO:
+    case CH376_BYTE_WR_GO:
+      ch376NextBlock(cmd == CH376_BYTE_WR_GO);
+      break;
+    case CH376_GET_IC_VER:
+    case CH376_RESET_ALL:
+    case CH376_GET_FILE_SIZE:
+    case CH376_SET_USB_MODE:
+    case CH376_GET_STATUS:
+    case CH376_RD_USB_DATA0:
+    case CH376_WR_REQ_DATA:
+    case CH376_FILE_CLOSE:
+    case CH376_BYTE_LOCATE:
+    case CH376_BYTE_READ:
+    case CH376_BYTE_WRITE:
+      break; // the arguments or results follow
+    default:
+      fatal("CH376 command not emulated", cmd);
+  }
+}
+
+// Handles a byte that is written to SPI1, and sets the byte that is read back
+void ch376Transfer(u32 b)
+{
+  ch376ReadByte = 0xFF;
+  if (ch376Cmd == CH376_NO_CMD)
+  {
+    ch376Command(b);
+    return;
+  }
+
+  switch (ch376Cmd)
+  {
+    case CH376_GET_IC_VER:
+      ch376ReadByte = CH376_IC_VER;
+      break;
+
+    case CH376_SET_USB_MODE:
+      // the mode and the result can be in separate frames
+      if (ch376ArgIndex == 0 && (b == 5 || b == 6))
+        ch376Interrupt(CH376_INT_CONNECT, CH376_DELAY_OPEN); // the drive is always connected
+      else if (ch376ArgIndex == 1)
+        ch376ReadByte = CH376_RET_SUCCESS;
+      break;
+
+    case CH376_GET_STATUS:
+      // the status can be read in the next frame
+      if (ch376ArgIndex == 0)
+      {
+        ch376ReadByte = ch376Status;
+        ch376IntAt = 0;
+      }
+      break;
+
+    case CH376_SET_FILE_NAME:
+      if (b != 0 && ch376NameLen < CH376_NAME_LEN - 1)
+        ch376Name[ch376NameLen++] = b;
+      break;
+
+    case CH376_GET_FILE_SIZE:
+      // a data byte (0x68), then the size from low to high byte
+      if (ch376ArgIndex >= 1 && ch376ArgIndex <= 4)
+        ch376ReadByte = (ch376FileSize >> (8 * (ch376ArgIndex - 1))) & 0xFF;
+      break;
+
+    case CH376_FILE_CLOSE:
+      ch376WriteBack();
+      ch376FileOpen = 0;
+      ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_CMD);
+      break;
+
+    case CH376_BYTE_LOCATE:
+      ch376Arg |= b << (8 * ch376ArgIndex);
+      if (ch376ArgIndex == 3)
+      {
+        ch376Pos = (ch376Arg > ch376FileSize) ? ch376FileSize : ch376Arg;
+        ch376Interrupt(CH376_INT_SUCCESS, CH376_DELAY_CMD);
+      }
+      break;
+
+    case CH376_BYTE_READ:
+    case CH376_BYTE_WRITE:
+      ch376Arg |= b << (8 * ch376ArgIndex);
+      if (ch376ArgIndex == 1)
+      {
+        ch376Left = ch376Arg;
+        if (ch376Cmd == CH376_BYTE_READ && ch376Left > ch376FileSize - ch376Pos)
+          ch376Left = ch376FileSize - ch376Pos;
+        ch376NextBlock(ch376Cmd == CH376_BYTE_WRITE);
+      }
+      break;
+
+    case CH376_RD_USB_DATA0:
+      if (ch376ArgIndex == 0)
+      {
+        ch376ReadByte = ch376BlockLen;
+      }
+      else if (ch376BlockPos < ch376BlockLen)
+      {
+        ch376ReadByte = ch376File[ch376Pos++];
+        ch376BlockPos++;
+        ch376Left--;
+      }
+      break;
+
+    case CH376_WR_REQ_DATA:
+      if (ch376ArgIndex == 0)
+      {
+        ch376ReadByte = ch376BlockLen;
+      }
+      else if (ch376BlockPos < ch376BlockLen)
+      {
+        if (ch376Pos >= ch376FileCap)
+        {
+          ch376FileCap = ch376FileCap * 2 + CH376_BLOCK_SIZE;
+          ch376File = realloc(ch376File, ch376FileCap);
+        }
+        ch376File[ch376Pos++] = b;
+        if (ch376Pos > ch376FileSize)
+          ch376FileSize = ch376Pos;
+        ch376FileDirty = 1;
+        ch376BlockPos++;
+        ch376Left--;
+      }
+      break;
+  }
+  ch376ArgIndex++;
+}
+
+// Handles a write to SPI1_CS, a frame starts when it goes low
+void ch376SetCs(u32 value)
+{
+  int cs = value & 1;
+  if (!cs && ch376Cs)
+  {
+    // GET_STATUS and SET_USB_MODE can continue in the next frame
+    if (!(ch376Cmd == CH376_GET_STATUS && ch376ArgIndex == 0) &&
+        !(ch376Cmd == CH376_SET_USB_MODE && ch376ArgIndex < 2))
+      ch376Cmd = CH376_NO_CMD;
+  }
+  ch376Cs = cs;
+}
+
+// Adds a connection from a -net port:infile:outfile option, outfile - does not keep the data
+void netAddConnection(char* spec)
+{
+  char inFile[CH376_PATH_LEN], outFile[CH376_PATH_LEN];
+  FILE* f;
+  long len;
+
+  if (netConnCount == NET_MAX_CONNECTIONS)
+    fatal("too many -net connections, maximum", NET_MAX_CONNECTIONS);
+  if (sscanf(spec, "%d:%1023[^:]:%1023s", &netConn[netConnCount].port, inFile, outFile) != 3)
+  {
+    fprintf(stderr, "emulator: -net expects port:infile:outfile, got %s\n", spec);
+    exit(1);
+  }
+
+  f = fopen(inFile, "rb");
+  if (!f)
+  {
+    fprintf(stderr, "emulator: cannot open %s\n", inFile);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  netConn[netConnCount].in = malloc(len + 1);
+  netConn[netConnCount].inLen = fread(netConn[netConnCount].in, 1, len, f);
+  fclose(f);
+
+  netConn[netConnCount].out = NULL;
+  if (strcmp(outFile, "-"))
+  {
+    netConn[netConnCount].out = fopen(outFile, "wb");
+    if (!netConn[netConnCount].out)
+    {
+      fprintf(stderr, "emulator: cannot open %s\n", outFile);
+      exit(1);
+    }
+  }
+  netConnCount++;
+}
+
+// Returns a 16 bit register of socket s that only holds the written value
+u32 w5500Reg16(int s, u32 addr)
+{
+  return (w5500Socket[s].reg[addr] << 8) | w5500Socket[s].reg[addr + 1];
+}
+
+u32 w5500RxSize(int s)
+{
+  return (w5500Socket[s].rxWr - w5500Socket[s].rxRd) & 0xFFFF;
+}
+
+u32 w5500TxFree(int s)
+{
+  return W5500_BUF_SIZE - ((w5500Socket[s].txWr - w5500Socket[s].txAcked) & 0xFFFF);
+}
+
+// Returns the SIR register, bit s is set if socket s has an event that is enabled in SnIMR
+u32 w5500Sir()
+{
+  u32 sir = 0;
+  int s;
+  for (s = 0; s < W5500_SOCKETS; s++)
+  {
+    if (w5500Socket[s].ir & w5500Socket[s].reg[0x2C])
+      sir |= 1 << s;
+  }
+  return sir;
+}
+
+// Ends the connection of socket s
+void w5500Disconnect(int s)
+{
+  int c = w5500Socket[s].conn;
+  if (c >= 0)
+  {
+    if (netConn[c].out)
+      fflush(netConn[c].out);
+    netConnClosed++;
+    if (optNetStop && netConnClosed == netConnCount)
+      running = 0;
+  }
+  w5500Socket[s].conn = -1;
+  w5500Socket[s].sr = W5500_SOCK_CLOSED;
+}
+
+// Connects socket s to the first unused connection with port
+void w5500Connect(int s, int port)
+{
+  int c;
+  for (c = 0; c < netConnCount; c++)
+  {
+    if (!netConn[c].used && netConn[c].port == port)
+    {
+      netConn[c].used = 1;
+      w5500Socket[s].conn = c;
+      w5500Socket[s].connectAt = cycles + W5500_DELAY_PACKET;
+      return;
+    }
+  }
+}
+
+// Executes a write to SnCR of socket s
+void w5500Command(int s, u32 cmd)
+{
+  u32 len, i;
+
+  switch (cmd)
+  {
+    case W5500_CR_OPEN:
+      w5500Disconnect(s);
+      w5500Socket[s].sr = ((w5500Socket[s].reg[W5500_SnMR] & 0xF) == 2) ? W5500_SOCK_UDP : W5500_SOCK_INIT;
+      w5500Socket[s].txRd = w5500Socket[s].txWr = w5500Socket[s].txAcked = 0;
+      w5500Socket[s].rxRd = w5500Socket[s].rxWr = 0;
+      memset(w5500Socket[s].reg + W5500_SnTX_WR, 0, 2);
+      memset(w5500Socket[s].reg + W5500_SnRX_RD, 0, 2);
+      w5500Socket[s].sendDoneAt = 0;
+      w5500Socket[s].ackCount = 0;
+      break;
+
+    case W5500_CR_LISTEN:
+      w5500Socket[s].sr = W5500_SOCK_LISTEN;
+      w5500Connect(s, w5500Reg16(s, W5500_SnPORT));
+      break;
+
+    case W5500_CR_CONNECT:
+      w5500Socket[s].sr = W5500_SOCK_SYNSENT;
+      w5500Connect(s, w5500Reg16(s, W5500_SnDPORT));
+      break;
+
+    case W5500_CR_DISCON:
+      // the peer always closes its side right away
+      w5500Disconnect(s);
+      w5500Socket[s].ir |= W5500_IR_DISCON;
+      break;
+
+    case W5500_CR_CLOSE:
+      w5500Disconnect(s);
+      break;
+
+    case W5500_CR_SEND:
+      if (w5500Socket[s].sendDoneAt)
+        fprintf(stderr, "emulator: SEND on socket %d before the previous SEND is done\n", s);
+      if (w5500Socket[s].ackCount == W5500_MAX_SENDS)
+        fatal("too many W5500 sends without acknowledgement on socket", s);
+
+      w5500Socket[s].txWr = w5500Reg16(s, W5500_SnTX_WR);
+      len = (w5500Socket[s].txWr - w5500Socket[s].txRd) & 0xFFFF;
+      if (w5500Socket[s].conn >= 0 && netConn[w5500Socket[s].conn].out)
+      {
+        for (i = 0; i < len; i++)
+          fputc(w5500Socket[s].tx[(w5500Socket[s].txRd + i) % W5500_BUF_SIZE], netConn[w5500Socket[s].conn].out);
+      }
+      netBytesOut += len;
+      w5500Socket[s].txRd = w5500Socket[s].txWr;
+      w5500Socket[s].sendDoneAt = cycles + len * W5500_SEND_CYCLES + 1;
+
+      // the data is acknowledged a round trip later
+      i = (w5500Socket[s].ackFirst + w5500Socket[s].ackCount) % W5500_MAX_SENDS;
+      w5500Socket[s].ackPos[i] = w5500Socket[s].txWr;
+      w5500Socket[s].ackAt[i] = w5500Socket[s].sendDoneAt + W5500_DELAY_ACK;
+      w5500Socket[s].ackCount++;
+      break;
+
+    case W5500_CR_RECV:
+      w5500Socket[s].rxRd = w5500Reg16(s, W5500_SnRX_RD);
+      break;
+  }
+}
+
+// Lets the network progress: connections are established, packets are received, sends complete
+void w5500Update()
+{
+  int s;
+  u32 len, i;
+
+  for (s = 0; s < W5500_SOCKETS; s++)
+  {
+    int c = w5500Socket[s].conn;
+
+    if (c >= 0 && (w5500Socket[s].sr == W5500_SOCK_LISTEN || w5500Socket[s].sr == W5500_SOCK_SYNSENT) &&
+        cycles >= w5500Socket[s].connectAt)
+    {
+      w5500Socket[s].sr = W5500_SOCK_ESTABLISHED;
+      w5500Socket[s].ir |= W5500_IR_CON;
+      w5500Socket[s].nextPacketAt = cycles + W5500_DELAY_PACKET;
+    }
+
+    if (c >= 0 && w5500Socket[s].sr == W5500_SOCK_ESTABLISHED && cycles >= w5500Socket[s].nextPacketAt)
+    {
+      // the next packet, if it fits in the RX buffer
+      len = netConn[c].inLen - netConn[c].inPos;
+      if (len > W5500_MSS)
+        len = W5500_MSS;
+      if (len > W5500_BUF_SIZE - w5500RxSize(s))
+        len = W5500_BUF_SIZE - w5500RxSize(s);
+      if (len)
+      {
+        for (i = 0; i < len; i++)
+          w5500Socket[s].rx[(w5500Socket[s].rxWr + i) % W5500_BUF_SIZE] = netConn[c].in[netConn[c].inPos + i];
+        w5500Socket[s].rxWr = (w5500Socket[s].rxWr + len) & 0xFFFF;
+        netConn[c].inPos += len;
+        netBytesIn += len;
+        w5500Socket[s].ir |= W5500_IR_RECV;
+      }
+      w5500Socket[s].nextPacketAt = cycles + W5500_DELAY_PACKET;
+    }
+
+    if (w5500Socket[s].sendDoneAt && cycles >= w5500Socket[s].sendDoneAt)
+    {
+      w5500Socket[s].sendDoneAt = 0;
+      w5500Socket[s].ir |= W5500_IR_SENDOK;
+    }
+
+    while (w5500Socket[s].ackCount && cycles >= w5500Socket[s].ackAt[w5500Socket[s].ackFirst])
+    {
+      w5500Socket[s].txAcked = w5500Socket[s].ackPos[w5500Socket[s].ackFirst];
+      w5500Socket[s].ackFirst = (w5500Socket[s].ackFirst + 1) % W5500_MAX_SENDS;
+      w5500Socket[s].ackCount--;
+    }
+  }
+}
+
+// Returns a socket register of socket s
+u32 w5500ReadSocketReg(int s, u32 addr)
+{
+  switch (addr)
+  {
+    case W5500_SnCR:          return 0; // commands complete right away
+    case W5500_SnIR:          return w5500Socket[s].ir;
+    case W5500_SnSR:          return w5500Socket[s].sr;
+    case W5500_SnTX_FSR:      return w5500TxFree(s) >> 8;
+    case W5500_SnTX_FSR + 1:  return w5500TxFree(s) & 0xFF;
+    case W5500_SnTX_RD:       return w5500Socket[s].txRd >> 8;
+    case W5500_SnTX_RD + 1:   return w5500Socket[s].txRd & 0xFF;
+    case W5500_SnRX_RSR:      return w5500RxSize(s) >> 8;
+    case W5500_SnRX_RSR + 1:  return w5500RxSize(s) & 0xFF;
+    case W5500_SnRX_WR:       return w5500Socket[s].rxWr >> 8;
+    case W5500_SnRX_WR + 1:   return w5500Socket[s].rxWr & 0xFF;
+  }
+  return (addr < 0x30) ? w5500Socket[s].reg[addr] : 0;
+}
+
+// Handles a byte that is written to SPI3, and sets the byte that is read back
+// A frame is the 16 bit address, the control byte (block, read or write) and the data bytes
+void w5500Transfer(u32 b)
+{
+  u32 block, s, addr;
+  int write;
+
+  w5500ReadByte = 0;
+  switch (w5500FramePos++)
+  {
+    case 0:
+      w5500Addr = b << 8;
+      return;
+    case 1:
+      w5500Addr |= b;
+      return;
+    case 2:
+      w5500Control = b;
+      return;
+  }
+
+  block = w5500Control >> 3;
+  write = (w5500Control >> 2) & 1;
+  s = block >> 2;
+  addr = w5500Addr & 0xFFFF;
+  w5500Addr++;
+
+  if (block == 0)
+  {
+    // common registers
+    if (addr == W5500_SIR)
+      w5500ReadByte = w5500Sir();
+    else if (addr == W5500_VERSIONR)
+      w5500ReadByte = 0x04;
+    else if (addr < sizeof(w5500Common))
+    {
+      if (write)
+        w5500Common[addr] = b;
+      w5500ReadByte = w5500Common[addr];
+    }
+  }
+  else if ((block & 3) == 1)
+  {
+    if (!write)
+      w5500ReadByte = w5500ReadSocketReg(s, addr);
+    else if (addr == W5500_SnCR)
+      w5500Command(s, b);
+    else if (addr == W5500_SnIR)
+      w5500Socket[s].ir &= ~b; // a bit is cleared by writing a 1
+    else if (addr < 0x30)
+      w5500Socket[s].reg[addr] = b;
+  }
+  else if ((block & 3) == 2)
+  {
+    if (write)
+      w5500Socket[s].tx[addr % W5500_BUF_SIZE] = b;
+    w5500ReadByte = w5500Socket[s].tx[addr % W5500_BUF_SIZE];
+  }
+  else if ((block & 3) == 3)
+  {
+    w5500ReadByte = w5500Socket[s].rx[addr % W5500_BUF_SIZE];
+  }
+}
+
+// Handles a write to SPI3_CS, a frame starts when it goes low
+void w5500SetCs(u32 value)
+{
+  int cs = value & 1;
+  if (!cs && w5500Cs)
+    w5500FramePos = 0;
+  w5500Cs = cs;
+}
+
+// Returns the latency of a memory access in cycles
+int memLatency(u32 addr, int write)
+{
+  if (addr < SDRAM_SIZE)
+    return write ? LAT_SDRAM_WRITE : LAT_SDRAM_READ;
+  if (addr < VRAM32_ADDR)
+    return LAT_FLASH_READ;
+  if (addr < ROM_ADDR)
+    return write ? LAT_VRAM_WRITE : LAT_VRAM_READ;
+  if (addr < IO_ADDR)
+    return LAT_ROM;
+
+  switch (addr)
+  {
+    case IO_UART0_TX:
+    case IO_UART2_TX:
+      return write ? LAT_UART_TX : LAT_IO;
+    case 0xC02728: // SPI0
+    case IO_SPI3:
+    case 0xC02734: // SPI4
+      return LAT_SPI;
+    case IO_SPI1:
+    case 0xC0272E: // SPI2
+      return LAT_SPI_CH376;
+  }
+  return LAT_IO;
+}
+
+u32 memRead(u32 addr)
+{
+  memReads++;
+  cycles += memLatency(addr, 0);
+
+  if (addr < SDRAM_SIZE)
+    return sdram[addr];
+  if (addr < VRAM32_ADDR)
+    return flash[addr - FLASH_ADDR];
+  if (addr < VRAM8_ADDR)
+    return vram32[addr - VRAM32_ADDR];
+  if (addr < VRAMSPR_ADDR)
+    return vram8[addr - VRAM8_ADDR];
+  if (addr < ROM_ADDR)
+    return vramspr[addr - VRAMSPR_ADDR];
+  if (addr < IO_ADDR)
+    return rom[addr - ROM_ADDR];
+
+  switch (addr)
+  {
+    case IO_SPI1_NINT:
+      if (usbRoot)
+        return !(ch376IntAt && cycles >= ch376IntAt);
+      return 1;
+    case IO_SPI2_NINT:
+      return 1; // no CH376 interrupt
+    case IO_SPI1:
+      if (usbRoot)
+        return ch376ReadByte;
+      return 0xFF;
+    case IO_SPI3_INT:
+      return !(w5500Sir() & w5500Common[W5500_SIMR]); // INTn of the W5500
+    case IO_SPI3:
+      return w5500ReadByte;
+    case IO_SPI3_CS:
+      return w5500Cs;
+    case IO_GPIO:
+      return gpio & 0xF0;
+    case IO_BOOTMODE:
+      return 0;
+    case 0xC02728: // SPI0
+    case 0xC0272E: // SPI2
+    case 0xC02734: // SPI4
+      return 0xFF; // nothing connected
+  }
+  return 0;
+}
+
+void memWrite(u32 addr, u32 value)
+{
+  memWrites++;
+  cycles += memLatency(addr, 1);
+
+  if (addr < SDRAM_SIZE)
+  {
+    sdram[addr] = value;
+    return;
+  }
+  if (addr < VRAM32_ADDR)
+    return; // flash is read only
+  if (addr < VRAM8_ADDR)
+  {
+    vram32[addr - VRAM32_ADDR] = value;
+    return;
+  }
+  if (addr < VRAMSPR_ADDR)
+  {
+    vram8[addr - VRAM8_ADDR] = value & 0xFF;
+    return;
+  }
+  if (addr < ROM_ADDR)
+  {
+    vramspr[addr - VRAMSPR_ADDR] = value & 0x1FF;
+    return;
+  }
+  if (addr < IO_ADDR)
+    return; // ROM is read only
+
+  switch (addr)
+  {
+    case IO_UART0_TX:
+      lastUartByte = value & 0xFF;
+      if (!optTestMode)
+      {
+        putchar(value & 0xFF);
+        fflush(stdout);
+      }
+      break;
+    case IO_GPIO:
+      gpio = value;
+      break;
+    case IO_SPI1:
+      if (usbRoot)
+        ch376Transfer(value & 0xFF);
+      break;
+    case IO_SPI1_CS:
+      if (usbRoot)
+        ch376SetCs(value);
+      break;
+    case IO_SPI3:
+      w5500Transfer(value & 0xFF);
+      break;
+    case IO_SPI3_CS:
+      w5500SetCs(value);
+      break;
+    case IO_TIMER1_VAL:
+    case IO_TIMER2_VAL:
+    case IO_TIMER3_VAL:
+      timerValue[(addr - IO_TIMER1_VAL) >> 1] = value;
+      break;
+    case IO_TIMER1_CTRL:
+    case IO_TIMER2_CTRL:
+    case IO_TIMER3_CTRL:
+    {
+      int t = (addr - IO_TIMER1_CTRL) >> 1;
+      timerDeadline[t] = cycles + (u64)timerValue[t] * CYCLES_PER_MS + 1;
+      break;
+    }
+  }
+}
+
+void push(u32 value)
+{
+  hwStack[hwStackPtr] = value;
+  hwStackPtr = (hwStackPtr + 1) % STACK_SIZE;
+}
+
+u32 pop()
+{
+  hwStackPtr = (hwStackPtr + STACK_SIZE - 1) % STACK_SIZE;
+  return hwStack[hwStackPtr];
+}
+
+// Raises interrupts of devices whose event has happened
+void updateDevices()
+{
+  int t;
+  static const int timerInt[3] = {INT_TIMER1, INT_TIMER2, INT_TIMER3};
+
+  for (t = 0; t < 3; t++)
+  {
+    if (timerDeadline[t] && cycles >= timerDeadline[t])
+    {
+      timerDeadline[t] = 0;
+      intPending[timerInt[t]] = 1;
+    }
+  }
+
+  if (cycles >= nextFrame)
+  {
+    nextFrame += CYCLES_PER_FRAME;
+    intPending[INT_FRAME] = 1;
+  }
+
+  // without connections nothing happens on the network
+  if (netConnCount)
+    w5500Update();
+}
+
+// Returns the cycle of the next device event, or 0 if no timer is running
+u64 nextTimerEvent()
+{
+  u64 next = 0;
+  int t;
+  for (t = 0; t < 3; t++)
+    if (timerDeadline[t] && (next == 0 || timerDeadline[t] < next))
+      next = timerDeadline[t];
+  return next;
+}
+
+// Emulates the BDOS system call handler
+void bdosSyscall()
+{
+  u32 id = sdram[BDOS_SYSCALL_ADDR];
+  u32 result = 0;
+
+  switch (id)
+  {
+    case SYSCALL_FIFO_AVAILABLE:
+    case SYSCALL_FIFO_READ:
+      result = 0;
+      break;
+    case SYSCALL_PRINT_C_CONSOLE:
+      putchar(sdram[BDOS_SYSCALL_ADDR + 1] & 0xFF);
+      fflush(stdout);
+      break;
+    case SYSCALL_GET_ARGS:
+      result = BDOS_ARGS_ADDR;
+      break;
+    case SYSCALL_GET_PATH:
+      result = BDOS_PATH_ADDR;
+      break;
+    case SYSCALL_GET_USB_KB_BUF:
+      result = BDOS_USBKB_ADDR;
+      break;
+  }
+  sdram[BDOS_SYSCALL_ADDR] = result;
+  cycles += 200; // rough cost of the BDOS handler
+
+  // Return_Syscall of BDOS
+  pc = (pop() + 3) & PC_MASK;
+}
+
+// Jumps to the interrupt vector, or to the handler of the user program in BDOS mode
+void handleInterrupts(u32 nextPc)
+{
+  int i;
+  if (!intEnabled || pc >= ROM_ADDR)
+    return;
+
+  for (i = 0; i < INT_COUNT; i++)
+  {
+    if (!intPending[i])
+      continue;
+
+    intPending[i] = 0;
+    intEnabled = 0;
+    pcIntBackup = nextPc;
+    if (i >= INT_TIMER3)
+      extIntID = i - INT_TIMER3 + 1;
+    else if (i == INT_TIMER2)
+      extIntID = 0;
+
+    if (optBdos)
+    {
+      // Same as the interrupt handlers of BDOS: backup registers and call the user handler
+      int r;
+      for (r = 1; r < 16; r++)
+        push(regs[r]);
+      push(BDOS_RET_INTERRUPT - 3);
+      pc = bdosOffset + ((i < INT_TIMER3) ? i + 1 : 2);
+    }
+    else
+    {
+      pc = (i < INT_TIMER3) ? i + 1 : 2;
+    }
+    return;
+  }
+}
+
+// Handles the magic return addresses of the emulated BDOS
+void bdosReturn()
+{
+  if (pc == BDOS_RET_PROGRAM)
+  {
+    running = 0;
+  }
+  else if (pc == BDOS_RET_INTERRUPT)
+  {
+    int r;
+    for (r = 15; r > 0; r--)
+      regs[r] = pop();
+    pc = pcIntBackup;
+    intEnabled = 1;
+  }
+  else
+  {
+    fatal("jump to invalid address", pc);
+  }
+}
+
+void trace(u32 instr)
+{
+  int r;
+  fprintf(stderr, "%07X: %08X |", pc, instr);
+  for (r = 1; r < 16; r++)
+    fprintf(stderr, " %X", regs[r]);
+  fprintf(stderr, "\n");
+}
+
+// Executes a single instruction
+void step()
+{
+  u32 instr, nextPc, a, b, addr;
+  u32 const16, const11, const27;
+  int areg, breg, dreg;
+
+  if (pc >= BDOS_RET_PROGRAM)
+  {
+    bdosReturn();
+    return;
+  }
+  if (optBdos && pc == 6)
+  {
+    bdosSyscall();
+    return;
+  }
+
+  // fetch
+  instr = memRead(pc);
+  memReads--;
+  // getRegs, readMem and writeBack take at least one cycle each
+  cycles += 3;
+  instructions++;
+
+  if (optTrace)
+    trace(instr);
+
+  const16 = (instr >> 12) & 0xFFFF;
+  const11 = (instr >> 12) & 0x7FF;
+  const27 = (instr >> 1) & 0x7FFFFFF;
+  areg = (instr >> 8) & 0xF;
+  breg = (instr >> 4) & 0xF;
+  dreg = instr & 0xF;
+  a = regs[areg];
+  b = regs[breg];
+  nextPc = (pc + 1) & PC_MASK;
+
+  switch (instr >> 28)
+  {
+    case 0xF: // HALT
+      nextPc = pc;
+      if (!intEnabled || !nextTimerEvent())
+      {
+        running = 0;
+        return;
+      }
+      // skip to the next timer event instead of spinning
+      if (nextTimerEvent() > cycles)
+        cycles = nextTimerEvent();
+      break;
+
+    case 0xE: // READ
+      if (instr & 0x10)
+      {
+        regs[dreg] = extIntID;
+      }
+      else
+      {
+        addr = (instr & 0x20) ? a - const16 : a + const16;
+        regs[dreg] = memRead(addr & PC_MASK);
+      }
+      cycles--;
+      break;
+
+    case 0xD: // WRITE
+      addr = (instr & 0x1) ? a - const16 : a + const16;
+      memWrite(addr & PC_MASK, b);
+      cycles--;
+      break;
+
+    case 0xC: // COPY
+      addr = (instr & 0x1) ? a - const16 : a + const16;
+      {
+        u32 value = memRead(addr & PC_MASK);
+        addr = (instr & 0x1) ? b - const16 : b + const16;
+        memWrite(addr & PC_MASK, value);
+      }
+      cycles -= 2;
+      break;
+
+    case 0xB: // PUSH
+      push(b);
+      break;
+
+    case 0xA: // POP
+      regs[dreg] = pop();
+      break;
+
+    case 0x9: // JUMP
+      nextPc = (instr & 1) ? pc + const27 : const27;
+      break;
+
+    case 0x8: // JUMPR
+      nextPc = (instr & 1) ? pc + b + const16 : b + const16;
+      break;
+
+    case 0x7: // LOAD
+      if (instr & 0x100)
+        regs[dreg] = (regs[dreg] & 0xFFFF) | (const16 << 16);
+      else
+        regs[dreg] = const16;
+      break;
+
+    case 0x6: // BEQ
+      if (a == b)
+        nextPc = pc + const16;
+      break;
+
+    case 0x5: // BNE
+      if (a != b)
+        nextPc = pc + const16;
+      break;
+
+    case 0x4: // BGT
+      if ((instr & 1) ? (int)a > (int)b : a > b)
+        nextPc = pc + const16;
+      break;
+
+    case 0x3: // BGE
+      if ((instr & 1) ? (int)a >= (int)b : a >= b)
+        nextPc = pc + const16;
+      break;
+
+    case 0x2: // SAVPC
+      regs[dreg] = pc;
+      break;
+
+    case 0x1: // RETI
+      nextPc = pcIntBackup;
+      intEnabled = 1;
+      break;
+
+    case 0x0: // ARITH
+      if (instr & (1 << 27))
+        b = const11;
+      switch ((instr >> 23) & 0xF)
+      {
+        case 0x0: regs[dreg] = a | b; break;
+        case 0x1: regs[dreg] = a & b; break;
+        case 0x2: regs[dreg] = a ^ b; break;
+        case 0x3: regs[dreg] = a + b; break;
+        case 0x4: regs[dreg] = a - b; break;
+        case 0x5: regs[dreg] = ((b & 0x3F) > 31) ? 0 : a << (b & 0x3F); break;
+        case 0x6: regs[dreg] = ((b & 0x3F) > 31) ? 0 : a >> (b & 0x3F); break;
+        case 0x7: regs[dreg] = (u32)((int)a * (int)b); break;
+        case 0x8: regs[dreg] = ~a; break;
+        default:  regs[dreg] = 0; break;
+      }
+      break;
+  }
+
+  regs[0] = 0;
+  pc = nextPc & PC_MASK;
+
+  updateDevices();
+  handleInterrupts(pc);
+}
+
+// Loads a binary file of big endian 32 bit words into mem
+// Returns the number of words read
+u32 loadBinary(char* fileName, u32* mem, u32 maxWords)
+{
+  FILE* f = fopen(fileName, "rb");
+  unsigned char buf[4];
+  u32 n = 0;
+
+  if (!f)
+  {
+    fprintf(stderr, "emulator: cannot open %s\n", fileName);
+    exit(1);
+  }
+
+  while (n < maxWords && fread(buf, 1, 4, f) == 4)
+  {
+    mem[n] = ((u32)buf[0] << 24) | ((u32)buf[1] << 16) | ((u32)buf[2] << 8) | buf[3];
+    n++;
+  }
+
+  fclose(f);
+  return n;
+}
+
+void printUsage()
+{
+  fprintf(stderr,
+    "Usage: emulator [options] code.bin\n"
+    "Options:\n"
+    "  -bdos [offset]  run as BDOS user program (default offset 0x400000),\n"
+    "                  BDOS system calls and interrupt handlers are emulated\n"
+    "  -args string    arguments returned by the GET_ARGS system call\n"
+    "  -flash file     load file into SPI flash\n"
+    "  -rom file       load file into ROM and start executing from ROM\n"
+    "  -usb dir        emulate the CH376 on SPI1 with dir as the USB drive\n"
+    "  -net port:infile:outfile\n"
+    "                  a TCP connection for the W5500, to a socket that listens\n"
+    "                  on port, or that connects to port. The peer sends infile\n"
+    "                  and what it receives is written to outfile (- for none)\n"
+    "  -netstop        stop when all -net connections are closed\n"
+    "  -maxcycles n    stop after n cycles\n"
+    "  -test           exit with the last byte written to UART (compilerTests)\n"
+    "  -stats          print cycle and instruction statistics\n"
+    "  -trace          print each executed instruction to stderr\n");
+}
+
+int main(int argc, char** argv)
+{
+  char* codeFile = NULL;
+  char* flashFile = NULL;
+  char* romFile = NULL;
+  int i;
+  clock_t startTime;
+  double hostSeconds;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-bdos"))
+    {
+      optBdos = 1;
+      if (i + 1 < argc && argv[i + 1][0] == '0')
+        bdosOffset = strtoul(argv[++i], NULL, 0);
+    }
+    else if (!strcmp(argv[i], "-args") && i + 1 < argc)
+      optArgs = argv[++i];
+    else if (!strcmp(argv[i], "-flash") && i + 1 < argc)
+      flashFile = argv[++i];
+    else if (!strcmp(argv[i], "-rom") && i + 1 < argc)
+      romFile = argv[++i];
+    else if (!strcmp(argv[i], "-usb") && i + 1 < argc)
+      usbRoot = argv[++i];
+    else if (!strcmp(argv[i], "-net") && i + 1 < argc)
+      netAddConnection(argv[++i]);
+    else if (!strcmp(argv[i], "-netstop"))
+      optNetStop = 1;
+    else if (!strcmp(argv[i], "-maxcycles") && i + 1 < argc)
+      optMaxCycles = strtoull(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "-test"))
+      optTestMode = 1;
+    else if (!strcmp(argv[i], "-stats"))
+      optStats = 1;
+    else if (!strcmp(argv[i], "-trace"))
+      optTrace = 1;
+    else if (argv[i][0] != '-' && !codeFile)
+      codeFile = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!codeFile)
+  {
+    printUsage();
+    return 1;
+  }
+
+  sdram = calloc(SDRAM_SIZE, sizeof(u32));
+  flash = malloc(FLASH_SIZE * sizeof(u32));
+  memset(flash, 0xFF, FLASH_SIZE * sizeof(u32));
+
+  if (flashFile)
+    loadBinary(flashFile, flash, FLASH_SIZE);
+
+  for (i = 0; i < W5500_SOCKETS; i++)
+    w5500Socket[i].conn = -1;
+
+  if (optBdos)
+  {
+    // BDOS user programs have no length word and start at the offset
+    loadBinary(codeFile, sdram + bdosOffset, SDRAM_SIZE - bdosOffset);
+    for (i = 0; optArgs[i] && i < 255; i++)
+      sdram[BDOS_ARGS_ADDR + i] = (unsigned char)optArgs[i];
+    sdram[BDOS_PATH_ADDR] = '/';
+    push(BDOS_RET_PROGRAM - 3); // Return_BDOS pops this address
+    pc = bdosOffset;
+  }
+  else
+  {
+    loadBinary(codeFile, sdram, SDRAM_SIZE);
+    pc = 0;
+  }
+
+  if (romFile)
+  {
+    loadBinary(romFile, rom, ROM_SIZE);
+    pc = ROM_ADDR;
+  }
+
+  startTime = clock();
+  while (running)
+  {
+    step();
+    if (optMaxCycles && cycles >= optMaxCycles)
+    {
+      fprintf(stderr, "emulator: reached the maximum number of cycles\n");
+      break;
+    }
+  }
+  hostSeconds = (double)(clock() - startTime) / CLOCKS_PER_SEC;
+
+  // files that are not closed are written back as well
+  ch376WriteBack();
+  for (i = 0; i < netConnCount; i++)
+  {
+    if (netConn[i].out)
+      fclose(netConn[i].out);
+  }
+
+  if (optStats)
+  {
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Instructions: %llu\n", instructions);
+    fprintf(stderr, "Cycles:       %llu (%.3f ms at 25MHz)\n", cycles, (double)cycles * 1000 / CLOCK_HZ);
+    fprintf(stderr, "CPI:          %.2f\n", instructions ? (double)cycles / instructions : 0.0);
+    fprintf(stderr, "Data reads:   %llu\n", memReads);
+    fprintf(stderr, "Data writes:  %llu\n", memWrites);
+    if (usbRoot)
+      fprintf(stderr, "CH376 busy:   %llu cycles\n", ch376BusyCycles);
+    if (netConnCount)
+      fprintf(stderr, "Network:      %llu bytes in, %llu bytes out\n", netBytesIn, netBytesOut);
+    if (hostSeconds > 0)
+      fprintf(stderr, "Host speed:   %.1f MIPS\n", instructions / hostSeconds / 1000000);
+  }
+
+  if (optTestMode)
+    return lastUartByte < 0 ? 255 : lastUartByte;
+
+  return 0;
+}